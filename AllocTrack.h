@@ -0,0 +1,29 @@
+#pragma once
+#include <Arduino.h>
+
+// Allocation counting for host builds.
+//
+// With ALLOC_TRACKING defined (the host build's CMake option of the same
+// name), malloc, calloc and realloc are replaced by counting wrappers around
+// the libc allocator, which also covers operator new and Arduino String. The
+// wrappers live in host/src/AllocTrack.cpp so they are defined once per
+// program. The counters are atomic because the UART fake is fed from another
+// thread in some tests. The scheduler counts allocations per loop pass and
+// the web server per request handler. Allocations the fakes make for the
+// other end of a connection run under host::UntrackedAllocs and are left
+// out. On the device allocCount() is always 0; heap health is exported as
+// gauges instead.
+
+#ifdef ALLOC_TRACKING
+#include <atomic>
+
+struct AllocStats {
+  std::atomic<uint32_t> count;
+  std::atomic<uint64_t> bytes;
+};
+extern AllocStats allocStats;
+
+inline uint32_t allocCount() { return allocStats.count.load(std::memory_order_relaxed); }
+#else
+inline uint32_t allocCount() { return 0; }
+#endif
@@ -0,0 +1,229 @@
+#pragma once
+#include <Arduino.h>
+#include <Wire.h>
+
+// Minimal BME280 driver using forced mode.
+//
+// A measurement is started with startMeasurement() and collected later with
+// poll(), so the main loop never busy-waits on the conversion. All eight data
+// registers are read in one burst and compensation (Bosch integer reference
+// code, datasheet section 4.2.3) runs once per sample.
+
+constexpr uint8_t BME280_REG_CALIB_TP = 0x88; // 0x88..0xA1, 26 bytes
+constexpr uint8_t BME280_REG_CHIP_ID = 0xD0;
+constexpr uint8_t BME280_REG_RESET = 0xE0;
+constexpr uint8_t BME280_REG_CALIB_H = 0xE1;  // 0xE1..0xE7, 7 bytes
+constexpr uint8_t BME280_REG_CTRL_HUM = 0xF2;
+constexpr uint8_t BME280_REG_STATUS = 0xF3;
+constexpr uint8_t BME280_REG_CTRL_MEAS = 0xF4;
+constexpr uint8_t BME280_REG_CONFIG = 0xF5;
+constexpr uint8_t BME280_REG_DATA = 0xF7;     // 0xF7..0xFE, 8 bytes
+
+constexpr uint8_t BME280_CHIP_ID = 0x60;
+constexpr uint8_t BME280_RESET_CMD = 0xB6;
+constexpr uint8_t BME280_STATUS_IM_UPDATE = 0x01;
+
+// Oversampling x1 for all channels, IIR filter off ("weather monitoring"
+// settings from the datasheet). Conversion takes at most 9.3 ms.
+constexpr uint8_t BME280_OSRS_H = 0x01;
+constexpr uint8_t BME280_CTRL_MEAS_SLEEP = (0x01 << 5) | (0x01 << 2);
+constexpr uint8_t BME280_MODE_FORCED = 0x01;
+constexpr unsigned long BME280_CONVERSION_TIME = 10;
+
+class BME280Driver {
+public:
+  bool begin(uint8_t address, TwoWire &wire = Wire) {
+    _wire = &wire;
+    _address = address;
+    _state = NotPresent;
+
+    uint8_t id;
+    if (!readRegisters(BME280_REG_CHIP_ID, &id, 1) || id != BME280_CHIP_ID) {
+      return false;
+    }
+    writeRegister(BME280_REG_RESET, BME280_RESET_CMD);
+    delay(2);
+    uint8_t status = BME280_STATUS_IM_UPDATE;
+    for (int i = 0; i < 10 && (status & BME280_STATUS_IM_UPDATE); i++) {
+      delay(1);
+      if (!readRegisters(BME280_REG_STATUS, &status, 1)) return false;
+    }
+
+    if (!readCalibration()) {
+      return false;
+    }
+
+    // ctrl_hum only takes effect after a write to ctrl_meas
+    writeRegister(BME280_REG_CTRL_HUM, BME280_OSRS_H);
+    writeRegister(BME280_REG_CONFIG, 0x00);
+    writeRegister(BME280_REG_CTRL_MEAS, BME280_CTRL_MEAS_SLEEP);
+    _state = Idle;
+    return true;
+  }
+
+  // Trigger a forced-mode conversion, returns false if one is already running
+  bool startMeasurement(unsigned long now) {
+    if (_state != Idle) {
+      return false;
+    }
+    if (!writeRegister(BME280_REG_CTRL_MEAS, BME280_CTRL_MEAS_SLEEP | BME280_MODE_FORCED)) {
+      return false;
+    }
+    _startTime = now;
+    _state = Measuring;
+    return true;
+  }
+
+  // Collect a finished conversion, returns true when a new sample is available
+  bool poll(unsigned long now) {
+    if (_state != Measuring || now - _startTime < BME280_CONVERSION_TIME) {
+      return false;
+    }
+
+    uint8_t data[8];
+    if (!readRegisters(BME280_REG_DATA, data, sizeof(data))) {
+      _state = Idle;
+      readErrors++;
+      return false;
+    }
+    _state = Idle;
+
+    int32_t adcP = ((int32_t)data[0] << 12) | ((int32_t)data[1] << 4) | (data[2] >> 4);
+    int32_t adcT = ((int32_t)data[3] << 12) | ((int32_t)data[4] << 4) | (data[5] >> 4);
+    int32_t adcH = ((int32_t)data[6] << 8) | data[7];
+
+    int32_t tFine;
+    _temperature = compensateTemperature(adcT, tFine);
+    _pressure = compensatePressure(adcP, tFine);
+    _humidity = compensateHumidity(adcH, tFine);
+    _sampleTime = now;
+    _hasSample = true;
+    sampleCount++;
+    return true;
+  }
+
+  bool busy() const { return _state == Measuring; }
+  bool present() const { return _state != NotPresent; }
+  bool hasSample() const { return _hasSample; }
+  unsigned long sampleTime() const { return _sampleTime; }
+
+  // Degrees Celsius
+  float readTemperature() const { return _hasSample ? _temperature / 100.0f : NAN; }
+  // Percent relative humidity
+  float readHumidity() const { return _hasSample ? _humidity / 1024.0f : NAN; }
+  // Pascal
+  float readPressure() const { return _hasSample ? _pressure / 256.0f : NAN; }
+
+  uint32_t i2cTransactions = 0;
+  uint32_t sampleCount = 0;
+  uint32_t readErrors = 0;
+
+private:
+  enum State : uint8_t { NotPresent, Idle, Measuring };
+
+  bool writeRegister(uint8_t reg, uint8_t value) {
+    i2cTransactions++;
+    _wire->beginTransmission(_address);
+    _wire->write(reg);
+    _wire->write(value);
+    return _wire->endTransmission() == 0;
+  }
+
+  bool readRegisters(uint8_t reg, uint8_t* out, uint8_t len) {
+    i2cTransactions++;
+    _wire->beginTransmission(_address);
+    _wire->write(reg);
+    if (_wire->endTransmission(false) != 0) {
+      return false;
+    }
+    if (_wire->requestFrom(_address, len) != len) {
+      return false;
+    }
+    for (uint8_t i = 0; i < len; i++) {
+      out[i] = _wire->read();
+    }
+    return true;
+  }
+
+  bool readCalibration() {
+    uint8_t c[26];
+    uint8_t h[7];
+    if (!readRegisters(BME280_REG_CALIB_TP, c, sizeof(c)) ||
+        !readRegisters(BME280_REG_CALIB_H, h, sizeof(h))) {
+      return false;
+    }
+    _digT1 = (uint16_t)(c[1] << 8 | c[0]);
+    _digT2 = (int16_t)(c[3] << 8 | c[2]);
+    _digT3 = (int16_t)(c[5] << 8 | c[4]);
+    _digP1 = (uint16_t)(c[7] << 8 | c[6]);
+    for (int i = 0; i < 8; i++) {
+      _digP[i] = (int16_t)(c[9 + 2 * i] << 8 | c[8 + 2 * i]);
+    }
+    _digH1 = c[25];
+    _digH2 = (int16_t)(h[1] << 8 | h[0]);
+    _digH3 = h[2];
+    _digH4 = (int16_t)((int8_t)h[3] * 16 | (h[4] & 0x0F));
+    _digH5 = (int16_t)((int8_t)h[5] * 16 | (h[4] >> 4));
+    _digH6 = (int8_t)h[6];
+    return true;
+  }
+
+  // Returns 0.01 degC, sets tFine for the other channels
+  int32_t compensateTemperature(int32_t adcT, int32_t &tFine) const {
+    int32_t var1 = ((((adcT >> 3) - ((int32_t)_digT1 << 1))) * ((int32_t)_digT2)) >> 11;
+    int32_t var2 = (((((adcT >> 4) - ((int32_t)_digT1)) * ((adcT >> 4) - ((int32_t)_digT1))) >> 12) *
+                    ((int32_t)_digT3)) >> 14;
+    tFine = var1 + var2;
+    return (tFine * 5 + 128) >> 8;
+  }
+
+  // Returns Pa in Q24.8
+  uint32_t compensatePressure(int32_t adcP, int32_t tFine) const {
+    int64_t var1 = ((int64_t)tFine) - 128000;
+    int64_t var2 = var1 * var1 * (int64_t)_digP[4];
+    var2 = var2 + ((var1 * (int64_t)_digP[3]) << 17);
+    var2 = var2 + (((int64_t)_digP[2]) << 35);
+    var1 = ((var1 * var1 * (int64_t)_digP[1]) >> 8) + ((var1 * (int64_t)_digP[0]) << 12);
+    var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)_digP1) >> 33;
+    if (var1 == 0) {
+      return 0; // avoid division by zero
+    }
+    int64_t p = 1048576 - adcP;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = (((int64_t)_digP[7]) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (((int64_t)_digP[6]) * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + (((int64_t)_digP[5]) << 4);
+    return (uint32_t)p;
+  }
+
+  // Returns %RH in Q22.10
+  uint32_t compensateHumidity(int32_t adcH, int32_t tFine) const {
+    int32_t v = tFine - ((int32_t)76800);
+    v = (((((adcH << 14) - (((int32_t)_digH4) << 20) - (((int32_t)_digH5) * v)) + ((int32_t)16384)) >> 15) *
+         (((((((v * ((int32_t)_digH6)) >> 10) * (((v * ((int32_t)_digH3)) >> 11) + ((int32_t)32768))) >> 10) +
+            ((int32_t)2097152)) * ((int32_t)_digH2) + 8192) >> 14));
+    v = (v - (((((v >> 15) * (v >> 15)) >> 7) * ((int32_t)_digH1)) >> 4));
+    v = (v < 0 ? 0 : v);
+    v = (v > 419430400 ? 419430400 : v);
+    return (uint32_t)(v >> 12);
+  }
+
+  TwoWire* _wire = nullptr;
+  uint8_t _address = 0;
+  State _state = NotPresent;
+  bool _hasSample = false;
+  unsigned long _startTime = 0;
+  unsigned long _sampleTime = 0;
+
+  int32_t _temperature = 0;
+  uint32_t _pressure = 0;
+  uint32_t _humidity = 0;
+
+  uint16_t _digT1 = 0;
+  int16_t _digT2 = 0, _digT3 = 0;
+  uint16_t _digP1 = 0;
+  int16_t _digP[8] = {}; // dig_P2..dig_P9
+  uint8_t _digH1 = 0, _digH3 = 0;
+  int16_t _digH2 = 0, _digH4 = 0, _digH5 = 0;
+  int8_t _digH6 = 0;
+};
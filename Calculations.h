@@ -1,5 +1,11 @@
 #pragma once
+#ifdef ARDUINO
 #include <Arduino.h>
+#else
+// Also built on hosts for backfill tools, see CalculationsBatch.h
+#include <stdint.h>
+#include <string.h>
+#endif
 #include <math.h>
 
 // AQI breakpoints for PM2.5 (US EPA standard)
@@ -28,8 +34,9 @@ constexpr float AQI_RANGE_BP4 = 94.9f;
 constexpr float AQI_RANGE_BP5 = 99.9f;
 constexpr float AQI_RANGE_BP6 = 249.9f;
 
-// Calculate PM2.5 AQI based on US EPA standard
-inline uint16_t calculatePM25AQI(uint16_t pm25) {
+// Calculate PM2.5 AQI based on US EPA standard, float reference. The
+// integer version below is checked against this for every uint16 input.
+inline uint16_t calculatePM25AQIFloat(uint16_t pm25) {
   if (pm25 <= AQI_PM25_BP1) return (uint16_t)round(pm25 * AQI_VALUE_BP1 / AQI_RANGE_BP1);
   if (pm25 <= AQI_PM25_BP2) return (uint16_t)round(AQI_VALUE_BP2 + (pm25 - AQI_PM25_BP1_START) * 49.0f / AQI_RANGE_BP2);
   if (pm25 <= AQI_PM25_BP3) return (uint16_t)round(AQI_VALUE_BP3 + (pm25 - AQI_PM25_BP2_START) * 49.0f / AQI_RANGE_BP3);
@@ -38,17 +45,94 @@ inline uint16_t calculatePM25AQI(uint16_t pm25) {
   return (uint16_t)round(AQI_VALUE_BP6 + (pm25 - AQI_PM25_BP5_START) * 99.0f / AQI_RANGE_BP6);
 }
 
+// The same breakpoints in integer form, with concentrations in tenths of
+// µg/m³: AQI = base + round((10 * pm25 - start) * slope / range)
+struct AqiSegment {
+  uint16_t pmMax;  // last integer pm25 of the segment
+  uint16_t base;
+  uint16_t slope;
+  uint16_t start;  // 0.1 µg/m³
+  uint16_t range;  // 0.1 µg/m³
+};
+
+// Above this the float path's rounding error starts to show near .5 (first
+// at 20529 µg/m³), so those inputs, far outside the sensor's range, keep it
+constexpr uint16_t AQI_PM25_INT_MAX = 16383;
+
+constexpr AqiSegment AQI_PM25_SEGMENTS[] = {
+  {12, 0, 50, 0, 120},
+  {35, AQI_VALUE_BP2, 49, 121, 233},
+  {55, AQI_VALUE_BP3, 49, 355, 199},
+  {150, AQI_VALUE_BP4, 49, 555, 949},
+  {250, AQI_VALUE_BP5, 99, 1505, 999},
+  {AQI_PM25_INT_MAX, AQI_VALUE_BP6, 99, 2505, 2499},
+};
+
+// Calculate PM2.5 AQI without floating point (the ESP8266 has no FPU)
+inline uint16_t calculatePM25AQI(uint16_t pm25) {
+  for (const AqiSegment &seg : AQI_PM25_SEGMENTS) {
+    if (pm25 <= seg.pmMax) {
+      // Round half up, all terms are non-negative inside a segment
+      uint32_t n = (uint32_t)(10 * (uint32_t)pm25 - seg.start) * seg.slope;
+      return seg.base + (uint16_t)((2 * n + seg.range) / (2 * (uint32_t)seg.range));
+    }
+  }
+  return calculatePM25AQIFloat(pm25);
+}
+
 // Constants for dew point calculation (Magnus formula)
 constexpr float DEWPOINT_A = 17.27f;
 constexpr float DEWPOINT_B = 237.7f;
 constexpr float HUMIDITY_MAX = 100.0f;
 
-// Calculate dew point in Celsius
-inline float calculateDewPoint(float temp, float humidity) {
+// Calculate dew point in Celsius with libm, reference for the version below
+inline float calculateDewPointLibm(float temp, float humidity) {
   float alpha = ((DEWPOINT_A * temp) / (DEWPOINT_B + temp)) + logf(humidity / HUMIDITY_MAX);
   return (DEWPOINT_B * alpha) / (DEWPOINT_A - alpha);
 }
 
+// Coefficients of ln(1 + z) / z for z in [√½ - 1, √2 - 1], degree-5
+// Chebyshev fit; fastLogf() is within 3.2e-6 of ln over [0.01, 100]
+constexpr float LN_POLY[] = {
+  1.0000037f, -0.49989480f, 0.33265906f, -0.25433356f, 0.21965708f, -0.14021623f
+};
+constexpr float LN_2 = 0.69314718f;
+constexpr float LN_HUMIDITY_MAX = 4.6051702f; // ln(100)
+
+// ln(x) for normal x > 0 without libm: take the binary exponent from the
+// float bits, reduce the mantissa to [√½, √2) and evaluate LN_POLY. Zero,
+// negative, infinite and NaN inputs give NaN. Integer ops and selects only
+// outside the polynomial, so batch loops vectorize (CalculationsBatch.h).
+inline float fastLogf(float x) {
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  uint32_t invalid = ((int32_t)bits <= 0) | (bits >= 0x7F800000);
+  int32_t e = (int32_t)((bits >> 23) & 0xFF) - 127;
+  bits = (bits & 0x007FFFFF) | 0x3F800000;
+  // Mantissa above √2: halve it through the exponent bits
+  uint32_t high = bits > 0x3FB504F3;
+  bits -= high << 23;
+  e += high;
+  float m;
+  memcpy(&m, &bits, sizeof(m));
+  float z = m - 1.0f;
+  float p = ((((LN_POLY[5] * z + LN_POLY[4]) * z + LN_POLY[3]) * z + LN_POLY[2]) * z + LN_POLY[1]) * z + LN_POLY[0];
+  float r = z * p + e * LN_2;
+  memcpy(&bits, &r, sizeof(bits));
+  bits |= (0u - invalid) & 0x7FC00000;
+  memcpy(&r, &bits, sizeof(r));
+  return r;
+}
+
+// Calculate dew point in Celsius. Magnus formula with both fractions folded
+// into one division and fastLogf() for the humidity term. Within 1e-4 °C of
+// a double-precision Magnus for -40..85 °C and 1..100 % RH; NaN without
+// humidity.
+inline float calculateDewPoint(float temp, float humidity) {
+  float u = (fastLogf(humidity) - LN_HUMIDITY_MAX) * (DEWPOINT_B + temp);
+  return DEWPOINT_B * (DEWPOINT_A * temp + u) / (DEWPOINT_A * DEWPOINT_B - u);
+}
+
 // Comfort index constants
 constexpr float COMFORT_TEMP_OPTIMAL = 22.0f;
 constexpr float COMFORT_TEMP_MIN = 18.0f;
@@ -64,18 +148,20 @@ constexpr float COMFORT_SCORE_DIVISOR = 2.0f;
 
 // Calculate comfort index (0-100, higher is better)
 inline float calculateComfortIndex(float temp, float humidity) {
-  float tempScore = COMFORT_SCORE_MAX;
-  float humidityScore = COMFORT_SCORE_MAX;
+  // Both penalties are computed unconditionally and selected, so batch loops
+  // vectorize (CalculationsBatch.h)
 
   // Temperature scoring: optimal around 22°C
-  if (temp < COMFORT_TEMP_MIN || temp > COMFORT_TEMP_MAX) {
-    tempScore = fmaxf(COMFORT_SCORE_MIN, COMFORT_SCORE_MAX - fabsf(temp - COMFORT_TEMP_OPTIMAL) * COMFORT_TEMP_PENALTY);
-  }
+  float tempPenalty = COMFORT_SCORE_MAX - fabsf(temp - COMFORT_TEMP_OPTIMAL) * COMFORT_TEMP_PENALTY;
+  tempPenalty = tempPenalty > COMFORT_SCORE_MIN ? tempPenalty : COMFORT_SCORE_MIN;
+  bool tempOutside = (temp < COMFORT_TEMP_MIN) | (temp > COMFORT_TEMP_MAX);
+  float tempScore = tempOutside ? tempPenalty : COMFORT_SCORE_MAX;
 
   // Humidity scoring: optimal around 50%
-  if (humidity < COMFORT_HUMIDITY_MIN || humidity > COMFORT_HUMIDITY_MAX) {
-    humidityScore = fmaxf(COMFORT_SCORE_MIN, COMFORT_SCORE_MAX - fabsf(humidity - COMFORT_HUMIDITY_OPTIMAL) * COMFORT_HUMIDITY_PENALTY);
-  }
+  float humidityPenalty = COMFORT_SCORE_MAX - fabsf(humidity - COMFORT_HUMIDITY_OPTIMAL) * COMFORT_HUMIDITY_PENALTY;
+  humidityPenalty = humidityPenalty > COMFORT_SCORE_MIN ? humidityPenalty : COMFORT_SCORE_MIN;
+  bool humidityOutside = (humidity < COMFORT_HUMIDITY_MIN) | (humidity > COMFORT_HUMIDITY_MAX);
+  float humidityScore = humidityOutside ? humidityPenalty : COMFORT_SCORE_MAX;
 
   return (tempScore + humidityScore) / COMFORT_SCORE_DIVISOR;
 }
@@ -86,12 +172,8 @@ constexpr uint16_t AQI_CAT2_MAX = 100;
 constexpr uint16_t AQI_CAT3_MAX = 150;
 constexpr uint16_t AQI_CAT4_MAX = 200;
 
-// Get AQI category (1-5)
+// Get AQI category (1-5), counted instead of branched so it vectorizes
 inline uint8_t getAQICategory(uint16_t aqi) {
-  if (aqi <= AQI_CAT1_MAX) return 1;
-  if (aqi <= AQI_CAT2_MAX) return 2;
-  if (aqi <= AQI_CAT3_MAX) return 3;
-  if (aqi <= AQI_CAT4_MAX) return 4;
-  return 5;
+  return 1 + (aqi > AQI_CAT1_MAX) + (aqi > AQI_CAT2_MAX) + (aqi > AQI_CAT3_MAX) + (aqi > AQI_CAT4_MAX);
 }
 
@@ -0,0 +1,140 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "Calculations.h"
+
+// Batch versions of the Calculations.h functions for journal replay and
+// history backfill on a host. Not used by the sketch.
+//
+// Inputs and outputs are structure-of-arrays spans of equal length. The loops
+// call the scalar functions, which are written branch-free so GCC and Clang
+// vectorize the inlined bodies (-O3, or -O2 -ftree-vectorize). The results
+// are the scalar results bit for bit as long as the compiler does not
+// contract a * b + c into an FMA differently in the two paths, which
+// -ffp-contract=off rules out.
+//
+// Define CALCULATIONS_BATCH_AVX2 on an AVX2 build to use the hand-written
+// dew point and comfort index loop instead; it follows the scalar operation
+// order and gives the same results.
+
+struct DerivedInputs {
+  const uint16_t* pm25;
+  const float* temperature;
+  const float* humidity;
+};
+
+struct DerivedOutputs {
+  uint16_t* aqi;
+  uint8_t* aqiCategory;
+  float* dewPoint;
+  float* comfortIndex;
+};
+
+// AQI of every uint16 input, filled once from calculatePM25AQI(). The
+// segment search does not vectorize; a table load does.
+struct Pm25AqiTable {
+  uint16_t aqi[65536];
+
+  Pm25AqiTable() {
+    for (uint32_t pm = 0; pm < 65536; pm++) {
+      aqi[pm] = calculatePM25AQI((uint16_t)pm);
+    }
+  }
+};
+
+inline const uint16_t* pm25AqiTable() {
+  static const Pm25AqiTable table;
+  return table.aqi;
+}
+
+inline void calculateAQIBatch(const uint16_t* pm25, uint16_t* aqi, uint8_t* category, size_t n) {
+  const uint16_t* table = pm25AqiTable();
+  for (size_t i = 0; i < n; i++) {
+    aqi[i] = table[pm25[i]];
+  }
+  for (size_t i = 0; i < n; i++) {
+    category[i] = getAQICategory(aqi[i]);
+  }
+}
+
+#if defined(CALCULATIONS_BATCH_AVX2) && defined(__AVX2__)
+#include <immintrin.h>
+
+// fastLogf() on eight lanes
+inline __m256 fastLogf8(__m256 x) {
+  __m256i bits = _mm256_castps_si256(x);
+  // Signed compares: sign bit set or zero, or at least 0x7F800000
+  __m256i invalid = _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(1), bits),
+                                    _mm256_cmpgt_epi32(bits, _mm256_set1_epi32(0x7F7FFFFF)));
+  __m256i e = _mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(0xFF)),
+                               _mm256_set1_epi32(127));
+  bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F800000));
+  __m256i high = _mm256_cmpgt_epi32(bits, _mm256_set1_epi32(0x3FB504F3)); // true lanes are -1
+  bits = _mm256_add_epi32(bits, _mm256_slli_epi32(high, 23));
+  e = _mm256_sub_epi32(e, high);
+  __m256 m = _mm256_castsi256_ps(bits);
+  __m256 z = _mm256_sub_ps(m, _mm256_set1_ps(1.0f));
+  __m256 p = _mm256_set1_ps(LN_POLY[5]);
+  for (int i = 4; i >= 0; i--) {
+    p = _mm256_add_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(LN_POLY[i]));
+  }
+  __m256 r = _mm256_add_ps(_mm256_mul_ps(z, p), _mm256_mul_ps(_mm256_cvtepi32_ps(e), _mm256_set1_ps(LN_2)));
+  return _mm256_or_ps(r, _mm256_castsi256_ps(_mm256_and_si256(invalid, _mm256_set1_epi32(0x7FC00000))));
+}
+
+// calculateComfortIndex() partial score on eight lanes
+inline __m256 comfortScore8(__m256 x, float lo, float hi, float optimal, float penalty) {
+  __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  __m256 dev = _mm256_and_ps(_mm256_sub_ps(x, _mm256_set1_ps(optimal)), absMask);
+  __m256 score = _mm256_max_ps(_mm256_sub_ps(_mm256_set1_ps(COMFORT_SCORE_MAX), _mm256_mul_ps(dev, _mm256_set1_ps(penalty))),
+                               _mm256_set1_ps(COMFORT_SCORE_MIN));
+  __m256 outside = _mm256_or_ps(_mm256_cmp_ps(x, _mm256_set1_ps(lo), _CMP_LT_OQ),
+                                _mm256_cmp_ps(x, _mm256_set1_ps(hi), _CMP_GT_OQ));
+  return _mm256_blendv_ps(_mm256_set1_ps(COMFORT_SCORE_MAX), score, outside);
+}
+
+inline void calculateEnvBatch(const float* temperature, const float* humidity,
+                              float* dewPoint, float* comfortIndex, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 t = _mm256_loadu_ps(temperature + i);
+    __m256 h = _mm256_loadu_ps(humidity + i);
+    __m256 u = _mm256_mul_ps(_mm256_sub_ps(fastLogf8(h), _mm256_set1_ps(LN_HUMIDITY_MAX)),
+                             _mm256_add_ps(_mm256_set1_ps(DEWPOINT_B), t));
+    __m256 num = _mm256_mul_ps(_mm256_set1_ps(DEWPOINT_B), _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(DEWPOINT_A), t), u));
+    __m256 den = _mm256_sub_ps(_mm256_set1_ps(DEWPOINT_A * DEWPOINT_B), u);
+    _mm256_storeu_ps(dewPoint + i, _mm256_div_ps(num, den));
+
+    __m256 ts = comfortScore8(t, COMFORT_TEMP_MIN, COMFORT_TEMP_MAX, COMFORT_TEMP_OPTIMAL, COMFORT_TEMP_PENALTY);
+    __m256 hs = comfortScore8(h, COMFORT_HUMIDITY_MIN, COMFORT_HUMIDITY_MAX, COMFORT_HUMIDITY_OPTIMAL, COMFORT_HUMIDITY_PENALTY);
+    _mm256_storeu_ps(comfortIndex + i, _mm256_div_ps(_mm256_add_ps(ts, hs), _mm256_set1_ps(COMFORT_SCORE_DIVISOR)));
+  }
+  for (; i < n; i++) {
+    dewPoint[i] = calculateDewPoint(temperature[i], humidity[i]);
+    comfortIndex[i] = calculateComfortIndex(temperature[i], humidity[i]);
+  }
+}
+
+#else
+
+inline void calculateEnvBatch(const float* temperature, const float* humidity,
+                              float* dewPoint, float* comfortIndex, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    dewPoint[i] = calculateDewPoint(temperature[i], humidity[i]);
+  }
+  for (size_t i = 0; i < n; i++) {
+    comfortIndex[i] = calculateComfortIndex(temperature[i], humidity[i]);
+  }
+}
+
+#endif
+
+// AQI, category, dew point and comfort index for n samples. Unlike
+// calculateDerived() there are no validity flags: the env outputs follow
+// the inputs (NaN in, NaN out) and the caller ignores rows it has no data for.
+inline void calculateDerivedBatch(const DerivedInputs &in, const DerivedOutputs &out, size_t n) {
+  calculateAQIBatch(in.pm25, out.aqi, out.aqiCategory, n);
+  calculateEnvBatch(in.temperature, in.humidity, out.dewPoint, out.comfortIndex, n);
+}
@@ -2,6 +2,7 @@
 #include <Arduino.h>
 #include <LittleFS.h>
 #include "secrets.h"
+#include "ConfigStore.h"
 
 #ifdef DEBUG
 #define DBG_PRINT(...) Serial.print(__VA_ARGS__)
@@ -49,11 +50,112 @@
 #define DEFAULT_SEND_INTERVAL 10000
 #endif
 
+#ifndef DEFAULT_MQTT_BATCH_SIZE
+#define DEFAULT_MQTT_BATCH_SIZE 1
+#endif
+
+// Deadband defaults match the thresholds of the Node-RED flow
+#ifndef DEFAULT_DEADBAND_ENABLED
+#define DEFAULT_DEADBAND_ENABLED 0
+#endif
+
+#ifndef DEFAULT_HEARTBEAT_INTERVAL
+#define DEFAULT_HEARTBEAT_INTERVAL 600
+#endif
+
+// Duty-cycle mode: buffer samples and only bring up WiFi every
+// uplinkPeriod minutes (see PowerSave.h). The RTC buffer fills after 41
+// samples, 6.8 minutes at the default interval, which wakes the radio
+// earlier than a longer period.
+#ifndef DEFAULT_POWER_SAVE
+#define DEFAULT_POWER_SAVE 0
+#endif
+
+#ifndef DEFAULT_UPLINK_PERIOD
+#define DEFAULT_UPLINK_PERIOD 5
+#endif
+
+// Reuse the last IP address instead of asking DHCP after a restart. Only
+// safe if the router always hands this device the same address.
+#ifndef DEFAULT_WIFI_REUSE_IP
+#define DEFAULT_WIFI_REUSE_IP 0
+#endif
+
+#ifndef DEFAULT_UPLINK_URL
+#define DEFAULT_UPLINK_URL ""
+#endif
+
 #ifndef DEFAULT_OTA_PASSWORD
 #define DEFAULT_OTA_PASSWORD ""
 #endif
 
 struct DeviceConfig {
+  char ssid[32];
+  char password[64];
+  char hostname[32];
+  char mqttHost[64];
+  uint16_t mqttPort;
+  char mqttUser[32];
+  char mqttPassword[64];
+  char mqttTopic[64];
+  uint32_t sendInterval;
+  float tempOffset;
+  uint8_t mqttBatchSize;  // samples per MQTT message, 1 = publish every sample
+  uint8_t mqttBinary;     // also publish the binary uplink frame on tele/<topic>/bin
+  char uplinkUrl[96];     // HTTP endpoint for binary POSTs, empty = off
+  uint8_t deadbandEnabled;    // only publish samples that changed (see Deadband.h)
+  uint16_t deadbandPm;        // µg/m³
+  uint16_t heartbeatInterval; // s, publish at least this often with the deadband on
+  float deadbandTemp;         // °C
+  float deadbandHum;          // %
+  float deadbandPress;        // hPa
+  uint8_t wifiReuseIp;        // skip DHCP on a fast reconnect (see WiFiLease.h)
+  uint8_t powerSave;          // radio only on for uplink bursts
+  uint16_t uplinkPeriod;      // min between bursts with powerSave
+};
+
+constexpr uint8_t MQTT_BATCH_MAX = 24;
+constexpr uint16_t HEARTBEAT_MIN = 10;
+constexpr uint16_t HEARTBEAT_MAX = 3600;
+constexpr uint16_t UPLINK_PERIOD_MIN = 1;
+constexpr uint16_t UPLINK_PERIOD_MAX = 240;
+
+#define CONFIG_FIELD(key, type, flags, member) \
+  {key, type, flags, sizeof(DeviceConfig::member), offsetof(DeviceConfig, member)}
+
+// Keys in /config.kv. New fields get the next free key; keys of removed
+// fields are never reused. Fields that can be preset in secrets.h track
+// their compiled default, see ConfigStore.h.
+static const ConfigField CONFIG_FIELDS[] PROGMEM = {
+  CONFIG_FIELD(1, CONFIG_STRING, CONFIG_TRACK_DEFAULT, ssid),
+  CONFIG_FIELD(2, CONFIG_STRING, CONFIG_TRACK_DEFAULT, password),
+  CONFIG_FIELD(3, CONFIG_STRING, CONFIG_TRACK_DEFAULT, hostname),
+  CONFIG_FIELD(4, CONFIG_STRING, CONFIG_TRACK_DEFAULT, mqttHost),
+  CONFIG_FIELD(5, CONFIG_BINARY, CONFIG_TRACK_DEFAULT, mqttPort),
+  CONFIG_FIELD(6, CONFIG_STRING, CONFIG_TRACK_DEFAULT, mqttUser),
+  CONFIG_FIELD(7, CONFIG_STRING, CONFIG_TRACK_DEFAULT, mqttPassword),
+  CONFIG_FIELD(8, CONFIG_STRING, CONFIG_TRACK_DEFAULT, mqttTopic),
+  CONFIG_FIELD(9, CONFIG_BINARY, 0, sendInterval),
+  CONFIG_FIELD(10, CONFIG_BINARY, 0, tempOffset),
+  CONFIG_FIELD(11, CONFIG_BINARY, 0, mqttBatchSize),
+  CONFIG_FIELD(12, CONFIG_BINARY, 0, mqttBinary),
+  CONFIG_FIELD(13, CONFIG_STRING, 0, uplinkUrl),
+  CONFIG_FIELD(14, CONFIG_BINARY, 0, deadbandEnabled),
+  CONFIG_FIELD(15, CONFIG_BINARY, 0, deadbandPm),
+  CONFIG_FIELD(16, CONFIG_BINARY, 0, heartbeatInterval),
+  CONFIG_FIELD(17, CONFIG_BINARY, 0, deadbandTemp),
+  CONFIG_FIELD(18, CONFIG_BINARY, 0, deadbandHum),
+  CONFIG_FIELD(19, CONFIG_BINARY, 0, deadbandPress),
+  CONFIG_FIELD(20, CONFIG_BINARY, 0, wifiReuseIp),
+  CONFIG_FIELD(21, CONFIG_BINARY, 0, powerSave),
+  CONFIG_FIELD(22, CONFIG_BINARY, 0, uplinkPeriod),
+};
+constexpr uint8_t CONFIG_FIELD_COUNT = sizeof(CONFIG_FIELDS) / sizeof(CONFIG_FIELDS[0]);
+static_assert(CONFIG_FIELD_COUNT <= CONFIG_MAX_FIELDS, "ConfigStore tracks at most CONFIG_MAX_FIELDS fields");
+
+// Raw struct dump written by older firmware to /config.bin, only read once
+// to migrate. Files from before mqttBatchSize end at defaultsHash.
+struct LegacyDeviceConfig {
   char ssid[32];
   char password[64];
   char hostname[32];
@@ -65,8 +167,24 @@ struct DeviceConfig {
   uint32_t sendInterval;
   float tempOffset;
   uint32_t defaultsHash;
+  uint8_t mqttBatchSize;
+  uint8_t mqttBinary;
+  char uplinkUrl[96];
+  uint8_t deadbandEnabled;
+  uint16_t deadbandPm;
+  uint16_t heartbeatInterval;
+  float deadbandTemp;
+  float deadbandHum;
+  float deadbandPress;
 };
 
+constexpr size_t LEGACY_CONFIG_MIN_SIZE = offsetof(LegacyDeviceConfig, defaultsHash) + sizeof(uint32_t);
+constexpr const char* CONFIG_PATH = "/config.kv";
+constexpr const char* CONFIG_TMP_PATH = "/config.new";
+constexpr const char* LEGACY_CONFIG_PATH = "/config.bin";
+
+extern ConfigStore configStore;
+
 inline uint32_t hashStr(const char *s, uint32_t h = 2166136261UL) {
   while (*s) {
     h = (h ^ static_cast<uint8_t>(*s++)) * 16777619UL;
@@ -74,6 +192,7 @@ inline uint32_t hashStr(const char *s, uint32_t h = 2166136261UL) {
   return h;
 }
 
+// Hash of the secrets.h defaults, only used to read /config.bin
 inline uint32_t calcDefaultsHash() {
   uint32_t h = 2166136261UL;
   h = hashStr(DEFAULT_WIFI_SSID, h);
@@ -106,36 +225,105 @@ inline void resetConfig(DeviceConfig &cfg) {
   strncpy(cfg.mqttTopic, DEFAULT_MQTT_TOPIC, sizeof(cfg.mqttTopic) - 1);
   cfg.mqttTopic[sizeof(cfg.mqttTopic) - 1] = '\0';
   cfg.sendInterval = DEFAULT_SEND_INTERVAL;
-  cfg.defaultsHash = calcDefaultsHash();
+  cfg.mqttBatchSize = DEFAULT_MQTT_BATCH_SIZE;
+  strncpy(cfg.uplinkUrl, DEFAULT_UPLINK_URL, sizeof(cfg.uplinkUrl) - 1);
+  cfg.uplinkUrl[sizeof(cfg.uplinkUrl) - 1] = '\0';
+  cfg.deadbandEnabled = DEFAULT_DEADBAND_ENABLED;
+  cfg.deadbandPm = 1;
+  cfg.heartbeatInterval = DEFAULT_HEARTBEAT_INTERVAL;
+  cfg.deadbandTemp = 0.2f;
+  cfg.deadbandHum = 1.0f;
+  cfg.deadbandPress = 0.5f;
+  cfg.wifiReuseIp = DEFAULT_WIFI_REUSE_IP;
+  cfg.powerSave = DEFAULT_POWER_SAVE;
+  cfg.uplinkPeriod = DEFAULT_UPLINK_PERIOD;
 }
 
-inline bool loadConfig(DeviceConfig &cfg) {
-  if (!LittleFS.begin()) return false;
-  File f = LittleFS.open("/config.bin", "r");
+// Clamp values a corrupted or hand-edited store could hold
+inline void validateConfig(DeviceConfig &cfg) {
+  if (cfg.mqttBatchSize < 1 || cfg.mqttBatchSize > MQTT_BATCH_MAX) {
+    cfg.mqttBatchSize = DEFAULT_MQTT_BATCH_SIZE;
+  }
+  if (cfg.heartbeatInterval < HEARTBEAT_MIN || cfg.heartbeatInterval > HEARTBEAT_MAX) {
+    cfg.heartbeatInterval = DEFAULT_HEARTBEAT_INTERVAL;
+  }
+  if (cfg.uplinkPeriod < UPLINK_PERIOD_MIN || cfg.uplinkPeriod > UPLINK_PERIOD_MAX) {
+    cfg.uplinkPeriod = DEFAULT_UPLINK_PERIOD;
+  }
+}
+
+// Take over /config.bin from older firmware. As before, a file written
+// with other secrets.h defaults is ignored.
+inline bool migrateLegacyConfig(DeviceConfig &cfg) {
+  File f = LittleFS.open(LEGACY_CONFIG_PATH, "r");
   if (!f) {
-    LittleFS.end();
     return false;
   }
-  size_t r = f.read(reinterpret_cast<uint8_t*>(&cfg), sizeof(cfg));
+  LegacyDeviceConfig old;
+  memset(&old, 0, sizeof(old));
+  size_t r = f.read(reinterpret_cast<uint8_t*>(&old), sizeof(old));
   f.close();
-  LittleFS.end();
-  if (r == sizeof(cfg) && cfg.defaultsHash == calcDefaultsHash()) {
-    return true;
+  if (r < LEGACY_CONFIG_MIN_SIZE || old.defaultsHash != calcDefaultsHash()) {
+    return false;
   }
-  resetConfig(cfg);
-  return false;
+  memcpy(cfg.ssid, old.ssid, sizeof(cfg.ssid));
+  memcpy(cfg.password, old.password, sizeof(cfg.password));
+  memcpy(cfg.hostname, old.hostname, sizeof(cfg.hostname));
+  memcpy(cfg.mqttHost, old.mqttHost, sizeof(cfg.mqttHost));
+  cfg.mqttPort = old.mqttPort;
+  memcpy(cfg.mqttUser, old.mqttUser, sizeof(cfg.mqttUser));
+  memcpy(cfg.mqttPassword, old.mqttPassword, sizeof(cfg.mqttPassword));
+  memcpy(cfg.mqttTopic, old.mqttTopic, sizeof(cfg.mqttTopic));
+  cfg.sendInterval = old.sendInterval;
+  cfg.tempOffset = old.tempOffset;
+  // Fields the file is too short for keep their defaults
+  if (r >= offsetof(LegacyDeviceConfig, uplinkUrl) + sizeof(old.uplinkUrl)) {
+    cfg.mqttBatchSize = old.mqttBatchSize;
+    cfg.mqttBinary = old.mqttBinary;
+    memcpy(cfg.uplinkUrl, old.uplinkUrl, sizeof(cfg.uplinkUrl));
+  }
+  if (r >= sizeof(old)) {
+    cfg.deadbandEnabled = old.deadbandEnabled;
+    cfg.deadbandPm = old.deadbandPm;
+    cfg.heartbeatInterval = old.heartbeatInterval;
+    cfg.deadbandTemp = old.deadbandTemp;
+    cfg.deadbandHum = old.deadbandHum;
+    cfg.deadbandPress = old.deadbandPress;
+  }
+  // Strings were never guaranteed terminated in the raw dump
+  cfg.ssid[sizeof(cfg.ssid) - 1] = '\0';
+  cfg.password[sizeof(cfg.password) - 1] = '\0';
+  cfg.hostname[sizeof(cfg.hostname) - 1] = '\0';
+  cfg.mqttHost[sizeof(cfg.mqttHost) - 1] = '\0';
+  cfg.mqttUser[sizeof(cfg.mqttUser) - 1] = '\0';
+  cfg.mqttPassword[sizeof(cfg.mqttPassword) - 1] = '\0';
+  cfg.mqttTopic[sizeof(cfg.mqttTopic) - 1] = '\0';
+  cfg.uplinkUrl[sizeof(cfg.uplinkUrl) - 1] = '\0';
+  return true;
 }
 
-inline bool saveConfig(DeviceConfig &cfg) {
-  cfg.defaultsHash = calcDefaultsHash();
-  if (!LittleFS.begin()) return false;
-  File f = LittleFS.open("/config.bin", "w");
-  if (!f) {
-    LittleFS.end();
+// Load the config, falling back to /config.bin and then to the defaults.
+// Call saveConfig() afterwards to persist migrated or adopted values.
+inline bool loadConfig(DeviceConfig &cfg) {
+  DeviceConfig defaults;
+  resetConfig(defaults);
+  cfg = defaults;
+  bool loaded = configStore.load(&cfg, &defaults);
+  if (!loaded && mountFS() && migrateLegacyConfig(cfg)) {
+    configStore.requestCompaction();
+    loaded = true;
+  }
+  validateConfig(cfg);
+  return loaded;
+}
+
+// Write the fields that changed since the last load or save
+inline bool saveConfig(const DeviceConfig &cfg) {
+  if (!configStore.save(&cfg)) {
     return false;
   }
-  size_t w = f.write(reinterpret_cast<const uint8_t*>(&cfg), sizeof(cfg));
-  f.close();
-  LittleFS.end();
-  return w == sizeof(cfg);
+  if (LittleFS.exists(LEGACY_CONFIG_PATH)) {
+    LittleFS.remove(LEGACY_CONFIG_PATH);
+  }
+  return true;
 }
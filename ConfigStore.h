@@ -0,0 +1,370 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "Crc.h"
+
+// Key/value store for a config struct, kept as an append-only record log.
+//
+// File layout: an 8-byte header (magic, format version), then records of
+//   key (1) | length (1) | default hash (4) | value (length) | CRC-32 (4)
+// with the CRC over everything before it. A later record for a key
+// overrides an earlier one. Each field of the struct has a stable key in a
+// ConfigField table, so fields can be added, and unknown keys are skipped.
+// Every save ends with a commit record, key CONFIG_COMMIT_KEY and a 4-byte
+// sequence number counting saves; load() only takes records up to the last
+// commit, so a save applies all of its fields or none.
+//
+// save() appends records only for fields whose value changed since they
+// were last read or written. Once the log grows past CONFIG_LOG_MAX, or
+// after a damaged record, all current values are written to a new file
+// that then replaces the log by rename. A write cut short by a power loss
+// leaves records without their commit, or one with a bad CRC, at the end of
+// the log; load() ignores them and compacts on the next save. An
+// interrupted compaction leaves the old log untouched.
+//
+// Fields marked CONFIG_TRACK_DEFAULT remember a hash of their compiled
+// default. If that default changed since the value was written, load()
+// takes the new default for that field only.
+
+#ifndef CONFIG_LOG_MAX
+#define CONFIG_LOG_MAX 2048 // bytes, about three rounds of full edits
+#endif
+
+constexpr uint32_t CONFIG_STORE_MAGIC = 0x46434B49; // "IKCF"
+constexpr uint8_t CONFIG_STORE_VERSION = 1;
+constexpr size_t CONFIG_HEADER_SIZE = 8;
+constexpr size_t CONFIG_RECORD_HEAD = 6;       // key, length, default hash
+constexpr size_t CONFIG_MAX_VALUE = 128;
+constexpr uint8_t CONFIG_MAX_FIELDS = 32;
+constexpr uint8_t CONFIG_COMMIT_KEY = 0xFF;    // ends a save, never a field key
+constexpr size_t CONFIG_COMMIT_SIZE = CONFIG_RECORD_HEAD + sizeof(uint32_t) + 4;
+
+// ConfigField::type
+constexpr uint8_t CONFIG_STRING = 0;  // null-terminated char array, stored without the terminator
+constexpr uint8_t CONFIG_BINARY = 1;  // fixed-size number, stored as its bytes
+
+// ConfigField::flags
+constexpr uint8_t CONFIG_TRACK_DEFAULT = 0x01;
+
+struct ConfigField {
+  uint8_t key;      // stable id in the file, never reused
+  uint8_t type;
+  uint8_t flags;
+  uint8_t size;     // sizeof the struct member
+  uint16_t offset;  // offsetof the struct member
+};
+
+// Mount LittleFS once and keep it mounted, the config and the sample
+// journal share it
+inline bool mountFS() {
+  static bool mounted = false;
+  if (!mounted) {
+    mounted = LittleFS.begin();
+  }
+  return mounted;
+}
+
+class ConfigStore {
+public:
+  ConfigStore(const char* path, const char* tmpPath, const ConfigField* fields, uint8_t count)
+    : _path(path), _tmpPath(tmpPath), _fields(fields), _count(count) {}
+
+  // Fill cfg from the committed part of the log; fields without a record
+  // keep what cfg already holds. defaults is the struct with compiled
+  // defaults. Returns false if there is no readable log.
+  bool load(void* cfg, const void* defaults) {
+    initDefaultHashes(defaults);
+    if (!mountFS()) {
+      return false;
+    }
+    // Left over from a compaction that did not reach the rename
+    if (LittleFS.exists(_tmpPath)) {
+      LittleFS.remove(_tmpPath);
+    }
+    File f = LittleFS.open(_path, "r");
+    if (!f) {
+      return false;
+    }
+    uint8_t header[CONFIG_HEADER_SIZE];
+    if ((size_t)f.read(header, sizeof(header)) != sizeof(header) || !headerValid(header)) {
+      f.close();
+      _compact = true;
+      return false;
+    }
+    // First pass: where the last complete save ends
+    uint8_t rec[CONFIG_RECORD_HEAD + CONFIG_MAX_VALUE + 4];
+    size_t pos = CONFIG_HEADER_SIZE;
+    size_t committed = CONFIG_HEADER_SIZE;
+    int n;
+    while ((n = readRecord(f, rec)) > 0) {
+      pos += n;
+      if (rec[0] == CONFIG_COMMIT_KEY) {
+        committed = pos;
+        memcpy(&_sequence, rec + CONFIG_RECORD_HEAD, sizeof(_sequence));
+      }
+    }
+    if (n < 0 || pos != committed) {
+      if (pos != committed) {
+        uncommitted++;
+      }
+      _compact = true;
+    }
+    // Second pass: apply what it covers
+    f.seek(CONFIG_HEADER_SIZE);
+    while (f.position() < committed && readRecord(f, rec) > 0) {
+      if (rec[0] != CONFIG_COMMIT_KEY) {
+        apply(cfg, rec);
+        recordsRead++;
+      }
+    }
+    f.close();
+    _logSize = committed;
+    adoptChangedDefaults(cfg, defaults);
+    return true;
+  }
+
+  // Write the fields of cfg that differ from the log
+  bool save(const void* cfg) {
+    if (!mountFS()) {
+      return false;
+    }
+    uint32_t dirty = 0;
+    size_t bytes = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+      ConfigField fd = field(i);
+      if (!(_present & (1UL << i)) || valueHash(fd, i, cfg) != _stored[i]) {
+        dirty |= 1UL << i;
+        bytes += CONFIG_RECORD_HEAD + valueLength(fd, cfg) + 4;
+      }
+    }
+    if (dirty == 0 && !_compact) {
+      return true;
+    }
+    if (_compact || _logSize == 0 || _logSize + bytes + CONFIG_COMMIT_SIZE > CONFIG_LOG_MAX) {
+      return compact(cfg);
+    }
+    File f = LittleFS.open(_path, "a");
+    if (!f) {
+      return false;
+    }
+    bool ok = true;
+    for (uint8_t i = 0; i < _count && ok; i++) {
+      if (dirty & (1UL << i)) {
+        ok = writeRecord(f, i, cfg);
+      }
+    }
+    ok = ok && writeCommit(f);
+    f.close();
+    if (!ok) {
+      // The log ends in a save without its commit, rewrite it next time
+      _present = 0;
+      _compact = true;
+    }
+    return ok;
+  }
+
+  // Rewrite the whole log on the next save(), e.g. after a migration
+  void requestCompaction() { _compact = true; }
+
+  // save() would write something: a field has no record in the log yet,
+  // took a changed default or the log needs rewriting
+  bool pending() const { return _compact || _present != (_count < 32 ? (1UL << _count) - 1 : 0xFFFFFFFFUL); }
+
+  // Saves committed to the log so far
+  uint32_t sequence() const { return _sequence; }
+
+  uint32_t recordsRead = 0;
+  uint32_t recordsWritten = 0;
+  uint32_t crcErrors = 0;
+  uint32_t torn = 0;        // log ended inside a record
+  uint32_t uncommitted = 0; // log ended in a save without its commit
+  uint32_t compactions = 0;
+  uint32_t defaultsAdopted = 0;
+
+private:
+  ConfigField field(uint8_t i) const {
+    ConfigField fd;
+    memcpy_P(&fd, &_fields[i], sizeof(fd));
+    return fd;
+  }
+
+  int8_t indexOf(uint8_t key) const {
+    for (uint8_t i = 0; i < _count; i++) {
+      if (field(i).key == key) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  // Next record into rec: its size, 0 at the end of the log, -1 if it is
+  // cut short or damaged
+  int readRecord(File &f, uint8_t* rec) {
+    size_t n = f.read(rec, CONFIG_RECORD_HEAD);
+    if (n == 0) {
+      return 0;
+    }
+    uint8_t len = rec[1];
+    size_t rest = len + 4;
+    if (n != CONFIG_RECORD_HEAD || len > CONFIG_MAX_VALUE ||
+        (size_t)f.read(rec + CONFIG_RECORD_HEAD, rest) != rest) {
+      torn++;
+      return -1;
+    }
+    size_t body = CONFIG_RECORD_HEAD + len;
+    uint32_t crc;
+    memcpy(&crc, rec + body, sizeof(crc));
+    if (crc != crc32(rec, body)) {
+      crcErrors++;
+      return -1;
+    }
+    return body + 4;
+  }
+
+  static bool headerValid(const uint8_t* header) {
+    uint32_t magic;
+    memcpy(&magic, header, sizeof(magic));
+    return magic == CONFIG_STORE_MAGIC && header[4] == CONFIG_STORE_VERSION;
+  }
+
+  static size_t valueLength(const ConfigField &fd, const void* cfg) {
+    const char* p = static_cast<const char*>(cfg) + fd.offset;
+    return fd.type == CONFIG_STRING ? strnlen(p, fd.size - 1) : fd.size;
+  }
+
+  // Identifies the value and the default it was written against
+  uint32_t valueHash(const ConfigField &fd, uint8_t i, const void* cfg) const {
+    const uint8_t* p = static_cast<const uint8_t*>(cfg) + fd.offset;
+    uint32_t h = crc32Update(0, reinterpret_cast<const uint8_t*>(&_defaultHash[i]), sizeof(uint32_t));
+    return crc32Update(h, p, valueLength(fd, cfg));
+  }
+
+  void initDefaultHashes(const void* defaults) {
+    for (uint8_t i = 0; i < _count; i++) {
+      ConfigField fd = field(i);
+      _defaultHash[i] = 0;
+      if (fd.flags & CONFIG_TRACK_DEFAULT) {
+        const uint8_t* p = static_cast<const uint8_t*>(defaults) + fd.offset;
+        _defaultHash[i] = crc32(p, valueLength(fd, defaults));
+      }
+    }
+  }
+
+  void apply(void* cfg, const uint8_t* rec) {
+    int8_t i = indexOf(rec[0]);
+    if (i < 0) {
+      return; // written by newer firmware
+    }
+    ConfigField fd = field(i);
+    uint8_t len = rec[1];
+    uint8_t* p = static_cast<uint8_t*>(cfg) + fd.offset;
+    if (fd.type == CONFIG_STRING) {
+      if (len >= fd.size) {
+        return;
+      }
+      memcpy(p, rec + CONFIG_RECORD_HEAD, len);
+      p[len] = '\0';
+    } else {
+      if (len != fd.size) {
+        return;
+      }
+      memcpy(p, rec + CONFIG_RECORD_HEAD, len);
+    }
+    memcpy(&_recordDefault[i], rec + 2, sizeof(uint32_t));
+    _present |= 1UL << i;
+  }
+
+  // A tracked field written against another compiled default gets the new
+  // one; it is written back on the next save()
+  void adoptChangedDefaults(void* cfg, const void* defaults) {
+    for (uint8_t i = 0; i < _count; i++) {
+      ConfigField fd = field(i);
+      if (!(_present & (1UL << i))) {
+        continue;
+      }
+      if ((fd.flags & CONFIG_TRACK_DEFAULT) && _recordDefault[i] != _defaultHash[i]) {
+        memcpy(static_cast<uint8_t*>(cfg) + fd.offset, static_cast<const uint8_t*>(defaults) + fd.offset, fd.size);
+        _present &= ~(1UL << i);
+        defaultsAdopted++;
+        continue;
+      }
+      _stored[i] = valueHash(fd, i, cfg);
+    }
+  }
+
+  bool writeRecord(File &f, uint8_t i, const void* cfg) {
+    ConfigField fd = field(i);
+    uint8_t rec[CONFIG_RECORD_HEAD + CONFIG_MAX_VALUE + 4];
+    uint8_t len = valueLength(fd, cfg);
+    rec[0] = fd.key;
+    rec[1] = len;
+    memcpy(rec + 2, &_defaultHash[i], sizeof(uint32_t));
+    memcpy(rec + CONFIG_RECORD_HEAD, static_cast<const uint8_t*>(cfg) + fd.offset, len);
+    size_t body = CONFIG_RECORD_HEAD + len;
+    uint32_t crc = crc32(rec, body);
+    memcpy(rec + body, &crc, sizeof(crc));
+    if (f.write(rec, body + 4) != body + 4) {
+      return false;
+    }
+    _logSize += body + 4;
+    _stored[i] = valueHash(fd, i, cfg);
+    _present |= 1UL << i;
+    recordsWritten++;
+    return true;
+  }
+
+  bool writeCommit(File &f) {
+    uint8_t rec[CONFIG_COMMIT_SIZE] = {CONFIG_COMMIT_KEY, sizeof(uint32_t)};
+    uint32_t sequence = _sequence + 1;
+    memcpy(rec + CONFIG_RECORD_HEAD, &sequence, sizeof(sequence));
+    uint32_t crc = crc32(rec, CONFIG_RECORD_HEAD + sizeof(sequence));
+    memcpy(rec + CONFIG_RECORD_HEAD + sizeof(sequence), &crc, sizeof(crc));
+    if (f.write(rec, sizeof(rec)) != sizeof(rec)) {
+      return false;
+    }
+    _logSize += sizeof(rec);
+    _sequence = sequence;
+    return true;
+  }
+
+  // Write every field to a new file and rename it over the log
+  bool compact(const void* cfg) {
+    File f = LittleFS.open(_tmpPath, "w");
+    if (!f) {
+      return false;
+    }
+    uint8_t header[CONFIG_HEADER_SIZE] = {};
+    memcpy(header, &CONFIG_STORE_MAGIC, sizeof(CONFIG_STORE_MAGIC));
+    header[4] = CONFIG_STORE_VERSION;
+    bool ok = f.write(header, sizeof(header)) == sizeof(header);
+    _logSize = CONFIG_HEADER_SIZE;
+    _present = 0;
+    for (uint8_t i = 0; i < _count && ok; i++) {
+      ok = writeRecord(f, i, cfg);
+    }
+    ok = ok && writeCommit(f);
+    f.close();
+    if (!ok || !LittleFS.rename(_tmpPath, _path)) {
+      LittleFS.remove(_tmpPath);
+      _present = 0; // the log on flash is unknown now, rewrite it next time
+      _compact = true;
+      return false;
+    }
+    _compact = false;
+    compactions++;
+    return true;
+  }
+
+  const char* _path;
+  const char* _tmpPath;
+  const ConfigField* _fields;
+  uint8_t _count;
+
+  uint32_t _present = 0;                        // fields with a valid record in the log
+  uint32_t _stored[CONFIG_MAX_FIELDS] = {};     // valueHash() of the logged value
+  uint32_t _defaultHash[CONFIG_MAX_FIELDS] = {};
+  uint32_t _recordDefault[CONFIG_MAX_FIELDS] = {};
+  size_t _logSize = 0;
+  uint32_t _sequence = 0;
+  bool _compact = false;
+};
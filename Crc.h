@@ -0,0 +1,22 @@
+#pragma once
+#include <Arduino.h>
+
+// CRC-32 (IEEE 802.3, reflected, same as zlib) with a 16-entry nibble table
+// to keep flash usage small
+inline uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+  static const uint32_t table[16] PROGMEM = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ pgm_read_dword(&table[crc & 0x0F]);
+    crc = (crc >> 4) ^ pgm_read_dword(&table[crc & 0x0F]);
+  }
+  return ~crc;
+}
+
+inline uint32_t crc32(const void* data, size_t len) {
+  return crc32Update(0, static_cast<const uint8_t*>(data), len);
+}
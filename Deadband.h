@@ -0,0 +1,50 @@
+#pragma once
+#include <Arduino.h>
+#include <math.h>
+#include "Config.h"
+#include "SampleStore.h"
+
+// Report-by-exception filter in front of the uplinks. A sample is sent when
+// any field moved by more than its deadband since the last sent sample, when
+// a sensor became valid or invalid, or when nothing was sent for the
+// heartbeat interval. Local consumers (history, SSE, web) still see every
+// sample.
+
+class DeadbandFilter {
+public:
+  // True if s should be published; it then becomes the new reference
+  bool pass(const Sample &s, const DeviceConfig &cfg) {
+    if (!cfg.deadbandEnabled || !_hasLast || changed(s, cfg) ||
+        s.uptime - _last.uptime >= cfg.heartbeatInterval) {
+      _last = s;
+      _hasLast = true;
+      passed++;
+      return true;
+    }
+    suppressed++;
+    return false;
+  }
+
+  uint32_t passed = 0;
+  uint32_t suppressed = 0;
+
+private:
+  bool changed(const Sample &s, const DeviceConfig &cfg) const {
+    if (s.valid != _last.valid) {
+      return true;
+    }
+    if (s.pmValid() && abs((int)s.pm25 - (int)_last.pm25) > cfg.deadbandPm) {
+      return true;
+    }
+    if (s.envValid() &&
+        (fabsf(s.temperature - _last.temperature) > cfg.deadbandTemp ||
+         fabsf(s.humidity - _last.humidity) > cfg.deadbandHum ||
+         fabsf(s.pressure - _last.pressure) > cfg.deadbandPress)) {
+      return true;
+    }
+    return false;
+  }
+
+  Sample _last = {};
+  bool _hasLast = false;
+};
@@ -0,0 +1,190 @@
+#pragma once
+#include "HAL.h"
+#include "Config.h"
+#include "Metrics.h"
+#include "Scheduler.h"
+#include "Sensors.h"
+#include "WebServer.h"
+#include "MQTTManager.h"
+#include "Journal.h"
+#include "Deadband.h"
+#include "RtcBuffer.h"
+
+// Export of Metrics, the scheduler's per-task histograms and the module
+// counters: Prometheus text on /metrics and a retained JSON summary on
+// tele/<topic>/diag
+
+constexpr unsigned long DIAG_INTERVAL = 300000; // 5 min
+
+extern Metrics metrics;
+extern Scheduler scheduler;
+extern SampleJournal journal;
+extern EventStream eventStream;
+extern DeadbandFilter deadband;
+extern ConfigStore configStore;
+extern RtcSampleBuffer rtcSamples;
+extern unsigned long uptimeMillis;
+
+// Print a duration in µs as seconds
+inline void printSeconds(ChunkedResponse &out, uint64_t us) {
+  out.printf("%lu.%06lu", (unsigned long)(us / 1000000), (unsigned long)(us % 1000000));
+}
+
+inline void printLatencyHistogram(ChunkedResponse &out, const char* subsystem, const LatencyHistogram &h) {
+  uint32_t cumulative = 0;
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+    cumulative += h.buckets[i];
+    uint32_t limit = LatencyHistogram::bucketLimitUs(i);
+    out.printf("ikea_air_duration_seconds_bucket{subsystem=\"%s\",le=\"", subsystem);
+    if (limit) {
+      printSeconds(out, limit);
+    } else {
+      out.printf("+Inf");
+    }
+    out.printf("\"} %lu\n", (unsigned long)cumulative);
+  }
+  out.printf("ikea_air_duration_seconds_sum{subsystem=\"%s\"} ", subsystem);
+  printSeconds(out, h.sumCycles / cpuCyclesPerUs());
+  out.printf("\nikea_air_duration_seconds_count{subsystem=\"%s\"} %lu\n", subsystem, (unsigned long)h.count);
+}
+
+inline void printCounter(ChunkedResponse &out, const char* name, uint32_t value) {
+  out.printf("# TYPE ikea_air_%s counter\nikea_air_%s %lu\n", name, name, (unsigned long)value);
+}
+
+inline void printGauge(ChunkedResponse &out, const char* name, long value) {
+  out.printf("# TYPE ikea_air_%s gauge\nikea_air_%s %ld\n", name, name, value);
+}
+
+inline void handleMetrics() {
+  ChunkedResponse &out = chunkedResponse;
+  out.begin("text/plain; version=0.0.4");
+  
+  out.printf("# HELP ikea_air_duration_seconds Run time per scheduler task and per sample stage\n");
+  out.printf("# TYPE ikea_air_duration_seconds histogram\n");
+  for (uint8_t i = 0; i < Scheduler::capacity(); i++) {
+    const SchedulerTask &t = scheduler.task(i);
+    if (t.active && !t.oneShot) {
+      printLatencyHistogram(out, t.name, t.latency);
+    }
+  }
+  printLatencyHistogram(out, "read", metrics.readLatency);
+  printLatencyHistogram(out, "publish", metrics.publishLatency);
+  
+  printCounter(out, "mqtt_publishes_total", metrics.mqttPublishes);
+  printCounter(out, "mqtt_publish_failures_total", metrics.mqttPublishFailures);
+  printCounter(out, "mqtt_connects_total", metrics.mqttConnects);
+  printCounter(out, "mqtt_connect_failures_total", metrics.mqttConnectFailures);
+  printCounter(out, "uplink_posts_total", metrics.uplinkPosts);
+  printCounter(out, "uplink_failures_total", metrics.uplinkFailures);
+  printCounter(out, "wifi_fast_connects_total", metrics.wifiFastConnects);
+  printCounter(out, "wifi_fast_connect_fallbacks_total", metrics.wifiFastConnectFallbacks);
+  printCounter(out, "radio_wakeups_total", metrics.radioWakeups);
+  printCounter(out, "radio_on_seconds_total", metrics.radioOnMs / 1000);
+  printCounter(out, "rtc_samples_spilled_total", rtcSamples.spilled);
+  printCounter(out, "deadband_passed_total", deadband.passed);
+  printCounter(out, "deadband_suppressed_total", deadband.suppressed);
+  printCounter(out, "pm_frames_total", pmParser.frameCount);
+  printCounter(out, "pm_checksum_errors_total", pmParser.checksumErrors);
+  printCounter(out, "pm_dropped_bytes_total", pmParser.droppedBytes);
+  printCounter(out, "pm_uart_overflows_total", metrics.pmUartOverflows);
+  printCounter(out, "env_read_errors_total", bme.readErrors);
+  printCounter(out, "journal_records_written_total", journal.recordsWritten);
+  printCounter(out, "journal_records_replayed_total", journal.recordsReplayed);
+  printCounter(out, "journal_records_dropped_total", journal.recordsDropped);
+  printCounter(out, "journal_crc_errors_total", journal.crcErrors);
+  printCounter(out, "config_records_written_total", configStore.recordsWritten);
+  printCounter(out, "config_crc_errors_total", configStore.crcErrors + configStore.torn);
+  printCounter(out, "config_compactions_total", configStore.compactions);
+  printCounter(out, "sse_events_total", eventStream.eventsSent);
+  printCounter(out, "sse_events_dropped_total", eventStream.eventsDropped);
+  out.printf("# TYPE ikea_air_http_requests_total counter\n");
+  for (uint8_t i = 0; i < routeCount; i++) {
+    out.printf("ikea_air_http_requests_total{route=\"%s\"} %lu\n", routeStats[i].path,
+               (unsigned long)routeStats[i].requests);
+  }
+#ifdef ALLOC_TRACKING
+  out.printf("# TYPE ikea_air_http_handler_allocations_total counter\n");
+  for (uint8_t i = 0; i < routeCount; i++) {
+    out.printf("ikea_air_http_handler_allocations_total{route=\"%s\"} %lu\n", routeStats[i].path,
+               (unsigned long)routeStats[i].allocs);
+  }
+  printCounter(out, "allocating_loop_passes_total", scheduler.allocatingPasses);
+#endif
+  printCounter(out, "loop_budget_overruns_total", scheduler.budgetOverruns);
+  printGauge(out, "loop_max_pass_microseconds", scheduler.maxPassUs);
+  printGauge(out, "journal_pending_records", journal.pending());
+  printGauge(out, "rtc_buffered_samples", rtcSamples.pending());
+  printGauge(out, "sse_clients", eventStream.clientCount());
+  printGauge(out, "heap_free_bytes", heapFree());
+  printGauge(out, "heap_free_min_bytes", metrics.heapFreeMin);
+  printGauge(out, "heap_max_block_bytes", heapMaxBlock());
+  printGauge(out, "heap_max_block_min_bytes", metrics.heapMaxBlockMin);
+  printGauge(out, "heap_fragmentation_percent", heapFragmentation());
+  printGauge(out, "wifi_rssi_dbm", WiFi.RSSI());
+  printGauge(out, "boot_wifi_connect_milliseconds", metrics.wifiConnectMs);
+  printGauge(out, "boot_first_publish_milliseconds", metrics.firstPublishMs);
+  printGauge(out, "uptime_seconds", uptimeMillis / 1000);
+  printGauge(out, "modeled_current_microamps", modeledCurrentUa(metrics, uptimeMillis));
+  out.end();
+}
+
+// Compact summary: per subsystem [count, avg µs, max µs] plus the counters
+// that point at trouble. With every scheduler slot in use it outgrows
+// PubSubClient's buffer, so it is formatted in the batch payload buffer and
+// streamed like a batch.
+inline void publishDiagnostics() {
+  char topic[96];
+  snprintf(topic, sizeof(topic), "tele/%s/diag", baseTopic);
+  
+  char* payload = mqttBatchPayload;
+  const size_t size = MQTT_BATCH_PAYLOAD_SIZE;
+  int len = snprintf(payload, size, "{\"uptime\":%lu,\"latency\":{", uptimeMillis / 1000);
+  bool first = true;
+  auto addLatency = [&](const char* name, const LatencyHistogram &h) {
+    if (len > 0 && len < (int)size) {
+      len += snprintf(payload + len, size - len, "%s\"%s\":[%lu,%lu,%lu]",
+                      first ? "" : ",", name, (unsigned long)h.count,
+                      (unsigned long)h.avgUs(), (unsigned long)h.maxUs());
+      first = false;
+    }
+  };
+  for (uint8_t i = 0; i < Scheduler::capacity(); i++) {
+    const SchedulerTask &t = scheduler.task(i);
+    if (t.active && !t.oneShot) {
+      addLatency(t.name, t.latency);
+    }
+  }
+  addLatency("read", metrics.readLatency);
+  addLatency("publish", metrics.publishLatency);
+  if (len > 0 && len < (int)size) {
+    len += snprintf(payload + len, size - len,
+      "},\"publishes\":%lu,\"publish_failures\":%lu,\"connects\":%lu,\"connect_failures\":%lu,"
+      "\"pm_checksum_errors\":%lu,\"journal_pending\":%lu,\"loop_max_us\":%lu,\"loop_overruns\":%lu,"
+      "\"heap_free\":%lu,\"heap_free_min\":%lu,\"heap_max_block\":%lu,\"heap_fragmentation\":%u,"
+      "\"boot_wifi_ms\":%lu,\"boot_publish_ms\":%lu,\"wifi_fast\":%lu,\"wifi_fallbacks\":%lu,"
+      "\"radio_on_s\":%lu,\"radio_wakeups\":%lu,\"current_ua\":%lu}",
+      (unsigned long)metrics.mqttPublishes, (unsigned long)metrics.mqttPublishFailures,
+      (unsigned long)metrics.mqttConnects, (unsigned long)metrics.mqttConnectFailures,
+      (unsigned long)pmParser.checksumErrors, (unsigned long)journal.pending(),
+      (unsigned long)scheduler.maxPassUs, (unsigned long)scheduler.budgetOverruns,
+      (unsigned long)heapFree(), (unsigned long)metrics.heapFreeMin,
+      (unsigned long)heapMaxBlock(), heapFragmentation(),
+      (unsigned long)metrics.wifiConnectMs, (unsigned long)metrics.firstPublishMs,
+      (unsigned long)metrics.wifiFastConnects, (unsigned long)metrics.wifiFastConnectFallbacks,
+      (unsigned long)(metrics.radioOnMs / 1000), (unsigned long)metrics.radioWakeups,
+      (unsigned long)modeledCurrentUa(metrics, uptimeMillis));
+  }
+  if (len <= 0 || len >= (int)size) {
+    DBG_PRINTLN("ERROR: diagnostics payload too large");
+    return;
+  }
+  if (mqttClient.beginPublish(topic, len, true)) {
+    mqttClient.write(reinterpret_cast<const uint8_t*>(payload), len);
+    mqttClient.endPublish();
+  }
+}
+
+inline void setupDiagnostics() {
+  route("/metrics", handleMetrics);
+}
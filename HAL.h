@@ -0,0 +1,75 @@
+#pragma once
+#include <Arduino.h>
+
+// Hardware abstraction layer
+//
+// All other modules reach the hardware only through the types and pin
+// constants declared here. A build that wants different drivers (e.g. fakes
+// on a development host) defines HAL_DRIVERS_HEADER to a header providing the
+// same aliases instead of the ESP8266 libraries below.
+
+// Result of a network step that is started once and then polled
+enum NetPoll : int8_t {
+  NET_FAILED = -1,
+  NET_PENDING = 0,
+  NET_DONE = 1
+};
+
+#ifdef HAL_DRIVERS_HEADER
+#include HAL_DRIVERS_HEADER
+#else
+#include <ESP8266WiFi.h>
+#include <ESP8266WebServer.h>
+#include <DNSServer.h>
+#include <PubSubClient.h>
+#include <SoftwareSerial.h>
+#include <Wire.h>
+#include "BME280.h"
+
+using PMSerial = SoftwareSerial;       // Vindriktning UART
+using EnvSensor = BME280Driver;        // BME280 on I2C
+using NetClient = WiFiClient;          // TCP transport for MQTT
+using MqttDriver = PubSubClient;
+using HttpServer = ESP8266WebServer;
+using DnsResponder = DNSServer;
+
+// HostResolver and TcpConnector, non-blocking DNS and TCP connect
+#include "NetAsync.h"
+
+// CPU cycle counter for cheap timing, wraps after about 53 s at 80 MHz
+inline uint32_t cpuCycles() { return ESP.getCycleCount(); }
+inline uint32_t cpuCyclesPerUs() { return ESP.getCpuFreqMHz(); }
+
+// Heap state
+inline uint32_t heapFree() { return ESP.getFreeHeap(); }
+inline uint32_t heapMaxBlock() { return ESP.getMaxFreeBlockSize(); }
+inline uint8_t heapFragmentation() { return ESP.getHeapFragmentation(); } // percent
+
+// RTC user memory, addressed in 4-byte blocks. Survives resets and deep
+// sleep, not a power loss.
+inline bool rtcRead(uint32_t block, void* data, size_t size) {
+  return ESP.rtcUserMemoryRead(block, static_cast<uint32_t*>(data), size);
+}
+inline bool rtcWrite(uint32_t block, const void* data, size_t size) {
+  return ESP.rtcUserMemoryWrite(block, static_cast<uint32_t*>(const_cast<void*>(data)), size);
+}
+
+// Pin assignment (Wemos D1 mini)
+constexpr uint8_t PIN_PM_RX = D1;   // Vindriktning TX -> D1
+constexpr uint8_t PIN_PM_TX = D8;   // unused, Vindriktning has no RX line
+constexpr uint8_t PIN_I2C_SDA = D3;
+constexpr uint8_t PIN_I2C_SCL = D2;
+#endif
+
+// RTC user memory layout in blocks (128 blocks, 512 bytes). The core keeps
+// the eboot command for OTA updates in the first 32 blocks.
+constexpr uint32_t RTC_BLOCK_USER = 32;       // first block free for the sketch
+constexpr uint32_t RTC_BLOCK_WIFI_LEASE = 32; // WiFiLease.h, 9 blocks
+constexpr uint32_t RTC_BLOCK_SAMPLES = 41;    // RtcBuffer.h, up to the end
+constexpr uint32_t RTC_BLOCKS = 128;
+
+static_assert(RTC_BLOCK_WIFI_LEASE >= RTC_BLOCK_USER, "RTC blocks below 32 belong to the OTA command");
+static_assert(RTC_BLOCK_SAMPLES >= RTC_BLOCK_USER, "RTC blocks below 32 belong to the OTA command");
+
+constexpr uint32_t PM_UART_BAUD = 9600;
+constexpr uint8_t BME280_I2C_ADDRESS = 0x76;
@@ -0,0 +1,333 @@
+#pragma once
+#include <Arduino.h>
+#include "SampleStore.h"
+
+// On-device sample history in two fixed RAM rings.
+//
+// The fine tier keeps every sample of the last few hours. Every sample is
+// also folded into a 5 minute average, and the coarse tier keeps those
+// averages for more than a day, so the history always spans at least 24 h:
+// recent hours at full resolution, older ones at 5 minutes.
+//
+// Samples are stored as fixed-point values (PM2.5 in µg/m³, temperature,
+// humidity and pressure in tenths) and delta-encoded against the previous
+// sample. The ring is made of fixed-size blocks; each block starts with the
+// absolute values of its first sample, so dropping the oldest block never
+// breaks the delta chain of the others.
+//
+// Record layout after the block header: one tag byte with a 2-bit code per
+// field (PM2.5, temperature, humidity, pressure from the low bits up), then
+// all 4-bit deltas packed two per byte, then the 8- and 16-bit deltas in field
+// order. A sample where every field moved by a few tenths takes 3 bytes.
+// Timestamps are not stored per sample: a block
+// holds samples at a fixed interval, and a sample that is more than
+// HISTORY_MAX_JITTER off that grid starts a new block.
+
+#ifndef HISTORY_BLOCK_SIZE
+#define HISTORY_BLOCK_SIZE 256
+#endif
+
+#ifndef HISTORY_BLOCK_COUNT
+#define HISTORY_BLOCK_COUNT 16 // 4 KB, 3-5 h at 10 s depending on how much values move
+#endif
+
+#ifndef HISTORY_COARSE_BLOCK_COUNT
+#define HISTORY_COARSE_BLOCK_COUNT 13 // 3.25 KB of 5 minute averages
+#endif
+
+static_assert(HISTORY_BLOCK_COUNT <= 255, "HISTORY_BLOCK_COUNT must fit in uint8_t");
+static_assert(HISTORY_COARSE_BLOCK_COUNT <= 255, "HISTORY_COARSE_BLOCK_COUNT must fit in uint8_t");
+
+constexpr uint8_t HISTORY_FIELDS = 4;
+constexpr uint8_t HISTORY_CODE_SAME = 0;
+constexpr uint8_t HISTORY_CODE_INT4 = 1;
+constexpr uint8_t HISTORY_CODE_INT8 = 2;
+constexpr uint8_t HISTORY_CODE_INT16 = 3;
+constexpr uint8_t HISTORY_MAX_RECORD = 1 + HISTORY_FIELDS * 2;
+constexpr uint32_t HISTORY_MAX_JITTER = 1000;
+constexpr uint32_t HISTORY_COARSE_INTERVAL = 5 * 60 * 1000UL;
+
+struct HistoryBlockHeader {
+  uint32_t startMs;     // uptime of the first sample
+  uint32_t intervalMs;  // average sample spacing, 0 until the second sample
+  uint16_t count;       // samples in this block
+  uint16_t used;        // payload bytes in use
+  uint8_t valid;        // SAMPLE_*_VALID, constant within a block
+  uint8_t reserved;
+  int16_t base[HISTORY_FIELDS];
+};
+
+constexpr size_t HISTORY_PAYLOAD_SIZE = HISTORY_BLOCK_SIZE - sizeof(HistoryBlockHeader);
+
+// Samples in a block when every record has the maximum size: the base
+// sample in the header plus the records that fit the payload
+constexpr uint32_t HISTORY_MIN_BLOCK_SAMPLES = 1 + HISTORY_PAYLOAD_SIZE / HISTORY_MAX_RECORD;
+
+// The ring drops a whole block to make room, so only BLOCK_COUNT - 1 full
+// blocks are guaranteed to be present
+static_assert((uint64_t)(HISTORY_COARSE_BLOCK_COUNT - 1) * HISTORY_MIN_BLOCK_SAMPLES * HISTORY_COARSE_INTERVAL >=
+                  24 * 3600 * 1000ULL,
+              "coarse history must cover 24 h even with worst-case records");
+
+struct HistoryBlock {
+  HistoryBlockHeader hdr;
+  uint8_t data[HISTORY_PAYLOAD_SIZE];
+};
+
+// A decoded history entry, values in tenths except PM2.5
+struct HistoryEntry {
+  uint32_t timeMs;
+  uint8_t valid;
+  int16_t v[HISTORY_FIELDS];
+};
+
+// Convert a sample to fixed point; fields of an invalid source keep their
+// previous value so they cost nothing in the delta stream
+inline void historyEncode(const Sample &s, const int16_t prev[HISTORY_FIELDS], int16_t v[HISTORY_FIELDS]) {
+  memcpy(v, prev, sizeof(int16_t) * HISTORY_FIELDS);
+  if (s.pmValid()) {
+    v[0] = (int16_t)min<uint16_t>(s.pm25, INT16_MAX);
+  }
+  if (s.envValid()) {
+    v[1] = (int16_t)lroundf(s.temperature * 10.0f);
+    v[2] = (int16_t)lroundf(s.humidity * 10.0f);
+    v[3] = (int16_t)lroundf(s.pressure * 10.0f);
+  }
+}
+
+// Ring of delta-encoded blocks, BLOCKS * HISTORY_BLOCK_SIZE bytes
+template <uint8_t BLOCKS>
+class HistoryRing {
+public:
+  // v holds the fixed-point values, fields not covered by valid repeat the
+  // previous value (see historyEncode())
+  void append(const int16_t v[HISTORY_FIELDS], uint8_t valid, uint32_t nowMs) {
+    if (_blockCount == 0 || !fits(valid, nowMs)) {
+      startBlock(v, valid, nowMs);
+      return;
+    }
+
+    // Track the average interval so a slightly slow or fast clock does not
+    // walk off the grid
+    HistoryBlock &b = _blocks[_head];
+    b.hdr.intervalMs = (nowMs - b.hdr.startMs) / b.hdr.count;
+
+    int32_t d[HISTORY_FIELDS];
+    uint8_t tag = 0;
+    uint8_t nibbles = 0;
+    for (uint8_t i = 0; i < HISTORY_FIELDS; i++) {
+      d[i] = (int32_t)v[i] - _last[i];
+      uint8_t code;
+      if (d[i] == 0) {
+        code = HISTORY_CODE_SAME;
+      } else if (d[i] >= -8 && d[i] <= 7) {
+        code = HISTORY_CODE_INT4;
+        nibbles++;
+      } else if (d[i] >= INT8_MIN && d[i] <= INT8_MAX) {
+        code = HISTORY_CODE_INT8;
+      } else {
+        code = HISTORY_CODE_INT16;
+      }
+      tag |= code << (i * 2);
+      _last[i] = v[i];
+    }
+
+    uint8_t* out = b.data + b.hdr.used;
+    uint8_t* p = out + 1;
+    uint8_t* wide = p + (nibbles + 1) / 2;
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < HISTORY_FIELDS; i++) {
+      uint8_t code = (tag >> (i * 2)) & 0x03;
+      if (code == HISTORY_CODE_INT4) {
+        if (n++ & 1) {
+          *p++ |= (uint8_t)(d[i] & 0x0F) << 4;
+        } else {
+          *p = (uint8_t)(d[i] & 0x0F);
+        }
+      } else if (code == HISTORY_CODE_INT8) {
+        *wide++ = (uint8_t)(int8_t)d[i];
+      } else if (code == HISTORY_CODE_INT16) {
+        uint16_t u = (uint16_t)(int16_t)d[i];
+        *wide++ = u & 0xFF;
+        *wide++ = u >> 8;
+      }
+    }
+    *out = tag;
+    b.hdr.used += wide - out;
+    b.hdr.count++;
+  }
+
+  const int16_t* last() const { return _last; }
+
+  // Uptime of the oldest stored sample, UINT32_MAX while empty
+  uint32_t oldestMs() const {
+    return _blockCount ? _blocks[(_head + BLOCKS - _blockCount + 1) % BLOCKS].hdr.startMs : UINT32_MAX;
+  }
+
+  // Calls fn(const HistoryEntry&) for every stored sample, oldest first
+  template <typename Fn>
+  void forEach(Fn fn) const {
+    for (uint8_t n = 0; n < _blockCount; n++) {
+      const HistoryBlock &b = _blocks[(_head + BLOCKS - _blockCount + 1 + n) % BLOCKS];
+      HistoryEntry e;
+      e.valid = b.hdr.valid;
+      memcpy(e.v, b.hdr.base, sizeof(e.v));
+      const uint8_t* p = b.data;
+      for (uint16_t i = 0; i < b.hdr.count; i++) {
+        if (i > 0) {
+          uint8_t tag = *p++;
+          uint8_t nibbles = 0;
+          for (uint8_t f = 0; f < HISTORY_FIELDS; f++) {
+            nibbles += ((tag >> (f * 2)) & 0x03) == HISTORY_CODE_INT4;
+          }
+          const uint8_t* wide = p + (nibbles + 1) / 2;
+          uint8_t n = 0;
+          for (uint8_t f = 0; f < HISTORY_FIELDS; f++) {
+            uint8_t code = (tag >> (f * 2)) & 0x03;
+            if (code == HISTORY_CODE_INT4) {
+              uint8_t nib = (n++ & 1) ? (*p++ >> 4) : (*p & 0x0F);
+              e.v[f] += (int8_t)(nib << 4) >> 4;
+            } else if (code == HISTORY_CODE_INT8) {
+              e.v[f] += (int8_t)*wide++;
+            } else if (code == HISTORY_CODE_INT16) {
+              e.v[f] += (int16_t)(wide[0] | (wide[1] << 8));
+              wide += 2;
+            }
+          }
+          p = wide;
+        }
+        e.timeMs = b.hdr.startMs + i * b.hdr.intervalMs;
+        fn(e);
+      }
+    }
+  }
+
+  uint32_t sampleCount() const {
+    uint32_t n = 0;
+    for (uint8_t i = 0; i < _blockCount; i++) {
+      n += _blocks[(_head + BLOCKS - i) % BLOCKS].hdr.count;
+    }
+    return n;
+  }
+
+  static constexpr size_t memoryUsage() { return sizeof(HistoryBlock) * BLOCKS; }
+
+private:
+  bool fits(uint8_t valid, uint32_t nowMs) const {
+    const HistoryBlockHeader &h = _blocks[_head].hdr;
+    if (h.valid != valid || h.used + HISTORY_MAX_RECORD > (int)HISTORY_PAYLOAD_SIZE) {
+      return false;
+    }
+    if (h.count < 2) {
+      return true; // the second sample defines the interval
+    }
+    uint32_t expected = h.startMs + h.count * h.intervalMs;
+    uint32_t jitter = nowMs > expected ? nowMs - expected : expected - nowMs;
+    return jitter <= HISTORY_MAX_JITTER;
+  }
+
+  void startBlock(const int16_t v[HISTORY_FIELDS], uint8_t valid, uint32_t nowMs) {
+    if (_blockCount > 0) {
+      _head = (_head + 1) % BLOCKS;
+    }
+    if (_blockCount < BLOCKS) {
+      _blockCount++;
+    }
+    HistoryBlockHeader &h = _blocks[_head].hdr;
+    h.startMs = nowMs;
+    h.intervalMs = 0;
+    h.count = 1;
+    h.used = 0;
+    h.valid = valid;
+    h.reserved = 0;
+    memcpy(h.base, v, sizeof(h.base));
+    memcpy(_last, v, sizeof(_last));
+  }
+
+  HistoryBlock _blocks[BLOCKS];
+  uint8_t _head = 0;
+  uint8_t _blockCount = 0;
+  int16_t _last[HISTORY_FIELDS] = {};
+};
+
+// Fine and coarse tier behind one interface. forEach() returns the coarse
+// averages from before the oldest fine sample, then the fine samples; a
+// coarse entry carries the start of its 5 minute window as time.
+class SampleHistory {
+public:
+  void append(const Sample &s, uint32_t nowMs) {
+    int16_t v[HISTORY_FIELDS];
+    historyEncode(s, _fine.last(), v);
+    _fine.append(v, s.valid & (SAMPLE_PM_VALID | SAMPLE_ENV_VALID), nowMs);
+
+    if (_windowSamples > 0 && nowMs - _windowStart >= HISTORY_COARSE_INTERVAL) {
+      closeWindow();
+      // Stay on the 5 minute grid unless samples stopped for a while
+      uint32_t elapsed = nowMs - _windowStart;
+      _windowStart = elapsed < 2 * HISTORY_COARSE_INTERVAL ? _windowStart + HISTORY_COARSE_INTERVAL : nowMs;
+    } else if (_windowSamples == 0) {
+      _windowStart = nowMs;
+    }
+    _windowSamples++;
+    if (s.pmValid()) {
+      _sum[0] += v[0];
+      _pmCount++;
+    }
+    if (s.envValid()) {
+      for (uint8_t i = 1; i < HISTORY_FIELDS; i++) {
+        _sum[i] += v[i];
+      }
+      _envCount++;
+    }
+  }
+
+  template <typename Fn>
+  void forEach(Fn fn) const {
+    uint32_t fineStart = _fine.oldestMs();
+    _coarse.forEach([&](const HistoryEntry &e) {
+      if ((int32_t)(e.timeMs - fineStart) < 0) {
+        fn(e);
+      }
+    });
+    _fine.forEach(fn);
+  }
+
+  uint32_t sampleCount() const { return _fine.sampleCount() + _coarse.sampleCount(); }
+  uint32_t coarseCount() const { return _coarse.sampleCount(); }
+
+  static constexpr size_t memoryUsage() {
+    return HistoryRing<HISTORY_BLOCK_COUNT>::memoryUsage() + HistoryRing<HISTORY_COARSE_BLOCK_COUNT>::memoryUsage();
+  }
+
+private:
+  void closeWindow() {
+    int16_t v[HISTORY_FIELDS];
+    memcpy(v, _coarse.last(), sizeof(v));
+    uint8_t valid = 0;
+    if (_pmCount > 0) {
+      v[0] = (int16_t)((_sum[0] + _pmCount / 2) / _pmCount);
+      valid |= SAMPLE_PM_VALID;
+    }
+    if (_envCount > 0) {
+      for (uint8_t i = 1; i < HISTORY_FIELDS; i++) {
+        v[i] = (int16_t)lroundf((float)_sum[i] / _envCount);
+      }
+      valid |= SAMPLE_ENV_VALID;
+    }
+    if (valid) {
+      _coarse.append(v, valid, _windowStart);
+    }
+    memset(_sum, 0, sizeof(_sum));
+    _pmCount = 0;
+    _envCount = 0;
+    _windowSamples = 0;
+  }
+
+  HistoryRing<HISTORY_BLOCK_COUNT> _fine;
+  HistoryRing<HISTORY_COARSE_BLOCK_COUNT> _coarse;
+  uint32_t _windowStart = 0;
+  int32_t _sum[HISTORY_FIELDS] = {};
+  uint16_t _pmCount = 0;
+  uint16_t _envCount = 0;
+  uint16_t _windowSamples = 0;
+};
@@ -1,45 +1,74 @@
-#include <ESP8266WiFi.h>
-#include <PubSubClient.h>
-#include <ArduinoOTA.h>
-
+#include "HAL.h"
 #include "Config.h"
 #include "Sensors.h"
 #include "WebServer.h"
 #include "MQTTManager.h"
+#include "Uplink.h"
+#include "Network.h"
+#include "Scheduler.h"
+#include "Diagnostics.h"
 #include "Calculations.h"
+#include "Deadband.h"
+#include "PowerSave.h"
 
 DeviceConfig config;
-Adafruit_BME280 bme;
-// Use D1 for the Vindriktning's TX line (Vindriktning TX -> D1 RX)
-SoftwareSerial pms(D1, D8); // RX=D1, TX=D8 (unused)
-ESP8266WebServer server(80);
-DNSServer dns;
-bool shouldRestart = false;
-WiFiClient wifiClient;
-PubSubClient mqttClient(wifiClient);
+EnvSensor bme;
+PMSerial pms(PIN_PM_RX, PIN_PM_TX);
+VindriktningParser pmParser;
+HttpServer server(80);
+DnsResponder dns;
+NetClient wifiClient;
+MqttTransport mqttTransport(wifiClient);
+MqttDriver mqttClient(mqttTransport);
 bool mqttConnected = false;
 
-unsigned long lastSend = 0;
 unsigned long lastMillis = 0;
 unsigned long uptimeMillis = 0;
 
 // MQTT state variables (moved from MQTTManager.h to avoid ODR violations)
-unsigned long lastMQTTReconnect = 0;
-const unsigned long MQTT_RECONNECT_INTERVAL = 5000;
+MqttState mqttState = MQTT_STATE_IDLE;
+unsigned long mqttNextAttempt = 0;
+unsigned long mqttStepSince = 0;
+HostResolver mqttResolver;
+TcpConnector mqttConnector;
+uint8_t mqttAttempts = 0;
+uint32_t mqttJitterSeed = 0;
 unsigned long lastStatusHeartbeat = 0;
 const unsigned long STATUS_HEARTBEAT_INTERVAL = 60000; // 60 seconds
 bool discoveryPublished = false;
+uint32_t discoveryHash[DISCOVERY_SENSOR_COUNT];
+uint16_t discoveryMatched = 0;
+bool discoveryChecking = false;
+unsigned long discoveryCheckStart = 0;
 bool pendingDataSend = false;
 bool firstDataSent = false;
-uint16_t lastPM25 = 0;
-float lastTemp = 0;
-float lastHumidity = 0;
-float lastPressure = 0;
-uint16_t lastAQI = 0;
-uint8_t lastAQICategory = 0;
-float lastDewPoint = 0;
-float lastComfortIndex = 0;
-uint32_t lastUptime = 0;
+SampleStore sampleStore;
+SampleHistory history;
+SampleJournal journal;
+unsigned long lastJournalBatch = 0;
+BatchEntry mqttBatch[MQTT_BATCH_MAX];
+uint8_t mqttBatchCount = 0;
+char mqttBatchPayload[MQTT_BATCH_PAYLOAD_SIZE];
+ChunkedResponse chunkedResponse;
+RouteStats routeStats[WEB_ROUTE_MAX];
+uint8_t routeCount = 0;
+Scheduler scheduler;
+Metrics metrics;
+WiFiState wifiState = WIFI_STATE_IDLE;
+unsigned long wifiStateSince = 0;
+bool networkServicesStarted = false;
+bool wifiFastConnect = false;
+int8_t sampleTaskId = -1;
+bool firstSampleDue = true;
+RtcSampleBuffer rtcSamples;
+unsigned long radioWakeSince = 0;
+unsigned long lastRtcBatch = 0;
+UplinkClient uplink;
+StateJsonCache stateJsonCache;
+EventStream eventStream;
+SensorWindow sensorWindow;
+DeadbandFilter deadband;
+ConfigStore configStore(CONFIG_PATH, CONFIG_TMP_PATH, CONFIG_FIELDS, CONFIG_FIELD_COUNT);
 
 // MQTT topic variables
 char deviceUniqueId[32] = "";
@@ -47,86 +76,140 @@ char baseTopic[96] = "";
 char discoveryPrefix[96] = "";
 bool mqttTopicsInitialized = false;
 
+void pmTask(uint32_t now) {
+  pollPMSensor();
+}
+
+void envTask(uint32_t now) {
+  pollEnvSensor(config);
+}
+
+void webTask(uint32_t now) {
+  if (wifiState == WIFI_STATE_AP || networkServicesStarted) {
+    handleWeb();
+  }
+}
+
+void heapTask(uint32_t now) {
+  updateHeapMetrics(metrics);
+}
+
+void diagTask(uint32_t now) {
+  if (mqttState == MQTT_STATE_ONLINE) {
+    publishDiagnostics();
+  }
+}
+
+// Take a sample and hand it to history, SSE and the uplinks
+void sampleTask(uint32_t now) {
+  DBG_PRINTLN("Reading measurements...");
+  firstSampleDue = false;
+  Sample &s = sampleStore.beginWrite();
+  s.uptime = uptimeMillis / 1000;
+  bool valid;
+  {
+    MetricTimer timer(metrics.readLatency);
+    valid = readMeasurements(s, config);
+  }
+  calculateDerived(s);
+  sampleStore.commit();
+  if (valid) {
+    history.append(s, uptimeMillis);
+    eventStream.publish(sampleStore.latest());
+  }
+
+  if (s.pmValid()) {
+    DBG_PRINT("Measurements - PM2.5: ");
+    DBG_PRINT(s.pm25);
+    DBG_PRINT(" µg/m³, AQI: ");
+    DBG_PRINT(s.aqi);
+    DBG_PRINT(", Category: ");
+    DBG_PRINTLN(s.aqiCategory);
+  }
+  if (s.envValid()) {
+    DBG_PRINT("Measurements - T: ");
+    DBG_PRINT(s.temperature);
+    DBG_PRINT("°C, H: ");
+    DBG_PRINT(s.humidity);
+    DBG_PRINT("%, P: ");
+    DBG_PRINT(s.pressure);
+    DBG_PRINT(" hPa, Dew Point: ");
+    DBG_PRINT(s.dewPoint, 1);
+    DBG_PRINT("°C, Comfort: ");
+    DBG_PRINTLN(s.comfortIndex, 1);
+  }
+
+  if (!valid) {
+    DBG_PRINTLN("No valid sensor data, skipping send");
+  } else if (!deadband.pass(sampleStore.latest(), config)) {
+    DBG_PRINTLN("Within deadband, skipping send");
+  } else if (powerSaveActive() && mqttState != MQTT_STATE_ONLINE) {
+    bufferSample(sampleStore.latest());
+  } else {
+    MetricTimer timer(metrics.publishLatency);
+    publishSensorData(sampleStore.latest());
+    uplink.post(sampleStore.latest());
+  }
+}
+
+void uplinkTask(uint32_t now) {
+  uplink.poll(now);
+}
+
+void mqttTask(uint32_t now) {
+  if (networkServicesStarted) {
+    loopMQTT();
+  }
+  // Once the broker is up and the Vindriktning has sent a frame, take the
+  // first sample right away instead of waiting for the first interval, and
+  // keep the interval from there
+  if (firstSampleDue && mqttState == MQTT_STATE_ONLINE && sensorWindow.pm25.count() > 0) {
+    sampleTask(now);
+    scheduler.setPeriod(sampleTaskId, config.sendInterval);
+  }
+}
+
 void setup() {
   Serial.begin(115200);
   DBG_PRINTLN("Booting IKEAAirMonitor");
 
-  resetConfig(config);
   bool cfgLoaded = loadConfig(config);
   if (cfgLoaded) {
     DBG_PRINTLN("Config loaded from flash");
   } else {
     DBG_PRINTLN("Using default config");
+  }
+  // Only when the config was migrated, defaults changed or the log needs
+  // compacting; a normal boot does not touch the log
+  if (configStore.pending()) {
     saveConfig(config);
   }
+  journal.begin();
+  restoreRtcSamples();
 
-  if (config.ssid[0] != '\0') {
-    WiFi.mode(WIFI_STA);
-    WiFi.hostname(config.hostname);
-    DBG_PRINT("Connecting to ");
-    DBG_PRINTLN(config.ssid);
-    WiFi.begin(config.ssid, config.password);
-    unsigned long start = millis();
-    while (WiFi.status() != WL_CONNECTED && millis() - start < 20000) {
-      delay(500);
-      DBG_PRINT('.');
-    }
-    DBG_PRINTLN("");
-    if (WiFi.status() == WL_CONNECTED) {
-      DBG_PRINT("Connected, IP: ");
-      DBG_PRINTLN(WiFi.localIP());
-      setupWeb();
-      initMQTT();
-      
-      // Setup OTA
-      ArduinoOTA.setHostname(config.hostname);
-      ArduinoOTA.setPassword(DEFAULT_OTA_PASSWORD);
-      
-      ArduinoOTA.onStart([]() {
-        DBG_PRINTLN("OTA Start");
-      });
-      ArduinoOTA.onEnd([]() {
-        DBG_PRINTLN("\nOTA End");
-      });
-      ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-        DBG_PRINTF("Progress: %u%%\r", (progress / (total / 100)));
-      });
-      ArduinoOTA.onError([](ota_error_t error) {
-        DBG_PRINTF("Error[%u]: ", error);
-        if (error == OTA_AUTH_ERROR) {
-          DBG_PRINTLN("Auth Failed");
-        } else if (error == OTA_BEGIN_ERROR) {
-          DBG_PRINTLN("Begin Failed");
-        } else if (error == OTA_CONNECT_ERROR) {
-          DBG_PRINTLN("Connect Failed");
-        } else if (error == OTA_RECEIVE_ERROR) {
-          DBG_PRINTLN("Receive Failed");
-        } else if (error == OTA_END_ERROR) {
-          DBG_PRINTLN("End Failed");
-        }
-      });
-      
-      ArduinoOTA.begin();
-      DBG_PRINTLN("OTA ready");
-    } else {
-      DBG_PRINTLN("WiFi not reachable, starting AP");
-      startAP();
-    }
-  } else {
-    DBG_PRINTLN("No WiFi configured, starting AP");
-    startAP();
-  }
+  beginWiFi();
 
   if (initSensors()) {
     DBG_PRINTLN("Sensors initialized");
   } else {
     DBG_PRINTLN("Failed to init sensors");
   }
-  
-  // Give Vindriktning time to start sending data
-  DBG_PRINTLN("Waiting for Vindriktning to send data...");
-  delay(2000);
   lastMillis = millis();
+
+  // Polling tasks run every pass, the rest at a fixed rate. The first
+  // sample is taken one interval after boot, or earlier by mqttTask()
+  // once there is something to publish.
+  scheduler.every("pm", pmTask, 0);
+  scheduler.every("env", envTask, 0);
+  scheduler.every("wifi", loopWiFi, WIFI_POLL_INTERVAL);
+  scheduler.every("web", webTask, 0);
+  scheduler.every("mqtt", mqttTask, 0);
+  scheduler.every("ota", handleOTA, 0);
+  scheduler.every("uplink", uplinkTask, 0);
+  sampleTaskId = scheduler.every("sample", sampleTask, config.sendInterval, config.sendInterval);
+  scheduler.every("diag", diagTask, DIAG_INTERVAL, DIAG_INTERVAL);
+  scheduler.every("heap", heapTask, HEAP_SAMPLE_INTERVAL);
+  scheduler.every("power", loopPower, POWER_POLL_INTERVAL);
 }
 
 void loop() {
@@ -134,58 +217,5 @@ void loop() {
   uptimeMillis += (unsigned long)(now - lastMillis);
   lastMillis = now;
 
-  handleWeb();
-  loopMQTT();
-  
-  // Handle OTA updates (only when WiFi is connected)
-  if (WiFi.status() == WL_CONNECTED) {
-    ArduinoOTA.handle();
-  }
-  
-  if (WiFi.status() == WL_CONNECTED && millis() - lastSend > config.sendInterval) {
-    uint16_t pm; float t, h, p;
-    
-    DBG_PRINTLN("Reading measurements...");
-    readMeasurements(pm, t, h, p, config);
-    
-    DBG_PRINT("Measurements - PM2.5: ");
-    DBG_PRINT(pm);
-    DBG_PRINT(" µg/m³, T: ");
-    DBG_PRINT(t);
-    DBG_PRINT("°C, H: ");
-    DBG_PRINT(h);
-    DBG_PRINT("%, P: ");
-    DBG_PRINT(p);
-    DBG_PRINTLN(" hPa");
-    
-    if (pm > 0 || t > -40) { // Only send if we have valid data
-      // Calculate derived values
-      uint16_t aqi = calculatePM25AQI(pm);
-      uint8_t aqiCategory = getAQICategory(aqi);
-      float dewPoint = calculateDewPoint(t, h);
-      float comfortIndex = calculateComfortIndex(t, h);
-      uint32_t uptime = uptimeMillis / 1000;
-      
-      DBG_PRINT("Calculated - AQI: ");
-      DBG_PRINT(aqi);
-      DBG_PRINT(", Category: ");
-      DBG_PRINT(aqiCategory);
-      DBG_PRINT(", Dew Point: ");
-      DBG_PRINT(dewPoint, 1);
-      DBG_PRINT("°C, Comfort: ");
-      DBG_PRINT(comfortIndex, 1);
-      DBG_PRINTLN();
-      
-      publishSensorData(pm, t, h, p, aqi, aqiCategory, dewPoint, comfortIndex, uptime);
-    } else {
-      DBG_PRINTLN("No valid sensor data, skipping send");
-    }
-    
-    lastSend = millis();
-  }
-  
-  if (shouldRestart) {
-    delay(5000);
-    ESP.restart();
-  }
-}
\ No newline at end of file
+  scheduler.run();
+}
@@ -0,0 +1,287 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <time.h>
+#include "Config.h"
+#include "Crc.h"
+#include "SampleStore.h"
+
+// Store-and-forward journal for samples that could not be published.
+//
+// Records are appended to numbered segment files under /journal. A segment
+// is closed after JOURNAL_SEGMENT_RECORDS records and the next number is
+// used, so writes rotate through fresh files instead of rewriting one. At most
+// JOURNAL_MAX_SEGMENTS segments are kept; when that is exceeded the oldest
+// segment is deleted. Records are buffered in RAM and written
+// JOURNAL_FLUSH_RECORDS at a time to cut the number of flash commits; while
+// the flash cannot be written, only the newest of those are kept.
+//
+// Replay is at-least-once: the read position inside a segment only lives in
+// RAM, so after a reboot a partly replayed segment is sent again. A segment
+// is deleted as soon as its last record is replayed.
+
+#ifndef JOURNAL_SEGMENT_RECORDS
+#define JOURNAL_SEGMENT_RECORDS 256
+#endif
+
+#ifndef JOURNAL_MAX_SEGMENTS
+#define JOURNAL_MAX_SEGMENTS 16 // 4096 records, about 11 h at 10 s
+#endif
+
+#ifndef JOURNAL_FLUSH_RECORDS
+#define JOURNAL_FLUSH_RECORDS 6
+#endif
+
+constexpr uint8_t JOURNAL_RECORD_MAGIC = 0xA5;
+constexpr size_t JOURNAL_MAX_PEEK = 16;
+constexpr time_t JOURNAL_MIN_EPOCH = 1600000000; // anything earlier means no NTP time yet
+
+struct JournalRecord {
+  uint8_t magic;
+  uint8_t valid;        // SAMPLE_*_VALID
+  uint16_t pm25;
+  int16_t temperature;  // 0.01 °C
+  uint16_t humidity;    // 0.01 %
+  uint32_t pressure;    // Pa
+  uint32_t uptime;      // seconds since boot
+  uint32_t epoch;       // seconds since 1970, 0 if the clock was not set
+  uint32_t crc;         // CRC-32 of the bytes above
+};
+static_assert(sizeof(JournalRecord) == 24, "JournalRecord must stay 24 bytes");
+
+inline void journalRecordFromSample(const Sample &s, JournalRecord &r) {
+  memset(&r, 0, sizeof(r));
+  r.magic = JOURNAL_RECORD_MAGIC;
+  r.valid = s.valid;
+  if (s.pmValid()) {
+    r.pm25 = s.pm25;
+  }
+  if (s.envValid()) {
+    r.temperature = (int16_t)lroundf(s.temperature * 100.0f);
+    r.humidity = (uint16_t)lroundf(s.humidity * 100.0f);
+    r.pressure = (uint32_t)lroundf(s.pressure * 100.0f);
+  }
+  r.uptime = s.uptime;
+  time_t now = time(nullptr);
+  r.epoch = now >= JOURNAL_MIN_EPOCH ? (uint32_t)now : 0;
+  r.crc = crc32(&r, offsetof(JournalRecord, crc));
+}
+
+inline bool journalRecordValid(const JournalRecord &r) {
+  return r.magic == JOURNAL_RECORD_MAGIC && r.crc == crc32(&r, offsetof(JournalRecord, crc));
+}
+
+class SampleJournal {
+public:
+  // Find existing segments, call once after the filesystem is mounted
+  bool begin() {
+    if (!mountFS()) {
+      return false;
+    }
+    LittleFS.mkdir("/journal");
+    bool any = false;
+    Dir dir = LittleFS.openDir("/journal");
+    while (dir.next()) {
+      uint32_t seq = strtoul(dir.fileName().c_str(), nullptr, 10);
+      if (!any || seq < _tailSeq) _tailSeq = seq;
+      if (!any || seq > _headSeq) {
+        _headSeq = seq;
+        _headSize = dir.fileSize();
+      }
+      _pending += dir.fileSize() / sizeof(JournalRecord);
+      any = true;
+    }
+    _ready = true;
+    return true;
+  }
+
+  bool append(const Sample &s) {
+    JournalRecord r;
+    journalRecordFromSample(s, r);
+    return appendRecord(r);
+  }
+
+  bool appendRecord(const JournalRecord &r) {
+    if (!_ready) {
+      return false;
+    }
+    if (_buffered >= JOURNAL_FLUSH_RECORDS && !flush()) {
+      // Flash still unwritable: make room by dropping the oldest buffered record
+      memmove(_writeBuf, _writeBuf + 1, (JOURNAL_FLUSH_RECORDS - 1) * sizeof(JournalRecord));
+      _buffered--;
+      _pending -= min<uint32_t>(_pending, 1);
+      recordsDropped++;
+    }
+    _writeBuf[_buffered++] = r;
+    _pending++;
+    if (_buffered >= JOURNAL_FLUSH_RECORDS) {
+      return flush();
+    }
+    return true;
+  }
+
+  // Write buffered records to flash
+  bool flush() {
+    if (_buffered == 0) {
+      return true;
+    }
+    if (_headSize >= JOURNAL_SEGMENT_RECORDS * sizeof(JournalRecord)) {
+      startSegment();
+    }
+    char path[32];
+    segmentPath(_headSeq, path, sizeof(path));
+    File f = LittleFS.open(path, "a");
+    if (!f) {
+      return false;
+    }
+    size_t len = _buffered * sizeof(JournalRecord);
+    size_t w = f.write(reinterpret_cast<const uint8_t*>(_writeBuf), len);
+    f.close();
+    bytesWritten += w;
+    // A short write keeps the whole records; the rest is lost
+    uint32_t written = w / sizeof(JournalRecord);
+    uint32_t lost = _buffered - written;
+    _headSize += written * sizeof(JournalRecord);
+    recordsWritten += written;
+    recordsDropped += lost;
+    _pending -= min(_pending, lost);
+    _buffered = 0;
+    if (w % sizeof(JournalRecord) != 0) {
+      // The segment ends in a partial record, later ones would be misaligned
+      startSegment();
+    }
+    return w == len;
+  }
+
+  // Read up to max valid records from the oldest segment without consuming
+  // them. Corrupted records are skipped and counted.
+  size_t peek(JournalRecord* out, size_t max) {
+    _peeked = 0;
+    if (!_ready || empty()) {
+      return 0;
+    }
+    flush();
+    if (max > JOURNAL_MAX_PEEK) {
+      max = JOURNAL_MAX_PEEK;
+    }
+    char path[32];
+    segmentPath(_tailSeq, path, sizeof(path));
+    File f = LittleFS.open(path, "r");
+    if (!f) {
+      finishTailSegment();
+      return 0;
+    }
+    size_t size = f.size();
+    if (!f.seek(_readOffset)) {
+      f.close();
+      finishTailSegment();
+      return 0;
+    }
+    uint32_t offset = _readOffset;
+    while (_peeked < max && offset + sizeof(JournalRecord) <= size) {
+      JournalRecord &r = out[_peeked];
+      if (f.read(reinterpret_cast<uint8_t*>(&r), sizeof(r)) != sizeof(r)) {
+        break;
+      }
+      if (!journalRecordValid(r)) {
+        if (_peeked > 0) {
+          break; // handled as the first record of the next batch
+        }
+        crcErrors++;
+        offset += sizeof(r);
+        _readOffset = offset;
+        _pending -= min<uint32_t>(_pending, 1);
+        continue;
+      }
+      offset += sizeof(r);
+      _peekEnd[_peeked++] = offset;
+    }
+    f.close();
+    if (_peeked == 0 && offset + sizeof(JournalRecord) > size) {
+      finishTailSegment();
+    }
+    return _peeked;
+  }
+
+  // Consume the first n records returned by the last peek()
+  void consume(size_t n) {
+    if (n == 0 || n > _peeked) {
+      return;
+    }
+    uint32_t end = _peekEnd[n - 1];
+    _pending -= min<uint32_t>(_pending, (end - _readOffset) / sizeof(JournalRecord));
+    recordsReplayed += n;
+    _readOffset = end;
+    _peeked = 0;
+    if (_pending == 0 && _buffered == 0) {
+      // All replayed: delete the segment now, or a reboot would send it again
+      finishTailSegment();
+    }
+  }
+
+  bool empty() const { return _pending == 0; }
+  uint32_t pending() const { return _pending; }
+
+  uint32_t recordsWritten = 0;
+  uint32_t recordsReplayed = 0;
+  uint32_t recordsDropped = 0;
+  uint32_t crcErrors = 0;
+  uint32_t bytesWritten = 0;
+
+private:
+  static void segmentPath(uint32_t seq, char* buf, size_t len) {
+    snprintf(buf, len, "/journal/%08lu", (unsigned long)seq);
+  }
+
+  void startSegment() {
+    _headSeq++;
+    _headSize = 0;
+    if (_headSeq - _tailSeq >= JOURNAL_MAX_SEGMENTS) {
+      dropTailSegment();
+    }
+  }
+
+  // Oldest segment is out of room: discard whatever was not replayed yet
+  void dropTailSegment() {
+    char path[32];
+    segmentPath(_tailSeq, path, sizeof(path));
+    File f = LittleFS.open(path, "r");
+    uint32_t left = 0;
+    if (f) {
+      left = (f.size() - min<uint32_t>(f.size(), _readOffset)) / sizeof(JournalRecord);
+      f.close();
+    }
+    LittleFS.remove(path);
+    recordsDropped += left;
+    _pending -= min(_pending, left);
+    _tailSeq++;
+    _readOffset = 0;
+  }
+
+  // Oldest segment fully replayed (or unreadable): delete it and move on
+  void finishTailSegment() {
+    char path[32];
+    segmentPath(_tailSeq, path, sizeof(path));
+    LittleFS.remove(path);
+    _readOffset = 0;
+    if (_tailSeq == _headSeq) {
+      // Nothing left; the next append starts a fresh segment
+      _headSeq++;
+      _headSize = 0;
+      _pending = _buffered;
+    }
+    _tailSeq++;
+  }
+
+  JournalRecord _writeBuf[JOURNAL_FLUSH_RECORDS];
+  uint8_t _buffered = 0;
+  uint32_t _peekEnd[JOURNAL_MAX_PEEK];
+  size_t _peeked = 0;
+
+  bool _ready = false;
+  uint32_t _tailSeq = 0;
+  uint32_t _headSeq = 0;
+  uint32_t _headSize = 0;
+  uint32_t _readOffset = 0;
+  uint32_t _pending = 0;
+};
@@ -1,29 +1,40 @@
 #pragma once
-#include <PubSubClient.h>
-#include <ESP8266WiFi.h>
+#include "HAL.h"
 #include "Config.h"
+#include "Sensors.h"
+#include "SampleStore.h"
+#include "Journal.h"
+#include "Uplink.h"
+#include "Crc.h"
+#include "Metrics.h"
+#include "MqttTransport.h"
 
-extern WiFiClient wifiClient;
+extern NetClient wifiClient;
+extern MqttTransport mqttTransport;
 extern DeviceConfig config;
-extern PubSubClient mqttClient;
+extern MqttDriver mqttClient;
 extern bool mqttConnected;
 
-extern unsigned long lastMQTTReconnect;
-extern const unsigned long MQTT_RECONNECT_INTERVAL;
 extern unsigned long lastStatusHeartbeat;
 extern const unsigned long STATUS_HEARTBEAT_INTERVAL;
 extern bool discoveryPublished;
 extern bool pendingDataSend;
 extern bool firstDataSent;
-extern uint16_t lastPM25;
-extern float lastTemp;
-extern float lastHumidity;
-extern float lastPressure;
-extern uint16_t lastAQI;
-extern uint8_t lastAQICategory;
-extern float lastDewPoint;
-extern float lastComfortIndex;
-extern uint32_t lastUptime;
+extern SampleStore sampleStore;
+extern SampleJournal journal;
+extern unsigned long lastJournalBatch;
+
+// Samples collected for the next batched publish (config.mqttBatchSize > 1)
+struct BatchEntry {
+  uint32_t uptime;
+  uint8_t valid;
+  uint16_t pm25;
+  float temperature;
+  float humidity;
+  float pressure;
+};
+extern BatchEntry mqttBatch[MQTT_BATCH_MAX];
+extern uint8_t mqttBatchCount;
 
 // Variables for device identification and topics
 extern char deviceUniqueId[32];
@@ -78,135 +89,171 @@ inline void createDeviceInfo(char* buffer, size_t len) {
   );
 }
 
-// Publish Home Assistant Discovery configuration for a sensor
-inline void publishDiscoverySensor(const char* sensorName, const char* sensorId, 
-                                   const char* unit, const char* deviceClass, 
-                                   const char* valueTemplate, 
-                                   const char* stateClass = nullptr,
-                                   const char* icon = nullptr) {
-  if (!mqttClient.connected()) {
-    DBG_PRINTLN("MQTT not connected, cannot publish discovery");
-    return;
-  }
-  
-  if (!mqttTopicsInitialized) {
-    initMQTTTopics();
-  }
-  
-  char topic[192];
-  snprintf(topic, sizeof(topic), "%s/%s/config", discoveryPrefix, sensorId);
-  
+// Home Assistant sensors, kept in flash. The id doubles as the JSON key in
+// the state message; empty strings leave the attribute out.
+struct DiscoverySensor {
+  char name[16];
+  char id[16];
+  char unit[8];
+  char deviceClass[12];
+  char stateClass[20];
+  char icon[24];
+};
+
+static const DiscoverySensor DISCOVERY_SENSORS[] PROGMEM = {
+  {"PM2.5",         "pm25",          "µg/m³", "pm25",        "measurement",      "mdi:air-filter"},
+  {"Temperature",   "temperature",   "°C",    "temperature", "measurement",      "mdi:thermometer"},
+  {"Humidity",      "humidity",      "%",     "humidity",    "measurement",      "mdi:water-percent"},
+  {"Pressure",      "pressure",      "hPa",   "pressure",    "measurement",      "mdi:gauge"},
+  {"AQI",           "aqi",           "",      "aqi",         "measurement",      "mdi:air-purifier"},
+  {"AQI Category",  "aqi_category",  "",      "",            "",                 "mdi:signal"},
+  {"Dew Point",     "dew_point",     "°C",    "temperature", "measurement",      "mdi:water-thermometer"},
+  {"Comfort Index", "comfort_index", "",      "",            "measurement",      "mdi:emoticon-happy"},
+  {"Uptime",        "uptime",        "s",     "duration",    "total_increasing", "mdi:timer-outline"},
+};
+
+constexpr uint8_t DISCOVERY_SENSOR_COUNT = sizeof(DISCOVERY_SENSORS) / sizeof(DISCOVERY_SENSORS[0]);
+constexpr size_t DISCOVERY_PAYLOAD_SIZE = 768;
+// How long to collect the retained configs from the broker before publishing
+constexpr unsigned long DISCOVERY_CHECK_WINDOW = 1500;
+
+extern uint32_t discoveryHash[DISCOVERY_SENSOR_COUNT];
+extern uint16_t discoveryMatched;
+extern bool discoveryChecking;
+extern unsigned long discoveryCheckStart;
+
+// Build the retained config message for one sensor, returns its length or 0
+inline int buildDiscoveryPayload(const DiscoverySensor &d, char* payload, size_t size) {
   char deviceInfo[192];
   createDeviceInfo(deviceInfo, sizeof(deviceInfo));
   
-  // Build value template - use provided or default
-  char valueTemplateStr[96];
-  if (valueTemplate && strlen(valueTemplate) > 0) {
-    snprintf(valueTemplateStr, sizeof(valueTemplateStr), "{{ value_json.%s }}", valueTemplate);
-  } else {
-    snprintf(valueTemplateStr, sizeof(valueTemplateStr), "{{ value_json.%s }}", sensorId);
-  }
-  
-  // Build state topic
-  char stateTopic[96];
-  snprintf(stateTopic, sizeof(stateTopic), "tele/%s/state", baseTopic);
-  
-  // Build availability topic
-  char availabilityTopic[96];
-  snprintf(availabilityTopic, sizeof(availabilityTopic), "tele/%s/status", baseTopic);
-  
-  // Build unique_id
-  char uniqueId[96];
-  snprintf(uniqueId, sizeof(uniqueId), "ikea_air_monitor_%s_%s", deviceUniqueId, sensorId);
-  
-  char payload[768];
-  int len = snprintf(payload, sizeof(payload),
+  int len = snprintf(payload, size,
     "{"
     "\"name\":\"%s\","
-    "\"unique_id\":\"%s\","
-    "\"state_topic\":\"%s\","
-    "\"value_template\":\"%s\","
-    "\"availability_topic\":\"%s\","
+    "\"unique_id\":\"ikea_air_monitor_%s_%s\","
+    "\"state_topic\":\"tele/%s/state\","
+    "\"value_template\":\"{{ value_json.%s }}\","
+    "\"availability_topic\":\"tele/%s/status\","
     "\"payload_available\":\"online\","
     "\"payload_not_available\":\"offline\","
     "\"device\":%s",
-    sensorName,
-    uniqueId,
-    stateTopic,
-    valueTemplateStr,
-    availabilityTopic,
+    d.name,
+    deviceUniqueId, d.id,
+    baseTopic,
+    d.id,
+    baseTopic,
     deviceInfo
   );
-  
-  // Add unit_of_measurement if provided
-  if (unit && strlen(unit) > 0) {
-    int newLen = snprintf(payload + len, sizeof(payload) - len, ",\"unit_of_measurement\":\"%s\"", unit);
-    if (newLen > 0 && len + newLen < (int)sizeof(payload)) {
-      len += newLen;
-    }
+  if (d.unit[0] != '\0' && len > 0 && len < (int)size) {
+    len += snprintf(payload + len, size - len, ",\"unit_of_measurement\":\"%s\"", d.unit);
   }
-  
-  // Add device_class if provided
-  if (deviceClass && strlen(deviceClass) > 0) {
-    int newLen = snprintf(payload + len, sizeof(payload) - len, ",\"device_class\":\"%s\"", deviceClass);
-    if (newLen > 0 && len + newLen < (int)sizeof(payload)) {
-      len += newLen;
-    }
+  if (d.deviceClass[0] != '\0' && len > 0 && len < (int)size) {
+    len += snprintf(payload + len, size - len, ",\"device_class\":\"%s\"", d.deviceClass);
   }
-  
-  // Add state_class if provided (for statistical sensors like uptime)
-  if (stateClass && strlen(stateClass) > 0) {
-    int newLen = snprintf(payload + len, sizeof(payload) - len, ",\"state_class\":\"%s\"", stateClass);
-    if (newLen > 0 && len + newLen < (int)sizeof(payload)) {
-      len += newLen;
-    }
+  if (d.stateClass[0] != '\0' && len > 0 && len < (int)size) {
+    len += snprintf(payload + len, size - len, ",\"state_class\":\"%s\"", d.stateClass);
   }
-  
-  // Add icon if provided
-  if (icon && strlen(icon) > 0) {
-    int newLen = snprintf(payload + len, sizeof(payload) - len, ",\"icon\":\"%s\"", icon);
-    if (newLen > 0 && len + newLen < (int)sizeof(payload)) {
-      len += newLen;
+  if (d.icon[0] != '\0' && len > 0 && len < (int)size) {
+    len += snprintf(payload + len, size - len, ",\"icon\":\"%s\"", d.icon);
+  }
+  // expire_after for better offline detection (120 seconds = 2x heartbeat
+  // interval). With the deadband on, unchanged values are only resent every
+  // heartbeatInterval, and in power save mode only every uplinkPeriod, so
+  // allow two of those instead.
+  uint32_t expireAfter = config.deadbandEnabled ? 2UL * config.heartbeatInterval : 120;
+  if (config.powerSave && 120UL * config.uplinkPeriod > expireAfter) {
+    expireAfter = 120UL * config.uplinkPeriod;
+  }
+  if (len > 0 && len < (int)size) {
+    len += snprintf(payload + len, size - len, ",\"expire_after\":%lu}", (unsigned long)expireAfter);
+  }
+  if (len <= 0 || len >= (int)size) {
+    return 0;
+  }
+  return len;
+}
+
+// CRC-32 of every sensor's config payload. The payloads only depend on the
+// MAC, hostname and topic, so this runs once per boot.
+inline void initDiscoveryHashes() {
+  static bool done = false;
+  if (done) {
+    return;
+  }
+  char payload[DISCOVERY_PAYLOAD_SIZE];
+  for (uint8_t i = 0; i < DISCOVERY_SENSOR_COUNT; i++) {
+    DiscoverySensor d;
+    memcpy_P(&d, &DISCOVERY_SENSORS[i], sizeof(d));
+    int len = buildDiscoveryPayload(d, payload, sizeof(payload));
+    discoveryHash[i] = len > 0 ? crc32(payload, len) : 0;
+  }
+  done = true;
+}
+
+// Called for retained configs echoed by the broker while checking; marks
+// sensors whose config on the broker already matches ours
+inline void checkRetainedDiscovery(const char* topic, const uint8_t* payload, unsigned int length) {
+  size_t prefixLen = strlen(discoveryPrefix);
+  if (strncmp(topic, discoveryPrefix, prefixLen) != 0 || topic[prefixLen] != '/') {
+    return;
+  }
+  const char* id = topic + prefixLen + 1;
+  const char* slash = strchr(id, '/');
+  if (!slash || strcmp(slash, "/config") != 0) {
+    return;
+  }
+  size_t idLen = slash - id;
+  for (uint8_t i = 0; i < DISCOVERY_SENSOR_COUNT; i++) {
+    const char* sensorId = DISCOVERY_SENSORS[i].id;
+    if (strncmp_P(id, sensorId, idLen) == 0 && pgm_read_byte(sensorId + idLen) == '\0') {
+      if (crc32(payload, length) == discoveryHash[i]) {
+        discoveryMatched |= 1u << i;
+      }
+      return;
     }
   }
+}
+
+inline void discoveryWildcard(char* buf, size_t len) {
+  snprintf(buf, len, "%s/+/config", discoveryPrefix);
+}
+
+// Publish Home Assistant Discovery configuration for one table entry
+inline bool publishDiscoverySensor(uint8_t index) {
+  DiscoverySensor d;
+  memcpy_P(&d, &DISCOVERY_SENSORS[index], sizeof(d));
   
-  // Add expire_after for better offline detection (120 seconds = 2x heartbeat interval)
-  int newLen = snprintf(payload + len, sizeof(payload) - len, ",\"expire_after\":120");
-  if (newLen > 0 && len + newLen < (int)sizeof(payload)) {
-    len += newLen;
-  }
+  char topic[192];
+  snprintf(topic, sizeof(topic), "%s/%s/config", discoveryPrefix, d.id);
   
-  // Close JSON
-  if (len + 2 < (int)sizeof(payload)) {
-    int newLen = snprintf(payload + len, sizeof(payload) - len, "}");
-    if (newLen > 0) {
-      len += newLen;
-    }
+  char payload[DISCOVERY_PAYLOAD_SIZE];
+  int len = buildDiscoveryPayload(d, payload, sizeof(payload));
+  if (len == 0) {
+    DBG_PRINT("Discovery payload too large for sensor: ");
+    DBG_PRINTLN(d.id);
+    return false;
   }
   
-  // Debug: Print discovery payload
   DBG_PRINT("Discovery payload for ");
-  DBG_PRINT(sensorId);
+  DBG_PRINT(d.id);
   DBG_PRINT(" -> ");
   DBG_PRINT(topic);
   DBG_PRINT(": ");
   DBG_PRINTLN(payload);
   
-  bool published = mqttClient.publish(topic, payload, true); // retain = true
+  bool published = mqttClient.publish(topic, reinterpret_cast<const uint8_t*>(payload), len, true); // retain = true
   if (published) {
     DBG_PRINT("Published discovery for sensor: ");
-    DBG_PRINT(sensorId);
-    DBG_PRINT(" -> ");
-    DBG_PRINTLN(topic);
+    DBG_PRINTLN(d.id);
   } else {
     DBG_PRINT("Failed to publish discovery for sensor: ");
-    DBG_PRINT(sensorId);
-    DBG_PRINT(", topic: ");
-    DBG_PRINTLN(topic);
+    DBG_PRINTLN(d.id);
   }
+  return published;
 }
 
-// Publish all Home Assistant Discovery configurations
+// Publish the Home Assistant Discovery configurations that are missing or
+// outdated on the broker
 inline void publishDiscovery() {
   if (discoveryPublished) {
     DBG_PRINTLN("Discovery already published, skipping");
@@ -221,62 +268,175 @@ inline void publishDiscovery() {
   if (!mqttTopicsInitialized) {
     initMQTTTopics();
   }
+  initDiscoveryHashes();
   
-  DBG_PRINTLN("Publishing Home Assistant discovery configuration...");
-  
-  // PM2.5 sensor
-  publishDiscoverySensor("PM2.5", "pm25", "µg/m³", "pm25", "pm25", "measurement", "mdi:air-filter");
-  
-  // Temperature sensor
-  publishDiscoverySensor("Temperature", "temperature", "°C", "temperature", "temperature", "measurement", "mdi:thermometer");
-  
-  // Humidity sensor
-  publishDiscoverySensor("Humidity", "humidity", "%", "humidity", "humidity", "measurement", "mdi:water-percent");
-  
-  // Pressure sensor
-  publishDiscoverySensor("Pressure", "pressure", "hPa", "pressure", "pressure", "measurement", "mdi:gauge");
-  
-  // AQI sensor
-  publishDiscoverySensor("AQI", "aqi", "", "aqi", "aqi", "measurement", "mdi:air-purifier");
-  
-  // AQI Category sensor
-  publishDiscoverySensor("AQI Category", "aqi_category", "", "", "aqi_category", nullptr, "mdi:signal");
-  
-  // Dew Point sensor
-  publishDiscoverySensor("Dew Point", "dew_point", "°C", "temperature", "dew_point", "measurement", "mdi:water-thermometer");
-  
-  // Comfort Index sensor
-  publishDiscoverySensor("Comfort Index", "comfort_index", "", "", "comfort_index", "measurement", "mdi:emoticon-happy");
+  if (discoveryChecking) {
+    char filter[128];
+    discoveryWildcard(filter, sizeof(filter));
+    mqttClient.unsubscribe(filter);
+    discoveryChecking = false;
+  }
   
-  // Uptime sensor (total_increasing for statistics)
-  publishDiscoverySensor("Uptime", "uptime", "s", "duration", "uptime", "total_increasing", "mdi:timer-outline");
+  uint8_t sent = 0;
+  for (uint8_t i = 0; i < DISCOVERY_SENSOR_COUNT; i++) {
+    if (discoveryMatched & (1u << i)) {
+      continue;
+    }
+    if (publishDiscoverySensor(i)) {
+      sent++;
+    }
+  }
   
   discoveryPublished = true;
-  DBG_PRINTLN("Home Assistant discovery configuration published");
+  DBG_PRINTF("Home Assistant discovery: %u published, %u unchanged\n",
+             sent, DISCOVERY_SENSOR_COUNT - sent);
+}
+
+// Subscribe to our own retained configs. The broker sends them right away;
+// publishDiscovery() runs once DISCOVERY_CHECK_WINDOW has passed and only
+// sends the sensors that did not come back unchanged.
+inline void startDiscovery() {
+  if (!mqttTopicsInitialized) {
+    initMQTTTopics();
+  }
+  initDiscoveryHashes();
+  discoveryPublished = false;
+  discoveryMatched = 0;
+  char filter[128];
+  discoveryWildcard(filter, sizeof(filter));
+  discoveryChecking = mqttClient.subscribe(filter);
+  discoveryCheckStart = millis();
+  if (!discoveryChecking) {
+    publishDiscovery();
+  }
 }
 
 // Forward declaration
 inline void publishAvailability(bool online);
 
-// Publish sensor data as JSON
-inline void publishSensorData(uint16_t pm25, float temp, float h, float p, 
-                              uint16_t aqi, uint8_t aqiCategory, 
-                              float dewPoint, float comfortIndex, 
-                              uint32_t uptime) {
-  // Store data for retry if connection fails
-  lastPM25 = pm25;
-  lastTemp = temp;
-  lastHumidity = h;
-  lastPressure = p;
-  lastAQI = aqi;
-  lastAQICategory = aqiCategory;
-  lastDewPoint = dewPoint;
-  lastComfortIndex = comfortIndex;
-  lastUptime = uptime;
+// Buffer for batched state messages, too large for the stack and for
+// PubSubClient's own buffer, so it is streamed with beginPublish(). The
+// diagnostics summary is formatted in it as well.
+constexpr size_t MQTT_BATCH_PAYLOAD_SIZE = 1408;
+extern char mqttBatchPayload[MQTT_BATCH_PAYLOAD_SIZE];
+
+// Publish a state message with the collected batch appended as
+// "samples":[[uptime,pm25,temperature,humidity,pressure],...], null for
+// fields without a valid reading. latest is the state JSON without batch.
+inline bool publishBatch(const char* topic, const char* latest, int latestLen, bool retain) {
+  char* buf = mqttBatchPayload;
+  const int size = (int)MQTT_BATCH_PAYLOAD_SIZE;
+  // Reopen the latest-values object to append the array
+  int len = latestLen - 1;
+  memcpy(buf, latest, len);
+  len += snprintf(buf + len, size - len, ",\"samples\":[");
+  for (uint8_t i = 0; i < mqttBatchCount && len < size; i++) {
+    const BatchEntry &e = mqttBatch[i];
+    len += snprintf(buf + len, size - len, "%s[%lu,", i ? "," : "", (unsigned long)e.uptime);
+    if (len >= size) break;
+    if (e.valid & SAMPLE_PM_VALID) {
+      len += snprintf(buf + len, size - len, "%u,", e.pm25);
+    } else {
+      len += snprintf(buf + len, size - len, "null,");
+    }
+    if (len >= size) break;
+    if (e.valid & SAMPLE_ENV_VALID) {
+      len += snprintf(buf + len, size - len, "%.1f,%.1f,%.2f]", e.temperature, e.humidity, e.pressure);
+    } else {
+      len += snprintf(buf + len, size - len, "null,null,null]");
+    }
+  }
+  if (len < size) {
+    len += snprintf(buf + len, size - len, "]}");
+  }
+  mqttBatchCount = 0;
+  if (len >= size) {
+    DBG_PRINTLN("ERROR: batch payload too large");
+    return false;
+  }
   
-  if (!mqttClient.connected()) {
+  if (!mqttClient.beginPublish(topic, len, retain)) {
+    return false;
+  }
+  mqttClient.write(reinterpret_cast<const uint8_t*>(buf), len);
+  return mqttClient.endPublish() == 1;
+}
+
+constexpr size_t STATE_JSON_SIZE = 512;
+
+// Serialize a sample as the state JSON shared by MQTT and /api/state,
+// fields of invalid sources are omitted. Returns the length written.
+// Append "name":[count,min,max,mean,stddev,p95] for a window with readings
+inline int formatFieldStats(const char* name, const FieldStats &f, char* payload, size_t size, bool first) {
+  if (f.count == 0) {
+    return 0;
+  }
+  int len = snprintf(payload, size, "%s\"%s\":[%u,%.2f,%.2f,%.2f,%.2f,%.2f]",
+                     first ? "" : ",", name, f.count, f.min, f.max, f.mean, f.stddev, f.p95);
+  return len > 0 && len < (int)size ? len : 0;
+}
+
+inline int formatStateJson(const Sample &s, char* payload, size_t size) {
+  int len = snprintf(payload, size, "{");
+  if (s.pmValid()) {
+    int newLen = snprintf(payload + len, size - len,
+      "\"pm25\":%u,"
+      "\"aqi\":%u,"
+      "\"aqi_category\":%u,",
+      s.pm25, s.aqi, s.aqiCategory
+    );
+    if (newLen > 0 && len + newLen < (int)size) {
+      len += newLen;
+    }
+  }
+  if (s.envValid()) {
+    int newLen = snprintf(payload + len, size - len,
+      "\"temperature\":%.1f,"
+      "\"humidity\":%.1f,"
+      "\"pressure\":%.2f,"
+      "\"dew_point\":%.1f,"
+      "\"comfort_index\":%.1f,",
+      s.temperature, s.humidity, s.pressure, s.dewPoint, s.comfortIndex
+    );
+    if (newLen > 0 && len + newLen < (int)size) {
+      len += newLen;
+    }
+  }
+  if (s.stats.pm25.count || s.stats.temperature.count) {
+    int newLen = snprintf(payload + len, size - len, "\"stats\":{");
+    if (newLen > 0 && len + newLen < (int)size) {
+      int start = len + newLen;
+      int end = start;
+      end += formatFieldStats("pm25", s.stats.pm25, payload + end, size - end, end == start);
+      end += formatFieldStats("temperature", s.stats.temperature, payload + end, size - end, end == start);
+      end += formatFieldStats("humidity", s.stats.humidity, payload + end, size - end, end == start);
+      end += formatFieldStats("pressure", s.stats.pressure, payload + end, size - end, end == start);
+      if (end + 2 < (int)size) {
+        payload[end++] = '}';
+        payload[end++] = ',';
+        payload[end] = '\0';
+        len = end;
+      } else {
+        payload[len] = '\0';
+      }
+    }
+  }
+  int newLen = snprintf(payload + len, size - len, "\"uptime\":%lu}", (unsigned long)s.uptime);
+  if (newLen > 0) {
+    len += newLen;
+  }
+  return len;
+}
+
+// Publish sensor data as JSON, fields of invalid sources are omitted
+inline void publishSensorData(const Sample &s) {
+  // mqttConnected is only set once CONNACK accepted the session
+  if (!mqttConnected || !mqttClient.connected()) {
+    // The latest sample stays in the store for the state topic, every sample
+    // goes to the journal and is replayed on the backlog topic later
     pendingDataSend = true;
-    DBG_PRINTLN("MQTT not connected, data will be sent when connection is restored");
+    journal.append(s);
+    DBG_PRINTLN("MQTT not connected, sample journaled for later replay");
     return;
   }
   
@@ -289,21 +449,36 @@ inline void publishSensorData(uint16_t pm25, float temp, float h, float p,
   char stateTopic[96];
   snprintf(stateTopic, sizeof(stateTopic), "tele/%s/state", baseTopic);
   
-  char payload[384];
-  int len = snprintf(payload, sizeof(payload),
-    "{"
-    "\"pm25\":%u,"
-    "\"temperature\":%.1f,"
-    "\"humidity\":%.1f,"
-    "\"pressure\":%.2f,"
-    "\"aqi\":%u,"
-    "\"aqi_category\":%u,"
-    "\"dew_point\":%.1f,"
-    "\"comfort_index\":%.1f,"
-    "\"uptime\":%lu"
-    "}",
-    pm25, temp, h, p, aqi, aqiCategory, dewPoint, comfortIndex, uptime
-  );
+  // Compact binary frame for consumers that decode the /sensor layout
+  if (config.mqttBinary) {
+    char binTopic[96];
+    snprintf(binTopic, sizeof(binTopic), "tele/%s/bin", baseTopic);
+    UplinkFrame frame;
+    encodeUplink(s, frame);
+    mqttClient.publish(binTopic, reinterpret_cast<const uint8_t*>(&frame), sizeof(frame), false);
+  }
+  
+  // In batch mode only every mqttBatchSize-th sample is published, carrying
+  // the earlier ones in a "samples" array next to the usual latest values
+  uint8_t batchSize = config.mqttBatchSize;
+  if (batchSize > 1) {
+    if (mqttBatchCount > 0 && mqttBatch[mqttBatchCount - 1].uptime == s.uptime) {
+      return; // reconnect republishing a sample that is already batched
+    }
+    BatchEntry &e = mqttBatch[mqttBatchCount++];
+    e.uptime = s.uptime;
+    e.valid = s.valid;
+    e.pm25 = s.pm25;
+    e.temperature = s.temperature;
+    e.humidity = s.humidity;
+    e.pressure = s.pressure;
+    if (mqttBatchCount < batchSize && mqttBatchCount < MQTT_BATCH_MAX) {
+      return;
+    }
+  }
+  
+  char payload[STATE_JSON_SIZE];
+  int len = formatStateJson(s, payload, sizeof(payload));
   
   // Validate JSON format - ensure it's properly closed
   if (len <= 0 || len >= (int)sizeof(payload)) {
@@ -315,65 +490,82 @@ inline void publishSensorData(uint16_t pm25, float temp, float h, float p,
   }
   
   // Verify JSON is properly closed (should end with })
-  if (len > 0 && len < (int)sizeof(payload)) {
-    if (payload[len-1] != '}') {
-      DBG_PRINTLN("ERROR: JSON payload not properly closed!");
-      return;
+  if (payload[len-1] != '}') {
+    DBG_PRINTLN("ERROR: JSON payload not properly closed!");
+    return;
+  }
+  DBG_PRINT("Publishing to ");
+  DBG_PRINT(stateTopic);
+  DBG_PRINT(": ");
+  DBG_PRINTLN(payload);
+  // Send first message with retain=true so Home Assistant picks it up immediately
+  bool retainFlag = !firstDataSent;
+  bool published;
+  if (batchSize > 1) {
+    published = publishBatch(stateTopic, payload, len, retainFlag);
+  } else {
+    published = mqttClient.publish(stateTopic, payload, retainFlag);
+  }
+  if (published) {
+    metrics.mqttPublishes++;
+    if (metrics.firstPublishMs == 0) {
+      metrics.firstPublishMs = millis();
     }
-    DBG_PRINT("Publishing to ");
-    DBG_PRINT(stateTopic);
-    DBG_PRINT(": ");
-    DBG_PRINTLN(payload);
-    // Send first message with retain=true so Home Assistant picks it up immediately
-    bool retainFlag = !firstDataSent;
-    bool published = mqttClient.publish(stateTopic, payload, retainFlag);
-    if (published) {
-      if (retainFlag) {
-        firstDataSent = true;
-        DBG_PRINT("MQTT data published to ");
-        DBG_PRINT(stateTopic);
-        DBG_PRINTLN(" (retained)");
-      } else {
-        DBG_PRINT("MQTT data published to ");
-        DBG_PRINTLN(stateTopic);
-      }
-      // Update availability topic to ensure Home Assistant knows device is online
-      publishAvailability(true);
+    if (retainFlag) {
+      firstDataSent = true;
+      DBG_PRINT("MQTT data published to ");
+      DBG_PRINT(stateTopic);
+      DBG_PRINTLN(" (retained)");
     } else {
-      DBG_PRINTLN("Failed to publish MQTT data");
+      DBG_PRINT("MQTT data published to ");
+      DBG_PRINTLN(stateTopic);
     }
+    // Update availability topic to ensure Home Assistant knows device is online
+    publishAvailability(true);
   } else {
-    DBG_PRINT("Payload too large: ");
-    DBG_PRINT(len);
-    DBG_PRINTLN(" bytes");
+    metrics.mqttPublishFailures++;
+    DBG_PRINTLN("Failed to publish MQTT data");
   }
   
   // Also publish in Tasmota format (tele/XXX/SENSOR)
   char tasmotaTopic[96];
   snprintf(tasmotaTopic, sizeof(tasmotaTopic), "tele/%s/SENSOR", baseTopic);
   
-  // Tasmota format with Time and sensor data
+  // Tasmota format with Time (seconds since boot) and sensor data
   char tasmotaPayload[384];
-  // Get current time (seconds since boot, formatted as uptime)
-  int tasmotaLen = snprintf(tasmotaPayload, sizeof(tasmotaPayload),
-    "{"
-    "\"Time\":\"%lu\","
-    "\"BME280\":{"
-    "\"Temperature\":%.1f,"
-    "\"Humidity\":%.1f,"
-    "\"Pressure\":%.2f"
-    "},"
-    "\"PM2.5\":{"
-    "\"PM2.5\":%u"
-    "},"
-    "\"AQI\":%u,"
-    "\"AQICategory\":%u,"
-    "\"DewPoint\":%.1f,"
-    "\"ComfortIndex\":%.1f,"
-    "\"Uptime\":%lu"
-    "}",
-    uptime, temp, h, p, pm25, aqi, aqiCategory, dewPoint, comfortIndex, uptime
-  );
+  int tasmotaLen = snprintf(tasmotaPayload, sizeof(tasmotaPayload), "{\"Time\":\"%lu\",", (unsigned long)s.uptime);
+  if (s.envValid()) {
+    int newLen = snprintf(tasmotaPayload + tasmotaLen, sizeof(tasmotaPayload) - tasmotaLen,
+      "\"BME280\":{"
+      "\"Temperature\":%.1f,"
+      "\"Humidity\":%.1f,"
+      "\"Pressure\":%.2f"
+      "},"
+      "\"DewPoint\":%.1f,"
+      "\"ComfortIndex\":%.1f,",
+      s.temperature, s.humidity, s.pressure, s.dewPoint, s.comfortIndex
+    );
+    if (newLen > 0 && tasmotaLen + newLen < (int)sizeof(tasmotaPayload)) {
+      tasmotaLen += newLen;
+    }
+  }
+  if (s.pmValid()) {
+    int newLen = snprintf(tasmotaPayload + tasmotaLen, sizeof(tasmotaPayload) - tasmotaLen,
+      "\"PM2.5\":{"
+      "\"PM2.5\":%u"
+      "},"
+      "\"AQI\":%u,"
+      "\"AQICategory\":%u,",
+      s.pm25, s.aqi, s.aqiCategory
+    );
+    if (newLen > 0 && tasmotaLen + newLen < (int)sizeof(tasmotaPayload)) {
+      tasmotaLen += newLen;
+    }
+  }
+  int newLen = snprintf(tasmotaPayload + tasmotaLen, sizeof(tasmotaPayload) - tasmotaLen, "\"Uptime\":%lu}", (unsigned long)s.uptime);
+  if (newLen > 0) {
+    tasmotaLen += newLen;
+  }
   
   // Validate Tasmota JSON format
   if (tasmotaLen <= 0 || tasmotaLen >= (int)sizeof(tasmotaPayload)) {
@@ -385,22 +577,83 @@ inline void publishSensorData(uint16_t pm25, float temp, float h, float p,
   }
   
   // Verify JSON is properly closed (should end with })
-  if (tasmotaLen > 0 && tasmotaLen < (int)sizeof(tasmotaPayload)) {
-    if (tasmotaPayload[tasmotaLen-1] != '}') {
-      DBG_PRINTLN("ERROR: Tasmota JSON payload not properly closed!");
-      return;
+  if (tasmotaPayload[tasmotaLen-1] != '}') {
+    DBG_PRINTLN("ERROR: Tasmota JSON payload not properly closed!");
+    return;
+  }
+  bool tasmotaPublished = mqttClient.publish(tasmotaTopic, tasmotaPayload, false);
+  if (tasmotaPublished) {
+    DBG_PRINT("MQTT data published to Tasmota format: ");
+    DBG_PRINTLN(tasmotaTopic);
+  } else {
+    DBG_PRINTLN("Failed to publish MQTT data in Tasmota format");
+  }
+}
+
+// Journal replay: records per message and minimum time between messages
+constexpr size_t JOURNAL_BATCH_RECORDS = 8;
+constexpr unsigned long JOURNAL_BATCH_INTERVAL = 250;
+
+// Publish samples as a JSON array on tele/XXX/backlog. Each entry carries
+// its original uptime and, once NTP time was available when it was
+// recorded, its epoch time. Returns how many of the n records went out, 0
+// if the publish failed.
+inline size_t publishBacklog(const JournalRecord* records, size_t n) {
+  char topic[96];
+  snprintf(topic, sizeof(topic), "tele/%s/backlog", baseTopic);
+  
+  char payload[900];
+  int len = snprintf(payload, sizeof(payload), "[");
+  size_t packed = 0;
+  for (size_t i = 0; i < n; i++) {
+    const JournalRecord &r = records[i];
+    char entry[160];
+    int entryLen = snprintf(entry, sizeof(entry), "%s{\"time\":%lu,\"uptime\":%lu",
+                            packed ? "," : "", (unsigned long)r.epoch, (unsigned long)r.uptime);
+    if (r.valid & SAMPLE_PM_VALID) {
+      entryLen += snprintf(entry + entryLen, sizeof(entry) - entryLen, ",\"pm25\":%u", r.pm25);
     }
-    bool tasmotaPublished = mqttClient.publish(tasmotaTopic, tasmotaPayload, false);
-    if (tasmotaPublished) {
-      DBG_PRINT("MQTT data published to Tasmota format: ");
-      DBG_PRINTLN(tasmotaTopic);
-    } else {
-      DBG_PRINTLN("Failed to publish MQTT data in Tasmota format");
+    if (r.valid & SAMPLE_ENV_VALID) {
+      entryLen += snprintf(entry + entryLen, sizeof(entry) - entryLen,
+                           ",\"temperature\":%.2f,\"humidity\":%.2f,\"pressure\":%.2f",
+                           r.temperature / 100.0f, r.humidity / 100.0f, r.pressure / 100.0f);
     }
+    entryLen += snprintf(entry + entryLen, sizeof(entry) - entryLen, "}");
+    if (len + entryLen + 2 > (int)sizeof(payload)) {
+      break;
+    }
+    memcpy(payload + len, entry, entryLen);
+    len += entryLen;
+    packed++;
+  }
+  payload[len++] = ']';
+  payload[len] = '\0';
+  
+  return mqttClient.publish(topic, payload, false) ? packed : 0;
+}
+
+// Replay one batch of journaled samples
+inline void drainJournal(unsigned long now) {
+  if (journal.empty() || now - lastJournalBatch < JOURNAL_BATCH_INTERVAL) {
+    return;
+  }
+  lastJournalBatch = now;
+  
+  JournalRecord records[JOURNAL_BATCH_RECORDS];
+  size_t n = journal.peek(records, JOURNAL_BATCH_RECORDS);
+  if (n == 0) {
+    return;
+  }
+  
+  size_t packed = publishBacklog(records, n);
+  if (packed > 0) {
+    journal.consume(packed);
+    DBG_PRINT("Replayed ");
+    DBG_PRINT(packed);
+    DBG_PRINT(" journaled samples, pending: ");
+    DBG_PRINTLN(journal.pending());
   } else {
-    DBG_PRINT("Tasmota payload too large: ");
-    DBG_PRINT(tasmotaLen);
-    DBG_PRINTLN(" bytes");
+    DBG_PRINTLN("Failed to publish journal batch");
   }
 }
 
@@ -428,27 +681,101 @@ inline void publishAvailability(bool online) {
 }
 
 // MQTT callback (not used but required by PubSubClient)
-void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  // No subscriptions needed for this device
+inline void mqttCallback(char* topic, byte* payload, unsigned int length) {
+  // The only subscription is the discovery check
+  if (discoveryChecking) {
+    checkRetainedDiscovery(topic, payload, length);
+  }
 }
 
-// Connect to MQTT broker
-inline bool connectMQTT() {
-  if (config.mqttHost[0] == '\0') {
-    DBG_PRINTLN("MQTT host not configured");
-    return false;
-  }
-  
-  // Check WiFi connection first
-  if (WiFi.status() != WL_CONNECTED) {
-    DBG_PRINTLN("WiFi not connected, cannot connect to MQTT");
-    return false;
-  }
-  
+// Connection state machine, advanced one step per loopMQTT() call. No step
+// waits for the network: the lookup, the TCP handshake and CONNACK are each
+// started once and polled on the following calls, with their own timeout.
+enum MqttState : uint8_t {
+  MQTT_STATE_IDLE,         // no WiFi or no broker configured
+  MQTT_STATE_BACKOFF,      // waiting for the next attempt
+  MQTT_STATE_RESOLVE,      // look up the broker's address
+  MQTT_STATE_TCP_CONNECT,  // TCP handshake
+  MQTT_STATE_SESSION,      // send CONNECT
+  MQTT_STATE_CONNACK,      // wait for the broker to accept the session
+  MQTT_STATE_DISCOVERY,    // check and publish discovery configs
+  MQTT_STATE_ONLINE
+};
+
+constexpr unsigned long MQTT_BACKOFF_MIN = 2000;
+constexpr unsigned long MQTT_BACKOFF_MAX = 120000;
+constexpr uint16_t MQTT_DNS_TIMEOUT = 5000;     // ms
+constexpr uint16_t MQTT_TCP_TIMEOUT = 1500;     // ms
+constexpr uint16_t MQTT_CONNACK_TIMEOUT = 2000; // ms
+
+extern MqttState mqttState;
+extern unsigned long mqttNextAttempt;
+extern unsigned long mqttStepSince;  // start of the lookup, connect or CONNACK wait
+extern HostResolver mqttResolver;
+extern TcpConnector mqttConnector;
+extern uint8_t mqttAttempts;
+extern uint32_t mqttJitterSeed;
+
+// xorshift32, seeded per device so devices that lost the broker at the same
+// moment spread their retries differently
+inline uint32_t mqttJitterRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+// Delay before retry number attempt (1-based): exponential from
+// MQTT_BACKOFF_MIN up to MQTT_BACKOFF_MAX, then a random point in the upper
+// half of that window
+inline unsigned long mqttBackoffDelay(uint8_t attempt, uint32_t &rng) {
+  uint8_t shift = attempt > 1 ? min<uint8_t>(attempt - 1, 10) : 0;
+  unsigned long window = min<unsigned long>(MQTT_BACKOFF_MAX, MQTT_BACKOFF_MIN << shift);
+  return window / 2 + mqttJitterRandom(rng) % (window / 2 + 1);
+}
+
+inline void scheduleMQTTReconnect(unsigned long now) {
+  if (mqttJitterSeed == 0) {
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    mqttJitterSeed = crc32(mac, sizeof(mac)) | 1;
+  }
+  if (mqttAttempts < UINT8_MAX) {
+    mqttAttempts++;
+  }
+  unsigned long wait = mqttBackoffDelay(mqttAttempts, mqttJitterSeed);
+  mqttNextAttempt = now + wait;
+  mqttState = MQTT_STATE_BACKOFF;
+  DBG_PRINTF("MQTT retry %u in %lu ms\n", mqttAttempts, wait);
+}
+
+inline void logMQTTState() {
+  int state = mqttClient.state();
+  DBG_PRINT("MQTT connection attempt failed, rc=");
+  DBG_PRINT(state);
+  DBG_PRINT(" (");
+  switch(state) {
+    case -4: DBG_PRINT("MQTT_CONNECTION_TIMEOUT"); break;
+    case -3: DBG_PRINT("MQTT_CONNECTION_LOST"); break;
+    case -2: DBG_PRINT("MQTT_CONNECT_FAILED"); break;
+    case -1: DBG_PRINT("MQTT_DISCONNECTED"); break;
+    case 1: DBG_PRINT("MQTT_CONNECT_BAD_PROTOCOL"); break;
+    case 2: DBG_PRINT("MQTT_CONNECT_BAD_CLIENT_ID"); break;
+    case 3: DBG_PRINT("MQTT_CONNECT_UNAVAILABLE"); break;
+    case 4: DBG_PRINT("MQTT_CONNECT_BAD_CREDENTIALS"); break;
+    case 5: DBG_PRINT("MQTT_CONNECT_UNAUTHORIZED"); break;
+    default: DBG_PRINT("UNKNOWN"); break;
+  }
+  DBG_PRINTLN(")");
+}
+
+// Send CONNECT on the socket mqttConnector opened. PubSubClient::connect()
+// reuses the connected socket and, through mqttTransport, returns without
+// waiting for CONNACK; finishMQTTSession() follows once it arrived.
+inline bool startMQTTSession() {
   mqttClient.setServer(config.mqttHost, config.mqttPort);
-  mqttClient.setCallback(mqttCallback);
-  mqttClient.setBufferSize(1024); // Increase buffer size for discovery messages
   mqttClient.setKeepAlive(60); // Set keepalive to 60 seconds
+  mqttClient.setSocketTimeout(MQTT_CONNACK_TIMEOUT / 1000);
   
   if (!mqttTopicsInitialized) {
     initMQTTTopics();
@@ -463,73 +790,45 @@ inline bool connectMQTT() {
   snprintf(willTopic, sizeof(willTopic), "tele/%s/status", baseTopic);
   const char* willMessage = "offline";
   
-  DBG_PRINT("Connecting to MQTT broker ");
-  DBG_PRINT(config.mqttHost);
-  DBG_PRINT(":");
-  DBG_PRINT(config.mqttPort);
-  DBG_PRINT(" as ");
-  DBG_PRINTLN(clientId);
-  
-  // Try to connect with timeout
-  bool connected = false;
-  unsigned long connectStart = millis();
-  const unsigned long CONNECT_TIMEOUT = 5000; // 5 seconds timeout
-  
-  while (!connected && (millis() - connectStart < CONNECT_TIMEOUT)) {
-    if (config.mqttUser[0] != '\0') {
-      // Connect with LWT: willTopic, willQoS=1, willRetain=true, willMessage
-      connected = mqttClient.connect(clientId, config.mqttUser, config.mqttPassword, 
-                                     willTopic, 1, true, willMessage);
-    } else {
-      // Connect with LWT but without credentials
-      connected = mqttClient.connect(clientId, willTopic, 1, true, willMessage);
-    }
-    
-    if (!connected) {
-      int state = mqttClient.state();
-      DBG_PRINT("MQTT connection attempt failed, rc=");
-      DBG_PRINT(state);
-      DBG_PRINT(" (");
-      switch(state) {
-        case -4: DBG_PRINT("MQTT_CONNECTION_TIMEOUT"); break;
-        case -3: DBG_PRINT("MQTT_CONNECTION_LOST"); break;
-        case -2: DBG_PRINT("MQTT_CONNECT_FAILED"); break;
-        case -1: DBG_PRINT("MQTT_DISCONNECTED"); break;
-        case 1: DBG_PRINT("MQTT_CONNECT_BAD_PROTOCOL"); break;
-        case 2: DBG_PRINT("MQTT_CONNECT_BAD_CLIENT_ID"); break;
-        case 3: DBG_PRINT("MQTT_CONNECT_UNAVAILABLE"); break;
-        case 4: DBG_PRINT("MQTT_CONNECT_BAD_CREDENTIALS"); break;
-        case 5: DBG_PRINT("MQTT_CONNECT_UNAUTHORIZED"); break;
-        default: DBG_PRINT("UNKNOWN"); break;
-      }
-      DBG_PRINTLN(")");
-      yield(); // Allow other tasks to run
-    }
-  }
-  
-  if (connected) {
-    DBG_PRINT("MQTT connected to ");
-    DBG_PRINT(config.mqttHost);
-    DBG_PRINT(":");
-    DBG_PRINTLN(config.mqttPort);
-    
-    mqttConnected = true;
-    // Initialize heartbeat timer
-    lastStatusHeartbeat = millis();
-    publishAvailability(true);
-    
-    // Reset discovery flag and publish discovery after connection
-    discoveryPublished = false;
-    publishDiscovery();
+  mqttTransport.expectConnack();
+  bool sent;
+  if (config.mqttUser[0] != '\0') {
+    // Connect with LWT: willTopic, willQoS=1, willRetain=true, willMessage
+    sent = mqttClient.connect(clientId, config.mqttUser, config.mqttPassword, 
+                              willTopic, 1, true, willMessage);
   } else {
-    DBG_PRINTLN("MQTT connection failed after timeout");
-    mqttConnected = false;
+    // Connect with LWT but without credentials
+    sent = mqttClient.connect(clientId, willTopic, 1, true, willMessage);
   }
-  
-  return connected;
+  if (!sent) {
+    logMQTTState();
+    mqttTransport.stop();
+    return false;
+  }
+  return true;
+}
+
+// CONNACK arrived and accepted the session
+inline void finishMQTTSession() {
+  DBG_PRINT("MQTT connected as ikea_air_monitor_");
+  DBG_PRINTLN(deviceUniqueId);
+  metrics.mqttConnects++;
+  mqttConnected = true;
+  // Initialize heartbeat timer
+  lastStatusHeartbeat = millis();
+  publishAvailability(true);
+}
+
+// Give up the current attempt and schedule the next one
+inline void failMQTTAttempt(const char* why, unsigned long now) {
+  DBG_PRINTLN(why);
+  mqttConnector.cancel();
+  mqttClient.disconnect();
+  metrics.mqttConnectFailures++;
+  scheduleMQTTReconnect(now);
 }
 
-// Initialize MQTT
+// Initialize MQTT, the connection itself is made by loopMQTT()
 inline bool initMQTT() {
   if (config.mqttHost[0] == '\0') {
     DBG_PRINTLN("MQTT not configured");
@@ -540,59 +839,126 @@ inline bool initMQTT() {
   if (WiFi.status() == WL_CONNECTED) {
     initMQTTTopics();
   }
-  
-  return connectMQTT();
+  // Sized once here; setting it on every reconnect reallocated the buffer
+  mqttClient.setBufferSize(1024); // Increase buffer size for discovery messages
+  mqttClient.setCallback(mqttCallback);
+  mqttAttempts = 0;
+  mqttNextAttempt = millis();
+  mqttState = MQTT_STATE_BACKOFF;
+  return true;
 }
 
 // MQTT loop - call regularly
 inline void loopMQTT() {
   unsigned long now = millis();
   
-  if (!mqttClient.connected()) {
-    // Connection lost - try to send offline status if we were previously connected
-    if (mqttConnected) {
-      // Try to send offline status before connection is fully lost
-      // Note: This might not always succeed if connection is already broken
-      DBG_PRINTLN("MQTT connection lost, attempting to send offline status");
-      if (mqttTopicsInitialized) {
-        // Try to publish offline status directly (might fail if connection is broken)
-        char statusTopic[96];
-        snprintf(statusTopic, sizeof(statusTopic), "tele/%s/status", baseTopic);
-        mqttClient.publish(statusTopic, "offline", true); // retain = true
+  if (mqttState >= MQTT_STATE_DISCOVERY && !mqttClient.connected()) {
+    DBG_PRINTLN("MQTT connection lost");
+    mqttConnected = false;
+    scheduleMQTTReconnect(now);
+  }
+  
+  switch (mqttState) {
+    case MQTT_STATE_IDLE:
+      if (config.mqttHost[0] != '\0' && WiFi.status() == WL_CONNECTED) {
+        mqttNextAttempt = now;
+        mqttState = MQTT_STATE_BACKOFF;
       }
-      mqttConnected = false;
-    }
+      break;
     
-    // Try to reconnect
-    if (now - lastMQTTReconnect >= MQTT_RECONNECT_INTERVAL) {
-      lastMQTTReconnect = now;
-      if (WiFi.status() == WL_CONNECTED) {
-        connectMQTT();
+    case MQTT_STATE_BACKOFF:
+      if (WiFi.status() != WL_CONNECTED) {
+        mqttState = MQTT_STATE_IDLE;
+      } else if ((long)(now - mqttNextAttempt) >= 0) {
+        DBG_PRINT("Connecting to MQTT broker ");
+        DBG_PRINT(config.mqttHost);
+        DBG_PRINT(":");
+        DBG_PRINTLN(config.mqttPort);
+        mqttResolver.start(config.mqttHost);
+        mqttStepSince = now;
+        mqttState = MQTT_STATE_RESOLVE;
       }
+      break;
+    
+    case MQTT_STATE_RESOLVE: {
+      IPAddress ip;
+      NetPoll r = mqttResolver.poll(ip);
+      if (r == NET_DONE) {
+        if (mqttConnector.start(ip, config.mqttPort)) {
+          mqttStepSince = now;
+          mqttState = MQTT_STATE_TCP_CONNECT;
+        } else {
+          failMQTTAttempt("MQTT TCP connect failed", now);
+        }
+      } else if (r == NET_FAILED || now - mqttStepSince >= MQTT_DNS_TIMEOUT) {
+        failMQTTAttempt("MQTT host lookup failed", now);
+      }
+      break;
     }
-  } else {
-    if (!mqttConnected) {
-      // Just reconnected, reset discovery and send pending data
-      discoveryPublished = false;
-      publishDiscovery();
-      
-      // Send pending data if available
-      if (pendingDataSend) {
-        DBG_PRINTLN("Sending pending sensor data after reconnection");
-        publishSensorData(lastPM25, lastTemp, lastHumidity, lastPressure, 
-                         lastAQI, lastAQICategory, lastDewPoint, lastComfortIndex, lastUptime);
+    
+    case MQTT_STATE_TCP_CONNECT: {
+      NetPoll r = mqttConnector.poll(wifiClient);
+      if (r == NET_DONE) {
+        mqttState = MQTT_STATE_SESSION;
+      } else if (r == NET_FAILED || now - mqttStepSince >= MQTT_TCP_TIMEOUT) {
+        failMQTTAttempt("MQTT TCP connect failed", now);
       }
-      
-      // Reset heartbeat timer on reconnect
-      lastStatusHeartbeat = now;
+      break;
     }
-    mqttConnected = true;
-    mqttClient.loop();
     
-    // Send periodic "online" heartbeat
-    if (now - lastStatusHeartbeat >= STATUS_HEARTBEAT_INTERVAL) {
-      lastStatusHeartbeat = now;
-      publishAvailability(true);
+    case MQTT_STATE_SESSION:
+      if (startMQTTSession()) {
+        mqttStepSince = now;
+        mqttState = MQTT_STATE_CONNACK;
+      } else {
+        failMQTTAttempt("MQTT CONNECT failed", now);
+      }
+      break;
+    
+    case MQTT_STATE_CONNACK: {
+      uint8_t rc = 0;
+      NetPoll r = mqttTransport.pollConnack(rc);
+      if (r == NET_DONE && rc == 0) {
+        finishMQTTSession();
+        // Check which discovery configs the broker already has; the missing
+        // ones are published once the check window is over
+        startDiscovery();
+        mqttState = MQTT_STATE_DISCOVERY;
+      } else if (r == NET_DONE) {
+        DBG_PRINTF("MQTT connection refused, rc=%u\n", rc);
+        failMQTTAttempt("MQTT CONNACK refused", now);
+      } else if (r == NET_FAILED || now - mqttStepSince >= MQTT_CONNACK_TIMEOUT) {
+        failMQTTAttempt("MQTT CONNACK timeout", now);
+      }
+      break;
     }
+    
+    case MQTT_STATE_DISCOVERY:
+      mqttClient.loop();
+      if (discoveryChecking && now - discoveryCheckStart >= DISCOVERY_CHECK_WINDOW) {
+        publishDiscovery();
+      }
+      if (discoveryPublished) {
+        // Send the sample that could not be published while offline; older
+        // ones follow from the journal
+        if (pendingDataSend) {
+          DBG_PRINTLN("Sending pending sensor data after reconnection");
+          publishSensorData(sampleStore.latest());
+        }
+        mqttAttempts = 0;
+        mqttState = MQTT_STATE_ONLINE;
+      }
+      break;
+    
+    case MQTT_STATE_ONLINE:
+      mqttClient.loop();
+      drainJournal(now);
+      
+      // Send periodic "online" heartbeat
+      if (now - lastStatusHeartbeat >= STATUS_HEARTBEAT_INTERVAL) {
+        lastStatusHeartbeat = now;
+        publishAvailability(true);
+      }
+      break;
   }
-}
\ No newline at end of file
+}
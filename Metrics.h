@@ -0,0 +1,119 @@
+#pragma once
+#include <Arduino.h>
+#include "HAL.h"
+
+// Run-time instrumentation that stays enabled in production builds.
+//
+// Durations are taken from the CPU cycle counter and sorted into fixed
+// log2 buckets, so recording is a subtraction, a count-leading-zeros and
+// three additions. Bucket i holds durations below 4 << i µs; the last
+// bucket takes everything slower (about 65 ms and up).
+
+constexpr uint8_t LATENCY_BUCKETS = 16;
+
+struct LatencyHistogram {
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint32_t count;
+  uint64_t sumCycles;
+  uint32_t maxCycles;
+
+  void record(uint32_t cycles) {
+    uint32_t us = cycles / cpuCyclesPerUs();
+    uint8_t b = us < 4 ? 0 : 30 - __builtin_clz(us); // log2(us) - 1
+    if (b >= LATENCY_BUCKETS) {
+      b = LATENCY_BUCKETS - 1;
+    }
+    buckets[b]++;
+    count++;
+    sumCycles += cycles;
+    if (cycles > maxCycles) {
+      maxCycles = cycles;
+    }
+  }
+
+  // Upper bound of bucket i in µs, 0 for the open-ended last bucket
+  static uint32_t bucketLimitUs(uint8_t i) {
+    return i + 1 < LATENCY_BUCKETS ? 4UL << i : 0;
+  }
+
+  uint32_t maxUs() const { return maxCycles / cpuCyclesPerUs(); }
+  uint32_t avgUs() const { return count ? (uint32_t)(sumCycles / count / cpuCyclesPerUs()) : 0; }
+};
+
+// Records the lifetime of the timer into a histogram
+class MetricTimer {
+public:
+  explicit MetricTimer(LatencyHistogram &h) : _h(h), _start(cpuCycles()) {}
+  ~MetricTimer() { _h.record(cpuCycles() - _start); }
+
+private:
+  LatencyHistogram &_h;
+  uint32_t _start;
+};
+
+// Timings below the scheduler's task level and event counters that have no
+// other owner. Counters kept by their modules (parser, journal, SSE,
+// scheduler) are read from there when exporting.
+struct Metrics {
+  LatencyHistogram readLatency;     // readMeasurements()
+  LatencyHistogram publishLatency;  // MQTT and HTTP uplink of one sample
+
+  uint32_t mqttPublishes;
+  uint32_t mqttPublishFailures;
+  uint32_t mqttConnects;
+  uint32_t mqttConnectFailures;
+  uint32_t uplinkPosts;
+  uint32_t uplinkFailures;
+  uint32_t wifiFastConnects;          // associations on the cached BSSID and channel
+  uint32_t wifiFastConnectFallbacks;  // cached AP did not answer, full scan instead
+  uint32_t pmUartOverflows;           // Vindriktning bytes lost in a full receive buffer
+
+  // Milliseconds since boot, 0 until it happened
+  uint32_t wifiConnectMs;             // first WiFi association
+  uint32_t firstPublishMs;            // first sample published on MQTT
+
+  // Radio duty cycle, see PowerSave.h
+  uint32_t radioOnMs;
+  uint32_t radioWakeups;
+
+  // Lowest values seen by updateHeapMetrics(), 0 until the first update
+  uint32_t heapFreeMin;
+  uint32_t heapMaxBlockMin;
+};
+
+constexpr unsigned long HEAP_SAMPLE_INTERVAL = 1000;
+
+// Rough supply current of a Wemos D1 mini with the station associated
+// (MQTT keepalives, default modem sleep between DTIM beacons) and with the
+// modem switched off while the CPU keeps sampling. Sensors not included.
+#ifndef POWER_RADIO_ON_UA
+#define POWER_RADIO_ON_UA 70000
+#endif
+
+#ifndef POWER_RADIO_OFF_UA
+#define POWER_RADIO_OFF_UA 16000
+#endif
+
+// Average current over uptimeMs from the radio-on share
+inline uint32_t modeledCurrentUa(const Metrics &m, uint32_t uptimeMs) {
+  if (uptimeMs == 0) {
+    return POWER_RADIO_ON_UA;
+  }
+  uint32_t onMs = m.radioOnMs < uptimeMs ? m.radioOnMs : uptimeMs;
+  uint64_t charge = (uint64_t)onMs * POWER_RADIO_ON_UA + (uint64_t)(uptimeMs - onMs) * POWER_RADIO_OFF_UA;
+  return (uint32_t)(charge / uptimeMs);
+}
+
+// Scheduler task: track the heap low-water marks
+inline void updateHeapMetrics(Metrics &m) {
+  uint32_t freeHeap = heapFree();
+  uint32_t maxBlock = heapMaxBlock();
+  if (m.heapFreeMin == 0 || freeHeap < m.heapFreeMin) {
+    m.heapFreeMin = freeHeap;
+  }
+  if (m.heapMaxBlockMin == 0 || maxBlock < m.heapMaxBlockMin) {
+    m.heapMaxBlockMin = maxBlock;
+  }
+}
+
+extern Metrics metrics;
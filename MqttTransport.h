@@ -0,0 +1,79 @@
+#pragma once
+#include <Arduino.h>
+#include "HAL.h"
+
+// Client between PubSubClient and the broker socket that keeps connect()
+// from blocking.
+//
+// PubSubClient::connect() sends CONNECT and then spins until CONNACK
+// arrives or the socket timeout expires. After expectConnack() this
+// transport answers that wait at once with a placeholder CONNACK
+// (accepted), so connect() returns right after sending. The broker's real
+// CONNACK stays in the socket and is read by pollConnack() on later
+// passes; until it has arrived the session must not be treated as up.
+// MQTT 3.1.1 allows a client to send before CONNACK, so nothing that
+// PubSubClient does meanwhile is out of protocol.
+//
+// Everything else is passed through to the socket unchanged.
+
+constexpr uint8_t MQTT_CONNACK = 0x20;
+constexpr uint8_t MQTT_CONNACK_SIZE = 4;
+
+class MqttTransport : public Client {
+public:
+  explicit MqttTransport(NetClient &net) : _net(net) {}
+
+  // Answer the next CONNACK wait with the placeholder
+  void expectConnack() { _placeholder = MQTT_CONNACK_SIZE; }
+
+  // The broker's CONNACK: NET_DONE with its return code in rc (0 is
+  // accepted), NET_FAILED if the connection closed or sent something else
+  NetPoll pollConnack(uint8_t &rc) {
+    if (_net.available() < MQTT_CONNACK_SIZE) {
+      return _net.connected() ? NET_PENDING : NET_FAILED;
+    }
+    uint8_t packet[MQTT_CONNACK_SIZE];
+    if (_net.read(packet, sizeof(packet)) != MQTT_CONNACK_SIZE || packet[0] != MQTT_CONNACK || packet[1] != 2) {
+      return NET_FAILED;
+    }
+    rc = packet[3];
+    return NET_DONE;
+  }
+
+  int connect(IPAddress ip, uint16_t port) override { return _net.connect(ip, port); }
+  int connect(const char* host, uint16_t port) override { return _net.connect(host, port); }
+  size_t write(uint8_t b) override { return _net.write(b); }
+  size_t write(const uint8_t* buf, size_t size) override { return _net.write(buf, size); }
+  int available() override { return _placeholder ? _placeholder : _net.available(); }
+  int read() override {
+    if (_placeholder) {
+      return PLACEHOLDER[MQTT_CONNACK_SIZE - _placeholder--];
+    }
+    return _net.read();
+  }
+  int read(uint8_t* buf, size_t size) override {
+    size_t n = 0;
+    while (_placeholder && n < size) {
+      buf[n++] = read();
+    }
+    if (n == size) {
+      return n;
+    }
+    int r = _net.read(buf + n, size - n);
+    return r > 0 ? (int)n + r : (n ? (int)n : r);
+  }
+  int peek() override { return _placeholder ? PLACEHOLDER[MQTT_CONNACK_SIZE - _placeholder] : _net.peek(); }
+  void flush() override { _net.flush(); }
+  void stop() override {
+    _placeholder = 0;
+    _net.stop();
+  }
+  uint8_t connected() override { return _net.connected(); }
+  operator bool() override { return _net.connected(); }
+
+private:
+  static constexpr uint8_t PLACEHOLDER[MQTT_CONNACK_SIZE] = {MQTT_CONNACK, 2, 0, 0};
+
+  NetClient &_net;
+  uint8_t _placeholder = 0;  // placeholder bytes left to hand out
+};
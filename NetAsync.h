@@ -0,0 +1,151 @@
+#pragma once
+#include <ESP8266WiFi.h>
+#include <lwip/dns.h>
+#include <lwip/tcp.h>
+#include <include/ClientContext.h>
+
+// Non-blocking DNS lookups and TCP connects on the lwIP raw API.
+//
+// WiFi.hostByName() and WiFiClient::connect() wait inside the call until
+// the answer arrives or their timeout expires, which stalls every other
+// task for that long. Here the request is started and lwIP reports back
+// through a callback; the caller polls for the result and applies its own
+// timeout. Included by HAL.h for the ESP8266 build only, host builds get
+// the same classes from their driver header.
+
+// One lookup at a time. The name must stay valid until poll() returns a
+// result.
+class HostResolver {
+public:
+  void start(const char* name) {
+    _name = name;
+    _done = false;
+    _ok = false;
+    if (_ip.fromString(name)) {
+      _done = _ok = true;
+      return;
+    }
+    ip_addr_t addr;
+    err_t err = dns_gethostbyname(name, &addr, &HostResolver::found, this);
+    if (err == ERR_OK) {
+      _ip = IPAddress(&addr);
+      _done = _ok = true;
+    } else if (err != ERR_INPROGRESS) {
+      _done = true;
+    }
+  }
+
+  NetPoll poll(IPAddress &ip) {
+    if (!_done) {
+      return NET_PENDING;
+    }
+    if (!_ok) {
+      return NET_FAILED;
+    }
+    ip = _ip;
+    return NET_DONE;
+  }
+
+private:
+  static void found(const char* name, const ip_addr_t* addr, void* arg) {
+    HostResolver* self = static_cast<HostResolver*>(arg);
+    // Answer to a lookup that was given up and replaced
+    if (self->_done || !self->_name || strcmp(name, self->_name) != 0) {
+      return;
+    }
+    if (addr) {
+      self->_ip = IPAddress(addr);
+      self->_ok = true;
+    }
+    self->_done = true;
+  }
+
+  const char* _name = nullptr;
+  IPAddress _ip;
+  volatile bool _done = true;
+  volatile bool _ok = false;
+};
+
+// One connect at a time. Once the handshake completes the connection is
+// wrapped in the same ClientContext WiFiClient uses, so everything after
+// poll() works on an ordinary WiFiClient.
+class TcpConnector {
+public:
+  ~TcpConnector() { cancel(); }
+
+  bool start(IPAddress ip, uint16_t port) {
+    cancel();
+    _pcb = tcp_new();
+    if (!_pcb) {
+      _state = NET_FAILED;
+      return false;
+    }
+    _state = NET_PENDING;
+    tcp_arg(_pcb, this);
+    tcp_err(_pcb, &TcpConnector::onError);
+    ip_addr_t addr = ip;
+    if (tcp_connect(_pcb, &addr, port, &TcpConnector::onConnected) != ERR_OK) {
+      tcp_abort(_pcb);
+      _pcb = nullptr;
+      _state = NET_FAILED;
+      return false;
+    }
+    return true;
+  }
+
+  // NET_DONE once client holds the new connection
+  NetPoll poll(NetClient &client) {
+    if (_state != NET_DONE || !_ctx) {
+      return _state;
+    }
+    client = Connected(_ctx);
+    _ctx->unref();
+    _ctx = nullptr;
+    _state = NET_FAILED; // nothing in progress any more
+    return NET_DONE;
+  }
+
+  // Give up a connect that is still in progress
+  void cancel() {
+    if (_ctx) {
+      _ctx->unref();
+      _ctx = nullptr;
+    }
+    if (_pcb) {
+      tcp_arg(_pcb, nullptr);
+      tcp_err(_pcb, nullptr);
+      tcp_abort(_pcb);
+      _pcb = nullptr;
+    }
+    _state = NET_FAILED;
+  }
+
+private:
+  // WiFiClient's constructor from a ClientContext is protected
+  class Connected : public WiFiClient {
+  public:
+    explicit Connected(ClientContext* ctx) : WiFiClient(ctx) {}
+  };
+
+  static err_t onConnected(void* arg, tcp_pcb* pcb, err_t err) {
+    TcpConnector* self = static_cast<TcpConnector*>(arg);
+    // Take the connection over right away so nothing the peer sends before
+    // the next poll() is lost; ClientContext installs its own callbacks
+    self->_pcb = nullptr;
+    self->_ctx = new ClientContext(pcb, nullptr, nullptr);
+    self->_ctx->ref();
+    self->_state = NET_DONE;
+    return ERR_OK;
+  }
+
+  static void onError(void* arg, err_t err) {
+    // lwIP has already freed the pcb
+    TcpConnector* self = static_cast<TcpConnector*>(arg);
+    self->_pcb = nullptr;
+    self->_state = NET_FAILED;
+  }
+
+  tcp_pcb* _pcb = nullptr;
+  ClientContext* _ctx = nullptr;
+  volatile NetPoll _state = NET_FAILED;
+};
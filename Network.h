@@ -0,0 +1,178 @@
+#pragma once
+#include <ArduinoOTA.h>
+#include "HAL.h"
+#include "Config.h"
+#include "WebServer.h"
+#include "MQTTManager.h"
+#include "Diagnostics.h"
+#include "WiFiLease.h"
+
+extern DeviceConfig config;
+extern Metrics metrics;
+
+// WiFi association as a state machine polled by the scheduler, so setup()
+// and loop() never wait for the access point
+
+constexpr unsigned long WIFI_CONNECT_TIMEOUT = 20000;
+constexpr unsigned long WIFI_FAST_CONNECT_TIMEOUT = 3000; // then scan instead
+constexpr unsigned long WIFI_POLL_INTERVAL = 250;
+
+enum WiFiState : uint8_t {
+  WIFI_STATE_IDLE,
+  WIFI_STATE_CONNECTING,
+  WIFI_STATE_CONNECTED,
+  WIFI_STATE_AP,
+  WIFI_STATE_OFF     // radio switched off by PowerSave.h
+};
+
+extern WiFiState wifiState;
+extern unsigned long wifiStateSince;
+extern bool networkServicesStarted;
+extern bool wifiFastConnect;  // station is pinned to the cached BSSID and channel
+
+inline void setupOTA() {
+  ArduinoOTA.setHostname(config.hostname);
+  ArduinoOTA.setPassword(DEFAULT_OTA_PASSWORD);
+  
+  ArduinoOTA.onStart([]() {
+    DBG_PRINTLN("OTA Start");
+    journal.flush();  // the update ends in a restart
+  });
+  ArduinoOTA.onEnd([]() {
+    DBG_PRINTLN("\nOTA End");
+  });
+  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
+    DBG_PRINTF("Progress: %u%%\r", (progress / (total / 100)));
+  });
+  ArduinoOTA.onError([](ota_error_t error) {
+    DBG_PRINTF("Error[%u]: ", error);
+    if (error == OTA_AUTH_ERROR) {
+      DBG_PRINTLN("Auth Failed");
+    } else if (error == OTA_BEGIN_ERROR) {
+      DBG_PRINTLN("Begin Failed");
+    } else if (error == OTA_CONNECT_ERROR) {
+      DBG_PRINTLN("Connect Failed");
+    } else if (error == OTA_RECEIVE_ERROR) {
+      DBG_PRINTLN("Receive Failed");
+    } else if (error == OTA_END_ERROR) {
+      DBG_PRINTLN("End Failed");
+    }
+  });
+  
+  ArduinoOTA.begin();
+  DBG_PRINTLN("OTA ready");
+}
+
+inline void setWiFiState(WiFiState state) {
+  wifiState = state;
+  wifiStateSince = millis();
+}
+
+// Associate the slow way: scan all channels, then DHCP
+inline void beginWiFiScan() {
+  if (wifiFastConnect && config.wifiReuseIp) {
+    WiFi.config(IPAddress(), IPAddress(), IPAddress()); // back to DHCP
+  }
+  wifiFastConnect = false;
+  DBG_PRINT("Connecting to ");
+  DBG_PRINTLN(config.ssid);
+  WiFi.begin(config.ssid, config.password);
+}
+
+// Start associating with the configured network, or open the setup AP if
+// there is none. With a lease from the last association the scan is
+// skipped, and with wifiReuseIp DHCP as well.
+inline void beginWiFi() {
+  if (config.ssid[0] == '\0') {
+    DBG_PRINTLN("No WiFi configured, starting AP");
+    startAP();
+    setWiFiState(WIFI_STATE_AP);
+    return;
+  }
+  WiFi.mode(WIFI_STA);
+  WiFi.hostname(config.hostname);
+  WiFiLease lease;
+  if (loadWiFiLease(lease, wifiNetworkHash(config.ssid, config.password))) {
+    if (config.wifiReuseIp && lease.ip != 0) {
+      WiFi.config(IPAddress(lease.ip), IPAddress(lease.gateway), IPAddress(lease.subnet), IPAddress(lease.dns));
+    }
+    DBG_PRINTF("Connecting to %s on channel %u (cached)\n", config.ssid, lease.channel);
+    WiFi.begin(config.ssid, config.password, lease.channel, lease.bssid);
+    wifiFastConnect = true;
+  } else {
+    beginWiFiScan();
+  }
+  setWiFiState(WIFI_STATE_CONNECTING);
+}
+
+// Cache the association that just came up for the next boot
+inline void rememberWiFiLease() {
+  WiFiLease lease;
+  memset(&lease, 0, sizeof(lease));
+  lease.network = wifiNetworkHash(config.ssid, config.password);
+  memcpy(lease.bssid, WiFi.BSSID(), sizeof(lease.bssid));
+  lease.channel = WiFi.channel();
+  lease.ip = WiFi.localIP();
+  lease.gateway = WiFi.gatewayIP();
+  lease.subnet = WiFi.subnetMask();
+  lease.dns = WiFi.dnsIP();
+  storeWiFiLease(lease);
+}
+
+// Scheduler task
+inline void loopWiFi(uint32_t now) {
+  switch (wifiState) {
+    case WIFI_STATE_CONNECTING:
+      if (WiFi.status() == WL_CONNECTED) {
+        DBG_PRINT("Connected, IP: ");
+        DBG_PRINTLN(WiFi.localIP());
+        setWiFiState(WIFI_STATE_CONNECTED);
+        if (metrics.wifiConnectMs == 0) {
+          metrics.wifiConnectMs = millis();
+          if (wifiFastConnect) {
+            metrics.wifiFastConnects++;
+          }
+        }
+        rememberWiFiLease();
+        if (!networkServicesStarted) {
+          // Wall-clock time for journaled samples
+          configTime(0, 0, "pool.ntp.org");
+          setupWeb();
+          setupDiagnostics();
+          initMQTT();
+          setupOTA();
+          networkServicesStarted = true;
+        }
+      } else if (wifiFastConnect &&
+                 now - wifiStateSince >= (networkServicesStarted ? WIFI_CONNECT_TIMEOUT : WIFI_FAST_CONNECT_TIMEOUT)) {
+        // The cached AP is gone or moved to another channel. The SDK would
+        // keep retrying that BSSID, so forget it and scan.
+        DBG_PRINTLN("Cached access point not reachable, scanning");
+        metrics.wifiFastConnectFallbacks++;
+        clearWiFiLease();
+        beginWiFiScan();
+        setWiFiState(WIFI_STATE_CONNECTING);
+      } else if (!networkServicesStarted && now - wifiStateSince >= WIFI_CONNECT_TIMEOUT) {
+        // Never connected since boot: fall back to the setup AP
+        DBG_PRINTLN("WiFi not reachable, starting AP");
+        startAP();
+        setWiFiState(WIFI_STATE_AP);
+      }
+      break;
+    case WIFI_STATE_CONNECTED:
+      if (WiFi.status() != WL_CONNECTED) {
+        // The SDK reconnects on its own, just track it
+        DBG_PRINTLN("WiFi connection lost");
+        setWiFiState(WIFI_STATE_CONNECTING);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+inline void handleOTA(uint32_t now) {
+  if (networkServicesStarted && WiFi.status() == WL_CONNECTED) {
+    ArduinoOTA.handle();
+  }
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <Arduino.h>
+#include "HAL.h"
+#include "Config.h"
+#include "Journal.h"
+#include "RtcBuffer.h"
+#include "Metrics.h"
+#include "MQTTManager.h"
+#include "Network.h"
+#include "Uplink.h"
+
+// Duty-cycle mode for battery operation (config.powerSave).
+//
+// The sensors keep sampling every sendInterval, but while the radio is off
+// samples are collected in RTC memory instead of being published. Every
+// uplinkPeriod minutes, or as soon as the buffer is full, WiFi is switched
+// back on (fast reconnect, see WiFiLease.h), the buffer goes out on the
+// backlog topic and the latest sample on the state topic, and the radio is
+// switched off again. The buffer holds RTC_SAMPLE_CAPACITY samples, so the
+// radio comes on at least every 41 sample intervals, see
+// powerSaveWakeInterval().
+//
+// The CPU stays awake in modem sleep: the Vindriktning streams its frames
+// over UART and deep sleep would miss them. RTC memory still keeps the
+// buffer across a watchdog reset or a restart; restoreRtcSamples() moves it
+// into the journal on the next boot.
+
+constexpr unsigned long POWER_POLL_INTERVAL = 100;
+constexpr unsigned long POWER_AWAKE_MAX = 60000; // give up on a burst after this
+
+extern RtcSampleBuffer rtcSamples;
+extern unsigned long radioWakeSince;
+extern unsigned long lastRtcBatch;
+extern bool firstSampleDue;
+
+inline bool powerSaveActive() {
+  return config.powerSave && wifiState != WIFI_STATE_AP;
+}
+
+// Time between uplink bursts: uplinkPeriod, or the time the RTC buffer
+// takes to fill if that is shorter
+inline uint32_t powerSaveWakeInterval() {
+  uint32_t fullMs = RTC_SAMPLE_CAPACITY * config.sendInterval;
+  uint32_t periodMs = config.uplinkPeriod * 60000UL;
+  return fullMs < periodMs ? fullMs : periodMs;
+}
+
+// Keep a sample for the next burst; journal it once RTC memory is full
+inline void bufferSample(const Sample &s) {
+  if (!rtcSamples.append(s)) {
+    journal.append(s);
+    rtcSamples.spilled++;
+  }
+  pendingDataSend = true; // latest sample goes to the state topic on reconnect
+}
+
+// Hand samples from before a reset to the journal. Call after journal.begin().
+inline void restoreRtcSamples() {
+  if (!rtcSamples.begin()) {
+    return;
+  }
+  JournalRecord records[JOURNAL_BATCH_RECORDS];
+  size_t n;
+  while ((n = rtcSamples.peek(records, JOURNAL_BATCH_RECORDS)) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      journal.appendRecord(records[i]);
+    }
+    rtcSamples.consume(n);
+  }
+  journal.flush();
+  DBG_PRINTLN("Buffered samples from before the restart moved to the journal");
+}
+
+inline void sleepRadio() {
+  DBG_PRINTLN("Radio off");
+  mqttClient.disconnect();
+  mqttConnected = false;
+  mqttState = MQTT_STATE_IDLE;
+  WiFi.mode(WIFI_OFF);
+  WiFi.forceSleepBegin();
+  delay(1); // the modem only turns off once the SDK gets to run
+  setWiFiState(WIFI_STATE_OFF);
+}
+
+inline void wakeRadio(uint32_t now) {
+  DBG_PRINTLN("Radio on for uplink burst");
+  WiFi.forceSleepWake();
+  delay(1);
+  metrics.radioWakeups++;
+  radioWakeSince = now;
+  beginWiFi();
+}
+
+// Send one batch of buffered samples on the backlog topic
+inline void sendRtcBacklog(uint32_t now) {
+  if (now - lastRtcBatch < JOURNAL_BATCH_INTERVAL) {
+    return;
+  }
+  lastRtcBatch = now;
+  JournalRecord records[JOURNAL_BATCH_RECORDS];
+  size_t n = rtcSamples.peek(records, JOURNAL_BATCH_RECORDS);
+  size_t packed = publishBacklog(records, n);
+  if (packed > 0) {
+    rtcSamples.consume(packed);
+    DBG_PRINT("Sent ");
+    DBG_PRINT(packed);
+    DBG_PRINTLN(" buffered samples");
+  }
+}
+
+// Scheduler task: radio-on accounting, and in power save mode the
+// sleep/wake cycle
+inline void loopPower(uint32_t now) {
+  static uint32_t lastPass = now;
+  if (wifiState != WIFI_STATE_OFF) {
+    metrics.radioOnMs += now - lastPass;
+  }
+  lastPass = now;
+
+  if (!powerSaveActive()) {
+    return;
+  }
+  if (wifiState == WIFI_STATE_OFF) {
+    if (rtcSamples.full() || now - wifiStateSince >= config.uplinkPeriod * 60000UL) {
+      wakeRadio(now);
+    }
+    return;
+  }
+  if (mqttState == MQTT_STATE_ONLINE) {
+    if (!rtcSamples.empty()) {
+      sendRtcBacklog(now);
+      return;
+    }
+    // Stay up for the first sample after boot, until the journal is
+    // replayed and until the HTTP uplink has sent the latest sample
+    if (!firstSampleDue && journal.empty() && uplink.idle()) {
+      sleepRadio();
+      return;
+    }
+  }
+  if (now - radioWakeSince >= POWER_AWAKE_MAX) {
+    DBG_PRINTLN("Uplink burst timed out");
+    sleepRadio();
+  }
+}
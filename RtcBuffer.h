@@ -0,0 +1,213 @@
+#pragma once
+#include <Arduino.h>
+#include <time.h>
+#include "HAL.h"
+#include "Crc.h"
+#include "SampleStore.h"
+#include "Journal.h"
+
+// Sample buffer in RTC memory for the duty-cycle mode (PowerSave.h).
+//
+// Samples are packed into 8-byte records, each timed relative to the one
+// before, so the 348 bytes after the WiFi lease hold RTC_SAMPLE_CAPACITY
+// (41) of them: 6.8 minutes at the default 10 s interval. Every append
+// writes the record and the header with a CRC over the whole buffer.
+// RTC memory survives resets but not a power loss; the CRC tells the two
+// apart. Samples are read back as JournalRecords, ready for the backlog
+// topic or the journal.
+
+constexpr uint16_t RTC_SAMPLES_MAGIC = 0x5053; // "SP", packed samples
+
+// RtcSample bit fields, low to high
+constexpr uint8_t RTC_DELTA_BITS = 12;     // s after the previous sample (the first: 0)
+constexpr uint8_t RTC_PM_BITS = 10;        // µg/m³, the Vindriktning reports up to 1000
+constexpr uint8_t RTC_TEMP_BITS = 14;      // 0.01 °C above RTC_TEMP_MIN
+constexpr uint8_t RTC_HUMIDITY_BITS = 14;  // 0.01 %
+constexpr uint8_t RTC_PRESSURE_BITS = 14;  // 10 Pa, 0 if the environment values are not valid
+static_assert(RTC_DELTA_BITS + RTC_PM_BITS + RTC_TEMP_BITS + RTC_HUMIDITY_BITS + RTC_PRESSURE_BITS == 64,
+              "RtcSample is 64 bits");
+constexpr uint16_t RTC_PM_INVALID = (1 << RTC_PM_BITS) - 1;
+constexpr int16_t RTC_TEMP_MIN = -4000;    // -40 °C, up to 123.83 °C
+
+// Two words rather than a uint64_t, which the Xtensa ABI aligns to 8 bytes
+struct RtcSample {
+  uint32_t low;
+  uint32_t high;
+};
+
+struct RtcSampleHeader {
+  uint16_t magic;
+  uint16_t count;
+  uint32_t baseUptime;   // uptime of the first sample
+  uint32_t baseEpoch;    // epoch time of the first sample, 0 without NTP
+  uint32_t crc;          // CRC-32 of the header before it and the samples
+};
+
+constexpr size_t RTC_SAMPLE_CAPACITY =
+  ((RTC_BLOCKS - RTC_BLOCK_SAMPLES) * 4 - sizeof(RtcSampleHeader)) / sizeof(RtcSample);
+
+class RtcSampleBuffer {
+public:
+  // Pick up the samples left in RTC memory by the previous boot. Returns
+  // false and starts empty if there are none.
+  bool begin() {
+    _sent = 0;
+    if (rtcRead(RTC_BLOCK_SAMPLES, &_image, sizeof(_image)) &&
+        _image.header.magic == RTC_SAMPLES_MAGIC && _image.header.count <= RTC_SAMPLE_CAPACITY &&
+        _image.header.crc == imageCrc()) {
+      if (_image.header.count == 0) {
+        return false;
+      }
+      _lastUptime = uptimeOf(_image.header.count - 1);
+      return true;
+    }
+    clear();
+    return false;
+  }
+
+  // False if the buffer is full or the sample is too far from the last one
+  bool append(const Sample &s) {
+    RtcSampleHeader &h = _image.header;
+    if (h.count == 0) {
+      h.baseUptime = s.uptime;
+      _lastUptime = s.uptime;
+      time_t now = time(nullptr);
+      h.baseEpoch = now >= JOURNAL_MIN_EPOCH ? (uint32_t)now : 0;
+    } else if (h.count >= RTC_SAMPLE_CAPACITY || s.uptime < _lastUptime ||
+               s.uptime - _lastUptime >= (1UL << RTC_DELTA_BITS)) {
+      return false;
+    }
+    uint64_t pm = !s.pmValid() ? RTC_PM_INVALID : s.pm25 < RTC_PM_INVALID ? s.pm25 : RTC_PM_INVALID - 1;
+    uint64_t temperature = 0;
+    uint64_t humidity = 0;
+    uint64_t pressure = 0;
+    if (s.envValid()) {
+      temperature = packField(lroundf(s.temperature * 100.0f) - RTC_TEMP_MIN, RTC_TEMP_BITS);
+      humidity = packField(lroundf(s.humidity * 100.0f), RTC_HUMIDITY_BITS);
+      // 0 marks a sample without environment values
+      pressure = packField(lroundf(s.pressure * 10.0f), RTC_PRESSURE_BITS);
+      pressure += pressure == 0;
+    }
+    uint64_t v = (s.uptime - _lastUptime) | pm << RTC_DELTA_BITS |
+                 temperature << (RTC_DELTA_BITS + RTC_PM_BITS) |
+                 humidity << (RTC_DELTA_BITS + RTC_PM_BITS + RTC_TEMP_BITS) |
+                 pressure << (RTC_DELTA_BITS + RTC_PM_BITS + RTC_TEMP_BITS + RTC_HUMIDITY_BITS);
+    RtcSample &r = _image.samples[h.count];
+    r.low = (uint32_t)v;
+    r.high = (uint32_t)(v >> 32);
+    _lastUptime = s.uptime;
+    h.count++;
+    store(offsetof(Image, samples) + (h.count - 1) * sizeof(RtcSample), sizeof(RtcSample));
+    return true;
+  }
+
+  // Read up to max unsent samples as journal records without consuming them
+  size_t peek(JournalRecord* out, size_t max) const {
+    size_t n = 0;
+    uint32_t uptime = uptimeOf(_sent);
+    for (size_t i = _sent; i < _image.header.count && n < max; i++) {
+      if (i > _sent) {
+        uptime += unpackField(_image.samples[i], 0, RTC_DELTA_BITS);
+      }
+      toRecord(_image.samples[i], uptime, out[n++]);
+    }
+    return n;
+  }
+
+  // Mark n samples as sent; the buffer is emptied once all are
+  void consume(size_t n) {
+    _sent += n;
+    if (_sent >= _image.header.count) {
+      clear();
+    }
+  }
+
+  void clear() {
+    memset(&_image.header, 0, sizeof(_image.header));
+    _image.header.magic = RTC_SAMPLES_MAGIC;
+    _sent = 0;
+    store(0, 0);
+  }
+
+  size_t pending() const { return _image.header.count - _sent; }
+  bool empty() const { return pending() == 0; }
+  bool full() const { return _image.header.count >= RTC_SAMPLE_CAPACITY; }
+
+  uint32_t spilled = 0; // samples that did not fit and went to the journal
+
+private:
+  struct Image {
+    RtcSampleHeader header;
+    RtcSample samples[RTC_SAMPLE_CAPACITY];
+  };
+  static_assert(sizeof(Image) <= (RTC_BLOCKS - RTC_BLOCK_SAMPLES) * 4, "RTC sample buffer too large");
+  static_assert(sizeof(Image) % 4 == 0, "RTC memory is accessed in 4-byte blocks");
+
+  // Clamped to what fits in bits
+  static uint64_t packField(long value, uint8_t bits) {
+    long max = (1L << bits) - 1;
+    return value < 0 ? 0 : value > max ? max : value;
+  }
+
+  static uint32_t unpackField(const RtcSample &r, uint8_t shift, uint8_t bits) {
+    uint64_t v = (uint64_t)r.high << 32 | r.low;
+    return (v >> shift) & ((1UL << bits) - 1);
+  }
+
+  // Uptime of sample i, the deltas summed up
+  uint32_t uptimeOf(size_t i) const {
+    uint32_t uptime = _image.header.baseUptime;
+    for (size_t k = 1; k <= i && k < _image.header.count; k++) {
+      uptime += unpackField(_image.samples[k], 0, RTC_DELTA_BITS);
+    }
+    return uptime;
+  }
+
+  uint32_t imageCrc() const {
+    uint32_t crc = crc32(&_image.header, offsetof(RtcSampleHeader, crc));
+    return crc32Update(crc, reinterpret_cast<const uint8_t*>(_image.samples),
+                       _image.header.count * sizeof(RtcSample));
+  }
+
+  // Write the header and the blocks holding bytes [at, at + len) of the image
+  void store(size_t at, size_t len) {
+    _image.header.crc = imageCrc();
+    rtcWrite(RTC_BLOCK_SAMPLES, &_image.header, sizeof(_image.header));
+    if (len == 0) {
+      return;
+    }
+    size_t first = at / 4;
+    size_t last = (at + len + 3) / 4;
+    rtcWrite(RTC_BLOCK_SAMPLES + first, reinterpret_cast<const uint8_t*>(&_image) + first * 4,
+             (last - first) * 4);
+  }
+
+  void toRecord(const RtcSample &s, uint32_t uptime, JournalRecord &r) const {
+    constexpr uint8_t PM_SHIFT = RTC_DELTA_BITS;
+    constexpr uint8_t TEMP_SHIFT = PM_SHIFT + RTC_PM_BITS;
+    constexpr uint8_t HUMIDITY_SHIFT = TEMP_SHIFT + RTC_TEMP_BITS;
+    constexpr uint8_t PRESSURE_SHIFT = HUMIDITY_SHIFT + RTC_HUMIDITY_BITS;
+    memset(&r, 0, sizeof(r));
+    r.magic = JOURNAL_RECORD_MAGIC;
+    uint32_t pm = unpackField(s, PM_SHIFT, RTC_PM_BITS);
+    if (pm != RTC_PM_INVALID) {
+      r.valid |= SAMPLE_PM_VALID;
+      r.pm25 = pm;
+    }
+    uint32_t pressure = unpackField(s, PRESSURE_SHIFT, RTC_PRESSURE_BITS);
+    if (pressure != 0) {
+      r.valid |= SAMPLE_ENV_VALID;
+      r.temperature = (int16_t)(unpackField(s, TEMP_SHIFT, RTC_TEMP_BITS) + RTC_TEMP_MIN);
+      r.humidity = unpackField(s, HUMIDITY_SHIFT, RTC_HUMIDITY_BITS);
+      r.pressure = pressure * 10UL;
+    }
+    r.uptime = uptime;
+    uint32_t offset = uptime - _image.header.baseUptime;
+    r.epoch = _image.header.baseEpoch ? _image.header.baseEpoch + offset : 0;
+    r.crc = crc32(&r, offsetof(JournalRecord, crc));
+  }
+
+  Image _image;
+  size_t _sent = 0;
+  uint32_t _lastUptime = 0;
+};
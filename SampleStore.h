@@ -0,0 +1,86 @@
+#pragma once
+#include <Arduino.h>
+#include "Calculations.h"
+#include "Statistics.h"
+
+// Validity flags for Sample::valid
+constexpr uint8_t SAMPLE_PM_VALID = 0x01;  // pm25, aqi, aqiCategory
+constexpr uint8_t SAMPLE_ENV_VALID = 0x02; // temperature, humidity, pressure, dewPoint, comfortIndex
+
+// Every reading of each field since the previous sample (see SensorWindow)
+struct SampleStats {
+  FieldStats pm25;
+  FieldStats temperature;
+  FieldStats humidity;
+  FieldStats pressure;
+};
+
+// One acquisition cycle: raw readings, derived values and when the sources
+// were last read (millis())
+struct Sample {
+  uint32_t seq;
+  uint32_t uptime;  // seconds since boot at acquisition
+  uint8_t valid;
+
+  uint16_t pm25;
+  float temperature;
+  float humidity;
+  float pressure;
+  uint32_t pmTime;
+  uint32_t envTime;
+
+  uint16_t aqi;
+  uint8_t aqiCategory;
+  float dewPoint;
+  float comfortIndex;
+
+  SampleStats stats;
+
+  bool pmValid() const { return valid & SAMPLE_PM_VALID; }
+  bool envValid() const { return valid & SAMPLE_ENV_VALID; }
+  uint32_t pmAge(uint32_t now) const { return now - pmTime; }
+  uint32_t envAge(uint32_t now) const { return now - envTime; }
+};
+
+// Fill in AQI, dew point and comfort index from the raw readings
+inline void calculateDerived(Sample &s) {
+  if (s.pmValid()) {
+    s.aqi = calculatePM25AQI(s.pm25);
+    s.aqiCategory = getAQICategory(s.aqi);
+  }
+  if (s.envValid()) {
+    s.dewPoint = calculateDewPoint(s.temperature, s.humidity);
+    s.comfortIndex = calculateComfortIndex(s.temperature, s.humidity);
+  }
+}
+
+// Double-buffered snapshot of the latest sample. The acquisition path is the
+// only writer; the web server, MQTT and history only read latest(), so they
+// never trigger sensor I/O themselves.
+class SampleStore {
+public:
+  // Back buffer, pre-filled with the current snapshot
+  Sample& beginWrite() {
+    Sample &back = _buf[_front ^ 1];
+    back = _buf[_front];
+    back.valid = 0;
+    return back;
+  }
+
+  // Publish the back buffer as the new snapshot
+  void commit() {
+    Sample &back = _buf[_front ^ 1];
+    back.seq = _buf[_front].seq + 1;
+    if (back.seq == 0) {
+      back.seq = 1; // 0 means empty, skip it when the counter wraps
+    }
+    _front ^= 1;
+  }
+
+  const Sample& latest() const { return _buf[_front]; }
+  bool empty() const { return _buf[_front].seq == 0; }
+
+private:
+  Sample _buf[2] = {};
+  uint8_t _front = 0;
+};
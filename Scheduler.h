@@ -0,0 +1,135 @@
+#pragma once
+#include <Arduino.h>
+#include "Config.h"
+#include "Metrics.h"
+#include "AllocTrack.h"
+
+// Cooperative scheduler driven from loop().
+//
+// Periodic tasks run at a fixed rate: the next due time advances by the
+// period from the previous due time, not from when the task finished, so a
+// slow pass does not shift the schedule. If a task falls more than a whole
+// period behind, the missed runs are skipped (and counted) instead of being
+// replayed back to back. A period of 0 runs the task on every pass. One-shot
+// tasks run once after a delay and free their slot.
+//
+// Tasks must return quickly; anything that waits is written as a state
+// machine that is polled by its task.
+
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 14
+#endif
+
+#ifndef SCHEDULER_LOOP_BUDGET_US
+#define SCHEDULER_LOOP_BUDGET_US 50000 // longest acceptable loop() pass
+#endif
+
+typedef void (*TaskFn)(uint32_t now);
+
+struct SchedulerTask {
+  const char* name;
+  TaskFn fn;
+  uint32_t period;     // ms, 0 = every pass
+  uint32_t due;        // millis() of the next run
+  bool active;
+  bool oneShot;
+
+  // Runtime accounting
+  LatencyHistogram latency;
+  uint32_t skipped;    // periods missed because the loop was late
+};
+
+class Scheduler {
+public:
+  // Run fn every period ms, first after startDelay ms. Returns the task id
+  // or -1 if all slots are taken.
+  int8_t every(const char* name, TaskFn fn, uint32_t period, uint32_t startDelay = 0) {
+    return add(name, fn, period, startDelay, false);
+  }
+
+  // Run fn once, delay ms from now
+  int8_t once(const char* name, TaskFn fn, uint32_t delay) {
+    return add(name, fn, 0, delay, true);
+  }
+
+  // Change a periodic task's rate; the next run is one new period from now
+  void setPeriod(int8_t id, uint32_t period) {
+    if (id < 0 || id >= SCHEDULER_MAX_TASKS) {
+      return;
+    }
+    _tasks[id].period = period;
+    _tasks[id].due = millis() + period;
+  }
+
+  void run() {
+    uint32_t passStart = cpuCycles();
+    uint32_t passAllocs = allocCount();
+    for (uint8_t i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+      SchedulerTask &t = _tasks[i];
+      if (!t.active) {
+        continue;
+      }
+      uint32_t now = millis();
+      if ((int32_t)(now - t.due) < 0) {
+        continue;
+      }
+      if (t.oneShot) {
+        t.active = false;
+      } else if (t.period > 0) {
+        t.due += t.period;
+        if ((int32_t)(now - t.due) >= 0) {
+          // More than a period behind: keep the phase, drop the backlog
+          uint32_t missed = (now - t.due) / t.period + 1;
+          t.skipped += missed;
+          t.due += missed * t.period;
+        }
+      }
+      uint32_t start = cpuCycles();
+      t.fn(now);
+      t.latency.record(cpuCycles() - start);
+    }
+    uint32_t pass = (cpuCycles() - passStart) / cpuCyclesPerUs();
+    if (pass > maxPassUs) {
+      maxPassUs = pass;
+    }
+    if (pass > SCHEDULER_LOOP_BUDGET_US) {
+      budgetOverruns++;
+    }
+    lastPassAllocs = allocCount() - passAllocs;
+    if (lastPassAllocs > 0) {
+      allocatingPasses++;
+    }
+    passes++;
+  }
+
+  const SchedulerTask& task(uint8_t id) const { return _tasks[id]; }
+  static constexpr uint8_t capacity() { return SCHEDULER_MAX_TASKS; }
+
+  uint32_t passes = 0;
+  uint32_t maxPassUs = 0;
+  uint32_t budgetOverruns = 0;  // passes longer than SCHEDULER_LOOP_BUDGET_US
+  uint32_t lastPassAllocs = 0;  // ALLOC_TRACKING only, see WebServer.h for per-handler counts
+  uint32_t allocatingPasses = 0;
+
+private:
+  int8_t add(const char* name, TaskFn fn, uint32_t period, uint32_t delay, bool oneShot) {
+    for (uint8_t i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+      SchedulerTask &t = _tasks[i];
+      if (t.active) {
+        continue;
+      }
+      t = SchedulerTask();
+      t.name = name;
+      t.fn = fn;
+      t.period = period;
+      t.due = millis() + delay;
+      t.active = true;
+      t.oneShot = oneShot;
+      return i;
+    }
+    DBG_PRINTLN("Scheduler full");
+    return -1;
+  }
+
+  SchedulerTask _tasks[SCHEDULER_MAX_TASKS] = {};
+};
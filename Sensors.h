@@ -1,18 +1,60 @@
 #pragma once
-#include <Wire.h>
-#include <Adafruit_BME280.h>
-#include <SoftwareSerial.h>
+#include "HAL.h"
 #include "Config.h"
+#include "Vindriktning.h"
+#include "Metrics.h"
+#include "SampleStore.h"
+#include "Statistics.h"
 
-extern Adafruit_BME280 bme;
-extern SoftwareSerial pms;
+extern EnvSensor bme;
+extern PMSerial pms;
+extern VindriktningParser pmParser;
+extern Metrics metrics;
 
-#define VINDRIKTNING_DATASET_SIZE 20
+// Streaming aggregates of every PM frame and BME280 conversion since the
+// last sample; readMeasurements() copies them into the sample and restarts
+// the window
+struct SensorWindow {
+  WindowStats pm25;
+  WindowStats temperature;
+  WindowStats humidity;
+  WindowStats pressure;
+
+  void reset() {
+    pm25.reset();
+    temperature.reset();
+    humidity.reset();
+    pressure.reset();
+  }
+
+  void summarize(SampleStats &out) const {
+    pm25.summarize(out.pm25);
+    temperature.summarize(out.temperature);
+    humidity.summarize(out.humidity);
+    pressure.summarize(out.pressure);
+  }
+};
+extern SensorWindow sensorWindow;
+
+// SoftwareSerial receive buffer, about 6 frames. EspSoftwareSerial's
+// interrupt only records bit edges and bytes are decoded when the buffer is
+// read, so there is no interrupt hook to feed a queue of our own from. The
+// driver sizes its edge queue from this (10 entries of 4 bytes per byte, so
+// 5 KB at 128, 2.5 KB more than the default of 64).
+constexpr size_t PM_UART_BUFFER_SIZE = 128;
+
+// A PM2.5 value older than this is not reported anymore
+constexpr unsigned long PM_FRAME_MAX_AGE = 120000;
+
+// BME280 forced-mode conversion period
+constexpr unsigned long ENV_SAMPLE_INTERVAL = 1000;
+// A BME280 reading older than this is not reported anymore
+constexpr unsigned long ENV_SAMPLE_MAX_AGE = 10000;
 
 inline bool initSensors() {
-  Wire.begin(D3, D2); // SDA, SCL
-  bool ok = bme.begin(0x76);
-  pms.begin(9600);
+  Wire.begin(PIN_I2C_SDA, PIN_I2C_SCL);
+  bool ok = bme.begin(BME280_I2C_ADDRESS);
+  pms.begin(PM_UART_BAUD, SWSERIAL_8N1, PIN_PM_RX, PIN_PM_TX, false, PM_UART_BUFFER_SIZE);
   // Flush any existing data
   while (pms.available()) {
     pms.read();
@@ -25,68 +67,78 @@ inline bool initSensors() {
   return ok;
 }
 
-inline uint16_t readPM25Raw() {
-  // Exact Tasmota implementation with improved packet handling
-  if (!pms.available()) {
-    return 0;
+// Decode everything received so far, call on every loop() pass
+inline void pollPMSensor() {
+  if (pms.overflow()) {
+    metrics.pmUartOverflows++;
   }
-  
-  // Wait for start byte 0x16, skip everything else
-  while ((pms.peek() != 0x16) && pms.available()) {
-    pms.read();
+  uint32_t now = millis();
+  uint8_t chunk[32];
+  size_t len;
+  while ((len = pms.read(chunk, sizeof(chunk))) > 0) {
+    // Byte by byte so a chunk holding two frames adds both to the window
+    for (size_t i = 0; i < len; i++) {
+      if (!pmParser.feed(chunk[i], now)) {
+        continue;
+      }
+      sensorWindow.pm25.add(pmParser.pm25());
+      DBG_PRINT("Vindriktning packet: ");
+      const uint8_t* frame = pmParser.lastFrame();
+      for (int j = 0; j < VINDRIKTNING_FRAME_SIZE; j++) {
+        if (frame[j] < 16) DBG_PRINT("0");
+        DBG_PRINT(frame[j], HEX);
+        DBG_PRINT(" ");
+      }
+      DBG_PRINTLN();
+    }
   }
-  
-  // Need at least 20 bytes available
-  if (pms.available() < VINDRIKTNING_DATASET_SIZE) {
-    return 0;
+}
+
+// Start a BME280 conversion once per ENV_SAMPLE_INTERVAL and collect it on a
+// later pass, call on every loop() pass
+inline void pollEnvSensor(const DeviceConfig &cfg) {
+  unsigned long now = millis();
+  if (bme.busy()) {
+    if (bme.poll(now)) {
+      sensorWindow.temperature.add(bme.readTemperature() + cfg.tempOffset);
+      sensorWindow.humidity.add(bme.readHumidity());
+      sensorWindow.pressure.add(bme.readPressure() / 100.0F);
+    }
+  } else if (bme.present() && (!bme.hasSample() || now - bme.sampleTime() >= ENV_SAMPLE_INTERVAL)) {
+    bme.startMeasurement(now);
   }
+}
 
-  uint8_t buffer[VINDRIKTNING_DATASET_SIZE];
-  pms.readBytes(buffer, VINDRIKTNING_DATASET_SIZE);
-  
-  // Flush any remaining bytes to prevent packet overlap
-  pms.flush();
+// Copy the latest cached readings and the window aggregates into a sample
+// and set its validity flags. Never touches the sensors; pollPMSensor() and
+// pollEnvSensor() keep the cached values current. Returns false if neither
+// source has recent data.
+inline bool readMeasurements(Sample &s, const DeviceConfig &cfg) {
+  uint32_t now = millis();
 
-  // Debug: Print the entire packet
-  DBG_PRINT("Vindriktning packet: ");
-  for (int i = 0; i < VINDRIKTNING_DATASET_SIZE; i++) {
-    if (buffer[i] < 16) DBG_PRINT("0");
-    DBG_PRINT(buffer[i], HEX);
-    DBG_PRINT(" ");
+  if (pmParser.hasFrame() && now - pmParser.frameTime() <= PM_FRAME_MAX_AGE) {
+    s.pm25 = pmParser.pm25();
+    s.pmTime = pmParser.frameTime();
+    s.valid |= SAMPLE_PM_VALID;
+    DBG_PRINT("Vindriktning PM2.5 raw: ");
+    DBG_PRINTLN(s.pm25);
+  } else {
+    DBG_PRINT("No recent Vindriktning frame, checksum errors: ");
+    DBG_PRINTLN(pmParser.checksumErrors);
   }
-  DBG_PRINTLN();
 
-  // Tasmota checksum: sum of all 20 bytes should be 0
-  uint8_t crc = 0;
-  for (uint32_t i = 0; i < VINDRIKTNING_DATASET_SIZE; i++) {
-    crc += buffer[i];
-  }
-  
-  if (crc != 0) {
-    DBG_PRINT("Vindriktning checksum error, CRC sum: ");
-    DBG_PRINTLN(crc);
-    return 0; // Don't use invalid data
+  if (bme.hasSample() && now - bme.sampleTime() <= ENV_SAMPLE_MAX_AGE) {
+    s.temperature = bme.readTemperature() + cfg.tempOffset;
+    s.humidity = bme.readHumidity();
+    s.pressure = bme.readPressure() / 100.0F;
+    s.envTime = bme.sampleTime();
+    s.valid |= SAMPLE_ENV_VALID;
+  } else {
+    DBG_PRINTLN("No recent BME280 reading");
   }
 
-  // Extract PM2.5 value from bytes 5-6 (big endian) exactly like Tasmota
-  // sample data from Tasmota comment:
-  //  0  1  2  3  4  5  6  7  8  9 10 11 12 13 14 15 16 17 18 19
-  // 16 11 0b 00 00 00 0c 00 00 03 cb 00 00 00 0c 01 00 00 00 e7
-  //               |pm2_5|     |pm1_0|     |pm10 |        | CRC |
-  uint16_t pm25 = (buffer[5] << 8) | buffer[6];
-  
-  DBG_PRINT("Vindriktning PM2.5 raw: ");
-  DBG_PRINTLN(pm25);
-  
-  return pm25;
-}
-
-inline void readMeasurements(uint16_t &pm25, float &t, float &h, float &p, const DeviceConfig &cfg) {
-  // Read PM2.5 directly (no multiple attempts needed with Tasmota approach)
-  pm25 = readPM25Raw();
+  sensorWindow.summarize(s.stats);
+  sensorWindow.reset();
 
-  // Read BME280 values
-  t = bme.readTemperature() + cfg.tempOffset;
-  h = bme.readHumidity();
-  p = bme.readPressure() / 100.0F;
-}
\ No newline at end of file
+  return s.valid != 0;
+}
@@ -0,0 +1,233 @@
+#pragma once
+#include <Arduino.h>
+#include <math.h>
+
+// Streaming statistics with O(1) memory and no allocations, for aggregating
+// every sensor reading between two published samples.
+
+// Aggregates of one window as published
+struct FieldStats {
+  uint16_t count;
+  float min;
+  float max;
+  float mean;
+  float stddev;
+  float p95;
+};
+
+// Count, min, max, mean and variance (Welford's algorithm, numerically
+// stable without keeping the values)
+class RunningStats {
+public:
+  void reset() {
+    _count = 0;
+    _mean = 0.0f;
+    _m2 = 0.0f;
+    _min = INFINITY;
+    _max = -INFINITY;
+  }
+
+  void add(float x) {
+    _count++;
+    float delta = x - _mean;
+    _mean += delta / _count;
+    _m2 += delta * (x - _mean);
+    if (x < _min) _min = x;
+    if (x > _max) _max = x;
+  }
+
+  uint32_t count() const { return _count; }
+  float mean() const { return _count ? _mean : NAN; }
+  float min() const { return _count ? _min : NAN; }
+  float max() const { return _count ? _max : NAN; }
+  // Sample variance, 0 for a single value
+  float variance() const { return _count > 1 ? _m2 / (_count - 1) : 0.0f; }
+  float stddev() const { return sqrtf(variance()); }
+
+private:
+  uint32_t _count = 0;
+  float _mean = 0.0f;
+  float _m2 = 0.0f;
+  float _min = INFINITY;
+  float _max = -INFINITY;
+};
+
+// P² quantile estimator (Jain & Chlamtac 1985): five markers whose heights
+// follow the p-quantile, adjusted by piecewise-parabolic interpolation.
+//
+// P² needs a few hundred values before the marker for a tail quantile
+// settles, which is longer than most windows here. Next to the markers the
+// P2_TAIL_VALUES values nearest the quantile's tail (the largest for
+// p >= 0.5, the smallest below) are kept sorted. As long as the target rank
+// falls among them the answer is exact: for the p95 that is every window of
+// up to 20 * P2_TAIL_VALUES values. Most values miss the tail, so keeping it
+// costs one comparison per value.
+
+#ifndef P2_TAIL_VALUES
+#define P2_TAIL_VALUES 16 // exact p95 for up to 310 values, 5 min of 1 Hz BME280 conversions
+#endif
+static_assert(P2_TAIL_VALUES >= 5, "the markers start from the first five values");
+
+class P2Quantile {
+public:
+  explicit P2Quantile(float p = 0.5f) : _p(p), _upper(p >= 0.5f) {
+    _dn[0] = 0.0f;
+    _dn[1] = _p / 2.0f;
+    _dn[2] = _p;
+    _dn[3] = (1.0f + _p) / 2.0f;
+    _dn[4] = 1.0f;
+  }
+
+  void reset() { _count = 0; }
+
+  void add(float x) {
+    keepTail(x);
+    _count++;
+    if (_count < 5) {
+      return;
+    }
+    if (_count == 5) {
+      // The tail holds all five values so far
+      for (uint8_t i = 0; i < 5; i++) {
+        _q[i] = _tail[i];
+        _n[i] = i;
+        _np[i] = 4 * _dn[i];
+      }
+      return;
+    }
+
+    uint8_t k;
+    if (x < _q[0]) {
+      _q[0] = x;
+      k = 0;
+    } else if (x >= _q[4]) {
+      _q[4] = x;
+      k = 3;
+    } else {
+      k = 0;
+      while (k < 3 && x >= _q[k + 1]) {
+        k++;
+      }
+    }
+    for (uint8_t i = k + 1; i < 5; i++) {
+      _n[i]++;
+    }
+    for (uint8_t i = 0; i < 5; i++) {
+      _np[i] += _dn[i];
+    }
+
+    for (uint8_t i = 1; i < 4; i++) {
+      float d = _np[i] - _n[i];
+      if ((d >= 1.0f && _n[i + 1] - _n[i] > 1) || (d <= -1.0f && _n[i - 1] - _n[i] < -1)) {
+        int8_t s = d > 0 ? 1 : -1;
+        float q = parabolic(i, s);
+        if (_q[i - 1] < q && q < _q[i + 1]) {
+          _q[i] = q;
+        } else {
+          _q[i] += s * (_q[i + s] - _q[i]) / (_n[i + s] - _n[i]);
+        }
+        _n[i] += s;
+      }
+    }
+  }
+
+  float value() const {
+    if (_count == 0) {
+      return NAN;
+    }
+    // Rank round(p (n - 1)) of the sorted values, exact if it is in the tail
+    uint32_t rank = lroundf(_p * (_count - 1));
+    uint32_t kept = _count < P2_TAIL_VALUES ? _count : P2_TAIL_VALUES;
+    if (_upper) {
+      uint32_t fromTop = _count - 1 - rank;
+      if (fromTop < kept) {
+        return _tail[kept - 1 - fromTop];
+      }
+    } else if (rank < kept) {
+      return _tail[rank];
+    }
+    return _q[2];
+  }
+
+  uint32_t count() const { return _count; }
+
+private:
+  // Insert x into the sorted tail, dropping the value furthest from it
+  // once the tail is full
+  void keepTail(float x) {
+    uint8_t i;
+    if (_count < P2_TAIL_VALUES) {
+      i = _count;
+      while (i > 0 && _tail[i - 1] > x) {
+        _tail[i] = _tail[i - 1];
+        i--;
+      }
+    } else if (_upper) {
+      if (x <= _tail[0]) {
+        return;
+      }
+      i = 0;
+      while (i < P2_TAIL_VALUES - 1 && _tail[i + 1] < x) {
+        _tail[i] = _tail[i + 1];
+        i++;
+      }
+    } else {
+      if (x >= _tail[P2_TAIL_VALUES - 1]) {
+        return;
+      }
+      i = P2_TAIL_VALUES - 1;
+      while (i > 0 && _tail[i - 1] > x) {
+        _tail[i] = _tail[i - 1];
+        i--;
+      }
+    }
+    _tail[i] = x;
+  }
+
+  float parabolic(uint8_t i, int8_t s) const {
+    float n0 = _n[i - 1], n1 = _n[i], n2 = _n[i + 1];
+    return _q[i] + s / (n2 - n0) *
+      ((n1 - n0 + s) * (_q[i + 1] - _q[i]) / (n2 - n1) +
+       (n2 - n1 - s) * (_q[i] - _q[i - 1]) / (n1 - n0));
+  }
+
+  float _p;
+  bool _upper;                    // the tail kept is the upper one
+  uint32_t _count = 0;
+  float _tail[P2_TAIL_VALUES];    // values nearest the tail, ascending
+  float _q[5];                    // marker heights
+  int32_t _n[5];                  // marker positions (0-based ranks)
+  float _np[5];                   // desired positions
+  float _dn[5];                   // desired position increments
+};
+
+// Everything published for one field over one window
+class WindowStats {
+public:
+  WindowStats() : _p95(0.95f) {}
+
+  void reset() {
+    _stats.reset();
+    _p95.reset();
+  }
+
+  void add(float x) {
+    _stats.add(x);
+    _p95.add(x);
+  }
+
+  void summarize(FieldStats &out) const {
+    out.count = _stats.count() > UINT16_MAX ? UINT16_MAX : _stats.count();
+    out.min = _stats.min();
+    out.max = _stats.max();
+    out.mean = _stats.mean();
+    out.stddev = _stats.stddev();
+    out.p95 = _p95.value();
+  }
+
+  uint32_t count() const { return _stats.count(); }
+
+private:
+  RunningStats _stats;
+  P2Quantile _p95;
+};
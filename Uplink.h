@@ -0,0 +1,266 @@
+#pragma once
+#include <Arduino.h>
+#include "HAL.h"
+#include "Config.h"
+#include "Crc.h"
+#include "SampleStore.h"
+#include "Metrics.h"
+
+extern DeviceConfig config;
+
+// Compact binary uplink frame, little-endian.
+//
+// The first 18 bytes are the layout the Node-RED /sensor flow already
+// decodes (uint16 PM2.5, float temperature, humidity, pressure in hPa,
+// uint32 uptime), so older decoders keep working and simply ignore the
+// rest. Version 1 appends a version byte, the validity flags, the sample
+// sequence number and a CRC-32 over everything before it. Invalid fields are
+// flagged in valid and sent as UPLINK_PM_INVALID (PM2.5) or NaN
+// (environment), so decoders that only read the legacy prefix see an
+// out-of-range value rather than a plausible 0 µg/m³.
+
+constexpr uint8_t UPLINK_VERSION = 1;
+constexpr uint16_t UPLINK_PM_INVALID = 0xFFFF;
+constexpr size_t UPLINK_LEGACY_SIZE = 18;
+constexpr size_t UPLINK_FRAME_SIZE = 28;
+
+struct __attribute__((packed)) UplinkFrame {
+  uint16_t pm25;
+  float temperature;
+  float humidity;
+  float pressure;
+  uint32_t uptime;
+  // version 1 extension
+  uint8_t version;
+  uint8_t valid;        // SAMPLE_*_VALID
+  uint32_t seq;
+  uint32_t crc;         // CRC-32 of the bytes above
+};
+static_assert(sizeof(UplinkFrame) == UPLINK_FRAME_SIZE, "UplinkFrame layout changed");
+static_assert(offsetof(UplinkFrame, version) == UPLINK_LEGACY_SIZE, "legacy prefix must stay 18 bytes");
+
+// The ESP8266 is little-endian like the wire format, so the frame is filled
+// in place and sent as is
+inline void encodeUplink(const Sample &s, UplinkFrame &f) {
+  f.pm25 = s.pmValid() ? min<uint16_t>(s.pm25, UPLINK_PM_INVALID - 1) : UPLINK_PM_INVALID;
+  f.temperature = s.envValid() ? s.temperature : NAN;
+  f.humidity = s.envValid() ? s.humidity : NAN;
+  f.pressure = s.envValid() ? s.pressure : NAN;
+  f.uptime = s.uptime;
+  f.version = UPLINK_VERSION;
+  f.valid = s.valid & (SAMPLE_PM_VALID | SAMPLE_ENV_VALID);
+  f.seq = s.seq;
+  f.crc = crc32(&f, offsetof(UplinkFrame, crc));
+}
+
+// Accepts a legacy 18-byte payload or a version 1 frame with a valid CRC.
+// Legacy payloads carry no flags, so validity follows from the sentinels.
+inline bool decodeUplink(const uint8_t* data, size_t len, UplinkFrame &f) {
+  if (len == UPLINK_LEGACY_SIZE) {
+    memset(&f, 0, sizeof(f));
+    memcpy(&f, data, UPLINK_LEGACY_SIZE);
+    f.valid = (f.pm25 != UPLINK_PM_INVALID ? SAMPLE_PM_VALID : 0) |
+              (!isnan(f.temperature) ? SAMPLE_ENV_VALID : 0);
+    return true;
+  }
+  if (len < UPLINK_FRAME_SIZE) {
+    return false;
+  }
+  memcpy(&f, data, UPLINK_FRAME_SIZE);
+  return f.version >= UPLINK_VERSION && f.crc == crc32(&f, offsetof(UplinkFrame, crc));
+}
+
+constexpr uint16_t UPLINK_HTTP_TIMEOUT = 2000;  // ms for the whole request
+
+// POSTs frames to config.uplinkUrl (plain http://host[:port]/path).
+//
+// A request goes through DNS, TCP connect and the wait for the status line
+// without blocking: post() only queues the frame and poll(), called from
+// the uplink task on every pass, moves the request one step further when
+// the network has answered. UPLINK_HTTP_TIMEOUT covers the whole request.
+// Only one request is in flight; a sample posted meanwhile waits and is
+// replaced by a newer one, the receiver only needs the latest.
+enum UplinkState : uint8_t {
+  UPLINK_IDLE,
+  UPLINK_RESOLVE,   // DNS lookup of the host
+  UPLINK_CONNECT,   // TCP handshake
+  UPLINK_RESPONSE   // request sent, waiting for the status line
+};
+
+class UplinkClient {
+public:
+  // Queue s for the next request, does nothing if no URL is set
+  void post(const Sample &s) {
+    if (config.uplinkUrl[0] == '\0') {
+      return;
+    }
+    encodeUplink(s, _next);
+    _queued = true;
+  }
+
+  void poll(uint32_t now) {
+    if (_state != UPLINK_IDLE && now - _started >= UPLINK_HTTP_TIMEOUT) {
+      finish(false, "timeout");
+    }
+    switch (_state) {
+      case UPLINK_IDLE:
+        if (_queued && WiFi.status() == WL_CONNECTED) {
+          start(now);
+        }
+        break;
+
+      case UPLINK_RESOLVE: {
+        IPAddress ip;
+        NetPoll r = _resolver.poll(ip);
+        if (r == NET_FAILED) {
+          finish(false, "host lookup failed");
+        } else if (r == NET_DONE) {
+          if (_connector.start(ip, _port)) {
+            _state = UPLINK_CONNECT;
+          } else {
+            finish(false, "connect failed");
+          }
+        }
+        break;
+      }
+
+      case UPLINK_CONNECT: {
+        NetPoll r = _connector.poll(_client);
+        if (r == NET_FAILED) {
+          finish(false, "connect failed");
+        } else if (r == NET_DONE) {
+          sendRequest();
+        }
+        break;
+      }
+
+      case UPLINK_RESPONSE:
+        readStatus();
+        break;
+    }
+  }
+
+  UplinkState state() const { return _state; }
+  // Nothing in flight and nothing waiting
+  bool idle() const { return _state == UPLINK_IDLE && !_queued; }
+
+private:
+  void start(uint32_t now) {
+    _queued = false;
+    _frame = _next;
+    _started = now;
+    if (!parseUrl()) {
+      DBG_PRINTLN("Uplink: invalid URL");
+      metrics.uplinkFailures++;
+      return;
+    }
+    _resolver.start(_host);
+    _state = UPLINK_RESOLVE;
+  }
+
+  // Splits config.uplinkUrl into _host, _port and _path
+  bool parseUrl() {
+    const char* url = config.uplinkUrl;
+    if (strncmp(url, "http://", 7) != 0) {
+      return false;
+    }
+    url += 7;
+    size_t hostLen = strcspn(url, ":/");
+    if (hostLen == 0 || hostLen >= sizeof(_host)) {
+      return false;
+    }
+    memcpy(_host, url, hostLen);
+    _host[hostLen] = '\0';
+    url += hostLen;
+    _port = 80;
+    if (*url == ':') {
+      char* end;
+      long port = strtol(url + 1, &end, 10);
+      if (port <= 0 || port > 65535) {
+        return false;
+      }
+      _port = port;
+      url = end;
+    }
+    if (*url != '\0' && *url != '/') {
+      return false;
+    }
+    _path = *url ? url : "/";
+    return true;
+  }
+
+  // Header and frame fit in the TCP send buffer, so neither write waits
+  void sendRequest() {
+    char head[224];
+    int n = snprintf(head, sizeof(head),
+                     "POST %s HTTP/1.1\r\nHost: %s\r\n"
+                     "Content-Type: application/octet-stream\r\n"
+                     "Content-Length: %u\r\nConnection: close\r\n\r\n",
+                     _path, _host, (unsigned)sizeof(_frame));
+    if (n <= 0 || n >= (int)sizeof(head) ||
+        _client.write(reinterpret_cast<const uint8_t*>(head), n) != (size_t)n ||
+        _client.write(reinterpret_cast<const uint8_t*>(&_frame), sizeof(_frame)) != sizeof(_frame)) {
+      finish(false, "send failed");
+      return;
+    }
+    _statusLen = 0;
+    _status[0] = '\0';
+    _state = UPLINK_RESPONSE;
+  }
+
+  // Reads what has arrived of "HTTP/1.1 200 OK\r\n", the rest is ignored
+  void readStatus() {
+    while (_client.available() > 0) {
+      int c = _client.read();
+      if (c == '\n') {
+        const char* sp = strchr(_status, ' ');
+        int code = sp ? atoi(sp + 1) : 0;
+        if (code >= 200 && code < 300) {
+          finish(true, nullptr);
+        } else {
+          DBG_PRINTF("Uplink POST failed: %d\n", code);
+          finish(false, nullptr);
+        }
+        return;
+      }
+      if (c >= 0 && _statusLen + 1u < sizeof(_status)) {
+        _status[_statusLen++] = (char)c;
+        _status[_statusLen] = '\0';
+      }
+    }
+    if (!_client.connected()) {
+      finish(false, "connection closed");
+    }
+  }
+
+  void finish(bool ok, const char* why) {
+    _connector.cancel();
+    _client.stop();
+    _state = UPLINK_IDLE;
+    if (ok) {
+      metrics.uplinkPosts++;
+      return;
+    }
+    metrics.uplinkFailures++;
+    if (why) {
+      DBG_PRINT("Uplink: ");
+      DBG_PRINTLN(why);
+    }
+  }
+
+  UplinkState _state = UPLINK_IDLE;
+  bool _queued = false;
+  uint32_t _started = 0;
+  UplinkFrame _frame;   // in flight
+  UplinkFrame _next;    // waiting for the next request
+  char _host[64];
+  uint16_t _port = 80;
+  const char* _path = "/";  // points into config.uplinkUrl
+  char _status[24];
+  uint8_t _statusLen = 0;
+  HostResolver _resolver;
+  TcpConnector _connector;
+  NetClient _client;
+};
+
+extern UplinkClient uplink;
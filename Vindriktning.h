@@ -0,0 +1,104 @@
+#pragma once
+#include <Arduino.h>
+
+// Vindriktning (PM1006) frame layout, sample data from Tasmota:
+//  0  1  2  3  4  5  6  7  8  9 10 11 12 13 14 15 16 17 18 19
+// 16 11 0b 00 00 00 0c 00 00 03 cb 00 00 00 0c 01 00 00 00 e7
+//               |pm2_5|     |pm1_0|     |pm10 |        | CRC |
+// The sum of all 20 bytes is 0 for a valid frame.
+constexpr uint8_t VINDRIKTNING_FRAME_SIZE = 20;
+constexpr uint8_t VINDRIKTNING_HEADER = 0x16;
+constexpr uint8_t VINDRIKTNING_LENGTH = 0x11;
+constexpr uint8_t VINDRIKTNING_COMMAND = 0x0B;
+
+// Incremental frame parser. Bytes can be fed in chunks of any size; a partial
+// frame is kept until the rest arrives. On a header or checksum mismatch the
+// already buffered bytes are rescanned so the start of the next frame is not
+// lost.
+class VindriktningParser {
+public:
+  // Feed one byte, returns true if it completed a valid frame
+  bool feed(uint8_t b, uint32_t now) {
+    if (!accept(b)) {
+      return false;
+    }
+    if (_sum != 0) {
+      checksumErrors++;
+      resync();
+      return false;
+    }
+    _pm25 = (_buf[5] << 8) | _buf[6];
+    _frameTime = now;
+    _hasFrame = true;
+    _pos = 0;
+    _sum = 0;
+    frameCount++;
+    return true;
+  }
+
+  // Feed a chunk, returns the number of valid frames it completed
+  size_t feed(const uint8_t* data, size_t len, uint32_t now) {
+    size_t frames = 0;
+    for (size_t i = 0; i < len; i++) {
+      if (feed(data[i], now)) {
+        frames++;
+      }
+    }
+    return frames;
+  }
+
+  bool hasFrame() const { return _hasFrame; }
+  uint16_t pm25() const { return _pm25; }
+  uint32_t frameTime() const { return _frameTime; }
+  const uint8_t* lastFrame() const { return _buf; }
+
+  uint32_t frameCount = 0;
+  uint32_t checksumErrors = 0;
+  uint32_t droppedBytes = 0;
+
+private:
+  // Append a byte to the current frame, returns true once 20 bytes are buffered
+  bool accept(uint8_t b) {
+    bool headerOk = true;
+    if (_pos == 0) headerOk = (b == VINDRIKTNING_HEADER);
+    else if (_pos == 1) headerOk = (b == VINDRIKTNING_LENGTH);
+    else if (_pos == 2) headerOk = (b == VINDRIKTNING_COMMAND);
+
+    if (!headerOk) {
+      droppedBytes += _pos;
+      if (b == VINDRIKTNING_HEADER) {
+        _buf[0] = b;
+        _sum = b;
+        _pos = 1;
+      } else {
+        droppedBytes++;
+        _pos = 0;
+        _sum = 0;
+      }
+      return false;
+    }
+
+    _buf[_pos++] = b;
+    _sum += b;
+    return _pos == VINDRIKTNING_FRAME_SIZE;
+  }
+
+  // Drop the first byte of a bad frame and replay the rest; at most 19 bytes
+  // are replayed, so this can never complete (and recurse into) another frame.
+  void resync() {
+    uint8_t n = _pos;
+    _pos = 0;
+    _sum = 0;
+    droppedBytes++;
+    for (uint8_t i = 1; i < n; i++) {
+      accept(_buf[i]);
+    }
+  }
+
+  uint8_t _buf[VINDRIKTNING_FRAME_SIZE];
+  uint8_t _pos = 0;
+  uint8_t _sum = 0;
+  bool _hasFrame = false;
+  uint16_t _pm25 = 0;
+  uint32_t _frameTime = 0;
+};
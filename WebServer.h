@@ -1,31 +1,170 @@
 #pragma once
-#include <ESP8266WebServer.h>
-#include <DNSServer.h>
-#include <ESP8266WiFi.h>
 #include <stdio.h>
+#include <stdarg.h>
+#include "HAL.h"
 #include "Config.h"
 #include "Sensors.h"
 #include "MQTTManager.h"
+#include "SampleStore.h"
+#include "History.h"
+#include "Crc.h"
+#include "Scheduler.h"
 
-extern ESP8266WebServer server;
-extern DNSServer dns;
+extern HttpServer server;
+extern DnsResponder dns;
 extern DeviceConfig config;
-extern bool shouldRestart;
+extern Scheduler scheduler;
 extern unsigned long uptimeMillis;
+extern SampleStore sampleStore;
+extern SampleHistory history;
 
-inline String htmlHeader() {
-  return F(
-    "<!DOCTYPE html><html><head><meta charset='utf-8'><meta name='viewport' content='width=device-width,initial-scale=1'>"
-    "<title>IKEAAirMonitor</title><style>"
-    "body{font-family:Arial,sans-serif;margin:20px;background:#f5f5f5;color:#333;}"
-    "nav{margin-bottom:20px;}nav a{margin-right:15px;text-decoration:none;color:#0366d6;}"
-    ".card{background:#fff;padding:20px;border-radius:8px;box-shadow:0 2px 4px rgba(0,0,0,0.1);}"
-    "label{display:block;margin-top:10px;}"
-    "input{width:100%;padding:8px;margin-top:5px;border:1px solid #ccc;border-radius:4px;}"
-    "button{margin-top:15px;padding:10px 15px;background:#0366d6;color:#fff;border:none;border-radius:4px;}"
-    "</style></head><body><nav><a href='/'>Status</a><a href='/config'>Konfiguration</a></nav><div class='card'>"
-  );
-}
+static const char PAGE_HEADER[] PROGMEM =
+  "<!DOCTYPE html><html><head><meta charset='utf-8'><meta name='viewport' content='width=device-width,initial-scale=1'>"
+  "<title>IKEAAirMonitor</title><style>"
+  "body{font-family:Arial,sans-serif;margin:20px;background:#f5f5f5;color:#333;}"
+  "nav{margin-bottom:20px;}nav a{margin-right:15px;text-decoration:none;color:#0366d6;}"
+  ".card{background:#fff;padding:20px;border-radius:8px;box-shadow:0 2px 4px rgba(0,0,0,0.1);}"
+  "label{display:block;margin-top:10px;}"
+  "input{width:100%;padding:8px;margin-top:5px;border:1px solid #ccc;border-radius:4px;}"
+  "button{margin-top:15px;padding:10px 15px;background:#0366d6;color:#fff;border:none;border-radius:4px;}"
+  "</style></head><body><nav><a href='/'>Status</a><a href='/config'>Konfiguration</a></nav><div class='card'>";
+
+static const char PAGE_FOOTER[] PROGMEM = "</div></body></html>";
+
+// Size of the buffer small writes are collected in before they go out as
+// one HTTP chunk
+constexpr size_t HTTP_CHUNK_SIZE = 512;
+
+// Chunked HTTP response assembled in a fixed buffer, so streaming a large
+// body never allocates
+class ChunkedResponse {
+public:
+  void begin(const char* contentType) {
+    _len = 0;
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200, contentType, "");
+  }
+
+  void printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+      va_list args;
+      va_start(args, fmt);
+      int n = vsnprintf(_buf + _len, sizeof(_buf) - _len, fmt, args);
+      va_end(args);
+      if (n < 0) {
+        return;
+      }
+      if (_len + n < sizeof(_buf)) {
+        _len += n;
+        return;
+      }
+      // Did not fit, send what we have and retry in an empty buffer
+      flush();
+    }
+  }
+
+  // Copy a string from flash
+  void print_P(PGM_P str) {
+    write_P(str, strlen_P(str));
+  }
+
+  // Copy a string with the characters that are special in HTML text and
+  // attribute values replaced by entities
+  void printEscaped(const char* str) {
+    for (; *str; str++) {
+      switch (*str) {
+        case '&': write("&amp;", 5); break;
+        case '<': write("&lt;", 4); break;
+        case '>': write("&gt;", 4); break;
+        case '"': write("&quot;", 6); break;
+        case '\'': write("&#39;", 5); break;
+        default: write(str, 1); break;
+      }
+    }
+  }
+
+  // Stream a template from flash. Every %key% is replaced by whatever
+  // field(key) prints, %% is a literal percent sign; text that does not form
+  // a placeholder is copied as is.
+  template <typename Fn>
+  void render_P(PGM_P tmpl, Fn field) {
+    PGM_P p = tmpl;
+    while (true) {
+      PGM_P run = p;
+      char c;
+      while ((c = pgm_read_byte(p)) != '\0' && c != '%') {
+        p++;
+      }
+      write_P(run, p - run);
+      if (c == '\0') {
+        return;
+      }
+      char key[24];
+      size_t n = 0;
+      PGM_P q = p + 1;
+      while (n < sizeof(key) - 1 && (c = pgm_read_byte(q)) != '\0' && (isalnum(c) || c == '_')) {
+        key[n++] = c;
+        q++;
+      }
+      key[n] = '\0';
+      if (c != '%') {
+        write("%", 1);
+        p++;
+      } else {
+        if (n == 0) {
+          write("%", 1);
+        } else {
+          field(key);
+        }
+        p = q + 1;
+      }
+    }
+  }
+
+  void end() {
+    flush();
+    server.sendContent("");
+  }
+
+private:
+  void write(const char* data, size_t len) {
+    while (len > 0) {
+      if (_len == sizeof(_buf)) {
+        flush();
+      }
+      size_t n = min(len, sizeof(_buf) - _len);
+      memcpy(_buf + _len, data, n);
+      _len += n;
+      data += n;
+      len -= n;
+    }
+  }
+
+  void write_P(PGM_P data, size_t len) {
+    while (len > 0) {
+      if (_len == sizeof(_buf)) {
+        flush();
+      }
+      size_t n = min(len, sizeof(_buf) - _len);
+      memcpy_P(_buf + _len, data, n);
+      _len += n;
+      data += n;
+      len -= n;
+    }
+  }
+
+  void flush() {
+    if (_len > 0) {
+      server.sendContent(_buf, _len);
+      _len = 0;
+    }
+  }
+
+  char _buf[HTTP_CHUNK_SIZE];
+  size_t _len = 0;
+};
+
+extern ChunkedResponse chunkedResponse;
 
 inline void formatUptime(unsigned long ms, char* buf, size_t len) {
   unsigned long seconds = ms / 1000;
@@ -38,193 +177,581 @@ inline void formatUptime(unsigned long ms, char* buf, size_t len) {
   snprintf(buf, len, "%lu d %02lu:%02lu:%02lu", days, hours, minutes, seconds);
 }
 
+static const char ROOT_TEMPLATE[] PROGMEM =
+  "<h1>Status</h1>"
+  "<p>PM2.5: <span id='pm25'>%pm25%</span></p>"
+  "<p>Temperatur: <span id='temperature'>%temperature%</span></p>"
+  "<p>Luftfeuchte: <span id='humidity'>%humidity%</span></p>"
+  "<p>Luftdruck: <span id='pressure'>%pressure%</span></p>"
+  "<p>Uptime: %uptime%</p>"
+  "<p>MQTT Status: %mqtt%</p>"
+  "<p>OTA Status: %ota%</p>"
+  // Live values from /events, the page itself is only loaded once
+  "<script>(function(){var u={pm25:' µg/m³',temperature:' °C',humidity:' %%',pressure:' hPa'};"
+  "new EventSource('/events').addEventListener('state',function(e){var d=JSON.parse(e.data);"
+  "for(var k in u){if(d[k]!==undefined)document.getElementById(k).textContent="
+  "(k=='pm25'?d[k]:d[k].toFixed(1))+u[k];}});})();</script>";
+
 inline void handleRoot() {
-  uint16_t pm; float t, h, p;
-  readMeasurements(pm, t, h, p, config);
+  // Only reads the latest snapshot, never the sensors themselves
+  const Sample &s = sampleStore.latest();
+  uint32_t now = millis();
+  ChunkedResponse &out = chunkedResponse;
   
-  char uptimeStr[32];
-  formatUptime(uptimeMillis, uptimeStr, sizeof(uptimeStr));
-  
-  char html[1024];
-  if (WiFi.status() == WL_CONNECTED) {
-    snprintf(html, sizeof(html),
-      "%s"
-      "<h1>Status</h1>"
-      "<p>PM2.5: %u µg/m³</p>"
-      "<p>Temperatur: %.1f °C</p>"
-      "<p>Luftfeuchte: %.1f %%</p>"
-      "<p>Luftdruck: %.1f hPa</p>"
-      "<p>Uptime: %s</p>"
-      "<p>MQTT Status: %s</p>"
-      "<p>OTA Status: Aktiv (Port 8266, Hostname: %s)</p>"
-      "</div></body></html>",
-      htmlHeader().c_str(),
-      pm, t, h, p, uptimeStr,
-      mqttConnected ? "Verbunden" : "Nicht verbunden",
-      config.hostname
-    );
-  } else {
-    snprintf(html, sizeof(html),
-      "%s"
-      "<h1>Status</h1>"
-      "<p>PM2.5: %u µg/m³</p>"
-      "<p>Temperatur: %.1f °C</p>"
-      "<p>Luftfeuchte: %.1f %%</p>"
-      "<p>Luftdruck: %.1f hPa</p>"
-      "<p>Uptime: %s</p>"
-      "<p>MQTT Status: %s</p>"
-      "<p>OTA Status: Inaktiv (WiFi nicht verbunden)</p>"
-      "</div></body></html>",
-      htmlHeader().c_str(),
-      pm, t, h, p, uptimeStr,
-      mqttConnected ? "Verbunden" : "Nicht verbunden"
-    );
-  }
-  
-  server.send(200, "text/html", html);
+  out.begin("text/html");
+  out.print_P(PAGE_HEADER);
+  out.render_P(ROOT_TEMPLATE, [&](const char* key) {
+    if (strcmp(key, "pm25") == 0) {
+      if (s.pmValid()) {
+        out.printf("%u µg/m³ (vor %lu s)", s.pm25, (unsigned long)(s.pmAge(now) / 1000));
+      } else {
+        out.printf("-");
+      }
+    } else if (strcmp(key, "temperature") == 0) {
+      if (s.envValid()) {
+        out.printf("%.1f °C (vor %lu s)", s.temperature, (unsigned long)(s.envAge(now) / 1000));
+      } else {
+        out.printf("-");
+      }
+    } else if (strcmp(key, "humidity") == 0) {
+      if (s.envValid()) {
+        out.printf("%.1f %%", s.humidity);
+      } else {
+        out.printf("-");
+      }
+    } else if (strcmp(key, "pressure") == 0) {
+      if (s.envValid()) {
+        out.printf("%.1f hPa", s.pressure);
+      } else {
+        out.printf("-");
+      }
+    } else if (strcmp(key, "uptime") == 0) {
+      char uptimeStr[32];
+      formatUptime(uptimeMillis, uptimeStr, sizeof(uptimeStr));
+      out.printf("%s", uptimeStr);
+    } else if (strcmp(key, "mqtt") == 0) {
+      out.printf("%s", mqttConnected ? "Verbunden" : "Nicht verbunden");
+    } else if (strcmp(key, "ota") == 0) {
+      if (WiFi.status() == WL_CONNECTED) {
+        out.printf("Aktiv (Port 8266, Hostname: ");
+        out.printEscaped(config.hostname);
+        out.printf(")");
+      } else {
+        out.printf("Inaktiv (WiFi nicht verbunden)");
+      }
+    }
+  });
+  out.print_P(PAGE_FOOTER);
+  out.end();
 }
 
+static const char CONFIG_TEMPLATE[] PROGMEM =
+  "<h1>Konfiguration</h1><form method='POST' action='/save'>"
+  "<label>SSID<input name='ssid' value='%ssid%'></label>"
+  "<label>Passwort<input type='password' name='password' value='%password%'></label>"
+  "<label><input type='checkbox' name='wifiReuseIp' value='1'%wifiReuseIp%> Letzte IP-Adresse wiederverwenden (nur mit fester Zuordnung im Router)</label>"
+  "<label>Hostname<input name='hostname' value='%hostname%'></label>"
+  "<label>MQTT Host<input name='mqttHost' value='%mqttHost%'></label>"
+  "<label>MQTT Port<input name='mqttPort' value='%mqttPort%'></label>"
+  "<label>MQTT Benutzer<input name='mqttUser' value='%mqttUser%'></label>"
+  "<label>MQTT Passwort<input type='password' name='mqttPassword' value='%mqttPassword%'></label>"
+  "<label>MQTT Topic<input name='mqttTopic' value='%mqttTopic%'></label>"
+  "<label>Sendeintervall (s)<input name='sendInterval' value='%sendInterval%'></label>"
+  "<label>Temperatur-Offset<input name='tempOffset' value='%tempOffset%'></label>"
+  "<label>Messwerte pro MQTT-Nachricht (1-%batchMax%)<input name='mqttBatchSize' value='%mqttBatchSize%'></label>"
+  "<label><input type='checkbox' name='mqttBinary' value='1'%mqttBinary%> Binärformat zusätzlich per MQTT senden</label>"
+  "<label>Binär-Upload URL (HTTP POST)<input name='uplinkUrl' value='%uplinkUrl%'></label>"
+  "<label><input type='checkbox' name='deadbandEnabled' value='1'%deadbandEnabled%> Nur bei Änderung senden</label>"
+  "<label>Schwelle Temperatur (°C)<input name='deadbandTemp' value='%deadbandTemp%'></label>"
+  "<label>Schwelle Luftfeuchtigkeit (%%)<input name='deadbandHum' value='%deadbandHum%'></label>"
+  "<label>Schwelle Luftdruck (hPa)<input name='deadbandPress' value='%deadbandPress%'></label>"
+  "<label>Schwelle PM2.5 (µg/m³)<input name='deadbandPm' value='%deadbandPm%'></label>"
+  "<label>Spätestens senden nach (s)<input name='heartbeatInterval' value='%heartbeatInterval%'></label>"
+  "<label><input type='checkbox' name='powerSave' value='1'%powerSave%> Stromsparmodus (WLAN nur zum Senden einschalten)</label>"
+  "<label>Senden alle (min, %uplinkPeriodMin%-%uplinkPeriodMax%)<input name='uplinkPeriod' value='%uplinkPeriod%'></label>"
+  "<button type='submit'>Speichern</button></form>";
+
 inline void handleConfig() {
-  char html[2048];
-  int len = snprintf(html, sizeof(html),
-    "%s"
-    "<h1>Konfiguration</h1><form method='POST' action='/save'>"
-    "<label>SSID<input name='ssid' value='%s'></label>"
-    "<label>Passwort<input type='password' name='password' value='%s'></label>"
-    "<label>Hostname<input name='hostname' value='%s'></label>"
-    "<label>MQTT Host<input name='mqttHost' value='%s'></label>"
-    "<label>MQTT Port<input name='mqttPort' value='%u'></label>"
-    "<label>MQTT Benutzer<input name='mqttUser' value='%s'></label>"
-    "<label>MQTT Passwort<input type='password' name='mqttPassword' value='%s'></label>"
-    "<label>MQTT Topic<input name='mqttTopic' value='%s'></label>"
-    "<label>Sendeintervall (s)<input name='sendInterval' value='%lu'></label>"
-    "<label>Temperatur-Offset<input name='tempOffset' value='%.1f'></label>"
-    "<button type='submit'>Speichern</button></form></div></body></html>",
-    htmlHeader().c_str(),
-    config.ssid, config.password, config.hostname, config.mqttHost, config.mqttPort,
-    config.mqttUser, config.mqttPassword, config.mqttTopic,
-    config.sendInterval / 1000, config.tempOffset
-  );
-  server.send(200, "text/html", html);
+  ChunkedResponse &out = chunkedResponse;
+  out.begin("text/html");
+  out.print_P(PAGE_HEADER);
+  out.render_P(CONFIG_TEMPLATE, [&](const char* key) {
+    if (strcmp(key, "ssid") == 0) {
+      out.printEscaped(config.ssid);
+    } else if (strcmp(key, "password") == 0) {
+      out.printEscaped(config.password);
+    } else if (strcmp(key, "hostname") == 0) {
+      out.printEscaped(config.hostname);
+    } else if (strcmp(key, "mqttHost") == 0) {
+      out.printEscaped(config.mqttHost);
+    } else if (strcmp(key, "mqttPort") == 0) {
+      out.printf("%u", config.mqttPort);
+    } else if (strcmp(key, "mqttUser") == 0) {
+      out.printEscaped(config.mqttUser);
+    } else if (strcmp(key, "mqttPassword") == 0) {
+      out.printEscaped(config.mqttPassword);
+    } else if (strcmp(key, "mqttTopic") == 0) {
+      out.printEscaped(config.mqttTopic);
+    } else if (strcmp(key, "sendInterval") == 0) {
+      out.printf("%lu", (unsigned long)(config.sendInterval / 1000));
+    } else if (strcmp(key, "tempOffset") == 0) {
+      out.printf("%.1f", config.tempOffset);
+    } else if (strcmp(key, "batchMax") == 0) {
+      out.printf("%u", MQTT_BATCH_MAX);
+    } else if (strcmp(key, "mqttBatchSize") == 0) {
+      out.printf("%u", config.mqttBatchSize);
+    } else if (strcmp(key, "mqttBinary") == 0) {
+      out.printf("%s", config.mqttBinary ? " checked" : "");
+    } else if (strcmp(key, "uplinkUrl") == 0) {
+      out.printEscaped(config.uplinkUrl);
+    } else if (strcmp(key, "wifiReuseIp") == 0) {
+      out.printf("%s", config.wifiReuseIp ? " checked" : "");
+    } else if (strcmp(key, "powerSave") == 0) {
+      out.printf("%s", config.powerSave ? " checked" : "");
+    } else if (strcmp(key, "uplinkPeriod") == 0) {
+      out.printf("%u", config.uplinkPeriod);
+    } else if (strcmp(key, "uplinkPeriodMin") == 0) {
+      out.printf("%u", UPLINK_PERIOD_MIN);
+    } else if (strcmp(key, "uplinkPeriodMax") == 0) {
+      out.printf("%u", UPLINK_PERIOD_MAX);
+    } else if (strcmp(key, "deadbandEnabled") == 0) {
+      out.printf("%s", config.deadbandEnabled ? " checked" : "");
+    } else if (strcmp(key, "deadbandTemp") == 0) {
+      out.printf("%.2f", config.deadbandTemp);
+    } else if (strcmp(key, "deadbandHum") == 0) {
+      out.printf("%.2f", config.deadbandHum);
+    } else if (strcmp(key, "deadbandPress") == 0) {
+      out.printf("%.2f", config.deadbandPress);
+    } else if (strcmp(key, "deadbandPm") == 0) {
+      out.printf("%u", config.deadbandPm);
+    } else if (strcmp(key, "heartbeatInterval") == 0) {
+      out.printf("%u", config.heartbeatInterval);
+    }
+  });
+  out.print_P(PAGE_FOOTER);
+  out.end();
 }
 
-inline void handleSave() {
-  // Validate and set SSID
-  if (server.hasArg("ssid")) {
-    String ssid = server.arg("ssid");
-    if (ssid.length() < sizeof(config.ssid)) {
-      ssid.toCharArray(config.ssid, sizeof(config.ssid));
-    }
+constexpr uint32_t RESTART_DELAY = 5000; // let the response reach the browser
+
+inline void restartDevice(uint32_t now) {
+  journal.flush();  // the records still buffered in RAM
+  ESP.restart();
+}
+
+// Copy a text field of the form into config; a value that does not fit
+// keeps the old one
+inline void formText(const String &value, char* field, size_t size, bool allowEmpty = true) {
+  if (value.length() < size && (allowEmpty || value.length() > 0)) {
+    memcpy(field, value.c_str(), value.length() + 1);
   }
+}
+
+// Apply the /config form to config. The arguments are walked once by
+// index and compared in place, so no String is built for a name or value
+// and the values go straight into the fixed config fields.
+inline void applyConfigForm() {
+  // Checkboxes, only present in the form data when ticked
+  config.wifiReuseIp = 0;
+  config.mqttBinary = 0;
+  config.deadbandEnabled = 0;
+  config.powerSave = 0;
   
-  // Validate and set password
-  if (server.hasArg("password")) {
-    String password = server.arg("password");
-    if (password.length() < sizeof(config.password)) {
-      password.toCharArray(config.password, sizeof(config.password));
+  for (int i = 0; i < server.args(); i++) {
+    const char* key = server.argName(i).c_str();
+    const String &value = server.arg(i);
+    if (strcmp(key, "ssid") == 0) {
+      formText(value, config.ssid, sizeof(config.ssid));
+    } else if (strcmp(key, "password") == 0) {
+      formText(value, config.password, sizeof(config.password));
+    } else if (strcmp(key, "hostname") == 0) {
+      formText(value, config.hostname, sizeof(config.hostname), false);
+    } else if (strcmp(key, "mqttHost") == 0) {
+      formText(value, config.mqttHost, sizeof(config.mqttHost));
+    } else if (strcmp(key, "mqttPort") == 0) {
+      // 1-65535
+      long n = value.toInt();
+      if (n > 0 && n <= 65535) {
+        config.mqttPort = n;
+      }
+    } else if (strcmp(key, "mqttUser") == 0) {
+      formText(value, config.mqttUser, sizeof(config.mqttUser));
+    } else if (strcmp(key, "mqttPassword") == 0) {
+      formText(value, config.mqttPassword, sizeof(config.mqttPassword));
+    } else if (strcmp(key, "mqttTopic") == 0) {
+      formText(value, config.mqttTopic, sizeof(config.mqttTopic));
+    } else if (strcmp(key, "sendInterval") == 0) {
+      // 1-3600 seconds
+      long n = value.toInt();
+      if (n >= 1 && n <= 3600) {
+        config.sendInterval = n * 1000;
+      }
+    } else if (strcmp(key, "tempOffset") == 0) {
+      // -50.0 to 50.0
+      float f = value.toFloat();
+      if (f >= -50.0f && f <= 50.0f) {
+        config.tempOffset = f;
+      }
+    } else if (strcmp(key, "mqttBatchSize") == 0) {
+      // 1-MQTT_BATCH_MAX samples per message
+      long n = value.toInt();
+      if (n >= 1 && n <= MQTT_BATCH_MAX) {
+        config.mqttBatchSize = n;
+        mqttBatchCount = 0;
+      }
+    } else if (strcmp(key, "wifiReuseIp") == 0) {
+      config.wifiReuseIp = 1;
+    } else if (strcmp(key, "mqttBinary") == 0) {
+      config.mqttBinary = 1;
+    } else if (strcmp(key, "uplinkUrl") == 0) {
+      // Empty disables the binary uplink
+      formText(value, config.uplinkUrl, sizeof(config.uplinkUrl));
+    } else if (strcmp(key, "deadbandEnabled") == 0) {
+      config.deadbandEnabled = 1;
+    } else if (strcmp(key, "deadbandTemp") == 0) {
+      // Deadband thresholds 0 to 100, 0 sends on any change
+      float f = value.toFloat();
+      if (f >= 0.0f && f <= 100.0f) {
+        config.deadbandTemp = f;
+      }
+    } else if (strcmp(key, "deadbandHum") == 0) {
+      float f = value.toFloat();
+      if (f >= 0.0f && f <= 100.0f) {
+        config.deadbandHum = f;
+      }
+    } else if (strcmp(key, "deadbandPress") == 0) {
+      float f = value.toFloat();
+      if (f >= 0.0f && f <= 100.0f) {
+        config.deadbandPress = f;
+      }
+    } else if (strcmp(key, "deadbandPm") == 0) {
+      long n = value.toInt();
+      if (n >= 0 && n <= 100) {
+        config.deadbandPm = n;
+      }
+    } else if (strcmp(key, "heartbeatInterval") == 0) {
+      // HEARTBEAT_MIN to HEARTBEAT_MAX seconds
+      long n = value.toInt();
+      if (n >= HEARTBEAT_MIN && n <= HEARTBEAT_MAX) {
+        config.heartbeatInterval = n;
+      }
+    } else if (strcmp(key, "powerSave") == 0) {
+      config.powerSave = 1;
+    } else if (strcmp(key, "uplinkPeriod") == 0) {
+      // UPLINK_PERIOD_MIN to UPLINK_PERIOD_MAX minutes
+      long n = value.toInt();
+      if (n >= UPLINK_PERIOD_MIN && n <= UPLINK_PERIOD_MAX) {
+        config.uplinkPeriod = n;
+      }
     }
   }
+}
+
+inline void handleSave() {
+  applyConfigForm();
   
-  // Validate and set hostname
-  if (server.hasArg("hostname")) {
-    String hostname = server.arg("hostname");
-    if (hostname.length() > 0 && hostname.length() < sizeof(config.hostname)) {
-      hostname.toCharArray(config.hostname, sizeof(config.hostname));
-    }
+  saveConfig(config);
+  DBG_PRINTLN("Configuration saved");
+
+  // The new WiFi settings take effect with the restart. Joining the network
+  // here would drop the connection this response goes out on, and in setup
+  // mode take the access point's channel away from the browser.
+  ChunkedResponse &out = chunkedResponse;
+  out.begin("text/html");
+  out.print_P(PAGE_HEADER);
+  out.printf("<p>Gespeichert. Nach dem Neustart verbindet sich das Ger&auml;t mit ");
+  out.printEscaped(config.ssid);
+  out.printf(".</p>");
+  out.printf("<p>Neustart in 5s...</p>");
+  out.print_P(PAGE_FOOTER);
+  out.end();
+  scheduler.once("restart", restartDevice, RESTART_DELAY);
+}
+
+// Print a value in tenths as a decimal number, e.g. -5 -> "-0.5"
+inline void printTenths(ChunkedResponse &out, int16_t v, const char* suffix) {
+  int32_t a = v < 0 ? -(int32_t)v : v;
+  out.printf("%s%ld.%ld%s", v < 0 ? "-" : "", (long)(a / 10), (long)(a % 10), suffix);
+}
+
+// Stream the RAM history as JSON or CSV, oldest sample first: 5 minute
+// averages, then the samples of the last hours. Time is the uptime in
+// seconds; fields without a valid reading are null (JSON) or empty (CSV).
+inline void streamHistory(bool csv) {
+  ChunkedResponse &out = chunkedResponse;
+  bool first = true;
+  if (csv) {
+    out.begin("text/csv");
+    out.printf("uptime,pm25,temperature,humidity,pressure\n");
+  } else {
+    out.begin("application/json");
+    out.printf("{\"fields\":[\"uptime\",\"pm25\",\"temperature\",\"humidity\",\"pressure\"],\"samples\":[");
   }
-  
-  // Validate and set MQTT host
-  if (server.hasArg("mqttHost")) {
-    String mqttHost = server.arg("mqttHost");
-    if (mqttHost.length() < sizeof(config.mqttHost)) {
-      mqttHost.toCharArray(config.mqttHost, sizeof(config.mqttHost));
+  history.forEach([&](const HistoryEntry &e) {
+    const char* sep = ",";
+    const char* missing = csv ? "" : "null";
+    if (!csv) {
+      out.printf(first ? "[" : ",[");
+    }
+    first = false;
+    out.printf("%lu%s", (unsigned long)(e.timeMs / 1000), sep);
+    if (e.valid & SAMPLE_PM_VALID) {
+      out.printf("%d%s", e.v[0], sep);
+    } else {
+      out.printf("%s%s", missing, sep);
+    }
+    const char* end = csv ? "\n" : "]";
+    if (e.valid & SAMPLE_ENV_VALID) {
+      printTenths(out, e.v[1], sep);
+      printTenths(out, e.v[2], sep);
+      printTenths(out, e.v[3], end);
+    } else {
+      out.printf("%s%s%s%s%s%s", missing, sep, missing, sep, missing, end);
     }
+  });
+  if (!csv) {
+    out.printf("]}");
   }
-  
-  // Validate and set MQTT port (1-65535)
-  if (server.hasArg("mqttPort")) {
-    int port = server.arg("mqttPort").toInt();
-    if (port > 0 && port <= 65535) {
-      config.mqttPort = port;
+  out.end();
+}
+
+// /api/state body for the latest sample. It is serialized again only when
+// the snapshot's sequence number moves, so repeated polls just copy the
+// cached bytes or, with a matching If-None-Match, send a bare 304.
+class StateJsonCache {
+public:
+  void refresh(const Sample &s) {
+    if (_valid && s.seq == _seq) {
+      return;
     }
+    int len = formatStateJson(s, _json, sizeof(_json));
+    _len = (len > 0 && len < (int)sizeof(_json)) ? len : 0;
+    // Strong validator: CRC of the exact bytes served
+    snprintf(_etag, sizeof(_etag), "\"%08lx\"", (unsigned long)crc32(_json, _len));
+    _seq = s.seq;
+    _valid = true;
   }
-  
-  // Validate and set MQTT user
-  if (server.hasArg("mqttUser")) {
-    String mqttUser = server.arg("mqttUser");
-    if (mqttUser.length() < sizeof(config.mqttUser)) {
-      mqttUser.toCharArray(config.mqttUser, sizeof(config.mqttUser));
+
+  const char* json() const { return _json; }
+  size_t length() const { return _len; }
+  const char* etag() const { return _etag; }
+
+private:
+  char _json[STATE_JSON_SIZE];
+  size_t _len = 0;
+  char _etag[12];
+  uint32_t _seq = 0;
+  bool _valid = false;
+};
+
+extern StateJsonCache stateJsonCache;
+
+// Value of a collected request header. The core keeps Authorization and
+// If-None-Match in front of the sketch's keys, so the index is looked up
+// by name, comparing in place instead of building a String for it.
+inline const String &requestHeader(const char* name) {
+  for (int i = 0; i < server.headers(); i++) {
+    if (strcasecmp(server.headerName(i).c_str(), name) == 0) {
+      return server.header(i);
     }
   }
-  
-  // Validate and set MQTT password
-  if (server.hasArg("mqttPassword")) {
-    String mqttPassword = server.arg("mqttPassword");
-    if (mqttPassword.length() < sizeof(config.mqttPassword)) {
-      mqttPassword.toCharArray(config.mqttPassword, sizeof(config.mqttPassword));
+  return emptyString;
+}
+
+inline void handleApiState() {
+  if (sampleStore.empty()) {
+    server.send(503, "application/json", "{}");
+    return;
+  }
+  StateJsonCache &cache = stateJsonCache;
+  cache.refresh(sampleStore.latest());
+  server.sendHeader("ETag", cache.etag());
+  server.sendHeader("Cache-Control", "no-cache");
+  const String &ifNoneMatch = requestHeader("If-None-Match");
+  if (ifNoneMatch.length() > 0 && strcmp(ifNoneMatch.c_str(), cache.etag()) == 0) {
+    server.send(304);
+    return;
+  }
+  server.setContentLength(cache.length());
+  server.send(200, "application/json", "");
+  server.sendContent(cache.json(), cache.length());
+}
+
+#ifndef SSE_MAX_CLIENTS
+#define SSE_MAX_CLIENTS 4
+#endif
+
+constexpr unsigned long SSE_KEEPALIVE_INTERVAL = 15000;
+constexpr size_t SSE_EVENT_SIZE = STATE_JSON_SIZE + 48;
+
+// Server-Sent Events fan-out for /events. Each new sample is formatted once
+// and written to every subscriber whose socket has room for the whole event;
+// a client that is still busy skips ahead to the newest sample once it can
+// take data again, so a slow reader never holds back the loop.
+class EventStream {
+public:
+  bool subscribe(const NetClient &client) {
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+      Subscriber &sub = _subs[i];
+      if (!sub.active) {
+        sub.client = client;
+        sub.client.setNoDelay(true);
+        sub.sentSeq = 0;
+        sub.lastWrite = millis();
+        sub.active = true;
+        return true;
+      }
     }
+    return false;
   }
-  
-  // Validate and set MQTT topic
-  if (server.hasArg("mqttTopic")) {
-    String mqttTopic = server.arg("mqttTopic");
-    if (mqttTopic.length() < sizeof(config.mqttTopic)) {
-      mqttTopic.toCharArray(config.mqttTopic, sizeof(config.mqttTopic));
+
+  // Called from the acquisition path after a new sample was committed
+  void publish(const Sample &s) {
+    if (clientCount() == 0) {
+      return;
     }
+    stateJsonCache.refresh(s);
+    _len = snprintf(_event, sizeof(_event), "id: %lu\nevent: state\ndata: %s\n\n",
+                    (unsigned long)s.seq, stateJsonCache.json());
+    if (_len >= sizeof(_event)) {
+      _len = 0;
+      return;
+    }
+    _seq = s.seq;
+    service(millis());
   }
-  
-  // Validate and set send interval (1-3600 seconds)
-  if (server.hasArg("sendInterval")) {
-    unsigned long interval = server.arg("sendInterval").toInt();
-    if (interval >= 1 && interval <= 3600) {
-      config.sendInterval = interval * 1000;
+
+  // Deliver the latest event to clients that have not seen it yet, send
+  // keepalives and release closed connections
+  void service(uint32_t now) {
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+      Subscriber &sub = _subs[i];
+      if (!sub.active) {
+        continue;
+      }
+      if (!sub.client.connected()) {
+        sub.client.stop();
+        sub.client = NetClient();
+        sub.active = false;
+        continue;
+      }
+      if (_len > 0 && sub.sentSeq != _seq && sub.client.availableForWrite() >= _len) {
+        if (sub.sentSeq != 0 && _seq - sub.sentSeq > 1) {
+          eventsDropped += _seq - sub.sentSeq - 1;
+        }
+        sub.client.write(reinterpret_cast<const uint8_t*>(_event), _len);
+        sub.sentSeq = _seq;
+        sub.lastWrite = now;
+        eventsSent++;
+      } else if (now - sub.lastWrite >= SSE_KEEPALIVE_INTERVAL && sub.client.availableForWrite() >= 2) {
+        sub.client.write(reinterpret_cast<const uint8_t*>(":\n"), 2);
+        sub.lastWrite = now;
+      }
     }
   }
-  
-  // Validate and set temperature offset (-50.0 to 50.0)
-  if (server.hasArg("tempOffset")) {
-    float offset = server.arg("tempOffset").toFloat();
-    if (offset >= -50.0f && offset <= 50.0f) {
-      config.tempOffset = offset;
+
+  uint8_t clientCount() const {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+      n += _subs[i].active;
     }
+    return n;
   }
-  
-  saveConfig(config);
-  DBG_PRINTLN("Configuration saved");
 
-  WiFi.mode(WIFI_STA);
-  WiFi.hostname(config.hostname);
-  WiFi.begin(config.ssid, config.password);
-  // Note: WiFi connection will be checked in next loop iteration
-  // This is in handleSave() which is called from server.handleClient(),
-  // so blocking here is acceptable for configuration save
-  char html[512];
-  if (WiFi.status() == WL_CONNECTED) {
-    IPAddress ip = WiFi.localIP();
-    snprintf(html, sizeof(html),
-      "%s"
-      "<p>Verbunden mit %s</p>"
-      "<p>IP: %u.%u.%u.%u</p>"
-      "<p>Neustart in 5s...</p></div></body></html>",
-      htmlHeader().c_str(),
-      config.ssid, ip[0], ip[1], ip[2], ip[3]
-    );
-  } else {
-    snprintf(html, sizeof(html),
-      "%s"
-      "<p>Verbindung fehlgeschlagen.</p>"
-      "<p>Neustart in 5s...</p></div></body></html>",
-      htmlHeader().c_str()
-    );
+  // RAM held by the stream and by each client slot, the socket buffers of
+  // the TCP stack not included
+  static constexpr size_t memoryUsage() { return sizeof(EventStream); }
+  static constexpr size_t memoryPerClient() { return sizeof(Subscriber); }
+
+  uint32_t eventsSent = 0;
+  uint32_t eventsDropped = 0;  // samples a slow client skipped
+
+private:
+  struct Subscriber {
+    NetClient client;
+    uint32_t sentSeq;
+    uint32_t lastWrite;
+    bool active;
+  };
+
+  Subscriber _subs[SSE_MAX_CLIENTS] = {};
+  char _event[SSE_EVENT_SIZE];
+  size_t _len = 0;
+  uint32_t _seq = 0;
+};
+
+extern EventStream eventStream;
+
+inline void handleEvents() {
+  if (!eventStream.subscribe(server.client())) {
+    server.send(503, "text/plain", "Zu viele Verbindungen");
+    return;
+  }
+  // The response never ends, so the headers are written by hand and the
+  // socket stays open through the copy held by eventStream
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.sendContent_P(PSTR(
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "Access-Control-Allow-Origin: *\r\n\r\n"
+  ));
+  if (!sampleStore.empty()) {
+    eventStream.publish(sampleStore.latest());
+  }
+}
+
+inline void handleHistory() {
+  streamHistory(false);
+}
+
+inline void handleHistoryCsv() {
+  streamHistory(true);
+}
+
+// Requests served and heap allocations made per route. Counted around the
+// handler only, so the server's own request parsing does not hide which
+// page allocates; allocations need ALLOC_TRACKING (host builds).
+struct RouteStats {
+  const char* path;
+  uint32_t requests;
+  uint32_t allocs;
+};
+constexpr uint8_t WEB_ROUTE_MAX = 10;
+extern RouteStats routeStats[WEB_ROUTE_MAX];
+extern uint8_t routeCount;
+
+inline void route(const char* path, HTTPMethod method, void (*handler)()) {
+  if (routeCount >= WEB_ROUTE_MAX) {
+    DBG_PRINTLN("Too many routes");
+    return;
   }
-  server.send(200, "text/html", html);
-  shouldRestart = true;
+  uint8_t i = routeCount++;
+  routeStats[i] = {path, 0, 0};
+  // Small enough for std::function's inline storage, no allocation
+  server.on(path, method, [i, handler] {
+    uint32_t before = allocCount();
+    handler();
+    routeStats[i].requests++;
+    routeStats[i].allocs += allocCount() - before;
+  });
+}
+
+inline void route(const char* path, void (*handler)()) {
+  route(path, HTTP_ANY, handler);
 }
 
 inline void setupWeb() {
-  server.on("/", handleRoot);
-  server.on("/config", handleConfig);
-  server.on("/save", HTTP_POST, handleSave);
+  static const char* headerKeys[] = {"If-None-Match"};
+  server.collectHeaders(headerKeys, 1);
+  route("/", handleRoot);
+  route("/history", handleHistory);
+  route("/history.csv", handleHistoryCsv);
+  route("/api/state", handleApiState);
+  route("/events", handleEvents);
+  route("/config", handleConfig);
+  route("/save", HTTP_POST, handleSave);
   server.begin();
   DBG_PRINTLN("Web server started");
 }
@@ -240,5 +767,6 @@ inline void startAP() {
 inline void handleWeb() {
   dns.processNextRequest();
   server.handleClient();
+  eventStream.service(millis());
 }
 
@@ -0,0 +1,99 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "HAL.h"
+#include "Crc.h"
+#include "ConfigStore.h"
+
+// The last successful association: access point, channel and IP settings.
+// beginWiFi() hands BSSID and channel to WiFi.begin(), which then skips the
+// scan, and optionally reuses the IP instead of waiting for DHCP.
+//
+// The lease is kept in RTC memory, which survives the restart after saving
+// the config or an OTA update, and in LittleFS for the first boot after a
+// power loss. Flash is only written when the lease changed.
+
+constexpr uint32_t WIFI_LEASE_MAGIC = 0x4C574B49; // "IKWL"
+constexpr const char* WIFI_LEASE_PATH = "/wifi.bin";
+
+struct WiFiLease {
+  uint32_t magic;
+  uint32_t network;   // wifiNetworkHash() of the credentials it was made with
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t reserved;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint32_t crc;       // CRC-32 of everything before
+};
+
+static_assert(sizeof(WiFiLease) % 4 == 0, "RTC memory is accessed in 4-byte blocks");
+static_assert(RTC_BLOCK_WIFI_LEASE + sizeof(WiFiLease) / 4 <= RTC_BLOCK_SAMPLES, "WiFi lease overlaps the RTC sample buffer");
+
+// A lease is only used with the SSID and password it was made with
+inline uint32_t wifiNetworkHash(const char* ssid, const char* password) {
+  uint32_t h = crc32Update(0, reinterpret_cast<const uint8_t*>(ssid), strlen(ssid) + 1);
+  return crc32Update(h, reinterpret_cast<const uint8_t*>(password), strlen(password));
+}
+
+inline uint32_t wifiLeaseCrc(const WiFiLease &lease) {
+  return crc32(&lease, offsetof(WiFiLease, crc));
+}
+
+inline bool wifiLeaseValid(const WiFiLease &lease, uint32_t network) {
+  return lease.magic == WIFI_LEASE_MAGIC && lease.network == network &&
+         lease.channel >= 1 && lease.channel <= 14 && lease.crc == wifiLeaseCrc(lease);
+}
+
+// Find the lease for a network, RTC memory first
+inline bool loadWiFiLease(WiFiLease &lease, uint32_t network) {
+  if (rtcRead(RTC_BLOCK_WIFI_LEASE, &lease, sizeof(lease)) && wifiLeaseValid(lease, network)) {
+    return true;
+  }
+  if (!mountFS()) {
+    return false;
+  }
+  File f = LittleFS.open(WIFI_LEASE_PATH, "r");
+  if (!f) {
+    return false;
+  }
+  size_t r = f.read(reinterpret_cast<uint8_t*>(&lease), sizeof(lease));
+  f.close();
+  if (r != sizeof(lease) || !wifiLeaseValid(lease, network)) {
+    return false;
+  }
+  rtcWrite(RTC_BLOCK_WIFI_LEASE, &lease, sizeof(lease));
+  return true;
+}
+
+// Remember the current association
+inline void storeWiFiLease(WiFiLease &lease) {
+  lease.magic = WIFI_LEASE_MAGIC;
+  lease.reserved = 0;
+  lease.crc = wifiLeaseCrc(lease);
+  WiFiLease known;
+  if (loadWiFiLease(known, lease.network) && memcmp(&known, &lease, sizeof(lease)) == 0) {
+    return;
+  }
+  rtcWrite(RTC_BLOCK_WIFI_LEASE, &lease, sizeof(lease));
+  if (!mountFS()) {
+    return;
+  }
+  File f = LittleFS.open(WIFI_LEASE_PATH, "w");
+  if (f) {
+    f.write(reinterpret_cast<const uint8_t*>(&lease), sizeof(lease));
+    f.close();
+  }
+}
+
+// The access point did not answer on the cached BSSID and channel
+inline void clearWiFiLease() {
+  WiFiLease empty;
+  memset(&empty, 0, sizeof(empty));
+  rtcWrite(RTC_BLOCK_WIFI_LEASE, &empty, sizeof(empty));
+  if (mountFS() && LittleFS.exists(WIFI_LEASE_PATH)) {
+    LittleFS.remove(WIFI_LEASE_PATH);
+  }
+}
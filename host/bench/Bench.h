@@ -0,0 +1,54 @@
+#pragma once
+#include <chrono>
+#include <stdio.h>
+#include "Test.h"
+
+// Wall-clock timing for host benchmarks. Figures are for the host CPU and
+// only meaningful relative to each other; under ctest (--quick) the runs are
+// shortened to a smoke test.
+
+namespace bench {
+
+inline uint64_t iterations(uint64_t full, uint64_t quick = 0) {
+  return test::quick ? (quick ? quick : (full / 100 > 0 ? full / 100 : 1)) : full;
+}
+
+// Nanoseconds per call of fn(i) over n calls
+template <typename Fn>
+double nsPerOp(uint64_t n, Fn fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < n; i++) {
+    fn(i);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / (n ? n : 1);
+}
+
+// Time-stamp counter cycles per call of fn(i) on x86-64, 0 elsewhere. The
+// TSC runs at a fixed rate close to the nominal clock, not the core clock
+template <typename Fn>
+double cyclesPerOp(uint64_t n, Fn fn) {
+#if defined(__x86_64__)
+  uint64_t start = __builtin_ia32_rdtsc();
+  for (uint64_t i = 0; i < n; i++) {
+    fn(i);
+  }
+  return (double)(__builtin_ia32_rdtsc() - start) / (n ? n : 1);
+#else
+  return 0;
+#endif
+}
+
+// Keep the compiler from dropping a computed value
+template <typename T>
+inline void keep(const T &v) {
+  asm volatile("" : : "g"(&v) : "memory");
+}
+
+inline void report(const char* name, const char* fmt, double value) {
+  printf("  %-40s ", name);
+  printf(fmt, value);
+  printf("\n");
+}
+
+} // namespace bench
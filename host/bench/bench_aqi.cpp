@@ -0,0 +1,47 @@
+#include "Board.h"
+#include "Bench.h"
+#include <random>
+#include <vector>
+
+// Integer AQI against the float reference. The host has an FPU, so the
+// gap here understates the one on the ESP8266, where every float operation
+// of the reference is a soft-float library call.
+
+enum Domain { INDOOR, INTEGER_RANGE, FULL_RANGE };
+static const char* const DOMAIN_NAMES[] = {"indoor readings", "uniform 0..16383", "uniform 0..65535"};
+
+static std::vector<uint16_t> inputs(Domain domain) {
+  std::mt19937 rng(3);
+  std::vector<uint16_t> v(65536);
+  for (auto &pm : v) {
+    // Indoor readings sit in the first segments. Up to AQI_PM25_INT_MAX
+    // every segment is used; above it the float fallback
+    if (domain == INDOOR) {
+      pm = (uint16_t)std::min(1000.0, std::exponential_distribution<double>(0.08)(rng));
+    } else {
+      pm = (uint16_t)(rng() % (domain == INTEGER_RANGE ? AQI_PM25_INT_MAX + 1 : 65536));
+    }
+  }
+  return v;
+}
+
+TEST(aqi_cost) {
+  uint64_t n = bench::iterations(50000000, 200000);
+  printf("PM2.5 AQI, %llu calls\n", (unsigned long long)n);
+  for (Domain d : {INDOOR, INTEGER_RANGE, FULL_RANGE}) {
+    std::vector<uint16_t> v = inputs(d);
+    const char* domain = DOMAIN_NAMES[d];
+    uint32_t sum = 0;
+    double intNs = bench::nsPerOp(n, [&](uint64_t i) { sum += calculatePM25AQI(v[i & 65535]); });
+    bench::keep(sum);
+    uint32_t sumFloat = 0;
+    double floatNs = bench::nsPerOp(n, [&](uint64_t i) { sumFloat += calculatePM25AQIFloat(v[i & 65535]); });
+    bench::keep(sumFloat);
+    CHECK_EQ(sum, sumFloat);
+    char name[64];
+    snprintf(name, sizeof(name), "integer, %s", domain);
+    bench::report(name, "%.2f ns", intNs);
+    snprintf(name, sizeof(name), "float, %s", domain);
+    bench::report(name, "%.2f ns", floatNs);
+  }
+}
@@ -0,0 +1,80 @@
+#include "Board.h"
+#include "Bench.h"
+
+// I2C transactions, bus time and host time per BME280 sample: the
+// forced-mode burst-read driver against the access pattern of the Adafruit
+// library it replaced (trigger, poll status until the conversion is done,
+// then readTemperature(), readPressure() and readHumidity(), the last two
+// re-reading the temperature for t_fine)
+
+struct Bus {
+  TwoWire wire;
+  host::FakeBme280 chip;
+  Bus() { wire.attach(BME280_I2C_ADDRESS, &chip); }
+};
+
+static void readRegs(TwoWire &w, uint8_t reg, uint8_t* out, uint8_t n) {
+  w.beginTransmission(BME280_I2C_ADDRESS);
+  w.write(reg);
+  w.endTransmission(false);
+  w.requestFrom((uint8_t)BME280_I2C_ADDRESS, n);
+  for (uint8_t i = 0; i < n; i++) {
+    out[i] = w.read();
+  }
+}
+
+static void librarySample(TwoWire &w) {
+  uint8_t b[3];
+  w.beginTransmission(BME280_I2C_ADDRESS);
+  w.write(BME280_REG_CTRL_MEAS);
+  w.write(BME280_CTRL_MEAS_SLEEP | BME280_MODE_FORCED);
+  w.endTransmission();
+  do {
+    delay(1);
+    readRegs(w, BME280_REG_STATUS, b, 1);
+  } while (b[0] & 0x08);
+  readRegs(w, 0xFA, b, 3);  // readTemperature()
+  readRegs(w, 0xFA, b, 3);  // readPressure(): temperature again
+  readRegs(w, 0xF7, b, 3);
+  readRegs(w, 0xFA, b, 3);  // readHumidity(): temperature again
+  readRegs(w, 0xFD, b, 2);
+}
+
+TEST(sample_cost) {
+  uint64_t n = bench::iterations(20000, 200);
+  printf("BME280 sample, %llu samples\n", (unsigned long long)n);
+
+  Bus lib;
+  uint32_t tx0 = lib.wire.transactions;
+  uint64_t t0 = host::nowMicros();
+  double libNs = bench::nsPerOp(n, [&](uint64_t) { librarySample(lib.wire); });
+  double libTx = double(lib.wire.transactions - tx0) / n;
+  double libUs = double(host::nowMicros() - t0) / n;
+
+  Bus drv;
+  BME280Driver driver;
+  CHECK(driver.begin(BME280_I2C_ADDRESS, drv.wire));
+  tx0 = drv.wire.transactions;
+  uint64_t busy = 0;
+  double drvNs = bench::nsPerOp(n, [&](uint64_t) {
+    uint64_t a = host::nowMicros();
+    driver.startMeasurement(millis());
+    busy += host::nowMicros() - a;
+    host::advanceMillis(BME280_CONVERSION_TIME);  // other loop() passes run meanwhile
+    a = host::nowMicros();
+    driver.poll(millis());
+    busy += host::nowMicros() - a;
+    bench::keep(driver.readPressure());
+  });
+  double drvTx = double(drv.wire.transactions - tx0) / n;
+  double drvUs = double(busy) / n;
+
+  bench::report("library pattern, I2C start conditions", "%.1f", libTx);
+  bench::report("library pattern, blocking time", "%.0f us", libUs);
+  bench::report("library pattern, host time", "%.0f ns", libNs);
+  bench::report("burst driver, I2C start conditions", "%.1f", drvTx);
+  bench::report("burst driver, blocking time", "%.0f us", drvUs);
+  bench::report("burst driver, host time", "%.0f ns", drvNs);
+  CHECK_LT(drvTx, libTx);
+  CHECK_LT(drvUs, libUs / 5);
+}
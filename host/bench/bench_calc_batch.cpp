@@ -0,0 +1,73 @@
+#include "Board.h"
+#include "Bench.h"
+#include "CalculationsBatch.h"
+#include <random>
+#include <vector>
+
+// calculateDerivedBatch() on structure-of-arrays columns against
+// calculateDerived() on an array of samples, at history-replay sizes. Built
+// as bench_calc_batch and, with the hand-written AVX2 loop, as
+// bench_calc_batch_avx2.
+
+struct Columns {
+  std::vector<uint16_t> pm25, aqi;
+  std::vector<uint8_t> aqiCategory;
+  std::vector<float> temperature, humidity, dewPoint, comfortIndex;
+
+  explicit Columns(size_t n)
+    : pm25(n), aqi(n), aqiCategory(n), temperature(n), humidity(n), dewPoint(n), comfortIndex(n) {}
+};
+
+static void measure(size_t n) {
+  std::mt19937 rng(4);
+  Columns c(n);
+  std::vector<Sample> samples(n);
+  for (size_t i = 0; i < n; i++) {
+    Sample &s = samples[i];
+    s.valid = SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+    s.pm25 = c.pm25[i] = (uint16_t)std::min(1000.0, std::exponential_distribution<double>(0.08)(rng));
+    s.temperature = c.temperature[i] = std::normal_distribution<float>(21.0f, 2.0f)(rng);
+    s.humidity = c.humidity[i] = std::uniform_real_distribution<float>(20.0f, 80.0f)(rng);
+  }
+  pm25AqiTable();  // built once per process, not part of a pass
+
+  double scalarNs = bench::nsPerOp(1, [&](uint64_t) {
+    for (Sample &s : samples) {
+      calculateDerived(s);
+    }
+  }) / n;
+  bench::keep(samples[n - 1]);
+  double batchNs = bench::nsPerOp(1, [&](uint64_t) {
+    calculateDerivedBatch({c.pm25.data(), c.temperature.data(), c.humidity.data()},
+                          {c.aqi.data(), c.aqiCategory.data(), c.dewPoint.data(), c.comfortIndex.data()}, n);
+  }) / n;
+  bench::keep(c.comfortIndex[n - 1]);
+  double envNs = bench::nsPerOp(1, [&](uint64_t) {
+    calculateEnvBatch(c.temperature.data(), c.humidity.data(), c.dewPoint.data(), c.comfortIndex.data(), n);
+  }) / n;
+  bench::keep(c.dewPoint[n - 1]);
+  CHECK(memcmp(&c.dewPoint[n - 1], &samples[n - 1].dewPoint, sizeof(float)) == 0);
+
+  char name[64];
+  snprintf(name, sizeof(name), "calculateDerived, %zu samples", n);
+  bench::report(name, "%.2f ns/sample", scalarNs);
+  snprintf(name, sizeof(name), "calculateDerivedBatch, %zu samples", n);
+  bench::report(name, "%.2f ns/sample", batchNs);
+  snprintf(name, sizeof(name), "calculateEnvBatch, %zu samples", n);
+  bench::report(name, "%.2f ns/sample", envNs);
+}
+
+TEST(batch_cost) {
+#if defined(CALCULATIONS_BATCH_AVX2) && defined(__AVX2__)
+  if (!__builtin_cpu_supports("avx2")) {
+    printf("no AVX2 on this CPU, skipped\n");
+    return;
+  }
+  printf("Derived values, AVX2 loop\n");
+#else
+  printf("Derived values, compiler-vectorized loop\n");
+#endif
+  for (size_t n : {bench::iterations(1000000, 10000), bench::iterations(10000000, 100000)}) {
+    measure(n);
+  }
+}
@@ -0,0 +1,58 @@
+#include "Board.h"
+#include "Bench.h"
+#include <random>
+#include <vector>
+
+// Cycles per call of the derived-value math against the libm versions. On
+// the x86 host logf is a few hardware instructions; on the ESP8266 every
+// float operation is a soft-float call, where the libm path's extra
+// divisions and newlib's logf weigh far more.
+
+struct EnvInput {
+  float t, h;
+};
+
+static std::vector<EnvInput> indoorInputs() {
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<float> t(15.0f, 30.0f), h(20.0f, 80.0f);
+  std::vector<EnvInput> v(4096);
+  for (auto &e : v) {
+    e = {t(rng), h(rng)};
+  }
+  return v;
+}
+
+template <typename Fn>
+static void measure(const char* name, uint64_t n, Fn fn) {
+  float sum = 0;
+  double cycles = bench::cyclesPerOp(n, [&](uint64_t i) { sum += fn(i); });
+  double ns = bench::nsPerOp(n, [&](uint64_t i) { sum += fn(i); });
+  bench::keep(sum);
+  printf("  %-40s %6.1f cycles %6.2f ns\n", name, cycles, ns);
+}
+
+TEST(derived_value_cost) {
+  uint64_t n = bench::iterations(20000000, 100000);
+  std::vector<EnvInput> in = indoorInputs();
+  printf("Derived values, %llu calls, TSC cycles\n", (unsigned long long)n);
+  measure("fastLogf", n, [&](uint64_t i) { return fastLogf(in[i & 4095].h); });
+  measure("logf", n, [&](uint64_t i) { return logf(in[i & 4095].h); });
+  measure("calculateDewPoint", n, [&](uint64_t i) { return calculateDewPoint(in[i & 4095].t, in[i & 4095].h); });
+  measure("calculateDewPointLibm", n, [&](uint64_t i) {
+    return calculateDewPointLibm(in[i & 4095].t, in[i & 4095].h);
+  });
+  measure("calculateComfortIndex", n, [&](uint64_t i) {
+    return calculateComfortIndex(in[i & 4095].t, in[i & 4095].h);
+  });
+
+  // The whole step as sampleTask() runs it
+  Sample s = {};
+  s.valid = SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+  measure("calculateDerived", n, [&](uint64_t i) {
+    s.pm25 = i & 255;
+    s.temperature = in[i & 4095].t;
+    s.humidity = in[i & 4095].h;
+    calculateDerived(s);
+    return s.dewPoint + s.comfortIndex + s.aqi;
+  });
+}
@@ -0,0 +1,52 @@
+#include "Board.h"
+#include "Bench.h"
+
+// Reading the config at boot: ConfigStore::load() over a freshly compacted
+// log and over one grown to just under CONFIG_LOG_MAX by single-field
+// edits, where every record is read twice (once to find the last commit,
+// once to apply it), and the whole of loadConfig().
+
+static void loadCost(const char* label) {
+  uint64_t n = bench::iterations(100000, 1000);
+  DeviceConfig defaults;
+  resetConfig(defaults);
+  uint32_t records = 0;
+  double ns = bench::nsPerOp(n, [&](uint64_t) {
+    ConfigStore store(CONFIG_PATH, CONFIG_TMP_PATH, CONFIG_FIELDS, CONFIG_FIELD_COUNT);
+    DeviceConfig cfg = defaults;
+    store.load(&cfg, &defaults);
+    records = store.recordsRead;
+    bench::keep(cfg);
+  });
+  char name[96];
+  snprintf(name, sizeof(name), "load, %s (%zu bytes, %u records)", label, LittleFS.fileSize(CONFIG_PATH),
+           (unsigned)records);
+  bench::report(name, "%.2f us", ns / 1000);
+}
+
+TEST(boot_load_cost) {
+  host::Board board;
+  board.boot();
+  printf("Config at boot, %u fields\n", (unsigned)CONFIG_FIELD_COUNT);
+  loadCost("compacted");
+
+  // Single-field edits up to the size where the next one would compact
+  constexpr size_t EDIT = CONFIG_RECORD_HEAD + sizeof(uint32_t) + 4 + CONFIG_COMMIT_SIZE;
+  uint32_t compactions = configStore.compactions;
+  DeviceConfig cfg = config;
+  while (LittleFS.fileSize(CONFIG_PATH) + EDIT <= CONFIG_LOG_MAX) {
+    cfg.sendInterval += 1000;
+    CHECK(configStore.save(&cfg));
+  }
+  CHECK_EQ(configStore.compactions, compactions);
+  loadCost("single-field edits");
+
+  uint64_t n = bench::iterations(100000, 1000);
+  double ns = bench::nsPerOp(n, [&](uint64_t) {
+    configStore = ConfigStore(CONFIG_PATH, CONFIG_TMP_PATH, CONFIG_FIELDS, CONFIG_FIELD_COUNT);
+    loadConfig(config);
+    bench::keep(config);
+  });
+  bench::report("loadConfig(), single-field edits", "%.2f us", ns / 1000);
+  CHECK(!configStore.pending());
+}
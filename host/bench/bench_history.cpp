@@ -0,0 +1,68 @@
+#include "Board.h"
+#include "Bench.h"
+#include <random>
+
+// Cost of the two-tier history: append per sample (delta encoding plus the
+// 5 minute average), decoding the full history, and how much of a day each
+// tier holds for indoor-like data at a 10 s interval
+
+struct Room {
+  std::mt19937 rng{7};
+  double pm = 8, t = 21.0, h = 45.0, p = 1013.0;
+
+  Sample next() {
+    std::normal_distribution<double> step(0, 1);
+    pm = std::max(0.0, pm + step(rng) * 0.8 + (rng() % 500 == 0 ? 40 : 0) - (pm > 10 ? 0.05 * (pm - 10) : 0));
+    t = std::min(30.0, std::max(15.0, t + step(rng) * 0.05));
+    h = std::min(90.0, std::max(20.0, h + step(rng) * 0.2));
+    p = std::min(1040.0, std::max(980.0, p + step(rng) * 0.03));
+    Sample s = {};
+    s.valid = SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+    s.pm25 = (uint16_t)lround(pm);
+    s.temperature = t;
+    s.humidity = h;
+    s.pressure = p;
+    return s;
+  }
+};
+
+static SampleHistory ring;
+
+TEST(history_cost) {
+  constexpr uint32_t INTERVAL_MS = 10000;
+  uint64_t n = bench::iterations(100000, 20000);
+  printf("Sample history, %llu samples at 10 s (%.1f days)\n", (unsigned long long)n, n * 10.0 / 86400);
+
+  Room room;
+  std::vector<Sample> samples(4096);
+  for (auto &s : samples) {
+    s = room.next();
+  }
+  double appendNs = bench::nsPerOp(n, [&](uint64_t i) { ring.append(samples[i & 4095], (uint32_t)(i * INTERVAL_MS)); });
+
+  uint32_t entries = 0;
+  int32_t sum = 0;
+  uint64_t rounds = bench::iterations(2000, 20);
+  double decodeNs = bench::nsPerOp(rounds, [&](uint64_t) {
+    entries = 0;
+    ring.forEach([&](const HistoryEntry &e) {
+      sum += e.v[0];
+      entries++;
+    });
+  });
+  bench::keep(sum);
+
+  uint32_t first = UINT32_MAX, last = 0;
+  ring.forEach([&](const HistoryEntry &e) {
+    first = std::min(first, e.timeMs);
+    last = e.timeMs;
+  });
+
+  bench::report("append", "%.1f ns/sample", appendNs);
+  bench::report("decode all entries", "%.1f ns/entry", decodeNs / entries);
+  bench::report("RAM", "%.0f bytes", (double)SampleHistory::memoryUsage());
+  bench::report("entries served", "%.0f", (double)entries);
+  bench::report("5 minute averages stored", "%.0f", (double)ring.coarseCount());
+  bench::report("span", "%.1f h", (last - first) / 3600000.0);
+  CHECK_GE(last - first, 24 * 3600 * 1000UL - HISTORY_COARSE_INTERVAL);
+}
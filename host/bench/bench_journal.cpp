@@ -0,0 +1,64 @@
+#include "Board.h"
+#include "Bench.h"
+
+// Journal cost: append per sample, replay throughput (peek, backlog JSON,
+// publish, consume) on the host CPU, flash bytes and write calls per record,
+// and how long draining a full journal takes at the replay rate limit
+
+static Sample makeSample(uint32_t uptime) {
+  Sample s = {};
+  s.valid = SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+  s.uptime = uptime;
+  s.pm25 = (uint16_t)(uptime % 97);
+  s.temperature = 21.5f;
+  s.humidity = 45.0f;
+  s.pressure = 1013.25f;
+  return s;
+}
+
+TEST(journal_cost) {
+  host::Board board;
+  board.boot();
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE; }, 30000));
+
+  uint64_t n = bench::iterations(JOURNAL_MAX_SEGMENTS * JOURNAL_SEGMENT_RECORDS, 1024);
+  printf("Sample journal, %llu records\n", (unsigned long long)n);
+
+  uint64_t bytes = LittleFS.bytesWritten;
+  uint32_t writes = LittleFS.writeCalls;
+  double appendNs = bench::nsPerOp(n, [&](uint64_t i) { journal.append(makeSample((uint32_t)i * 10)); });
+  journal.flush();
+  bytes = LittleFS.bytesWritten - bytes;
+  writes = LittleFS.writeCalls - writes;
+  CHECK_EQ(journal.pending(), (uint32_t)n);
+
+  uint32_t messages = 0;
+  uint64_t wire = board.broker.bytesIn;
+  auto start = std::chrono::steady_clock::now();
+  while (!journal.empty()) {
+    JournalRecord records[JOURNAL_BATCH_RECORDS];
+    size_t got = journal.peek(records, JOURNAL_BATCH_RECORDS);
+    if (got == 0) {
+      continue;
+    }
+    size_t packed = publishBacklog(records, got);
+    CHECK_GT(packed, 0u);
+    journal.consume(packed);
+    messages++;
+  }
+  double replayNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  wire = board.broker.bytesIn - wire;
+  CHECK_EQ(journal.recordsReplayed, (uint32_t)n);
+
+  double drainS = (double)messages * JOURNAL_BATCH_INTERVAL / 1000.0;
+  bench::report("append", "%.1f ns/record", appendNs);
+  bench::report("replay", "%.1f ns/record", replayNs / n);
+  bench::report("replay throughput (host CPU)", "%.0f records/s", n / (replayNs / 1e9));
+  bench::report("flash bytes per record", "%.1f", (double)bytes / n);
+  bench::report("flash writes per record", "%.3f", (double)writes / n);
+  bench::report("backlog messages", "%.0f", (double)messages);
+  bench::report("MQTT bytes per record", "%.1f", (double)wire / n);
+  bench::report("drain time at the rate limit", "%.0f s", drainS);
+  CHECK_LE(bytes, n * sizeof(JournalRecord));
+  CHECK_LE(writes, n / JOURNAL_FLUSH_RECORDS + 1);
+}
@@ -0,0 +1,51 @@
+#include "Board.h"
+#include "Bench.h"
+
+// MQTT bytes on the wire per sample for batch sizes 1 to MQTT_BATCH_MAX:
+// the state topic alone and everything the sample causes (SENSOR message,
+// availability), counted by the broker as MQTT 3.1.1 packets, plus the
+// CPU time of publishSensorData()
+
+TEST(batch_bytes_on_wire) {
+  host::Board board;
+  board.boot();
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE; }, 30000));
+  board.run(30000);
+  Sample s = sampleStore.latest();
+  CHECK(s.pmValid() && s.envValid());
+
+  uint64_t n = bench::iterations(24000, 480);
+  printf("MQTT batching, %llu samples per batch size\n", (unsigned long long)n);
+  const uint8_t sizes[] = {1, 2, 6, 12, MQTT_BATCH_MAX};
+  double single = 0;
+  for (uint8_t batch : sizes) {
+    config.mqttBatchSize = batch;
+    mqttBatchCount = 0;
+    board.broker.clearLog();
+    uint64_t bytes = board.broker.bytesIn;
+    double ns = bench::nsPerOp(n, [&](uint64_t i) {
+      s.uptime = (uint32_t)i * 10;
+      publishSensorData(s);
+    });
+    bytes = board.broker.bytesIn - bytes;
+    uint64_t state = 0;
+    for (const auto &m : board.broker.log()) {
+      if (m.topic == "tele/ikea-air-monitor/state") {
+        state += host::mqttPacketSize(2 + m.topic.size() + m.payload.size());
+      }
+    }
+    if (batch == 1) {
+      single = (double)bytes / n;
+    }
+    char name[48];
+    snprintf(name, sizeof(name), "batch %u: state topic", batch);
+    bench::report(name, "%.1f bytes/sample", (double)state / n);
+    snprintf(name, sizeof(name), "batch %u: all topics", batch);
+    bench::report(name, "%.1f bytes/sample", (double)bytes / n);
+    snprintf(name, sizeof(name), "batch %u: publishSensorData", batch);
+    bench::report(name, "%.0f ns/sample", ns);
+    if (batch > 1) {
+      CHECK_LT((double)bytes / n, single);
+    }
+  }
+}
@@ -0,0 +1,85 @@
+#include "Board.h"
+#include "Bench.h"
+#include "Statistics.h"
+#include <algorithm>
+#include <random>
+
+// Cost of the streaming window statistics per reading, against keeping the
+// window and sorting it for an exact p95 at publish time
+
+static std::vector<float> readings(size_t n, bool ascending) {
+  std::mt19937 rng(11);
+  std::normal_distribution<float> d(21.0f, 0.5f);
+  std::vector<float> v(n);
+  for (size_t i = 0; i < n; i++) {
+    v[i] = ascending ? 20.0f + i * 1e-4f : d(rng);
+  }
+  return v;
+}
+
+TEST(streaming_cost_per_reading) {
+  uint64_t n = bench::iterations(10000000, 100000);
+  printf("Streaming statistics, %llu readings\n", (unsigned long long)n);
+  for (bool ascending : {false, true}) {
+    // Ascending input enters the p95 tail on every reading, the worst case
+    std::vector<float> v = readings(65536, ascending);
+    const char* input = ascending ? "ascending" : "normal";
+    char name[64];
+
+    RunningStats stats;
+    double ns = bench::nsPerOp(n, [&](uint64_t i) { stats.add(v[i & 65535]); });
+    bench::keep(stats);
+    snprintf(name, sizeof(name), "RunningStats::add, %s", input);
+    bench::report(name, "%.2f ns", ns);
+
+    P2Quantile p95(0.95f);
+    ns = bench::nsPerOp(n, [&](uint64_t i) { p95.add(v[i & 65535]); });
+    bench::keep(p95);
+    snprintf(name, sizeof(name), "P2Quantile::add, %s", input);
+    bench::report(name, "%.2f ns", ns);
+
+    WindowStats w;
+    ns = bench::nsPerOp(n, [&](uint64_t i) { w.add(v[i & 65535]); });
+    FieldStats f;
+    w.summarize(f);
+    bench::keep(f);
+    snprintf(name, sizeof(name), "WindowStats::add, %s", input);
+    bench::report(name, "%.2f ns", ns);
+    CHECK_EQ(w.count(), n);
+  }
+}
+
+TEST(window_against_sorting) {
+  // Per window: stream every reading and summarize once, against keeping
+  // the readings and sorting them for the p95
+  std::vector<float> v = readings(65536, false);
+  printf("Window of n readings, streaming vs. sort\n");
+  for (size_t window : {10, 60, 600, 3600}) {
+    uint64_t rounds = bench::iterations(2000000 / window, 100);
+    WindowStats w;
+    FieldStats f = {};
+    double streamNs = bench::nsPerOp(rounds, [&](uint64_t r) {
+      w.reset();
+      for (size_t i = 0; i < window; i++) {
+        w.add(v[(r * window + i) & 65535]);
+      }
+      w.summarize(f);
+      bench::keep(f);
+    });
+    std::vector<float> kept(window);
+    float p95 = 0;
+    double sortNs = bench::nsPerOp(rounds, [&](uint64_t r) {
+      for (size_t i = 0; i < window; i++) {
+        kept[i] = v[(r * window + i) & 65535];
+      }
+      std::sort(kept.begin(), kept.end());
+      p95 = kept[lround(0.95 * (window - 1))];
+      bench::keep(p95);
+    });
+    char name[64];
+    snprintf(name, sizeof(name), "n=%zu streaming (%zu bytes)", window, sizeof(WindowStats));
+    bench::report(name, "%.0f ns/window", streamNs);
+    snprintf(name, sizeof(name), "n=%zu kept and sorted (%zu bytes)", window, window * sizeof(float));
+    bench::report(name, "%.0f ns/window", sortNs);
+  }
+}
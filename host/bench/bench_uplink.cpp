@@ -0,0 +1,49 @@
+#include "Board.h"
+#include "Bench.h"
+
+// Cost of the binary uplink frame next to the state JSON: encode and
+// decode time on the host CPU and bytes per sample
+
+TEST(uplink_cost) {
+  Sample s = {};
+  s.valid = SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+  s.pm25 = 12;
+  s.temperature = 21.5f;
+  s.humidity = 45.0f;
+  s.pressure = 1013.25f;
+  s.aqi = 50;
+  s.aqiCategory = 1;
+  s.dewPoint = 9.0f;
+  s.comfortIndex = 100.0f;
+
+  uint64_t n = bench::iterations(2000000, 20000);
+  printf("Uplink frame, %llu samples\n", (unsigned long long)n);
+  UplinkFrame f;
+  double encodeNs = bench::nsPerOp(n, [&](uint64_t i) {
+    s.seq = (uint32_t)i;
+    encodeUplink(s, f);
+    bench::keep(f);
+  });
+  uint32_t ok = 0;
+  double decodeNs = bench::nsPerOp(n, [&](uint64_t i) {
+    UplinkFrame out;
+    ok += decodeUplink(reinterpret_cast<const uint8_t*>(&f), sizeof(f), out);
+    bench::keep(out);
+  });
+  CHECK_EQ(ok, (uint32_t)n);
+
+  char json[STATE_JSON_SIZE];
+  int jsonLen = 0;
+  double jsonNs = bench::nsPerOp(n / 10, [&](uint64_t i) {
+    s.uptime = (uint32_t)i;
+    jsonLen = formatStateJson(s, json, sizeof(json));
+    bench::keep(json);
+  });
+
+  bench::report("encode", "%.1f ns", encodeNs);
+  bench::report("decode with CRC check", "%.1f ns", decodeNs);
+  bench::report("state JSON for comparison", "%.1f ns", jsonNs);
+  bench::report("frame size", "%.0f bytes", (double)sizeof(UplinkFrame));
+  bench::report("state JSON size", "%.0f bytes", (double)jsonLen);
+  CHECK_LT(sizeof(UplinkFrame), (size_t)jsonLen);
+}
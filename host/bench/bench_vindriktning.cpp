@@ -0,0 +1,51 @@
+#include "Board.h"
+#include "Bench.h"
+#include <random>
+#include <vector>
+
+// VindriktningParser throughput on clean and corrupted streams. The UART
+// delivers 960 bytes/s at most, so anything in the MB/s range leaves the
+// parser far below 1 % of a loop() pass.
+
+static std::vector<uint8_t> makeStream(size_t frames, bool corrupt) {
+  std::minstd_rand rng(7);
+  std::vector<uint8_t> s;
+  uint8_t f[VINDRIKTNING_FRAME_SIZE];
+  for (size_t i = 0; i < frames; i++) {
+    host::vindriktningFrame((uint16_t)(rng() % 1000), f);
+    if (corrupt && i % 10 == 0) {
+      f[5 + rng() % 14] ^= 0x10;
+    }
+    s.insert(s.end(), f, f + sizeof(f));
+    if (corrupt && i % 10 == 5) {
+      for (int j = 0; j < 7; j++) {
+        s.push_back((uint8_t)rng());
+      }
+    }
+  }
+  return s;
+}
+
+TEST(parser_throughput) {
+  uint64_t frames = bench::iterations(500000, 2000);
+  printf("VindriktningParser, %llu frames\n", (unsigned long long)frames);
+  for (bool corrupt : {false, true}) {
+    std::vector<uint8_t> stream = makeStream(frames, corrupt);
+    for (size_t chunk : {1, 20, 64}) {
+      VindriktningParser p;
+      size_t chunks = (stream.size() + chunk - 1) / chunk;
+      double ns = bench::nsPerOp(chunks, [&](uint64_t i) {
+        size_t off = i * chunk;
+        p.feed(stream.data() + off, std::min(chunk, stream.size() - off), (uint32_t)i);
+      });
+      double nsPerByte = ns * chunks / stream.size();
+      char name[64];
+      snprintf(name, sizeof(name), "%s, %zu-byte chunks", corrupt ? "10% corrupted" : "clean", chunk);
+      bench::report(name, "%.2f ns/byte", nsPerByte);
+      CHECK_GT(p.frameCount, 0u);
+      if (!corrupt) {
+        CHECK_EQ(p.frameCount, frames);
+      }
+    }
+  }
+}
@@ -0,0 +1,223 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+
+// Arduino core stand-in for the host build.
+//
+// Only what the sketch uses: flash access macros, timing on a virtual clock,
+// String, Print/Stream, IPAddress and the few ESP methods the sketch calls
+// directly. Everything below HAL.h lives in the other headers of this
+// directory and in HostDrivers.h.
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+using std::min;
+using std::max;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Flash is ordinary memory on the host
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper*>(p))
+#define F(s) FPSTR(s)
+
+inline size_t strlen_P(PGM_P s) { return strlen(s); }
+inline void* memcpy_P(void* dst, const void* src, size_t n) { return memcpy(dst, src, n); }
+inline int strcmp_P(const char* a, PGM_P b) { return strcmp(a, b); }
+inline int strncmp_P(const char* a, PGM_P b, size_t n) { return strncmp(a, b, n); }
+inline char* strncpy_P(char* dst, PGM_P src, size_t n) { return strncpy(dst, src, n); }
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+#define sprintf_P sprintf
+inline uint8_t pgm_read_byte(const void* p) { return *static_cast<const uint8_t*>(p); }
+inline uint16_t pgm_read_word(const void* p) { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+inline uint32_t pgm_read_dword(const void* p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+inline float pgm_read_float(const void* p) { float v; memcpy(&v, p, sizeof(v)); return v; }
+inline const void* pgm_read_ptr(const void* p) { return *static_cast<const void* const*>(p); }
+
+// Wemos D1 mini pin numbers
+constexpr uint8_t D0 = 16;
+constexpr uint8_t D1 = 5;
+constexpr uint8_t D2 = 4;
+constexpr uint8_t D3 = 0;
+constexpr uint8_t D4 = 2;
+constexpr uint8_t D5 = 14;
+constexpr uint8_t D6 = 12;
+constexpr uint8_t D7 = 13;
+constexpr uint8_t D8 = 15;
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// Time comes from a virtual clock that only moves when a test advances it,
+// or when the sketch waits in delay() or a fake driver models a blocking
+// call (see host::advance()).
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+// NTP is not simulated, time() is the host's wall clock
+inline void configTime(int, int, const char*, const char* = nullptr, const char* = nullptr) {}
+
+class String {
+public:
+  String() {}
+  String(const char* s) : _s(s ? s : "") {}
+  String(const __FlashStringHelper* s) : _s(reinterpret_cast<const char*>(s)) {}
+  String(const std::string &s) : _s(s) {}
+  explicit String(char c) : _s(1, c) {}
+  explicit String(int v, unsigned char base = 10) : _s(format(v, base)) {}
+  explicit String(unsigned v, unsigned char base = 10) : _s(formatUnsigned(v, base)) {}
+  explicit String(long v, unsigned char base = 10) : _s(format(v, base)) {}
+  explicit String(unsigned long v, unsigned char base = 10) : _s(formatUnsigned(v, base)) {}
+  explicit String(double v, unsigned char decimals = 2);
+
+  const char* c_str() const { return _s.c_str(); }
+  unsigned int length() const { return _s.size(); }
+  bool isEmpty() const { return _s.empty(); }
+  bool reserve(unsigned int size) { _s.reserve(size); return true; }
+  char operator[](unsigned int i) const { return i < _s.size() ? _s[i] : '\0'; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+
+  long toInt() const { return strtol(_s.c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(_s.c_str(), nullptr); }
+  void toCharArray(char* buf, unsigned int size, unsigned int index = 0) const;
+
+  bool equals(const String &other) const { return _s == other._s; }
+  bool operator==(const String &other) const { return _s == other._s; }
+  bool operator==(const char* other) const { return _s == other; }
+  bool operator!=(const String &other) const { return _s != other._s; }
+  bool operator!=(const char* other) const { return _s != other; }
+  bool startsWith(const String &prefix) const { return _s.rfind(prefix._s, 0) == 0; }
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const String &s, unsigned int from = 0) const;
+  String substring(unsigned int from) const { return substring(from, _s.size()); }
+  String substring(unsigned int from, unsigned int to) const;
+  void trim();
+
+  String &operator+=(const String &s) { _s += s._s; return *this; }
+  String &operator+=(const char* s) { _s += s; return *this; }
+  String &operator+=(char c) { _s += c; return *this; }
+  bool concat(const char* s) { _s += s; return true; }
+  friend String operator+(const String &a, const String &b) { return String(a._s + b._s); }
+  friend String operator+(const String &a, const char* b) { return String(a._s + b); }
+
+private:
+  static std::string format(long v, unsigned char base);
+  static std::string formatUnsigned(unsigned long v, unsigned char base);
+
+  std::string _s;
+};
+
+extern const String emptyString;
+
+class IPAddress;
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t* buf, size_t len);
+  size_t write(const char* s) { return s ? write(reinterpret_cast<const uint8_t*>(s), strlen(s)) : 0; }
+  size_t write(const char* buf, size_t len) { return write(reinterpret_cast<const uint8_t*>(buf), len); }
+
+  size_t print(const char* s) { return write(s); }
+  size_t print(const __FlashStringHelper* s) { return write(reinterpret_cast<const char*>(s)); }
+  size_t print(const String &s) { return write(s.c_str(), s.length()); }
+  size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+  size_t print(unsigned char v, int base = DEC) { return print(static_cast<unsigned long>(v), base); }
+  size_t print(int v, int base = DEC) { return print(static_cast<long>(v), base); }
+  size_t print(unsigned int v, int base = DEC) { return print(static_cast<unsigned long>(v), base); }
+  size_t print(long v, int base = DEC);
+  size_t print(unsigned long v, int base = DEC);
+  size_t print(long long v, int base = DEC) { return print(static_cast<long>(v), base); }
+  size_t print(unsigned long long v, int base = DEC) { return print(static_cast<unsigned long>(v), base); }
+  size_t print(double v, int digits = 2);
+  size_t print(const IPAddress &ip);
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T &v) { size_t n = print(v); return n + println(); }
+  template <typename T>
+  size_t println(const T &v, int format) { size_t n = print(v, format); return n + println(); }
+
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  void setTimeout(unsigned long timeout) { _timeout = timeout; }
+  size_t readBytes(uint8_t* buf, size_t len);
+  size_t readBytes(char* buf, size_t len) { return readBytes(reinterpret_cast<uint8_t*>(buf), len); }
+
+protected:
+  unsigned long _timeout = 1000;
+};
+
+// Serial goes to stdout
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long) {}
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t len) override;
+  using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+class IPAddress {
+public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+    : _addr(a | (uint32_t)b << 8 | (uint32_t)c << 16 | (uint32_t)d << 24) {}
+  IPAddress(uint32_t addr) : _addr(addr) {}
+
+  operator uint32_t() const { return _addr; }
+  uint8_t operator[](int i) const { return _addr >> (8 * i); }
+  bool operator==(const IPAddress &other) const { return _addr == other._addr; }
+  bool isSet() const { return _addr != 0; }
+  bool fromString(const char* s);
+  String toString() const;
+
+private:
+  uint32_t _addr = 0; // first octet in the lowest byte, as lwIP stores it
+};
+
+class EspClass {
+public:
+  // The host cannot reboot the sketch; tests check host::restarts instead
+  void restart();
+  uint32_t getChipId() { return 0x00c0ffee; }
+  uint32_t getFreeHeap();
+  uint8_t getCpuFreqMHz() { return 80; }
+};
+
+extern EspClass ESP;
@@ -0,0 +1,47 @@
+#pragma once
+#include <Arduino.h>
+#include <functional>
+
+// OTA updates are not available on the host, handle() only counts calls
+
+typedef enum {
+  OTA_AUTH_ERROR,
+  OTA_BEGIN_ERROR,
+  OTA_CONNECT_ERROR,
+  OTA_RECEIVE_ERROR,
+  OTA_END_ERROR
+} ota_error_t;
+
+class ArduinoOTAClass {
+public:
+  typedef std::function<void(void)> THandlerFunction;
+  typedef std::function<void(ota_error_t)> THandlerFunction_Error;
+  typedef std::function<void(unsigned int, unsigned int)> THandlerFunction_Progress;
+
+  void setHostname(const char* hostname) { _hostname = hostname ? hostname : ""; }
+  void setPassword(const char* password) {}
+  void onStart(THandlerFunction fn) { _start = fn; }
+  void onEnd(THandlerFunction fn) { _end = fn; }
+  void onProgress(THandlerFunction_Progress fn) { _progress = fn; }
+  void onError(THandlerFunction_Error fn) { _error = fn; }
+  void begin() { begun = true; }
+  void handle() { handles++; }
+
+  // Host side: an update arriving, as far as the sketch sees it
+  void start() {
+    if (_start) {
+      _start();
+    }
+  }
+  bool begun = false;
+  uint32_t handles = 0;
+
+private:
+  std::string _hostname;
+  THandlerFunction _start;
+  THandlerFunction _end;
+  THandlerFunction_Progress _progress;
+  THandlerFunction_Error _error;
+};
+
+inline ArduinoOTAClass ArduinoOTA;
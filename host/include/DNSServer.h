@@ -0,0 +1,23 @@
+#pragma once
+#include <ESP8266WiFi.h>
+
+// Captive portal DNS, answers nothing on the host
+class DNSServer {
+public:
+  bool start(uint16_t port, const String &domainName, const IPAddress &resolvedIP) {
+    _running = true;
+    return true;
+  }
+  void stop() { _running = false; }
+  void processNextRequest() {
+    if (_running) {
+      polls++;
+    }
+  }
+
+  // Host side
+  uint32_t polls = 0;
+
+private:
+  bool _running = false;
+};
@@ -0,0 +1,110 @@
+#pragma once
+#include <ESP8266WiFi.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// ESP8266WebServer stand-in serving real TCP sockets on 127.0.0.1, so tests
+// and a browser talk HTTP to the unmodified handlers. Response framing
+// follows the original: send() writes the header with Content-Length from
+// setContentLength() or the body, chunked encoding when the length is
+// CONTENT_LENGTH_UNKNOWN, and sendContent() frames chunks only after such a
+// send(). After a handler returns the server drops its reference to the
+// client instead of stopping it, so a handler that kept a copy (SSE) keeps
+// the socket open. Accepted sockets get a send buffer the size of lwIP's.
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+
+namespace host {
+// Port the next ESP8266WebServer listens on instead of the one the sketch
+// asks for, 0 picks a free one (see localPort())
+extern int webPort;
+}
+
+class ESP8266WebServer {
+public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  explicit ESP8266WebServer(int port = 80) : _port(port) {}
+  ~ESP8266WebServer() { close(); }
+
+  void begin();
+  void close();
+  void stop() { close(); }
+  void handleClient();
+
+  void on(const char* uri, THandlerFunction fn) { on(uri, HTTP_ANY, fn); }
+  void on(const char* uri, HTTPMethod method, THandlerFunction fn) { _handlers.push_back({uri, method, fn}); }
+  void onNotFound(THandlerFunction fn) { _notFound = fn; }
+
+  void send(int code, const char* contentType = nullptr, const String &content = String(""));
+  void send(int code, const char* contentType, const char* content) { send(code, contentType, String(content)); }
+  void send(int code, const String &contentType, const String &content) { send(code, contentType.c_str(), content); }
+  void send_P(int code, PGM_P contentType, PGM_P content) { send(code, contentType, String(content)); }
+  void setContentLength(size_t len) { _contentLength = len; }
+  void sendHeader(const String &name, const String &value, bool first = false);
+  void sendContent(const String &content) { sendContent(content.c_str(), content.length()); }
+  void sendContent(const char* content) { sendContent(content, strlen(content)); }
+  void sendContent(const char* content, size_t len);
+  void sendContent_P(PGM_P content) { sendContent(content, strlen(content)); }
+  void sendContent_P(PGM_P content, size_t len) { sendContent(content, len); }
+
+  const String &arg(const String &name) const;
+  const String &arg(int i) const;
+  const String &argName(int i) const;
+  int args() const { return (int)_args.size(); }
+  bool hasArg(const String &name) const;
+
+  void collectHeaders(const char* headerKeys[], const size_t count);
+  const String &header(const String &name) const;
+  const String &header(int i) const;
+  const String &headerName(int i) const;
+  int headers() const { return (int)_headers.size(); }
+  bool hasHeader(const String &name) const;
+
+  WiFiClient &client() { return _currentClient; }
+  HTTPMethod method() const { return _method; }
+  const String &uri() const { return _uri; }
+
+  // Host side
+  uint16_t localPort() const { return _boundPort; }
+  uint32_t requests = 0;
+  uint32_t notFound = 0;
+  uint64_t bytesSent = 0;
+
+private:
+  struct Handler {
+    std::string uri;
+    HTTPMethod method;
+    THandlerFunction fn;
+  };
+  struct KeyValue {
+    String key;
+    String value;
+  };
+
+  bool parseRequest();
+  void parseArgs(const std::string &data);
+  void handleRequest();
+  void write(const char* data, size_t len);
+
+  int _port;
+  int _listenFd = -1;
+  uint16_t _boundPort = 0;
+  std::vector<Handler> _handlers;
+  THandlerFunction _notFound;
+
+  WiFiClient _currentClient;
+  std::string _request;
+  unsigned long _requestStart = 0;
+  HTTPMethod _method = HTTP_ANY;
+  String _uri;
+  std::vector<KeyValue> _args;
+  std::vector<KeyValue> _headers;  // collected keys, values of the current request
+  std::string _extraHeaders;
+  size_t _contentLength = CONTENT_LENGTH_NOT_SET;
+  bool _chunked = false;
+};
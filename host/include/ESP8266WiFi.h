@@ -0,0 +1,164 @@
+#pragma once
+#include <Arduino.h>
+#include <memory>
+#include <string>
+
+// ESP8266WiFi stand-in: a simulated station/AP radio and TCP clients.
+//
+// WiFiClient connects to services registered on the virtual network (the
+// in-process MQTT broker) or, for loopback addresses, opens a real socket,
+// so HTTP code can be exercised against servers running in the test.
+
+enum wl_status_t {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+};
+
+enum WiFiMode_t { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 };
+
+namespace host {
+
+struct Connection;
+
+// Something listening on the virtual network. Restarting it bumps the
+// epoch, which drops every connection opened before.
+class Service {
+public:
+  virtual ~Service() {}
+  // Bytes a client wrote; the service answers by queueing bytes on conn
+  virtual void received(Connection &conn, const uint8_t* data, size_t len) {}
+  bool up = true;
+  uint32_t epoch = 0;
+  uint32_t connectUs = 2000;  // TCP handshake time
+  uint32_t tcpConnects = 0;
+  uint32_t tcpRefused = 0;
+};
+
+// Name and address registry of the virtual network
+void registerService(const char* name, IPAddress ip, uint16_t port, Service* service);
+void unregisterService(Service* service);
+Service* findService(IPAddress ip, uint16_t port);
+bool resolve(const char* name, IPAddress &ip);
+
+// The access point the station can reach and how long association takes
+struct WiFiModel {
+  std::string ssid = "testnet";
+  std::string password = "testpass";
+  uint8_t bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+  uint8_t channel = 6;
+  bool apUp = true;
+  uint32_t scanMs = 2200;   // active scan of all channels
+  uint32_t authMs = 180;    // authentication and association
+  uint32_t dhcpMs = 1100;
+  uint32_t dnsMs = 20;
+  IPAddress dhcpIp = IPAddress(192, 168, 1, 50);
+  IPAddress gateway = IPAddress(192, 168, 1, 1);
+  IPAddress subnet = IPAddress(255, 255, 255, 0);
+  IPAddress dns = IPAddress(192, 168, 1, 1);
+  uint8_t mac[6] = {0x5c, 0xcf, 0x7f, 0x12, 0x34, 0x56};
+
+  uint32_t begins = 0;
+  uint32_t pinnedBegins = 0;   // begin() with BSSID and channel
+  uint32_t scans = 0;
+  uint32_t dhcpRequests = 0;
+  uint64_t radioOnUs = 0;      // up to the last status() call
+};
+extern WiFiModel wifi;
+
+} // namespace host
+
+class Client : public Stream {
+public:
+  virtual int connect(IPAddress ip, uint16_t port) = 0;
+  virtual int connect(const char* host, uint16_t port) = 0;
+  virtual size_t write(const uint8_t* buf, size_t len) override = 0;
+  virtual int read(uint8_t* buf, size_t len) = 0;
+  virtual void flush() = 0;
+  virtual uint8_t connected() = 0;
+  virtual void stop() = 0;
+  virtual operator bool() = 0;
+  using Print::write;
+  using Stream::read;
+};
+
+// Copies share the connection, stop() on any of them closes it for all
+class WiFiClient : public Client {
+public:
+  WiFiClient() {}
+  explicit WiFiClient(std::shared_ptr<host::Connection> conn) : _conn(std::move(conn)) {}
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char* host, uint16_t port) override;
+  uint8_t connected() override;
+  void stop() override;
+  operator bool() override { return connected(); }
+
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t len) override;
+  int peek() override;
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buf, size_t len) override;
+  size_t write_P(PGM_P buf, size_t len) { return write(reinterpret_cast<const uint8_t*>(buf), len); }
+  using Print::write;
+  size_t availableForWrite();
+  void flush() override {}
+  void setNoDelay(bool) {}
+  void setSync(bool) {}
+  IPAddress remoteIP();
+  host::Service* service();
+
+private:
+  std::shared_ptr<host::Connection> _conn;
+};
+
+class ESP8266WiFiClass {
+public:
+  bool mode(WiFiMode_t m);
+  WiFiMode_t getMode() { return _mode; }
+  bool hostname(const char* name) { return true; }
+  void persistent(bool) {}
+  void setAutoReconnect(bool) {}
+
+  wl_status_t begin(const char* ssid, const char* password = nullptr, int32_t channel = 0,
+                    const uint8_t* bssid = nullptr, bool connect = true);
+  bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress(),
+              IPAddress dns2 = IPAddress());
+  bool disconnect(bool wifiOff = false);
+  wl_status_t status();
+
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t i = 0);
+  uint8_t* BSSID();
+  int32_t channel();
+  int32_t RSSI() { return status() == WL_CONNECTED ? -61 : 31; }
+  uint8_t* macAddress(uint8_t* mac);
+  String macAddress();
+  int hostByName(const char* name, IPAddress &ip, uint32_t timeoutMs = 10000);
+
+  bool softAP(const char* ssid, const char* password = nullptr);
+  IPAddress softAPIP() { return IPAddress(192, 168, 4, 1); }
+
+  bool forceSleepBegin(uint32_t sleepUs = 0);
+  bool forceSleepWake();
+
+private:
+  void trackRadio();
+
+  WiFiMode_t _mode = WIFI_STA;
+  bool _asleep = false;
+  bool _joining = false;
+  bool _willAssociate = false;
+  uint64_t _associateAt = 0;
+  bool _staticIp = false;
+  IPAddress _ip, _gateway, _subnet, _dns;
+  uint64_t _radioSince = 0;
+};
+
+extern ESP8266WiFiClass WiFi;
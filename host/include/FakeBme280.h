@@ -0,0 +1,70 @@
+#pragma once
+#include <Wire.h>
+
+namespace host {
+
+// Trimming parameters as named in the BME280 datasheet
+struct Bme280Calibration {
+  uint16_t T1;
+  int16_t T2, T3;
+  uint16_t P1;
+  int16_t P2, P3, P4, P5, P6, P7, P8, P9;
+  uint8_t H1;
+  int16_t H2;
+  uint8_t H3;
+  int16_t H4, H5;
+  int8_t H6;
+};
+
+// T/P trimming of the BMP280 datasheet example (section 3.12) and humidity
+// trimming in the range of production BME280 parts
+extern const Bme280Calibration BME280_DEFAULT_CALIBRATION;
+
+// Floating point compensation of the datasheet (BME280 section 8.1), the
+// reference the integer driver is checked against
+struct Bme280Reading {
+  double temperature;  // °C
+  double pressure;     // Pa
+  double humidity;     // %RH
+  int32_t tFine;
+};
+Bme280Reading bme280Reference(const Bme280Calibration &cal, int32_t adcT, int32_t adcP, int32_t adcH);
+
+// Register-level BME280 on the fake I2C bus: chip id, soft reset, the
+// calibration block, ctrl/status registers and forced-mode conversions that
+// latch the data registers once the conversion time has passed. The
+// environment is set in physical units and turned into ADC counts by
+// inverting the reference compensation, or raw counts are set directly.
+class FakeBme280 : public I2cDevice {
+public:
+  explicit FakeBme280(const Bme280Calibration &cal = BME280_DEFAULT_CALIBRATION);
+
+  void setEnvironment(double temperature, double humidity, double pressurePa);
+  void setRaw(int32_t adcT, int32_t adcP, int32_t adcH);
+  const Bme280Calibration &calibration() const { return _cal; }
+  int32_t adcT() const { return _adcT; }
+  int32_t adcP() const { return _adcP; }
+  int32_t adcH() const { return _adcH; }
+
+  bool i2cWrite(const uint8_t* data, size_t len) override;
+  size_t i2cRead(uint8_t* data, size_t len) override;
+
+  bool present = true;          // false NACKs every transaction
+  uint32_t conversions = 0;
+  uint32_t conversionUs = 9300; // x1 oversampling on all channels, datasheet max
+
+private:
+  uint8_t readRegister(uint8_t reg);
+  void update();
+
+  Bme280Calibration _cal;
+  uint8_t _regs[256] = {};
+  uint8_t _pointer = 0;
+  int32_t _adcT = 0x80000;
+  int32_t _adcP = 0x80000;
+  int32_t _adcH = 0x8000;
+  bool _measuring = false;
+  uint64_t _conversionEnd = 0;
+};
+
+} // namespace host
@@ -0,0 +1,54 @@
+#pragma once
+#include <Arduino.h>
+#include <string>
+
+// Controls of the simulated board, for tests and the host runner
+
+namespace host {
+
+// Virtual clock. millis()/micros() only move through advance(); delay() and
+// fakes that model a blocking call advance it as well. With realtime on,
+// the host's monotonic clock is added, for running the sketch interactively.
+void advance(uint64_t us);
+inline void advanceMillis(uint32_t ms) { advance((uint64_t)ms * 1000); }
+uint64_t nowMicros();
+void setRealtime(bool on);
+
+// Cycle counter at CPU_MHZ: virtual time plus the real time spent on the
+// host, so a pass that waits in a fake driver shows up like on the device
+constexpr uint32_t CPU_MHZ = 80;
+uint32_t cycleCount();
+
+// Heap figures reported to the sketch. The host heap is not the ESP8266
+// heap, so these are fixed unless a test sets them.
+struct HeapModel {
+  uint32_t free = 41000;
+  uint32_t maxBlock = 36000;
+};
+extern HeapModel heap;
+
+// ESP.restart() calls
+extern uint32_t restarts;
+
+// RTC user memory, 128 blocks of 4 bytes
+constexpr size_t RTC_USER_BYTES = 512;
+bool rtcRead(uint32_t block, void* data, size_t size);
+bool rtcWrite(uint32_t block, const void* data, size_t size);
+void rtcClear();
+
+// Everything that survives a restart (RTC memory and the flash file
+// system), serialized so a test can carry it into a fresh process
+std::string saveState();
+void loadState(const std::string &state);
+
+// Allocations a fake makes for the other end of a connection (the broker's
+// message log, a service's buffers) are not the device's and are left out
+// of allocCount() while an UntrackedAllocs is in scope. Per thread.
+extern thread_local uint32_t untrackedDepth;
+
+struct UntrackedAllocs {
+  UntrackedAllocs() { untrackedDepth++; }
+  ~UntrackedAllocs() { untrackedDepth--; }
+};
+
+} // namespace host
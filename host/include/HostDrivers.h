@@ -0,0 +1,41 @@
+#pragma once
+// Drivers for host builds, selected with -DHAL_DRIVERS_HEADER="HostDrivers.h".
+// Same aliases as the ESP8266 section of HAL.h, backed by the fakes in
+// host/: the UART, I2C bus and network are simulated, the BME280 driver is
+// the real one talking to a register-level fake on the bus.
+
+#include <ESP8266WiFi.h>
+#include <ESP8266WebServer.h>
+#include <DNSServer.h>
+#include <PubSubClient.h>
+#include <SoftwareSerial.h>
+#include <Wire.h>
+#include "Host.h"
+#include "BME280.h"
+
+using PMSerial = SoftwareSerial;
+using EnvSensor = BME280Driver;
+using NetClient = WiFiClient;
+using MqttDriver = PubSubClient;
+using HttpServer = ESP8266WebServer;
+using DnsResponder = DNSServer;
+
+#include "NetAsync.h"
+
+inline uint32_t cpuCycles() { return host::cycleCount(); }
+inline uint32_t cpuCyclesPerUs() { return host::CPU_MHZ; }
+
+inline uint32_t heapFree() { return host::heap.free; }
+inline uint32_t heapMaxBlock() { return host::heap.maxBlock; }
+inline uint8_t heapFragmentation() {
+  // Share of free memory outside the largest block, close to the core's figure
+  return host::heap.free ? 100 - (uint32_t)host::heap.maxBlock * 100 / host::heap.free : 0;
+}
+
+inline bool rtcRead(uint32_t block, void* data, size_t size) { return host::rtcRead(block, data, size); }
+inline bool rtcWrite(uint32_t block, const void* data, size_t size) { return host::rtcWrite(block, data, size); }
+
+constexpr uint8_t PIN_PM_RX = D1;
+constexpr uint8_t PIN_PM_TX = D8;
+constexpr uint8_t PIN_I2C_SDA = D3;
+constexpr uint8_t PIN_I2C_SCL = D2;
@@ -0,0 +1,101 @@
+#pragma once
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// In-memory LittleFS for the host build.
+//
+// Files are byte vectors keyed by absolute path. Writes go straight into the
+// vector, like LittleFS commits a file on close. Faults can be injected to
+// test the code paths of a full or failing flash:
+//  - failOpens: the next n opens for writing return an invalid File
+//  - writeBudget: bytes that can still be written; the write that exhausts
+//    it is cut short and the flash counts as powered off from then on, so
+//    every later write, rename and remove fails until powerOn()
+
+class File {
+public:
+  File() {}
+
+  operator bool() const { return _data != nullptr; }
+  size_t size() const { return _data ? _data->size() : 0; }
+  size_t position() const { return _pos; }
+  int available() const { return _data ? (int)(_data->size() - _pos) : 0; }
+  bool seek(uint32_t pos);
+  int read();
+  int read(uint8_t* buf, size_t len);
+  size_t write(uint8_t b) { return write(&b, 1); }
+  size_t write(const uint8_t* buf, size_t len);
+  size_t write(const char* s) { return write(reinterpret_cast<const uint8_t*>(s), strlen(s)); }
+  bool truncate(uint32_t size);
+  const char* name() const { return _path.c_str(); }
+  void close() { _data.reset(); }
+
+private:
+  friend class FS;
+  std::shared_ptr<std::vector<uint8_t>> _data;
+  std::string _path;
+  size_t _pos = 0;
+  bool _append = false;
+  bool _writable = false;
+};
+
+class Dir {
+public:
+  bool next();
+  String fileName() const { return String(_entries[_index].first.c_str()); }
+  size_t fileSize() const { return _entries[_index].second; }
+
+private:
+  friend class FS;
+  std::vector<std::pair<std::string, size_t>> _entries;
+  size_t _index = 0;
+  bool _started = false;
+};
+
+class FS {
+public:
+  bool begin();
+  void end() { _mounted = false; }
+  bool format();
+  File open(const char* path, const char* mode);
+  File open(const String &path, const char* mode) { return open(path.c_str(), mode); }
+  bool exists(const char* path);
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char* path);
+  bool remove(const String &path) { return remove(path.c_str()); }
+  bool rename(const char* from, const char* to);
+  bool mkdir(const char* path);
+  Dir openDir(const char* path);
+
+  // Host side
+  std::string image() const;
+  void loadImage(const std::string &image);
+  size_t fileSize(const char* path) const;
+  void powerOn() { powerLost = false; writeBudget = -1; }
+
+  // Fault injection, see above
+  uint32_t failOpens = 0;
+  long writeBudget = -1;  // bytes, -1 = unlimited
+  bool powerLost = false;
+  bool mountFails = false;
+
+  // Wear accounting
+  uint64_t bytesWritten = 0;
+  uint32_t writeCalls = 0;
+  uint32_t opens = 0;
+  uint32_t mounts = 0;
+
+private:
+  friend class File;
+  bool consumeBudget(size_t &len);
+
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> _files;
+  std::set<std::string> _dirs;
+  bool _mounted = false;
+};
+
+extern FS LittleFS;
@@ -0,0 +1,86 @@
+#pragma once
+#include <ESP8266WiFi.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace host {
+
+struct MqttMessage {
+  std::string topic;
+  std::string payload;
+  bool retained;
+};
+
+// In-process MQTT broker on the virtual network. PubSubClient instances
+// talk to it directly once their WiFiClient is connected to its address;
+// the wire is not encoded, but every packet is counted with the size it
+// would have as MQTT 3.1.1. Only the CONNECT/CONNACK exchange goes over
+// the connection, so the client's wait for CONNACK is real: a CONNECT
+// written to the socket is answered with a CONNACK connackUs later.
+class MqttBroker : public Service {
+public:
+  MqttBroker(const char* name = "broker.test", IPAddress ip = IPAddress(192, 168, 1, 2), uint16_t port = 1883);
+  ~MqttBroker();
+
+  // Broker restart: drops all sessions, keeps retained messages. The will
+  // of every client that was connected is published.
+  void restart();
+  void setUp(bool on);
+
+  // Observers see every message the broker routes
+  void observe(std::function<void(const MqttMessage &)> fn) { _observers.push_back(fn); }
+  const std::map<std::string, std::string> &retained() const { return _retained; }
+  const std::vector<MqttMessage> &log() const { return _log; }
+  size_t count(const std::string &filter) const;
+  void clearLog() { _log.clear(); }
+
+  // Topic filter with + and # wildcards
+  static bool matches(const std::string &filter, const std::string &topic);
+
+  // CONNACK delay, a broker under load answers late
+  uint32_t connackUs = 5000;
+  bool acceptConnect = true;
+
+  // Counters
+  uint32_t connects = 0;
+  uint32_t publishes = 0;
+  uint64_t bytesIn = 0;   // PUBLISH/CONNECT/SUBSCRIBE... from clients
+  uint64_t bytesOut = 0;  // CONNACK, SUBACK and PUBLISH to clients
+
+  // Used by PubSubClient, sessions are referred to by id, 0 is none
+  uint32_t connect(const std::string &clientId, const char* willTopic, const char* willMessage, bool willRetain);
+  void disconnect(uint32_t session, bool graceful);
+  void publish(uint32_t session, const std::string &topic, const std::string &payload, bool retain);
+  bool subscribe(uint32_t session, const std::string &filter);
+  bool unsubscribe(uint32_t session, const std::string &filter);
+  bool poll(uint32_t session, MqttMessage &out);
+  bool alive(uint32_t session) const { return _sessions.count(session) > 0; }
+  void received(Connection &conn, const uint8_t* data, size_t len) override;
+  size_t sessionCount() const { return _sessions.size(); }
+
+private:
+  struct Session {
+    std::string clientId;
+    std::vector<std::string> filters;
+    std::deque<MqttMessage> inbox;
+    std::string willTopic;
+    std::string willMessage;
+    bool willRetain = false;
+  };
+
+  void route(const MqttMessage &m);
+
+  std::map<uint32_t, Session> _sessions;
+  uint32_t _nextSession = 1;
+  std::map<std::string, std::string> _retained;
+  std::vector<MqttMessage> _log;
+  std::vector<std::function<void(const MqttMessage &)>> _observers;
+};
+
+// Size of an MQTT packet with the given remaining length
+size_t mqttPacketSize(size_t remaining);
+
+} // namespace host
@@ -0,0 +1,36 @@
+#pragma once
+#include <ESP8266WiFi.h>
+
+// Non-blocking DNS and TCP connect, the host side of the sketch's
+// NetAsync.h. Nothing waits: a lookup finishes dnsMs of virtual time after
+// it was started, a connect to a service after its connectUs, and a
+// connect to a loopback address is a real non-blocking socket. Names and
+// addresses nobody answers for stay pending until the caller gives up.
+
+class HostResolver {
+public:
+  void start(const char* name);
+  NetPoll poll(IPAddress &ip);
+
+private:
+  IPAddress _ip;
+  uint64_t _readyAt = 0;
+  NetPoll _state = NET_FAILED;
+};
+
+class TcpConnector {
+public:
+  ~TcpConnector() { cancel(); }
+
+  bool start(IPAddress ip, uint16_t port);
+  NetPoll poll(NetClient &client);
+  void cancel();
+
+private:
+  IPAddress _ip;
+  uint16_t _port = 0;
+  host::Service* _service = nullptr;
+  int _fd = -1;
+  uint64_t _readyAt = 0;
+  NetPoll _state = NET_FAILED;
+};
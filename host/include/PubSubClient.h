@@ -0,0 +1,103 @@
+#pragma once
+#include <ESP8266WiFi.h>
+#include <functional>
+#include "MqttBroker.h"
+
+// PubSubClient stand-in talking to the in-process broker (MqttBroker.h)
+// behind the WiFiClient it was given. It keeps the parts of the real
+// client's behaviour the sketch depends on: the transport is only opened by
+// connect() if it is not already connected, CONNACK is waited for up to the
+// socket timeout, publishes larger than the buffer fail, loop() hands over
+// one incoming message per call and sends keepalive pings. The buffer is
+// allocated and resized with malloc/realloc like the original.
+
+#define MQTT_MAX_PACKET_SIZE 256
+#define MQTT_KEEPALIVE 15
+#define MQTT_SOCKET_TIMEOUT 15
+#define MQTT_MAX_HEADER_SIZE 5
+
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+#define MQTT_CONNECT_BAD_PROTOCOL    1
+#define MQTT_CONNECT_BAD_CLIENT_ID   2
+#define MQTT_CONNECT_UNAVAILABLE     3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED    5
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+class PubSubClient : public Print {
+public:
+  explicit PubSubClient(Client &client);
+  ~PubSubClient();
+
+  PubSubClient &setServer(IPAddress ip, uint16_t port);
+  PubSubClient &setServer(const char* domain, uint16_t port);
+  PubSubClient &setCallback(MQTT_CALLBACK_SIGNATURE);
+  PubSubClient &setKeepAlive(uint16_t keepAlive) { _keepAlive = keepAlive; return *this; }
+  PubSubClient &setSocketTimeout(uint16_t timeout) { _socketTimeout = timeout; return *this; }
+  bool setBufferSize(uint16_t size);
+  uint16_t getBufferSize() { return _bufferSize; }
+
+  bool connect(const char* id) { return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr, true); }
+  bool connect(const char* id, const char* user, const char* pass) {
+    return connect(id, user, pass, nullptr, 0, false, nullptr, true);
+  }
+  bool connect(const char* id, const char* willTopic, uint8_t willQos, bool willRetain, const char* willMessage) {
+    return connect(id, nullptr, nullptr, willTopic, willQos, willRetain, willMessage, true);
+  }
+  bool connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos,
+               bool willRetain, const char* willMessage) {
+    return connect(id, user, pass, willTopic, willQos, willRetain, willMessage, true);
+  }
+  bool connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos,
+               bool willRetain, const char* willMessage, bool cleanSession);
+  void disconnect();
+
+  bool publish(const char* topic, const char* payload) { return publish(topic, payload, false); }
+  bool publish(const char* topic, const char* payload, bool retained) {
+    return publish(topic, reinterpret_cast<const uint8_t*>(payload), payload ? strlen(payload) : 0, retained);
+  }
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length) { return publish(topic, payload, length, false); }
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained);
+  bool publish_P(const char* topic, const char* payload, bool retained) { return publish(topic, payload, retained); }
+
+  bool beginPublish(const char* topic, unsigned int length, bool retained);
+  int endPublish();
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t len) override;
+  using Print::write;
+
+  bool subscribe(const char* topic, uint8_t qos = 0);
+  bool unsubscribe(const char* topic);
+  bool loop();
+  bool connected();
+  int state() { return _state; }
+
+  // Host side
+  host::MqttBroker* broker();
+  uint32_t pings = 0;
+
+private:
+  Client* _client;
+  uint8_t* _buffer = nullptr;
+  uint16_t _bufferSize = 0;
+  uint16_t _keepAlive = MQTT_KEEPALIVE;
+  uint16_t _socketTimeout = MQTT_SOCKET_TIMEOUT;
+  const char* _domain = nullptr;
+  IPAddress _ip;
+  uint16_t _port = 0;
+  std::function<void(char*, uint8_t*, unsigned int)> _callback;
+  int _state = MQTT_DISCONNECTED;
+  uint32_t _session = 0;
+  unsigned long _lastOutActivity = 0;
+
+  // beginPublish() in progress
+  std::string _streamTopic;
+  std::string _streamPayload;
+  bool _streamRetained = false;
+  bool _streaming = false;
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <Arduino.h>
+#include <deque>
+#include <mutex>
+
+// EspSoftwareSerial stand-in. The receive buffer is bounded like the
+// library's: bytes that arrive while it is full are lost and overflow()
+// reports it.
+//
+// Bytes reach the buffer in two ways: send() puts them on the line at the
+// configured baud rate starting at the current virtual time, so they arrive
+// while the sketch is busy or stalled; receive() stores them right away and
+// may be called from another thread, the way the receive interrupt fills
+// the buffer on the device.
+
+enum SoftwareSerialConfig { SWSERIAL_8N1 = 0 };
+
+class SoftwareSerial : public Stream {
+public:
+  SoftwareSerial(int8_t rxPin = -1, int8_t txPin = -1, bool invert = false) {}
+
+  void begin(uint32_t baud) { begin(baud, SWSERIAL_8N1); }
+  void begin(uint32_t baud, SoftwareSerialConfig config, int8_t rxPin = -1, int8_t txPin = -1,
+             bool invert = false, int bufCapacity = 64, int isrBufCapacity = 0);
+  void end() {}
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t* buf, size_t len);
+  size_t write(uint8_t b) override { return 1; }
+  using Print::write;
+  void flush() {}
+  bool overflow();
+
+  // Host side
+  void send(const uint8_t* data, size_t len);
+  size_t receive(const uint8_t* data, size_t len);
+  size_t capacity() const { return _capacity; }
+  uint32_t bytesLost = 0;
+
+private:
+  void arrive();
+  void store(uint8_t b);
+
+  std::mutex _lock;
+  std::deque<uint8_t> _buffer;
+  std::deque<std::pair<uint64_t, uint8_t>> _line;  // arrival time in µs, byte
+  size_t _capacity = 64;
+  uint32_t _baud = 9600;
+  uint64_t _lineFree = 0;
+  bool _overflow = false;
+};
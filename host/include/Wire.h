@@ -0,0 +1,56 @@
+#pragma once
+#include <Arduino.h>
+
+// I2C master for the host build. Transactions are routed to the fake device
+// attached at the address; a missing device NACKs. Bus time is modeled from
+// the bytes on the wire (9 clocks each plus start/stop) and advances the
+// virtual clock, so driver latency can be measured.
+
+namespace host {
+
+class I2cDevice {
+public:
+  virtual ~I2cDevice() {}
+  // A write transaction; false NACKs it
+  virtual bool i2cWrite(const uint8_t* data, size_t len) = 0;
+  // A read transaction, returns how many bytes the device supplied
+  virtual size_t i2cRead(uint8_t* data, size_t len) = 0;
+};
+
+} // namespace host
+
+class TwoWire {
+public:
+  void begin(int sda, int scl) { begin(); }
+  void begin() {}
+  void setClock(uint32_t hz) { _clock = hz; }
+
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t b);
+  size_t write(const uint8_t* data, size_t len);
+  uint8_t endTransmission(bool sendStop = true);
+  uint8_t requestFrom(uint8_t address, size_t len, bool sendStop = true);
+  uint8_t requestFrom(uint8_t address, uint8_t len) { return requestFrom(address, (size_t)len, true); }
+  int available() { return (int)(_rxLen - _rxPos); }
+  int read() { return _rxPos < _rxLen ? _rx[_rxPos++] : -1; }
+
+  // Host side
+  void attach(uint8_t address, host::I2cDevice* device);
+  void detach(uint8_t address) { attach(address, nullptr); }
+  uint32_t transactions = 0;  // address phases, one per start condition
+  uint32_t bytes = 0;         // data bytes in both directions
+
+private:
+  void busTime(size_t dataBytes);
+
+  host::I2cDevice* _devices[128] = {};
+  uint32_t _clock = 100000;
+  uint8_t _address = 0;
+  uint8_t _tx[32];
+  size_t _txLen = 0;
+  uint8_t _rx[32];
+  size_t _rxLen = 0;
+  size_t _rxPos = 0;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,14 @@
+#pragma once
+
+// Defaults for host builds, matching the fake network (ESP8266WiFi.h) and
+// broker (MqttBroker.h)
+
+#define DEFAULT_WIFI_SSID "testnet"
+#define DEFAULT_WIFI_PASSWORD "testpass"
+#define DEFAULT_HOSTNAME "ikea-air-monitor"
+#define DEFAULT_MQTT_HOST "broker.test"
+#define DEFAULT_MQTT_PORT 1883
+#define DEFAULT_MQTT_USER ""
+#define DEFAULT_MQTT_PASSWORD ""
+#define DEFAULT_MQTT_TOPIC "ikea-air-monitor"
+#define DEFAULT_OTA_PASSWORD "host"
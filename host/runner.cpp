@@ -0,0 +1,29 @@
+// Runs the sketch on the host in real time: the web UI is served on
+// http://127.0.0.1:8080 (or the port given as first argument), the fake
+// Vindriktning and BME280 report fixed values and MQTT goes to the
+// in-process broker, whose traffic is printed.
+#include "Board.h"
+#include <unistd.h>
+
+int main(int argc, char** argv) {
+  host::Board board;
+  // After the Board, which sets an ephemeral port for the tests
+  host::webPort = argc > 1 ? atoi(argv[1]) : 8080;
+  board.broker.observe([](const host::MqttMessage &m) {
+    printf("mqtt %s%s %s\n", m.topic.c_str(), m.retained ? " (retained)" : "", m.payload.c_str());
+    fflush(stdout);
+  });
+  host::setRealtime(true);
+  board.boot();
+  // The server starts once WiFi is up
+  bool announced = false;
+  while (true) {
+    board.pass();
+    if (!announced && server.localPort() != 0) {
+      printf("web server on http://127.0.0.1:%u\n", server.localPort());
+      fflush(stdout);
+      announced = true;
+    }
+    usleep(1000);
+  }
+}
@@ -0,0 +1,2 @@
+// The sketch as one translation unit, like the Arduino IDE builds it
+#include "IKEAAirMonitor.ino"
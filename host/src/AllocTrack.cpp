@@ -0,0 +1,44 @@
+#include <AllocTrack.h>
+#include "Host.h"
+
+// Counting replacements for the glibc allocator, see AllocTrack.h. They
+// interpose on malloc for the whole program, including libstdc++.
+
+thread_local uint32_t host::untrackedDepth = 0;
+
+#ifdef ALLOC_TRACKING
+AllocStats allocStats = {};
+
+static inline void count(size_t bytes) {
+  if (host::untrackedDepth == 0) {
+    allocStats.count.fetch_add(1, std::memory_order_relaxed);
+    allocStats.bytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+}
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void __libc_free(void* p);
+
+void* malloc(size_t size) {
+  count(size);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+  count(n * size);
+  return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size) {
+  count(size);
+  return __libc_realloc(p, size);
+}
+
+void free(void* p) {
+  __libc_free(p);
+}
+}
+#endif
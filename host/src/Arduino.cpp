@@ -0,0 +1,267 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <chrono>
+#include <random>
+#include "Host.h"
+
+HardwareSerial Serial;
+const String emptyString;
+EspClass ESP;
+
+namespace host {
+
+HeapModel heap;
+uint32_t restarts = 0;
+
+static uint64_t virtualUs = 0;
+static bool realtime = false;
+static const auto realStart = std::chrono::steady_clock::now();
+
+static uint64_t realNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - realStart).count();
+}
+
+void advance(uint64_t us) {
+  virtualUs += us;
+}
+
+uint64_t nowMicros() {
+  return virtualUs + (realtime ? realNanos() / 1000 : 0);
+}
+
+void setRealtime(bool on) {
+  realtime = on;
+}
+
+uint32_t cycleCount() {
+  return (uint32_t)(virtualUs * CPU_MHZ + realNanos() * CPU_MHZ / 1000);
+}
+
+static uint8_t rtcMemory[RTC_USER_BYTES];
+
+bool rtcRead(uint32_t block, void* data, size_t size) {
+  if (size == 0 || size % 4 != 0 || block * 4 + size > RTC_USER_BYTES) {
+    return false;
+  }
+  memcpy(data, rtcMemory + block * 4, size);
+  return true;
+}
+
+bool rtcWrite(uint32_t block, const void* data, size_t size) {
+  if (size == 0 || size % 4 != 0 || block * 4 + size > RTC_USER_BYTES) {
+    return false;
+  }
+  memcpy(rtcMemory + block * 4, data, size);
+  return true;
+}
+
+void rtcClear() {
+  memset(rtcMemory, 0, sizeof(rtcMemory));
+}
+
+std::string saveState() {
+  std::string state(reinterpret_cast<const char*>(rtcMemory), sizeof(rtcMemory));
+  state += LittleFS.image();
+  return state;
+}
+
+void loadState(const std::string &state) {
+  if (state.size() < sizeof(rtcMemory)) {
+    rtcClear();
+    LittleFS.format();
+    return;
+  }
+  memcpy(rtcMemory, state.data(), sizeof(rtcMemory));
+  LittleFS.loadImage(state.substr(sizeof(rtcMemory)));
+}
+
+} // namespace host
+
+unsigned long millis() {
+  return (unsigned long)(uint32_t)(host::nowMicros() / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)(uint32_t)host::nowMicros();
+}
+
+void delay(unsigned long ms) {
+  host::advance((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  host::advance(us);
+}
+
+void yield() {}
+
+static std::minstd_rand rng;
+
+long random(long max) {
+  return max > 0 ? (long)(rng() % (unsigned long)max) : 0;
+}
+
+long random(long min, long max) {
+  return max > min ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed) {
+  rng.seed(seed);
+}
+
+void EspClass::restart() {
+  host::restarts++;
+}
+
+uint32_t EspClass::getFreeHeap() {
+  return host::heap.free;
+}
+
+// String
+
+String::String(double v, unsigned char decimals) {
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+  _s = buf;
+}
+
+std::string String::format(long v, unsigned char base) {
+  if (v < 0 && base == 10) {
+    return "-" + formatUnsigned(-(unsigned long)v, base);
+  }
+  return formatUnsigned((unsigned long)v, base);
+}
+
+std::string String::formatUnsigned(unsigned long v, unsigned char base) {
+  if (base < 2 || base > 16) {
+    base = 10;
+  }
+  char buf[66];
+  char* p = buf + sizeof(buf) - 1;
+  *p = '\0';
+  do {
+    *--p = "0123456789abcdef"[v % base];
+    v /= base;
+  } while (v);
+  return p;
+}
+
+void String::toCharArray(char* buf, unsigned int size, unsigned int index) const {
+  if (size == 0) {
+    return;
+  }
+  size_t n = index < _s.size() ? std::min<size_t>(size - 1, _s.size() - index) : 0;
+  memcpy(buf, _s.data() + index, n);
+  buf[n] = '\0';
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  size_t i = _s.find(c, from);
+  return i == std::string::npos ? -1 : (int)i;
+}
+
+int String::indexOf(const String &s, unsigned int from) const {
+  size_t i = _s.find(s._s, from);
+  return i == std::string::npos ? -1 : (int)i;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) {
+    std::swap(from, to);
+  }
+  if (from >= _s.size()) {
+    return String();
+  }
+  return String(_s.substr(from, std::min<size_t>(to, _s.size()) - from));
+}
+
+void String::trim() {
+  size_t b = 0;
+  size_t e = _s.size();
+  while (b < e && isspace((unsigned char)_s[b])) b++;
+  while (e > b && isspace((unsigned char)_s[e - 1])) e--;
+  _s = _s.substr(b, e - b);
+}
+
+// Print
+
+size_t Print::write(const uint8_t* buf, size_t len) {
+  size_t n = 0;
+  while (len--) {
+    n += write(*buf++);
+  }
+  return n;
+}
+
+size_t Print::print(long v, int base) {
+  return print(String(v, (unsigned char)base));
+}
+
+size_t Print::print(unsigned long v, int base) {
+  return print(String(v, (unsigned char)base));
+}
+
+size_t Print::print(double v, int digits) {
+  return print(String(v, (unsigned char)digits));
+}
+
+size_t Print::print(const IPAddress &ip) {
+  return print(ip.toString());
+}
+
+size_t Print::printf(const char* fmt, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  if (n < 0) {
+    return 0;
+  }
+  if ((size_t)n < sizeof(buf)) {
+    return write(reinterpret_cast<const uint8_t*>(buf), n);
+  }
+  std::string big(n + 1, '\0');
+  va_start(args, fmt);
+  vsnprintf(&big[0], big.size(), fmt, args);
+  va_end(args);
+  return write(reinterpret_cast<const uint8_t*>(big.data()), n);
+}
+
+size_t Stream::readBytes(uint8_t* buf, size_t len) {
+  size_t n = 0;
+  while (n < len) {
+    int c = read();
+    if (c < 0) {
+      break;
+    }
+    buf[n++] = (uint8_t)c;
+  }
+  return n;
+}
+
+size_t HardwareSerial::write(uint8_t b) {
+  return fwrite(&b, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t len) {
+  return fwrite(buf, 1, len, stdout);
+}
+
+// IPAddress
+
+bool IPAddress::fromString(const char* s) {
+  unsigned a, b, c, d;
+  char tail;
+  if (sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+    return false;
+  }
+  *this = IPAddress(a, b, c, d);
+  return true;
+}
+
+String IPAddress::toString() const {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+  return String(buf);
+}
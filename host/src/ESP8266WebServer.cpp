@@ -0,0 +1,315 @@
+#include <ESP8266WebServer.h>
+#include "Host.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include "HostNet.h"
+
+namespace host {
+int webPort = -1;
+}
+
+// Like the core, a request that does not complete within this time is dropped
+constexpr unsigned long HTTP_MAX_DATA_WAIT = 5000;
+constexpr int LWIP_SND_BUF = 2920;
+
+void ESP8266WebServer::begin() {
+  close();
+  int port = host::webPort >= 0 ? host::webPort : _port;
+  _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  fcntl(_listenFd, F_SETFL, fcntl(_listenFd, F_GETFL) | O_NONBLOCK);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(_listenFd, 8) < 0) {
+    fprintf(stderr, "ESP8266WebServer: cannot listen on port %d\n", port);
+    ::close(_listenFd);
+    _listenFd = -1;
+    return;
+  }
+  socklen_t len = sizeof(addr);
+  getsockname(_listenFd, reinterpret_cast<sockaddr*>(&addr), &len);
+  _boundPort = ntohs(addr.sin_port);
+}
+
+void ESP8266WebServer::close() {
+  if (_listenFd >= 0) {
+    ::close(_listenFd);
+    _listenFd = -1;
+  }
+  _currentClient = WiFiClient();
+}
+
+void ESP8266WebServer::handleClient() {
+  if (_listenFd < 0) {
+    return;
+  }
+  if (!_currentClient) {
+    sockaddr_in addr = {};
+    socklen_t len = sizeof(addr);
+    int fd = accept4(_listenFd, reinterpret_cast<sockaddr*>(&addr), &len, SOCK_NONBLOCK);
+    if (fd < 0) {
+      return;
+    }
+    int sndbuf = LWIP_SND_BUF;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    _currentClient = host::acceptedClient(fd, IPAddress(addr.sin_addr.s_addr));
+    _request.clear();
+    _requestStart = millis();
+  }
+  char buf[512];
+  int n;
+  while ((n = _currentClient.read(reinterpret_cast<uint8_t*>(buf), sizeof(buf))) > 0) {
+    _request.append(buf, n);
+  }
+  if (parseRequest()) {
+    handleRequest();
+    // Only the reference is dropped, a handler may keep the socket open
+    _currentClient = WiFiClient();
+  } else if (!_currentClient.connected() || millis() - _requestStart > HTTP_MAX_DATA_WAIT) {
+    _currentClient.stop();
+    _currentClient = WiFiClient();
+  }
+}
+
+static std::string urlDecode(const std::string &s) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '+') {
+      out += ' ';
+    } else if (s[i] == '%' && i + 2 < s.size()) {
+      out += (char)strtol(s.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    } else {
+      out += s[i];
+    }
+  }
+  return out;
+}
+
+void ESP8266WebServer::parseArgs(const std::string &data) {
+  size_t start = 0;
+  while (start < data.size()) {
+    size_t amp = data.find('&', start);
+    std::string pair = data.substr(start, amp == std::string::npos ? std::string::npos : amp - start);
+    size_t eq = pair.find('=');
+    if (!pair.empty()) {
+      _args.push_back({String(urlDecode(pair.substr(0, eq))),
+                       String(eq == std::string::npos ? std::string() : urlDecode(pair.substr(eq + 1)))});
+    }
+    if (amp == std::string::npos) {
+      break;
+    }
+    start = amp + 1;
+  }
+}
+
+bool ESP8266WebServer::parseRequest() {
+  size_t end = _request.find("\r\n\r\n");
+  if (end == std::string::npos) {
+    return false;
+  }
+  size_t lineEnd = _request.find("\r\n");
+  std::string line = _request.substr(0, lineEnd);
+  size_t sp1 = line.find(' ');
+  size_t sp2 = line.find(' ', sp1 + 1);
+  std::string method = line.substr(0, sp1);
+  std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+
+  size_t contentLength = 0;
+  bool form = false;
+  for (auto &h : _headers) {
+    h.value = String();
+  }
+  size_t pos = lineEnd + 2;
+  while (pos < end) {
+    size_t next = _request.find("\r\n", pos);
+    std::string header = _request.substr(pos, next - pos);
+    pos = next + 2;
+    size_t colon = header.find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    std::string name = header.substr(0, colon);
+    std::string value = header.substr(colon + 1);
+    value.erase(0, value.find_first_not_of(' '));
+    if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+      contentLength = strtoul(value.c_str(), nullptr, 10);
+    } else if (strcasecmp(name.c_str(), "Content-Type") == 0) {
+      form = value.rfind("application/x-www-form-urlencoded", 0) == 0;
+    }
+    for (auto &h : _headers) {
+      if (strcasecmp(h.key.c_str(), name.c_str()) == 0) {
+        h.value = String(value);
+        break;
+      }
+    }
+  }
+  if (_request.size() < end + 4 + contentLength) {
+    return false;
+  }
+  std::string body = _request.substr(end + 4, contentLength);
+
+  _method = method == "GET" ? HTTP_GET : method == "HEAD" ? HTTP_HEAD : method == "POST" ? HTTP_POST :
+            method == "PUT" ? HTTP_PUT : method == "PATCH" ? HTTP_PATCH : method == "DELETE" ? HTTP_DELETE :
+            method == "OPTIONS" ? HTTP_OPTIONS : HTTP_ANY;
+  size_t q = target.find('?');
+  _uri = String(target.substr(0, q));
+  _args.clear();
+  if (q != std::string::npos) {
+    parseArgs(target.substr(q + 1));
+  }
+  if (form) {
+    parseArgs(body);
+  } else if (!body.empty()) {
+    _args.push_back({String("plain"), String(body)});
+  }
+  return true;
+}
+
+void ESP8266WebServer::handleRequest() {
+  _contentLength = CONTENT_LENGTH_NOT_SET;
+  _chunked = false;
+  _extraHeaders.clear();
+  requests++;
+  for (const auto &h : _handlers) {
+    if (h.uri == _uri.c_str() && (h.method == HTTP_ANY || h.method == _method)) {
+      h.fn();
+      return;
+    }
+  }
+  notFound++;
+  if (_notFound) {
+    _notFound();
+  } else {
+    send(404, "text/plain", String("Not found: ") + _uri);
+  }
+}
+
+static const char* statusText(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 204: return "No Content";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default: return "";
+  }
+}
+
+// The response is assembled in std::string and host sockets here; what the
+// core allocates for it on the device is not the handler's, so none of it
+// counts towards allocCount()
+void ESP8266WebServer::write(const char* data, size_t len) {
+  host::UntrackedAllocs untracked;
+  bytesSent += _currentClient.write(reinterpret_cast<const uint8_t*>(data), len);
+}
+
+void ESP8266WebServer::sendHeader(const String &name, const String &value, bool first) {
+  host::UntrackedAllocs untracked;
+  std::string line = std::string(name.c_str()) + ": " + value.c_str() + "\r\n";
+  _extraHeaders = first ? line + _extraHeaders : _extraHeaders + line;
+}
+
+void ESP8266WebServer::send(int code, const char* contentType, const String &content) {
+  host::UntrackedAllocs untracked;
+  char line[64];
+  snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", code, statusText(code));
+  std::string h = line;
+  h += std::string("Content-Type: ") + (contentType ? contentType : "text/html") + "\r\n";
+  size_t len = _contentLength == CONTENT_LENGTH_NOT_SET ? content.length() : _contentLength;
+  if (len == CONTENT_LENGTH_UNKNOWN) {
+    _chunked = true;
+    h += "Transfer-Encoding: chunked\r\n";
+  } else {
+    h += "Content-Length: " + std::to_string(len) + "\r\n";
+  }
+  h += _extraHeaders;
+  h += "Connection: close\r\n\r\n";
+  _extraHeaders.clear();
+  write(h.data(), h.size());
+  if (content.length() > 0) {
+    sendContent(content);
+  }
+}
+
+void ESP8266WebServer::sendContent(const char* content, size_t len) {
+  if (_chunked) {
+    char size[12];
+    int n = snprintf(size, sizeof(size), "%zx\r\n", len);
+    write(size, n);
+  }
+  write(content, len);
+  if (_chunked) {
+    write("\r\n", 2);
+    if (len == 0) {
+      _chunked = false;
+    }
+  }
+}
+
+const String &ESP8266WebServer::arg(const String &name) const {
+  for (const auto &a : _args) {
+    if (a.key == name) {
+      return a.value;
+    }
+  }
+  return emptyString;
+}
+
+const String &ESP8266WebServer::arg(int i) const {
+  return i >= 0 && i < (int)_args.size() ? _args[i].value : emptyString;
+}
+
+const String &ESP8266WebServer::argName(int i) const {
+  return i >= 0 && i < (int)_args.size() ? _args[i].key : emptyString;
+}
+
+bool ESP8266WebServer::hasArg(const String &name) const {
+  for (const auto &a : _args) {
+    if (a.key == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ESP8266WebServer::collectHeaders(const char* headerKeys[], const size_t count) {
+  // The core always collects these two in front of the sketch's keys
+  _headers = {{String("Authorization"), String()}, {String("If-None-Match"), String()}};
+  for (size_t i = 0; i < count; i++) {
+    _headers.push_back({String(headerKeys[i]), String()});
+  }
+}
+
+const String &ESP8266WebServer::header(const String &name) const {
+  for (const auto &h : _headers) {
+    if (strcasecmp(h.key.c_str(), name.c_str()) == 0) {
+      return h.value;
+    }
+  }
+  return emptyString;
+}
+
+const String &ESP8266WebServer::header(int i) const {
+  return i >= 0 && i < (int)_headers.size() ? _headers[i].value : emptyString;
+}
+
+const String &ESP8266WebServer::headerName(int i) const {
+  return i >= 0 && i < (int)_headers.size() ? _headers[i].key : emptyString;
+}
+
+bool ESP8266WebServer::hasHeader(const String &name) const {
+  return header(name).length() > 0;
+}
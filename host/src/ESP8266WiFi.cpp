@@ -0,0 +1,430 @@
+#include <ESP8266WiFi.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/sockios.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <map>
+#include <vector>
+#include "Host.h"
+#include "HostNet.h"
+
+ESP8266WiFiClass WiFi;
+
+namespace host {
+
+WiFiModel wifi;
+
+struct Registration {
+  std::string name;
+  IPAddress ip;
+  uint16_t port;
+  Service* service;
+};
+static std::vector<Registration> registry;
+
+void registerService(const char* name, IPAddress ip, uint16_t port, Service* service) {
+  unregisterService(service);
+  registry.push_back({name ? name : "", ip, port, service});
+}
+
+void unregisterService(Service* service) {
+  for (auto it = registry.begin(); it != registry.end();) {
+    it = it->service == service ? registry.erase(it) : it + 1;
+  }
+}
+
+Service* findService(IPAddress ip, uint16_t port) {
+  for (const auto &r : registry) {
+    if (r.ip == ip && r.port == port) {
+      return r.service;
+    }
+  }
+  return nullptr;
+}
+
+bool resolve(const char* name, IPAddress &ip) {
+  if (ip.fromString(name)) {
+    return true;
+  }
+  if (strcmp(name, "localhost") == 0) {
+    ip = IPAddress(127, 0, 0, 1);
+    return true;
+  }
+  for (const auto &r : registry) {
+    if (r.name == name) {
+      ip = r.ip;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool waitSocket(int fd, bool write, int timeoutMs) {
+  pollfd p = {fd, (short)(write ? POLLOUT : POLLIN), 0};
+  return poll(&p, 1, timeoutMs) == 1 && !(p.revents & (POLLERR | POLLNVAL));
+}
+
+WiFiClient acceptedClient(int fd, IPAddress remote) {
+  auto conn = std::make_shared<Connection>();
+  conn->fd = fd;
+  conn->open = true;
+  conn->remote = remote;
+  return WiFiClient(conn);
+}
+
+} // namespace host
+
+// WiFiClient
+
+static int openSocket(IPAddress ip, uint16_t port, unsigned long timeoutMs) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = (uint32_t)ip;
+  int rc = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  if (rc < 0 && errno == EINPROGRESS && host::waitSocket(fd, true, (int)timeoutMs)) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    rc = err == 0 ? 0 : -1;
+  }
+  if (rc < 0) {
+    close(fd);
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  stop();
+  if (WiFi.status() != WL_CONNECTED) {
+    return 0;
+  }
+  auto conn = std::make_shared<host::Connection>();
+  conn->remote = ip;
+  if (host::Service* s = host::findService(ip, port)) {
+    host::advance(s->connectUs);
+    if (!s->up) {
+      s->tcpRefused++;
+      return 0;
+    }
+    s->tcpConnects++;
+    conn->service = s;
+    conn->epoch = s->epoch;
+  } else if (ip[0] == 127) {
+    conn->fd = openSocket(ip, port, _timeout);
+    if (conn->fd < 0) {
+      return 0;
+    }
+  } else {
+    // Nobody there: the SYN goes unanswered until the timeout
+    host::advance((uint64_t)_timeout * 1000);
+    return 0;
+  }
+  conn->open = true;
+  _conn = conn;
+  return 1;
+}
+
+int WiFiClient::connect(const char* name, uint16_t port) {
+  IPAddress ip;
+  if (!WiFi.hostByName(name, ip, _timeout)) {
+    return 0;
+  }
+  return connect(ip, port);
+}
+
+uint8_t WiFiClient::connected() {
+  if (!_conn || !_conn->open) {
+    return 0;
+  }
+  if (_conn->service) {
+    host::Service* s = _conn->service;
+    if (!s->up || s->epoch != _conn->epoch || WiFi.status() != WL_CONNECTED) {
+      _conn->open = false;
+    }
+    return _conn->open;
+  }
+  // Like lwIP, a closed connection still counts while it has data to read
+  char c;
+  ssize_t n = recv(_conn->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    _conn->open = false;
+  }
+  return _conn->open || available() > 0;
+}
+
+void WiFiClient::stop() {
+  if (!_conn) {
+    return;
+  }
+  _conn->open = false;
+  if (_conn->fd >= 0) {
+    close(_conn->fd);
+    _conn->fd = -1;
+  }
+  _conn.reset();
+}
+
+// Bytes a service queued that have arrived by now
+static bool serviceRx(host::Connection &c) {
+  return c.service && !c.rx.empty() && host::nowMicros() >= c.rxAt;
+}
+
+int WiFiClient::available() {
+  if (_conn && _conn->service) {
+    return serviceRx(*_conn) ? _conn->rx.size() : 0;
+  }
+  if (!_conn || _conn->fd < 0) {
+    return 0;
+  }
+  int n = 0;
+  ioctl(_conn->fd, FIONREAD, &n);
+  return n;
+}
+
+int WiFiClient::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int WiFiClient::read(uint8_t* buf, size_t len) {
+  if (_conn && _conn->service) {
+    if (!serviceRx(*_conn)) {
+      return -1;
+    }
+    size_t n = min(len, _conn->rx.size());
+    memcpy(buf, _conn->rx.data(), n);
+    _conn->rx.erase(0, n);
+    return n;
+  }
+  if (!_conn || _conn->fd < 0) {
+    return -1;
+  }
+  ssize_t n = recv(_conn->fd, buf, len, MSG_DONTWAIT);
+  return n < 0 ? -1 : (int)n;
+}
+
+int WiFiClient::peek() {
+  if (_conn && _conn->service) {
+    return serviceRx(*_conn) ? (uint8_t)_conn->rx[0] : -1;
+  }
+  if (!_conn || _conn->fd < 0) {
+    return -1;
+  }
+  uint8_t b;
+  return recv(_conn->fd, &b, 1, MSG_PEEK | MSG_DONTWAIT) == 1 ? b : -1;
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t len) {
+  if (!_conn || !_conn->open) {
+    return 0;
+  }
+  if (_conn->service) {
+    if (!connected()) {
+      return 0;
+    }
+    _conn->service->received(*_conn, buf, len);
+    return len;
+  }
+  size_t sent = 0;
+  while (sent < len) {
+    ssize_t n = send(_conn->fd, buf + sent, len - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += n;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (!host::waitSocket(_conn->fd, true, (int)_timeout)) {
+        break;
+      }
+    } else {
+      _conn->open = false;
+      break;
+    }
+  }
+  return sent;
+}
+
+size_t WiFiClient::availableForWrite() {
+  if (!_conn || !_conn->open) {
+    return 0;
+  }
+  if (_conn->service) {
+    return 2920; // lwIP TCP_SND_BUF, two segments
+  }
+  int sndbuf = 0;
+  socklen_t len = sizeof(sndbuf);
+  getsockopt(_conn->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &len);
+  int queued = 0;
+  ioctl(_conn->fd, SIOCOUTQ, &queued);
+  // The kernel reports twice the requested buffer to cover its bookkeeping
+  int room = sndbuf / 2 - queued;
+  return room > 0 ? room : 0;
+}
+
+IPAddress WiFiClient::remoteIP() {
+  return _conn ? _conn->remote : IPAddress();
+}
+
+host::Service* WiFiClient::service() {
+  return _conn ? _conn->service : nullptr;
+}
+
+// WiFi
+
+void ESP8266WiFiClass::trackRadio() {
+  uint64_t now = host::nowMicros();
+  if (!_asleep && _mode != WIFI_OFF) {
+    host::wifi.radioOnUs += now - _radioSince;
+  }
+  _radioSince = now;
+}
+
+bool ESP8266WiFiClass::mode(WiFiMode_t m) {
+  trackRadio();
+  _mode = m;
+  if (!(m & WIFI_STA)) {
+    _willAssociate = false;
+  }
+  return true;
+}
+
+wl_status_t ESP8266WiFiClass::begin(const char* ssid, const char* password, int32_t ch,
+                                    const uint8_t* bssid, bool connect) {
+  trackRadio();
+  host::WiFiModel &w = host::wifi;
+  w.begins++;
+  if (!(_mode & WIFI_STA)) {
+    _mode = WIFI_STA;
+  }
+  bool credentials = w.ssid == ssid && w.password == (password ? password : "");
+  uint64_t at = host::nowMicros();
+  if (bssid) {
+    // Pinned: probe that AP on that channel only
+    w.pinnedBegins++;
+    _willAssociate = credentials && ch == w.channel && memcmp(bssid, w.bssid, 6) == 0;
+    at += (uint64_t)w.authMs * 1000;
+  } else {
+    w.scans++;
+    _willAssociate = credentials;
+    at += (uint64_t)(w.scanMs + w.authMs) * 1000;
+  }
+  if (!_staticIp) {
+    w.dhcpRequests++;
+    at += (uint64_t)w.dhcpMs * 1000;
+  }
+  _associateAt = at;
+  return WL_DISCONNECTED;
+}
+
+bool ESP8266WiFiClass::config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2) {
+  _staticIp = local.isSet();
+  _ip = local;
+  _gateway = gateway;
+  _subnet = subnet;
+  _dns = dns1;
+  return true;
+}
+
+bool ESP8266WiFiClass::disconnect(bool wifiOff) {
+  _willAssociate = false;
+  if (wifiOff) {
+    mode(WIFI_OFF);
+  }
+  return true;
+}
+
+wl_status_t ESP8266WiFiClass::status() {
+  trackRadio();
+  if (_asleep || !(_mode & WIFI_STA) || !_willAssociate || !host::wifi.apUp ||
+      host::nowMicros() < _associateAt) {
+    return WL_DISCONNECTED;
+  }
+  return WL_CONNECTED;
+}
+
+IPAddress ESP8266WiFiClass::localIP() {
+  if (status() != WL_CONNECTED) {
+    return IPAddress();
+  }
+  return _staticIp ? _ip : host::wifi.dhcpIp;
+}
+
+IPAddress ESP8266WiFiClass::gatewayIP() {
+  return status() != WL_CONNECTED ? IPAddress() : (_staticIp ? _gateway : host::wifi.gateway);
+}
+
+IPAddress ESP8266WiFiClass::subnetMask() {
+  return status() != WL_CONNECTED ? IPAddress() : (_staticIp ? _subnet : host::wifi.subnet);
+}
+
+IPAddress ESP8266WiFiClass::dnsIP(uint8_t i) {
+  return status() != WL_CONNECTED ? IPAddress() : (_staticIp ? _dns : host::wifi.dns);
+}
+
+uint8_t* ESP8266WiFiClass::BSSID() {
+  return host::wifi.bssid;
+}
+
+int32_t ESP8266WiFiClass::channel() {
+  return host::wifi.channel;
+}
+
+uint8_t* ESP8266WiFiClass::macAddress(uint8_t* mac) {
+  memcpy(mac, host::wifi.mac, 6);
+  return mac;
+}
+
+String ESP8266WiFiClass::macAddress() {
+  char buf[18];
+  const uint8_t* m = host::wifi.mac;
+  snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", m[0], m[1], m[2], m[3], m[4], m[5]);
+  return String(buf);
+}
+
+int ESP8266WiFiClass::hostByName(const char* name, IPAddress &ip, uint32_t timeoutMs) {
+  IPAddress parsed;
+  if (parsed.fromString(name)) {
+    ip = parsed;
+    return 1;
+  }
+  if (status() != WL_CONNECTED) {
+    return 0;
+  }
+  if (!host::resolve(name, ip)) {
+    host::advance((uint64_t)timeoutMs * 1000);
+    return 0;
+  }
+  host::advance((uint64_t)host::wifi.dnsMs * 1000);
+  return 1;
+}
+
+bool ESP8266WiFiClass::softAP(const char* ssid, const char* password) {
+  trackRadio();
+  _mode = (WiFiMode_t)(_mode | WIFI_AP);
+  return true;
+}
+
+bool ESP8266WiFiClass::forceSleepBegin(uint32_t sleepUs) {
+  trackRadio();
+  _asleep = true;
+  _willAssociate = false;
+  return true;
+}
+
+bool ESP8266WiFiClass::forceSleepWake() {
+  trackRadio();
+  _asleep = false;
+  return true;
+}
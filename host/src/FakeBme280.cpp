@@ -0,0 +1,169 @@
+#include "FakeBme280.h"
+#include "Host.h"
+
+namespace host {
+
+const Bme280Calibration BME280_DEFAULT_CALIBRATION = {
+  27504, 26435, -1000,
+  36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000,
+  75, 362, 0, 313, 50, 30,
+};
+
+Bme280Reading bme280Reference(const Bme280Calibration &c, int32_t adcT, int32_t adcP, int32_t adcH) {
+  Bme280Reading r;
+  double var1 = (adcT / 16384.0 - c.T1 / 1024.0) * c.T2;
+  double var2 = (adcT / 131072.0 - c.T1 / 8192.0) * (adcT / 131072.0 - c.T1 / 8192.0) * c.T3;
+  r.tFine = (int32_t)(var1 + var2);
+  r.temperature = (var1 + var2) / 5120.0;
+
+  var1 = r.tFine / 2.0 - 64000.0;
+  var2 = var1 * var1 * c.P6 / 32768.0;
+  var2 = var2 + var1 * c.P5 * 2.0;
+  var2 = var2 / 4.0 + c.P4 * 65536.0;
+  var1 = (c.P3 * var1 * var1 / 524288.0 + c.P2 * var1) / 524288.0;
+  var1 = (1.0 + var1 / 32768.0) * c.P1;
+  if (var1 == 0.0) {
+    r.pressure = 0;
+  } else {
+    double p = 1048576.0 - adcP;
+    p = (p - var2 / 4096.0) * 6250.0 / var1;
+    var1 = c.P9 * p * p / 2147483648.0;
+    var2 = p * c.P8 / 32768.0;
+    r.pressure = p + (var1 + var2 + c.P7) / 16.0;
+  }
+
+  double h = r.tFine - 76800.0;
+  h = (adcH - (c.H4 * 64.0 + c.H5 / 16384.0 * h)) *
+      (c.H2 / 65536.0 * (1.0 + c.H6 / 67108864.0 * h * (1.0 + c.H3 / 67108864.0 * h)));
+  h = h * (1.0 - c.H1 * h / 524288.0);
+  r.humidity = h > 100.0 ? 100.0 : (h < 0.0 ? 0.0 : h);
+  return r;
+}
+
+FakeBme280::FakeBme280(const Bme280Calibration &cal) : _cal(cal) {
+  auto put16 = [this](uint8_t reg, uint16_t v) {
+    _regs[reg] = v & 0xFF;
+    _regs[reg + 1] = v >> 8;
+  };
+  put16(0x88, cal.T1);
+  put16(0x8A, cal.T2);
+  put16(0x8C, cal.T3);
+  put16(0x8E, cal.P1);
+  const int16_t p[8] = {cal.P2, cal.P3, cal.P4, cal.P5, cal.P6, cal.P7, cal.P8, cal.P9};
+  for (int i = 0; i < 8; i++) {
+    put16(0x90 + 2 * i, p[i]);
+  }
+  _regs[0xA1] = cal.H1;
+  put16(0xE1, cal.H2);
+  _regs[0xE3] = cal.H3;
+  _regs[0xE4] = (uint8_t)(cal.H4 >> 4);
+  _regs[0xE5] = (uint8_t)((cal.H4 & 0x0F) | (cal.H5 & 0x0F) << 4);
+  _regs[0xE6] = (uint8_t)(cal.H5 >> 4);
+  _regs[0xE7] = (uint8_t)cal.H6;
+  _regs[0xD0] = 0x60;
+  setEnvironment(21.0, 45.0, 101325.0);
+}
+
+// Largest x in [lo, hi] with f(x) <= target for increasing f
+template <typename Fn>
+static int32_t invert(int32_t lo, int32_t hi, double target, Fn f) {
+  while (lo < hi) {
+    int32_t mid = lo + (hi - lo + 1) / 2;
+    if (f(mid) <= target) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return lo;
+}
+
+void FakeBme280::setEnvironment(double temperature, double humidity, double pressurePa) {
+  const Bme280Calibration &c = _cal;
+  int32_t adcT = invert(0, 0xFFFFF, temperature, [&](int32_t x) { return bme280Reference(c, x, 0, 0).temperature; });
+  // Pressure falls with the ADC value
+  int32_t adcP = invert(0, 0xFFFFF, -pressurePa, [&](int32_t x) { return -bme280Reference(c, adcT, x, 0).pressure; });
+  int32_t adcH = invert(0, 0xFFFF, humidity, [&](int32_t x) { return bme280Reference(c, adcT, 0, x).humidity; });
+  setRaw(adcT, adcP, adcH);
+}
+
+void FakeBme280::setRaw(int32_t adcT, int32_t adcP, int32_t adcH) {
+  _adcT = adcT;
+  _adcP = adcP;
+  _adcH = adcH;
+}
+
+void FakeBme280::update() {
+  if (_measuring && nowMicros() >= _conversionEnd) {
+    _measuring = false;
+    _regs[0xF7] = _adcP >> 12;
+    _regs[0xF8] = _adcP >> 4;
+    _regs[0xF9] = (_adcP & 0x0F) << 4;
+    _regs[0xFA] = _adcT >> 12;
+    _regs[0xFB] = _adcT >> 4;
+    _regs[0xFC] = (_adcT & 0x0F) << 4;
+    _regs[0xFD] = _adcH >> 8;
+    _regs[0xFE] = _adcH;
+    _regs[0xF4] &= ~0x03; // back to sleep mode
+    conversions++;
+  }
+}
+
+uint8_t FakeBme280::readRegister(uint8_t reg) {
+  if (reg == 0xF3) {
+    return _measuring ? 0x08 : 0x00;
+  }
+  return _regs[reg];
+}
+
+bool FakeBme280::i2cWrite(const uint8_t* data, size_t len) {
+  if (!present) {
+    return false;
+  }
+  update();
+  if (len == 0) {
+    return true;
+  }
+  // A lone byte sets the register pointer for the next read, otherwise the
+  // transaction is a sequence of register/value pairs
+  _pointer = data[0];
+  for (size_t i = 0; i + 1 < len; i += 2) {
+    uint8_t reg = data[i];
+    uint8_t value = data[i + 1];
+    switch (reg) {
+      case 0xE0:
+        if (value == 0xB6) {
+          _regs[0xF2] = _regs[0xF4] = _regs[0xF5] = 0;
+          _measuring = false;
+        }
+        break;
+      case 0xF2:
+      case 0xF5:
+        _regs[reg] = value;
+        break;
+      case 0xF4:
+        _regs[reg] = value;
+        if ((value & 0x03) == 0x01 || (value & 0x03) == 0x02) {
+          _measuring = true;
+          _conversionEnd = nowMicros() + conversionUs;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  return true;
+}
+
+size_t FakeBme280::i2cRead(uint8_t* data, size_t len) {
+  if (!present) {
+    return 0;
+  }
+  update();
+  for (size_t i = 0; i < len; i++) {
+    data[i] = readRegister(_pointer++);
+  }
+  return len;
+}
+
+} // namespace host
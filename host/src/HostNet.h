@@ -0,0 +1,33 @@
+#pragma once
+#include <ESP8266WiFi.h>
+#include <string>
+#include <unistd.h>
+
+namespace host {
+
+// State shared by all copies of a WiFiClient: a real socket, or a
+// connection to a service on the virtual network
+struct Connection {
+  int fd = -1;
+  Service* service = nullptr;
+  uint32_t epoch = 0;
+  bool open = false;
+  IPAddress remote;
+  // From the service, readable once the virtual clock reaches rxAt
+  std::string rx;
+  uint64_t rxAt = 0;
+
+  ~Connection() {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+};
+
+// Wrap an accepted socket
+WiFiClient acceptedClient(int fd, IPAddress remote);
+
+// Wait for a socket to become readable/writable, up to timeoutMs of real time
+bool waitSocket(int fd, bool write, int timeoutMs);
+
+} // namespace host
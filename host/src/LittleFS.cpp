@@ -0,0 +1,218 @@
+#include <LittleFS.h>
+
+FS LittleFS;
+
+bool File::seek(uint32_t pos) {
+  if (!_data || pos > _data->size()) {
+    return false;
+  }
+  _pos = pos;
+  return true;
+}
+
+int File::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int File::read(uint8_t* buf, size_t len) {
+  if (!_data) {
+    return -1;
+  }
+  size_t n = std::min(len, _data->size() - _pos);
+  memcpy(buf, _data->data() + _pos, n);
+  _pos += n;
+  return (int)n;
+}
+
+size_t File::write(const uint8_t* buf, size_t len) {
+  if (!_data || !_writable) {
+    return 0;
+  }
+  LittleFS.writeCalls++;
+  if (!LittleFS.consumeBudget(len)) {
+    return 0;
+  }
+  if (_append) {
+    _pos = _data->size();
+  }
+  if (_pos + len > _data->size()) {
+    _data->resize(_pos + len);
+  }
+  memcpy(_data->data() + _pos, buf, len);
+  _pos += len;
+  LittleFS.bytesWritten += len;
+  return len;
+}
+
+bool File::truncate(uint32_t size) {
+  if (!_data || !_writable || LittleFS.powerLost) {
+    return false;
+  }
+  _data->resize(size);
+  if (_pos > size) {
+    _pos = size;
+  }
+  return true;
+}
+
+bool Dir::next() {
+  if (!_started) {
+    _started = true;
+    return !_entries.empty();
+  }
+  if (_index + 1 >= _entries.size()) {
+    return false;
+  }
+  _index++;
+  return true;
+}
+
+bool FS::begin() {
+  if (mountFails) {
+    return false;
+  }
+  mounts++;
+  _mounted = true;
+  return true;
+}
+
+bool FS::format() {
+  _files.clear();
+  _dirs.clear();
+  return true;
+}
+
+bool FS::consumeBudget(size_t &len) {
+  if (powerLost) {
+    return false;
+  }
+  if (writeBudget >= 0 && (long)len >= writeBudget) {
+    len = writeBudget;
+    writeBudget = 0;
+    powerLost = true;
+    return len > 0;
+  }
+  if (writeBudget > 0) {
+    writeBudget -= len;
+  }
+  return true;
+}
+
+File FS::open(const char* path, const char* mode) {
+  File f;
+  if (!_mounted) {
+    return f;
+  }
+  opens++;
+  bool write = mode[0] == 'w' || mode[0] == 'a' || strchr(mode, '+');
+  if (write && (powerLost || failOpens > 0)) {
+    if (failOpens > 0) {
+      failOpens--;
+    }
+    return f;
+  }
+  auto it = _files.find(path);
+  if (it == _files.end()) {
+    if (!write) {
+      return f;
+    }
+    it = _files.emplace(path, std::make_shared<std::vector<uint8_t>>()).first;
+  }
+  if (mode[0] == 'w') {
+    it->second->clear();
+  }
+  f._data = it->second;
+  f._path = path;
+  f._writable = write;
+  f._append = mode[0] == 'a';
+  f._pos = f._append ? f._data->size() : 0;
+  return f;
+}
+
+bool FS::exists(const char* path) {
+  return _files.count(path) || _dirs.count(path);
+}
+
+bool FS::remove(const char* path) {
+  if (powerLost) {
+    return false;
+  }
+  return _files.erase(path) > 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+  if (powerLost) {
+    return false;
+  }
+  auto it = _files.find(from);
+  if (it == _files.end()) {
+    return false;
+  }
+  auto data = it->second;
+  _files.erase(it);
+  _files[to] = data;
+  return true;
+}
+
+bool FS::mkdir(const char* path) {
+  if (powerLost) {
+    return false;
+  }
+  _dirs.insert(path);
+  return true;
+}
+
+Dir FS::openDir(const char* path) {
+  Dir d;
+  std::string prefix = std::string(path) + "/";
+  for (const auto &kv : _files) {
+    if (kv.first.compare(0, prefix.size(), prefix) == 0 && kv.first.find('/', prefix.size()) == std::string::npos) {
+      d._entries.emplace_back(kv.first.substr(prefix.size()), kv.second->size());
+    }
+  }
+  return d;
+}
+
+size_t FS::fileSize(const char* path) const {
+  auto it = _files.find(path);
+  return it == _files.end() ? 0 : it->second->size();
+}
+
+// Image format: per file a NUL-terminated path, a 4-byte length and the
+// data; directories as a path with length 0xFFFFFFFF
+std::string FS::image() const {
+  std::string out;
+  auto put = [&out](const std::string &path, uint32_t len, const uint8_t* data) {
+    out.append(path.c_str(), path.size() + 1);
+    out.append(reinterpret_cast<const char*>(&len), sizeof(len));
+    if (data) {
+      out.append(reinterpret_cast<const char*>(data), len);
+    }
+  };
+  for (const auto &dir : _dirs) {
+    put(dir, 0xFFFFFFFF, nullptr);
+  }
+  for (const auto &kv : _files) {
+    put(kv.first, kv.second->size(), kv.second->data());
+  }
+  return out;
+}
+
+void FS::loadImage(const std::string &image) {
+  format();
+  size_t pos = 0;
+  while (pos < image.size()) {
+    std::string path(image.c_str() + pos);
+    pos += path.size() + 1;
+    uint32_t len;
+    memcpy(&len, image.data() + pos, sizeof(len));
+    pos += sizeof(len);
+    if (len == 0xFFFFFFFF) {
+      _dirs.insert(path);
+      continue;
+    }
+    _files[path] = std::make_shared<std::vector<uint8_t>>(image.begin() + pos, image.begin() + pos + len);
+    pos += len;
+  }
+}
@@ -0,0 +1,207 @@
+#include "MqttBroker.h"
+#include "Host.h"
+#include "HostNet.h"
+
+namespace host {
+
+size_t mqttPacketSize(size_t remaining) {
+  size_t lengthBytes = 1;
+  for (size_t r = remaining; r >= 128; r /= 128) {
+    lengthBytes++;
+  }
+  return 1 + lengthBytes + remaining;
+}
+
+MqttBroker::MqttBroker(const char* name, IPAddress ip, uint16_t port) {
+  registerService(name, ip, port, this);
+}
+
+MqttBroker::~MqttBroker() {
+  unregisterService(this);
+}
+
+void MqttBroker::restart() {
+  std::vector<uint32_t> ids;
+  for (const auto &kv : _sessions) {
+    ids.push_back(kv.first);
+  }
+  for (uint32_t id : ids) {
+    disconnect(id, false);
+  }
+  epoch++;
+}
+
+void MqttBroker::setUp(bool on) {
+  if (!on && up) {
+    restart();
+  }
+  up = on;
+}
+
+static std::vector<std::string> levels(const std::string &s) {
+  std::vector<std::string> out;
+  size_t start = 0;
+  while (true) {
+    size_t slash = s.find('/', start);
+    out.push_back(s.substr(start, slash == std::string::npos ? std::string::npos : slash - start));
+    if (slash == std::string::npos) {
+      return out;
+    }
+    start = slash + 1;
+  }
+}
+
+bool MqttBroker::matches(const std::string &filter, const std::string &topic) {
+  std::vector<std::string> f = levels(filter);
+  std::vector<std::string> t = levels(topic);
+  for (size_t i = 0; i < f.size(); i++) {
+    if (f[i] == "#") {
+      return true;
+    }
+    if (i >= t.size() || (f[i] != "+" && f[i] != t[i])) {
+      return false;
+    }
+  }
+  return f.size() == t.size();
+}
+
+size_t MqttBroker::count(const std::string &filter) const {
+  size_t n = 0;
+  for (const auto &m : _log) {
+    n += matches(filter, m.topic);
+  }
+  return n;
+}
+
+uint32_t MqttBroker::connect(const std::string &clientId, const char* willTopic, const char* willMessage, bool willRetain) {
+  size_t remaining = 10 + 2 + clientId.size();
+  if (willTopic) {
+    remaining += 2 + strlen(willTopic) + 2 + strlen(willMessage);
+  }
+  bytesIn += mqttPacketSize(remaining);
+  if (!up || !acceptConnect) {
+    return 0;
+  }
+  bytesOut += 4; // CONNACK
+  // A second connection with the same client id takes over the session
+  for (auto it = _sessions.begin(); it != _sessions.end(); ++it) {
+    if (it->second.clientId == clientId) {
+      disconnect(it->first, false);
+      break;
+    }
+  }
+  uint32_t id = _nextSession++;
+  Session &s = _sessions[id];
+  s.clientId = clientId;
+  if (willTopic) {
+    s.willTopic = willTopic;
+    s.willMessage = willMessage;
+    s.willRetain = willRetain;
+  }
+  connects++;
+  return id;
+}
+
+void MqttBroker::received(Connection &conn, const uint8_t* data, size_t len) {
+  // CONNECT: answer with CONNACK, 3 (server unavailable) when refusing.
+  // The sizes are counted in connect().
+  if (len > 0 && (data[0] & 0xF0) == 0x10) {
+    const char connack[4] = {0x20, 0x02, 0x00, (char)(up && acceptConnect ? 0 : 3)};
+    conn.rx.append(connack, sizeof(connack));
+    conn.rxAt = nowMicros() + connackUs;
+  }
+}
+
+void MqttBroker::disconnect(uint32_t session, bool graceful) {
+  auto it = _sessions.find(session);
+  if (it == _sessions.end()) {
+    return;
+  }
+  Session s = it->second;
+  _sessions.erase(it);
+  if (graceful) {
+    bytesIn += 2;
+  } else if (!s.willTopic.empty()) {
+    MqttMessage will = {s.willTopic, s.willMessage, s.willRetain};
+    if (will.retained) {
+      _retained[will.topic] = will.payload;
+    }
+    route(will);
+  }
+}
+
+void MqttBroker::publish(uint32_t session, const std::string &topic, const std::string &payload, bool retain) {
+  bytesIn += mqttPacketSize(2 + topic.size() + payload.size());
+  if (!alive(session)) {
+    return;
+  }
+  publishes++;
+  if (retain) {
+    if (payload.empty()) {
+      _retained.erase(topic);
+    } else {
+      _retained[topic] = payload;
+    }
+  }
+  route({topic, payload, retain});
+}
+
+void MqttBroker::route(const MqttMessage &m) {
+  _log.push_back(m);
+  for (auto &fn : _observers) {
+    fn(m);
+  }
+  for (auto &kv : _sessions) {
+    for (const auto &f : kv.second.filters) {
+      if (matches(f, m.topic)) {
+        // Retain flag is only set on delivery of stored messages
+        kv.second.inbox.push_back({m.topic, m.payload, false});
+        bytesOut += mqttPacketSize(2 + m.topic.size() + m.payload.size());
+        break;
+      }
+    }
+  }
+}
+
+bool MqttBroker::subscribe(uint32_t session, const std::string &filter) {
+  bytesIn += mqttPacketSize(2 + 2 + filter.size() + 1);
+  auto it = _sessions.find(session);
+  if (it == _sessions.end()) {
+    return false;
+  }
+  bytesOut += 5; // SUBACK
+  it->second.filters.push_back(filter);
+  for (const auto &kv : _retained) {
+    if (matches(filter, kv.first)) {
+      it->second.inbox.push_back({kv.first, kv.second, true});
+      bytesOut += mqttPacketSize(2 + kv.first.size() + kv.second.size());
+    }
+  }
+  return true;
+}
+
+bool MqttBroker::unsubscribe(uint32_t session, const std::string &filter) {
+  bytesIn += mqttPacketSize(2 + 2 + filter.size());
+  auto it = _sessions.find(session);
+  if (it == _sessions.end()) {
+    return false;
+  }
+  bytesOut += 4; // UNSUBACK
+  auto &filters = it->second.filters;
+  for (auto f = filters.begin(); f != filters.end();) {
+    f = *f == filter ? filters.erase(f) : f + 1;
+  }
+  return true;
+}
+
+bool MqttBroker::poll(uint32_t session, MqttMessage &out) {
+  auto it = _sessions.find(session);
+  if (it == _sessions.end() || it->second.inbox.empty()) {
+    return false;
+  }
+  out = it->second.inbox.front();
+  it->second.inbox.pop_front();
+  return true;
+}
+
+} // namespace host
@@ -0,0 +1,123 @@
+#include <HAL.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "Host.h"
+#include "HostNet.h"
+
+// HostResolver
+
+void HostResolver::start(const char* name) {
+  if (_ip.fromString(name)) {
+    _readyAt = 0;
+    _state = NET_DONE;
+    return;
+  }
+  if (WiFi.status() != WL_CONNECTED) {
+    _state = NET_FAILED;
+    return;
+  }
+  // An unknown name is never answered, the caller's timeout ends it
+  _state = host::resolve(name, _ip) ? NET_DONE : NET_PENDING;
+  _readyAt = _state == NET_DONE ? host::nowMicros() + (uint64_t)host::wifi.dnsMs * 1000 : UINT64_MAX;
+}
+
+NetPoll HostResolver::poll(IPAddress &ip) {
+  if (_state != NET_DONE) {
+    return _state;
+  }
+  if (host::nowMicros() < _readyAt) {
+    return NET_PENDING;
+  }
+  ip = _ip;
+  return NET_DONE;
+}
+
+// TcpConnector
+
+bool TcpConnector::start(IPAddress ip, uint16_t port) {
+  cancel();
+  if (WiFi.status() != WL_CONNECTED) {
+    return false;
+  }
+  _ip = ip;
+  _port = port;
+  _service = host::findService(ip, port);
+  _readyAt = UINT64_MAX; // no answer
+  if (_service) {
+    _readyAt = host::nowMicros() + _service->connectUs;
+  } else if (ip[0] == 127) {
+    _fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (_fd < 0) {
+      return false;
+    }
+    fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = (uint32_t)ip;
+    if (::connect(_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 && errno != EINPROGRESS) {
+      cancel();
+      return false;
+    }
+  }
+  _state = NET_PENDING;
+  return true;
+}
+
+NetPoll TcpConnector::poll(NetClient &client) {
+  if (_state != NET_PENDING) {
+    return _state;
+  }
+  auto conn = std::make_shared<host::Connection>();
+  conn->remote = _ip;
+  if (_fd >= 0) {
+    if (!host::waitSocket(_fd, true, 0)) {
+      return NET_PENDING;
+    }
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0) {
+      cancel();
+      return NET_FAILED;
+    }
+    int one = 1;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    conn->fd = _fd;
+    _fd = -1;
+  } else {
+    if (host::nowMicros() < _readyAt) {
+      return NET_PENDING;
+    }
+    // A service unregistered while connecting is gone like a stopped one
+    bool registered = host::findService(_ip, _port) == _service;
+    if (!registered || !_service->up) {
+      if (registered) {
+        _service->tcpRefused++;
+      }
+      cancel();
+      return NET_FAILED;
+    }
+    _service->tcpConnects++;
+    conn->service = _service;
+    conn->epoch = _service->epoch;
+  }
+  conn->open = true;
+  client = WiFiClient(conn);
+  _service = nullptr;
+  _state = NET_FAILED; // nothing in progress any more
+  return NET_DONE;
+}
+
+void TcpConnector::cancel() {
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+  _service = nullptr;
+  _state = NET_FAILED;
+}
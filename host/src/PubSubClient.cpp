@@ -0,0 +1,233 @@
+#include <PubSubClient.h>
+#include "Host.h"
+
+PubSubClient::PubSubClient(Client &client) : _client(&client) {
+  setBufferSize(MQTT_MAX_PACKET_SIZE);
+}
+
+PubSubClient::~PubSubClient() {
+  free(_buffer);
+}
+
+PubSubClient &PubSubClient::setServer(IPAddress ip, uint16_t port) {
+  _ip = ip;
+  _port = port;
+  _domain = nullptr;
+  return *this;
+}
+
+PubSubClient &PubSubClient::setServer(const char* domain, uint16_t port) {
+  _domain = domain;
+  _port = port;
+  return *this;
+}
+
+PubSubClient &PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+  _callback = callback;
+  return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+  if (size == 0) {
+    return false;
+  }
+  uint8_t* buffer = static_cast<uint8_t*>(_bufferSize == 0 ? malloc(size) : realloc(_buffer, size));
+  if (!buffer) {
+    return false;
+  }
+  _buffer = buffer;
+  _bufferSize = size;
+  return true;
+}
+
+host::MqttBroker* PubSubClient::broker() {
+  // The client may be wrapped, so the broker is found by its address
+  IPAddress ip = _ip;
+  if (_domain && !host::resolve(_domain, ip)) {
+    return nullptr;
+  }
+  return dynamic_cast<host::MqttBroker*>(host::findService(ip, _port));
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass, const char* willTopic,
+                           uint8_t willQos, bool willRetain, const char* willMessage, bool cleanSession) {
+  if (connected()) {
+    return true;
+  }
+  int result = _client->connected() ? 1 : (_domain ? _client->connect(_domain, _port) : _client->connect(_ip, _port));
+  if (!result) {
+    _state = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  host::MqttBroker* b = broker();
+  if (!b) {
+    _state = MQTT_CONNECT_FAILED;
+    _client->stop();
+    return false;
+  }
+  // CONNECT goes out, then the client spins on available() for CONNACK.
+  // Only the packet type is on the wire, the broker counts the full size.
+  const uint8_t connectPacket[2] = {0x10, 0x00};
+  _client->write(connectPacket, sizeof(connectPacket));
+  unsigned long start = millis();
+  while (!_client->available()) {
+    if (millis() - start >= _socketTimeout * 1000UL) {
+      _state = MQTT_CONNECTION_TIMEOUT;
+      _client->stop();
+      return false;
+    }
+    host::advance(100);
+  }
+  uint8_t connack[4] = {};
+  for (uint8_t &c : connack) {
+    c = _client->read();
+  }
+  if (connack[0] != 0x20 || connack[3] != 0) {
+    _state = connack[0] == 0x20 ? connack[3] : MQTT_CONNECT_FAILED;
+    _client->stop();
+    return false;
+  }
+  _session = b->connect(id, willTopic, willMessage, willRetain);
+  if (_session == 0) {
+    _state = MQTT_CONNECT_UNAVAILABLE;
+    _client->stop();
+    return false;
+  }
+  _lastOutActivity = millis();
+  _state = MQTT_CONNECTED;
+  return true;
+}
+
+bool PubSubClient::connected() {
+  if (!_client->connected()) {
+    if (_state == MQTT_CONNECTED) {
+      _state = MQTT_CONNECTION_LOST;
+      _client->stop();
+    }
+    return false;
+  }
+  host::MqttBroker* b = broker();
+  if (_state == MQTT_CONNECTED && (!b || !b->alive(_session))) {
+    // Session taken over or dropped by the broker, which closes the socket
+    _state = MQTT_CONNECTION_LOST;
+    _client->stop();
+    return false;
+  }
+  return _state == MQTT_CONNECTED;
+}
+
+void PubSubClient::disconnect() {
+  if (host::MqttBroker* b = broker()) {
+    b->disconnect(_session, true);
+  }
+  _session = 0;
+  _state = MQTT_DISCONNECTED;
+  _client->stop();
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+  if (!connected()) {
+    return false;
+  }
+  if (_bufferSize < MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + length) {
+    return false;
+  }
+  // The packet is assembled in the buffer before it is written
+  size_t topicLen = strlen(topic);
+  memcpy(_buffer + MQTT_MAX_HEADER_SIZE + 2, topic, topicLen);
+  if (length) {
+    memcpy(_buffer + MQTT_MAX_HEADER_SIZE + 2 + topicLen, payload, length);
+  }
+  host::UntrackedAllocs untracked;
+  broker()->publish(_session, topic, std::string(reinterpret_cast<const char*>(payload), length), retained);
+  _lastOutActivity = millis();
+  return true;
+}
+
+bool PubSubClient::beginPublish(const char* topic, unsigned int length, bool retained) {
+  if (!connected()) {
+    return false;
+  }
+  // Stands in for writing straight to the socket, which does not allocate
+  host::UntrackedAllocs untracked;
+  _streamTopic = topic;
+  _streamPayload.clear();
+  _streamPayload.reserve(length);
+  _streamRetained = retained;
+  _streaming = true;
+  return true;
+}
+
+size_t PubSubClient::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t PubSubClient::write(const uint8_t* buf, size_t len) {
+  if (!_streaming) {
+    return 0;
+  }
+  host::UntrackedAllocs untracked;
+  _streamPayload.append(reinterpret_cast<const char*>(buf), len);
+  return len;
+}
+
+int PubSubClient::endPublish() {
+  if (_streaming && connected()) {
+    host::UntrackedAllocs untracked;
+    broker()->publish(_session, _streamTopic, _streamPayload, _streamRetained);
+    _lastOutActivity = millis();
+  }
+  _streaming = false;
+  return 1;
+}
+
+bool PubSubClient::subscribe(const char* topic, uint8_t qos) {
+  if (MQTT_MAX_HEADER_SIZE + 9 + strlen(topic) > _bufferSize || !connected()) {
+    return false;
+  }
+  _lastOutActivity = millis();
+  return broker()->subscribe(_session, topic);
+}
+
+bool PubSubClient::unsubscribe(const char* topic) {
+  if (MQTT_MAX_HEADER_SIZE + 9 + strlen(topic) > _bufferSize || !connected()) {
+    return false;
+  }
+  _lastOutActivity = millis();
+  return broker()->unsubscribe(_session, topic);
+}
+
+bool PubSubClient::loop() {
+  if (!connected()) {
+    return false;
+  }
+  host::MqttBroker* b = broker();
+  unsigned long now = millis();
+  if (_keepAlive && now - _lastOutActivity > _keepAlive * 1000UL) {
+    // PINGREQ, answered right away
+    b->bytesIn += 2;
+    b->bytesOut += 2;
+    pings++;
+    _lastOutActivity = now;
+  }
+  host::MqttMessage m;
+  bool received;
+  {
+    host::UntrackedAllocs untracked;
+    received = b->poll(_session, m);
+  }
+  if (received) {
+    size_t topicLen = m.topic.size();
+    if (MQTT_MAX_HEADER_SIZE + 2 + topicLen + m.payload.size() + 1 <= _bufferSize && _callback) {
+      // Same layout as the real client: topic NUL-terminated in the buffer,
+      // payload right behind it
+      char* t = reinterpret_cast<char*>(_buffer + MQTT_MAX_HEADER_SIZE);
+      memcpy(t, m.topic.data(), topicLen);
+      t[topicLen] = '\0';
+      uint8_t* p = reinterpret_cast<uint8_t*>(t + topicLen + 1);
+      memcpy(p, m.payload.data(), m.payload.size());
+      _callback(t, p, m.payload.size());
+    }
+  }
+  return true;
+}
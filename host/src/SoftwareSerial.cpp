@@ -0,0 +1,93 @@
+#include <SoftwareSerial.h>
+#include "Host.h"
+
+void SoftwareSerial::begin(uint32_t baud, SoftwareSerialConfig config, int8_t rxPin, int8_t txPin,
+                           bool invert, int bufCapacity, int isrBufCapacity) {
+  std::lock_guard<std::mutex> guard(_lock);
+  _baud = baud;
+  _capacity = bufCapacity > 0 ? bufCapacity : 64;
+  _buffer.clear();
+  _overflow = false;
+}
+
+void SoftwareSerial::store(uint8_t b) {
+  if (_buffer.size() >= _capacity) {
+    _overflow = true;
+    bytesLost++;
+    return;
+  }
+  _buffer.push_back(b);
+}
+
+// Move the bytes whose stop bit has passed from the line into the buffer
+void SoftwareSerial::arrive() {
+  // The deques stand in for the fixed receive buffer, not device heap
+  host::UntrackedAllocs untracked;
+  uint64_t now = host::nowMicros();
+  while (!_line.empty() && _line.front().first <= now) {
+    store(_line.front().second);
+    _line.pop_front();
+  }
+}
+
+int SoftwareSerial::available() {
+  std::lock_guard<std::mutex> guard(_lock);
+  arrive();
+  return (int)_buffer.size();
+}
+
+int SoftwareSerial::read() {
+  std::lock_guard<std::mutex> guard(_lock);
+  arrive();
+  if (_buffer.empty()) {
+    return -1;
+  }
+  uint8_t b = _buffer.front();
+  _buffer.pop_front();
+  return b;
+}
+
+int SoftwareSerial::peek() {
+  std::lock_guard<std::mutex> guard(_lock);
+  arrive();
+  return _buffer.empty() ? -1 : _buffer.front();
+}
+
+size_t SoftwareSerial::read(uint8_t* buf, size_t len) {
+  std::lock_guard<std::mutex> guard(_lock);
+  arrive();
+  size_t n = 0;
+  while (n < len && !_buffer.empty()) {
+    buf[n++] = _buffer.front();
+    _buffer.pop_front();
+  }
+  return n;
+}
+
+bool SoftwareSerial::overflow() {
+  std::lock_guard<std::mutex> guard(_lock);
+  arrive();
+  bool o = _overflow;
+  _overflow = false;
+  return o;
+}
+
+void SoftwareSerial::send(const uint8_t* data, size_t len) {
+  std::lock_guard<std::mutex> guard(_lock);
+  uint64_t byteUs = 10ULL * 1000000 / _baud; // start, 8 data, stop bit
+  uint64_t t = std::max(_lineFree, host::nowMicros());
+  for (size_t i = 0; i < len; i++) {
+    t += byteUs;
+    _line.emplace_back(t, data[i]);
+  }
+  _lineFree = t;
+}
+
+size_t SoftwareSerial::receive(const uint8_t* data, size_t len) {
+  std::lock_guard<std::mutex> guard(_lock);
+  size_t before = bytesLost;
+  for (size_t i = 0; i < len; i++) {
+    store(data[i]);
+  }
+  return len - (bytesLost - before);
+}
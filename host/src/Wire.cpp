@@ -0,0 +1,64 @@
+#include <Wire.h>
+#include "Host.h"
+
+TwoWire Wire;
+
+void TwoWire::attach(uint8_t address, host::I2cDevice* device) {
+  _devices[address & 0x7F] = device;
+}
+
+void TwoWire::busTime(size_t dataBytes) {
+  // Start, address byte with ACK, data bytes with ACK, stop
+  uint64_t clocks = 1 + 9 * (1 + dataBytes) + 1;
+  host::advance(clocks * 1000000 / _clock);
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  _address = address & 0x7F;
+  _txLen = 0;
+}
+
+size_t TwoWire::write(uint8_t b) {
+  if (_txLen >= sizeof(_tx)) {
+    return 0;
+  }
+  _tx[_txLen++] = b;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t len) {
+  size_t n = 0;
+  while (n < len && write(data[n])) {
+    n++;
+  }
+  return n;
+}
+
+// Arduino return codes: 0 success, 2 address NACK, 3 data NACK
+uint8_t TwoWire::endTransmission(bool sendStop) {
+  transactions++;
+  bytes += _txLen;
+  busTime(_txLen);
+  host::I2cDevice* dev = _devices[_address];
+  if (!dev) {
+    return 2;
+  }
+  return dev->i2cWrite(_tx, _txLen) ? 0 : 3;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, size_t len, bool sendStop) {
+  transactions++;
+  _rxLen = _rxPos = 0;
+  if (len > sizeof(_rx)) {
+    len = sizeof(_rx);
+  }
+  host::I2cDevice* dev = _devices[address & 0x7F];
+  if (!dev) {
+    busTime(0);
+    return 0;
+  }
+  _rxLen = dev->i2cRead(_rx, len);
+  bytes += _rxLen;
+  busTime(_rxLen);
+  return (uint8_t)_rxLen;
+}
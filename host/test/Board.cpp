@@ -0,0 +1,217 @@
+#include "Board.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace host {
+
+void vindriktningFrame(uint16_t pm25, uint8_t* frame) {
+  memset(frame, 0, VINDRIKTNING_FRAME_SIZE);
+  frame[0] = VINDRIKTNING_HEADER;
+  frame[1] = VINDRIKTNING_LENGTH;
+  frame[2] = VINDRIKTNING_COMMAND;
+  frame[5] = pm25 >> 8;
+  frame[6] = pm25 & 0xFF;
+  uint8_t sum = 0;
+  for (int i = 0; i < VINDRIKTNING_FRAME_SIZE - 1; i++) {
+    sum += frame[i];
+  }
+  frame[VINDRIKTNING_FRAME_SIZE - 1] = (uint8_t)(0x100 - sum);
+}
+
+Board::Board() {
+  Wire.attach(BME280_I2C_ADDRESS, &bme);
+  bme.setEnvironment(21.5, 45.0, 101325.0);
+  webPort = 0;
+}
+
+void Board::sendPm(uint16_t value) {
+  uint8_t frame[VINDRIKTNING_FRAME_SIZE];
+  vindriktningFrame(value, frame);
+  pms.send(frame, sizeof(frame));
+}
+
+void Board::pass() {
+  if (pmIntervalMs && nowMicros() >= _nextPmUs) {
+    sendPm(pm25);
+    _nextPmUs = nowMicros() + (uint64_t)pmIntervalMs * 1000;
+  }
+  loop();
+  passes++;
+}
+
+void Board::run(uint32_t ms, uint32_t stepUs) {
+  uint64_t end = nowMicros() + (uint64_t)ms * 1000;
+  while (nowMicros() < end) {
+    pass();
+    advance(stepUs);
+  }
+}
+
+bool Board::runUntil(const std::function<bool()> &done, uint32_t timeoutMs, uint32_t stepUs) {
+  uint64_t end = nowMicros() + (uint64_t)timeoutMs * 1000;
+  while (!done()) {
+    if (nowMicros() >= end) {
+      return false;
+    }
+    pass();
+    advance(stepUs);
+  }
+  return true;
+}
+
+int Board::open(const char* path) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(server.localPort());
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  std::string req = std::string("GET ") + path + " HTTP/1.1\r\nHost: device\r\n\r\n";
+  ::send(fd, req.data(), req.size(), MSG_NOSIGNAL);
+  return fd;
+}
+
+std::string readSocket(int fd) {
+  std::string out;
+  char buf[4096];
+  ssize_t n;
+  while ((n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+    out.append(buf, n);
+  }
+  return out;
+}
+
+static std::string dechunk(const std::string &body) {
+  std::string out;
+  size_t pos = 0;
+  while (pos < body.size()) {
+    size_t eol = body.find("\r\n", pos);
+    if (eol == std::string::npos) {
+      break;
+    }
+    size_t len = strtoul(body.substr(pos, eol - pos).c_str(), nullptr, 16);
+    if (len == 0) {
+      break;
+    }
+    out += body.substr(eol + 2, len);
+    pos = eol + 2 + len + 2;
+  }
+  return out;
+}
+
+HttpResponse Board::http(const char* method, const char* path, const std::string &body,
+                         const std::vector<std::string> &headers, uint32_t timeoutMs) {
+  HttpResponse r;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(server.localPort());
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+    close(fd);
+    return r;
+  }
+  std::string req = std::string(method) + " " + path + " HTTP/1.1\r\nHost: device\r\n";
+  for (const auto &h : headers) {
+    req += h + "\r\n";
+  }
+  if (!body.empty()) {
+    req += "Content-Type: application/x-www-form-urlencoded\r\n";
+    req += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+  }
+  req += "\r\n" + body;
+  ::send(fd, req.data(), req.size(), MSG_NOSIGNAL);
+
+  // The server closes the connection after every response
+  std::string raw;
+  uint64_t end = nowMicros() + (uint64_t)timeoutMs * 1000;
+  bool closed = false;
+  while (!closed && nowMicros() < end) {
+    pass();
+    advance(1000);
+    char buf[4096];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+      raw.append(buf, n);
+    }
+    closed = n == 0;
+  }
+  close(fd);
+
+  size_t headerEnd = raw.find("\r\n\r\n");
+  if (raw.compare(0, 9, "HTTP/1.1 ") != 0 || headerEnd == std::string::npos) {
+    return r;
+  }
+  r.status = atoi(raw.c_str() + 9);
+  size_t pos = raw.find("\r\n") + 2;
+  while (pos < headerEnd) {
+    size_t eol = raw.find("\r\n", pos);
+    std::string line = raw.substr(pos, eol - pos);
+    size_t colon = line.find(':');
+    if (colon != std::string::npos) {
+      std::string name = line.substr(0, colon);
+      for (auto &c : name) {
+        c = tolower(c);
+      }
+      std::string value = line.substr(colon + 1);
+      value.erase(0, value.find_first_not_of(' '));
+      r.headers[name] = value;
+    }
+    pos = eol + 2;
+  }
+  r.body = raw.substr(headerEnd + 4);
+  if (r.headers["transfer-encoding"] == "chunked") {
+    r.body = dechunk(r.body);
+  }
+  return r;
+}
+
+std::string runBoot(const std::string &state, const std::function<void()> &fn) {
+  int fds[2];
+  if (pipe(fds) < 0) {
+    test::fail(__FILE__, __LINE__, "pipe");
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    loadState(state);
+    fn();
+    std::string out = saveState();
+    size_t off = 0;
+    while (off < out.size()) {
+      ssize_t n = write(fds[1], out.data() + off, out.size() - off);
+      if (n <= 0) {
+        _exit(2);
+      }
+      off += n;
+    }
+    close(fds[1]);
+    fflush(stdout);
+    _exit(0);
+  }
+  close(fds[1]);
+  std::string out;
+  char buf[65536];
+  ssize_t n;
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+    out.append(buf, n);
+  }
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    test::fail(__FILE__, __LINE__, "boot failed");
+  }
+  return out;
+}
+
+} // namespace host
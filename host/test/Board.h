@@ -0,0 +1,82 @@
+#pragma once
+// The sketch's headers, for the globals and helpers tests look at
+#include "HAL.h"
+#include "Config.h"
+#include "Sensors.h"
+#include "WebServer.h"
+#include "MQTTManager.h"
+#include "Uplink.h"
+#include "Network.h"
+#include "Scheduler.h"
+#include "PowerSave.h"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "FakeBme280.h"
+#include "Host.h"
+#include "MqttBroker.h"
+#include "Test.h"
+
+void setup();
+void loop();
+
+namespace host {
+
+// The 20-byte frame the Vindriktning sends for a PM2.5 reading
+void vindriktningFrame(uint16_t pm25, uint8_t* frame);
+
+struct HttpResponse {
+  int status = 0;
+  std::map<std::string, std::string> headers;  // lower-case names
+  std::string body;                            // chunked encoding removed
+};
+
+// The simulated device: a BME280 on the I2C bus, the Vindriktning on the
+// UART, the access point from ESP8266WiFi.h and an MQTT broker at the
+// address the host secrets.h points the sketch to. The web server listens
+// on a free port on 127.0.0.1.
+class Board {
+public:
+  Board();
+
+  void boot() { setup(); }
+
+  // Run loop() for ms of virtual time with stepUs between passes. The
+  // Vindriktning sends pm25 every pmIntervalMs while pmIntervalMs is set.
+  void run(uint32_t ms, uint32_t stepUs = 1000);
+  bool runUntil(const std::function<bool()> &done, uint32_t timeoutMs, uint32_t stepUs = 1000);
+  void pass();
+
+  void sendPm(uint16_t value);
+
+  // HTTP request to the sketch's web server, loop() runs until the
+  // response is complete or timeoutMs of virtual time passed
+  HttpResponse http(const char* method, const char* path, const std::string &body = "",
+                    const std::vector<std::string> &headers = {}, uint32_t timeoutMs = 5000);
+  HttpResponse get(const char* path, const std::vector<std::string> &headers = {}) {
+    return http("GET", path, "", headers);
+  }
+  // Open a connection and send a GET without waiting for the response
+  int open(const char* path);
+
+  FakeBme280 bme;
+  MqttBroker broker;
+  uint16_t pm25 = 12;
+  uint32_t pmIntervalMs = 20000;  // the Vindriktning's MCU forwards a reading about every 20 s
+  uint64_t passes = 0;
+
+private:
+  uint64_t _nextPmUs = 0;
+};
+
+// Read what arrived on a socket from open() so far, without blocking
+std::string readSocket(int fd);
+
+// One boot of the device in a child process: restore the state a previous
+// boot left behind (RTC memory and flash), run fn and return the state at
+// its end. A failed CHECK in fn fails the calling test.
+std::string runBoot(const std::string &state, const std::function<void()> &fn);
+
+} // namespace host
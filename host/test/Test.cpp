@@ -0,0 +1,69 @@
+#include "Test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace test {
+
+bool quick = false;
+
+struct Entry {
+  const char* name;
+  TestFn fn;
+};
+
+static std::vector<Entry> &registry() {
+  static std::vector<Entry> tests;
+  return tests;
+}
+
+Registrar::Registrar(const char* name, TestFn fn) {
+  registry().push_back({name, fn});
+}
+
+void fail(const char* file, int line, const std::string &what) {
+  fprintf(stderr, "%s:%d: CHECK failed: %s\n", file, line, what.c_str());
+  fflush(stderr);
+  _exit(1);
+}
+
+int runAll(int argc, char** argv) {
+  const char* filter = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    } else {
+      filter = argv[i];
+    }
+  }
+  int failed = 0;
+  int run = 0;
+  for (const auto &t : registry()) {
+    if (filter && !strstr(t.name, filter)) {
+      continue;
+    }
+    run++;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      t.fn();
+      fflush(stdout);
+      _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (!ok && WIFSIGNALED(status)) {
+      fprintf(stderr, "%s: killed by signal %d\n", t.name, WTERMSIG(status));
+    }
+    printf("[%s] %s\n", ok ? " OK " : "FAIL", t.name);
+    failed += !ok;
+  }
+  printf("%d/%d passed\n", run - failed, run);
+  return failed == 0 && run > 0 ? 0 : 1;
+}
+
+} // namespace test
@@ -0,0 +1,61 @@
+#pragma once
+#include <sstream>
+#include <string>
+
+// Minimal test registry. Every TEST runs in a forked child, so each starts
+// from the sketch's initial globals and a fresh simulated board; a failed
+// CHECK ends only that child.
+
+namespace test {
+
+typedef void (*TestFn)();
+
+struct Registrar {
+  Registrar(const char* name, TestFn fn);
+};
+
+[[noreturn]] void fail(const char* file, int line, const std::string &what);
+
+// Runs every registered test in its own process, returns the exit code
+int runAll(int argc, char** argv);
+
+// --quick on the command line: benchmarks shorten their runs to a smoke test
+extern bool quick;
+
+template <typename A, typename B>
+void checkEq(const A &a, const B &b, const char* as, const char* bs, const char* file, int line) {
+  if (!(a == b)) {
+    std::ostringstream os;
+    os << as << " == " << bs << " (" << a << " vs " << b << ")";
+    fail(file, line, os.str());
+  }
+}
+
+template <typename A, typename B>
+void checkOp(bool ok, const A &a, const B &b, const char* expr, const char* file, int line) {
+  if (!ok) {
+    std::ostringstream os;
+    os << expr << " (" << a << ", " << b << ")";
+    fail(file, line, os.str());
+  }
+}
+
+} // namespace test
+
+#define TEST(name) \
+  static void name(); \
+  static test::Registrar name##_registrar(#name, name); \
+  static void name()
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) test::fail(__FILE__, __LINE__, #cond); \
+  } while (0)
+
+#define CHECK_EQ(a, b) test::checkEq((a), (b), #a, #b, __FILE__, __LINE__)
+#define CHECK_LT(a, b) test::checkOp((a) < (b), (a), (b), #a " < " #b, __FILE__, __LINE__)
+#define CHECK_LE(a, b) test::checkOp((a) <= (b), (a), (b), #a " <= " #b, __FILE__, __LINE__)
+#define CHECK_GT(a, b) test::checkOp((a) > (b), (a), (b), #a " > " #b, __FILE__, __LINE__)
+#define CHECK_GE(a, b) test::checkOp((a) >= (b), (a), (b), #a " >= " #b, __FILE__, __LINE__)
+#define CHECK_NEAR(a, b, eps) \
+  test::checkOp(fabs((double)(a) - (double)(b)) <= (eps), (a), (b), #a " ~ " #b, __FILE__, __LINE__)
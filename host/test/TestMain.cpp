@@ -0,0 +1,6 @@
+#include "Test.h"
+
+// Usage: <test> [--quick] [name filter]
+int main(int argc, char** argv) {
+  return test::runAll(argc, argv);
+}
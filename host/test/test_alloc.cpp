@@ -0,0 +1,89 @@
+#include "Board.h"
+#include <thread>
+
+// Steady state does not touch the heap: once the device is online and every
+// buffer has been sized, a loop pass without web requests allocates
+// nothing. Request handlers are counted on their own, per route, since the
+// pages are built on demand. Needs the ALLOC_TRACKING build option.
+
+static void bootOnline(host::Board &board) {
+  board.boot();
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE && !sampleStore.empty(); }, 60000));
+}
+
+TEST(steady_state_allocates_nothing) {
+  host::Board board;
+  bootOnline(board);
+  // Warm up: the first diag run, discovery and a full sample batch size
+  // their buffers once
+  board.run(DIAG_INTERVAL + 60000);
+  scheduler.allocatingPasses = 0;
+  uint32_t passes = scheduler.passes;
+  uint32_t before = allocCount();
+  board.run(10 * 60000);
+  printf("%u passes in 10 min, %u allocating, %u allocations\n", (unsigned)(scheduler.passes - passes),
+         (unsigned)scheduler.allocatingPasses, (unsigned)(allocCount() - before));
+  CHECK_GT(scheduler.passes - passes, 100000u);
+  CHECK_EQ(scheduler.allocatingPasses, 0u);
+  CHECK_GT(metrics.mqttPublishes, 0u);
+}
+
+static const RouteStats* findRoute(const char* path) {
+  for (uint8_t i = 0; i < routeCount; i++) {
+    if (strcmp(routeStats[i].path, path) == 0) {
+      return &routeStats[i];
+    }
+  }
+  return nullptr;
+}
+
+TEST(handlers_allocate_nothing) {
+  host::Board board;
+  bootOnline(board);
+  board.run(60000);
+  const char* paths[] = {"/", "/api/state", "/metrics", "/history", "/history.csv", "/config"};
+  for (const char* path : paths) {
+    CHECK_EQ(board.get(path).status, 200);
+  }
+  for (const char* path : paths) {
+    const RouteStats* r = findRoute(path);
+    CHECK(r != nullptr);
+    CHECK_EQ(r->requests, 1u);
+    CHECK_EQ(r->allocs, 0u);
+  }
+  CHECK_EQ(findRoute("/save")->requests, 0u);
+
+  host::HttpResponse m = board.get("/metrics");
+  CHECK(m.body.find("ikea_air_http_requests_total{route=\"/api/state\"} 1\n") != std::string::npos);
+  CHECK(m.body.find("ikea_air_http_handler_allocations_total{route=\"/api/state\"} 0\n") != std::string::npos);
+}
+
+static void* kept;
+
+TEST(allocating_handler_is_counted) {
+  host::Board board;
+  bootOnline(board);
+  route("/test", [] {
+    kept = malloc(100);
+    server.send(200, "text/plain", "ok");
+  });
+  CHECK_EQ(board.get("/test").status, 200);
+  CHECK_EQ(findRoute("/test")->allocs, 1u);
+  free(kept);
+}
+
+TEST(counters_are_thread_safe) {
+  // The UART fake is fed from a second thread in test_pm_uart
+  constexpr int N = 100000;
+  uint32_t before = allocCount();
+  auto churn = [] {
+    for (int i = 0; i < N; i++) {
+      void* volatile p = malloc(16);  // volatile: a malloc/free pair may be elided
+      free(p);
+    }
+  };
+  std::thread other(churn);
+  churn();
+  other.join();
+  CHECK_GE(allocCount() - before, 2u * N);
+}
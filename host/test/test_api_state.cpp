@@ -0,0 +1,92 @@
+#include "Board.h"
+
+// Conditional GET of /api/state: the ETag changes with every sample, a
+// matching If-None-Match gets a bodyless 304 whatever other headers the
+// request carries, and under polling load most responses are 304s
+
+static std::string etagHeader(const std::string &etag) { return "If-None-Match: " + etag; }
+
+static void ready(host::Board &board) {
+  board.boot();
+  CHECK(board.runUntil([] { return networkServicesStarted && !sampleStore.empty(); }, 60000));
+}
+
+TEST(matching_etag_gets_304) {
+  host::Board board;
+  ready(board);
+  host::HttpResponse r = board.get("/api/state");
+  CHECK_EQ(r.status, 200);
+  std::string etag = r.headers["etag"];
+  CHECK_EQ(etag.size(), 10u);
+
+  r = board.get("/api/state", {etagHeader(etag)});
+  CHECK_EQ(r.status, 304);
+  CHECK(r.body.empty());
+  CHECK_EQ(r.headers["etag"], etag);
+
+  // Authorization sits in front of If-None-Match in the collected headers
+  r = board.get("/api/state", {"Authorization: Basic dXNlcjpwYXNz", etagHeader(etag)});
+  CHECK_EQ(r.status, 304);
+  r = board.get("/api/state", {etagHeader(etag), "Authorization: Basic dXNlcjpwYXNz"});
+  CHECK_EQ(r.status, 304);
+  r = board.get("/api/state", {"Authorization: " + etag});
+  CHECK_EQ(r.status, 200);
+
+  r = board.get("/api/state", {etagHeader("\"00000000\"")});
+  CHECK_EQ(r.status, 200);
+  CHECK(!r.body.empty());
+}
+
+TEST(etag_changes_with_the_sample) {
+  host::Board board;
+  ready(board);
+  std::string etag = board.get("/api/state").headers["etag"];
+  board.pm25 = 40;
+  CHECK(board.runUntil([] { return sampleStore.latest().pm25 == 40; }, 60000));
+  host::HttpResponse r = board.get("/api/state", {etagHeader(etag)});
+  CHECK_EQ(r.status, 200);
+  CHECK(r.headers["etag"] != etag);
+  CHECK(r.body.find("\"pm25\":40") != std::string::npos);
+}
+
+TEST(polling_load_is_mostly_304) {
+  host::Board board;
+  ready(board);
+  // Four dashboards polling every second for ten minutes, samples every 10 s
+  constexpr int CLIENTS = 4;
+  constexpr int SECONDS = 600;
+  std::string etags[CLIENTS];
+  uint32_t full = 0, notModified = 0, stale = 0;
+  uint64_t fullBytes = 0, notModifiedBytes = 0;
+  uint32_t firstSeq = sampleStore.latest().seq;
+  for (int t = 0; t < SECONDS; t++) {
+    for (int c = 0; c < CLIENTS; c++) {
+      uint64_t sent = server.bytesSent;
+      std::vector<std::string> headers;
+      if (!etags[c].empty()) {
+        headers.push_back(etagHeader(etags[c]));
+      }
+      host::HttpResponse r = board.get("/api/state", headers);
+      if (r.status == 200) {
+        full++;
+        fullBytes += server.bytesSent - sent;
+        stale += r.headers["etag"] == etags[c];
+        etags[c] = r.headers["etag"];
+      } else {
+        CHECK_EQ(r.status, 304);
+        CHECK_EQ(r.headers["etag"], etags[c]);
+        notModified++;
+        notModifiedBytes += server.bytesSent - sent;
+      }
+    }
+    board.run(1000 - CLIENTS * 2);
+  }
+  uint32_t samples = sampleStore.latest().seq - firstSeq;
+  printf("  %u samples: %u responses with body (%.0f bytes each), %u 304 (%.0f bytes each)\n", samples, full,
+         (double)fullBytes / full, notModified, (double)notModifiedBytes / notModified);
+  CHECK_EQ(stale, 0u);
+  // One full response per client and sample, the first poll included
+  CHECK_LE(full, (samples + 1) * CLIENTS);
+  CHECK_GE(notModified, (uint32_t)(SECONDS * CLIENTS * 8 / 10));
+  CHECK_LT(notModifiedBytes / notModified, fullBytes / full / 2);
+}
@@ -0,0 +1,60 @@
+#include "Board.h"
+
+// The integer AQI against the float reference for every uint16 input, and
+// the integer formula itself against exact rational arithmetic, which is
+// what justifies AQI_PM25_INT_MAX.
+
+TEST(every_input_matches_float) {
+  uint32_t mismatches = 0;
+  for (uint32_t pm = 0; pm <= UINT16_MAX; pm++) {
+    if (calculatePM25AQI(pm) != calculatePM25AQIFloat(pm)) {
+      if (mismatches++ < 5) {
+        printf("pm25 %u: integer %u, float %u\n", (unsigned)pm, calculatePM25AQI(pm), calculatePM25AQIFloat(pm));
+      }
+    }
+  }
+  CHECK_EQ(mismatches, 0u);
+}
+
+// AQI of the segment holding pm, rounded half up in exact arithmetic
+static uint32_t exactAqi(uint32_t pm, const AqiSegment &seg) {
+  uint64_t n = (uint64_t)(10 * pm - seg.start) * seg.slope;
+  uint64_t q = n / seg.range;
+  return seg.base + q + (2 * (n % seg.range) >= seg.range ? 1 : 0);
+}
+
+TEST(integer_formula_is_exact) {
+  // The segment formula over the whole domain, the last segment extended
+  // past AQI_PM25_INT_MAX
+  constexpr size_t SEGMENTS = sizeof(AQI_PM25_SEGMENTS) / sizeof(AQI_PM25_SEGMENTS[0]);
+  uint32_t firstFloatError = 0;
+  for (uint32_t pm = 0; pm <= UINT16_MAX; pm++) {
+    size_t i = 0;
+    while (i < SEGMENTS - 1 && pm > AQI_PM25_SEGMENTS[i].pmMax) {
+      i++;
+    }
+    uint32_t exact = exactAqi(pm, AQI_PM25_SEGMENTS[i]);
+    if (pm <= AQI_PM25_INT_MAX) {
+      CHECK_EQ((uint32_t)calculatePM25AQI(pm), exact);
+    }
+    if (!firstFloatError && calculatePM25AQIFloat(pm) != exact) {
+      firstFloatError = pm;
+    }
+  }
+  // Where the float path first rounds the wrong way, so the fallback above
+  // AQI_PM25_INT_MAX keeps the two identical
+  printf("float reference first differs from exact rounding at %u\n", (unsigned)firstFloatError);
+  CHECK_EQ(firstFloatError, 20529u);
+  CHECK_LT(AQI_PM25_INT_MAX, firstFloatError);
+}
+
+TEST(breakpoints) {
+  const uint16_t PM[] = {0, 12, 13, 35, 36, 55, 56, 150, 151, 250, 251, 500};
+  const uint16_t AQI[] = {0, 50, 53, 99, 102, 149, 151, 200, 201, 300, 301, 400};
+  for (size_t i = 0; i < sizeof(PM) / sizeof(PM[0]); i++) {
+    CHECK_EQ(calculatePM25AQI(PM[i]), AQI[i]);
+  }
+  for (uint32_t pm = 1; pm <= UINT16_MAX; pm++) {
+    CHECK_GE(calculatePM25AQI(pm), calculatePM25AQI(pm - 1));
+  }
+}
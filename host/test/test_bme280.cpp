@@ -0,0 +1,139 @@
+#include "Board.h"
+
+// BME280Driver against the register-level fake: integer compensation
+// versus the datasheet's floating point formulas, one trigger and one burst
+// read per sample, and no waiting for the conversion
+
+struct Bus {
+  TwoWire wire;
+  host::FakeBme280 chip;
+  BME280Driver driver;
+
+  Bus() { wire.attach(BME280_I2C_ADDRESS, &chip); }
+
+  bool sample() {
+    unsigned long now = millis();
+    if (!driver.startMeasurement(now)) {
+      return false;
+    }
+    host::advanceMillis(BME280_CONVERSION_TIME);
+    return driver.poll(millis());
+  }
+};
+
+TEST(begin_reads_id_and_calibration) {
+  Bus bus;
+  CHECK(bus.driver.begin(BME280_I2C_ADDRESS, bus.wire));
+  CHECK(bus.driver.present());
+  CHECK(!bus.driver.hasSample());
+  CHECK(std::isnan(bus.driver.readTemperature()));
+}
+
+TEST(missing_chip) {
+  Bus bus;
+  bus.chip.present = false;
+  CHECK(!bus.driver.begin(BME280_I2C_ADDRESS, bus.wire));
+  CHECK(!bus.driver.present());
+  CHECK(!bus.driver.startMeasurement(0));
+
+  // Nothing at the other BME280 address
+  Bus other;
+  CHECK(!other.driver.begin(0x77, other.wire));
+}
+
+TEST(compensation_matches_reference) {
+  Bus bus;
+  CHECK(bus.driver.begin(BME280_I2C_ADDRESS, bus.wire));
+  double worstT = 0, worstP = 0, worstH = 0;
+  for (double t = -40; t <= 85; t += 2.5) {
+    for (double h = 0; h <= 100; h += 12.5) {
+      for (double p = 30000; p <= 110000; p += 10000) {
+        bus.chip.setEnvironment(t, h, p);
+        CHECK(bus.sample());
+        host::Bme280Reading ref = host::bme280Reference(bus.chip.calibration(), bus.chip.adcT(),
+                                                        bus.chip.adcP(), bus.chip.adcH());
+        worstT = std::max(worstT, fabs(bus.driver.readTemperature() - ref.temperature));
+        worstP = std::max(worstP, fabs(bus.driver.readPressure() - ref.pressure));
+        worstH = std::max(worstH, fabs(bus.driver.readHumidity() - ref.humidity));
+        // And the environment the fake was set to, within ADC resolution
+        CHECK_NEAR(bus.driver.readTemperature(), t, 0.02);
+        CHECK_NEAR(bus.driver.readPressure(), p, 3.0);
+        CHECK_NEAR(bus.driver.readHumidity(), h, 0.05);
+      }
+    }
+  }
+  printf("worst deviation from the float reference: %.4f degC, %.3f Pa, %.4f %%RH\n", worstT, worstP, worstH);
+  CHECK_LE(worstT, 0.01);
+  CHECK_LE(worstP, 2.0);
+  CHECK_LE(worstH, 0.02);
+}
+
+TEST(two_transactions_per_sample) {
+  Bus bus;
+  CHECK(bus.driver.begin(BME280_I2C_ADDRESS, bus.wire));
+  uint32_t txBefore = bus.driver.i2cTransactions;
+  uint32_t startsBefore = bus.wire.transactions;
+  for (int i = 0; i < 100; i++) {
+    CHECK(bus.sample());
+  }
+  CHECK_EQ(bus.driver.i2cTransactions - txBefore, 200u);
+  // The burst read is a write of the register address and a repeated start
+  CHECK_EQ(bus.wire.transactions - startsBefore, 300u);
+  CHECK_EQ(bus.chip.conversions, 100u);
+  CHECK_EQ(bus.driver.sampleCount, 100u);
+}
+
+TEST(conversion_is_not_waited_for) {
+  Bus bus;
+  CHECK(bus.driver.begin(BME280_I2C_ADDRESS, bus.wire));
+  uint64_t t0 = host::nowMicros();
+  CHECK(bus.driver.startMeasurement(millis()));
+  // Only the bus time of one register write
+  CHECK_LT(host::nowMicros() - t0, 500u);
+  CHECK(bus.driver.busy());
+  CHECK(!bus.driver.startMeasurement(millis()));
+  uint32_t tx = bus.driver.i2cTransactions;
+  host::advanceMillis(BME280_CONVERSION_TIME - 1);
+  CHECK(!bus.driver.poll(millis()));
+  CHECK_EQ(bus.driver.i2cTransactions, tx);
+  host::advanceMillis(1);
+  t0 = host::nowMicros();
+  CHECK(bus.driver.poll(millis()));
+  CHECK_LT(host::nowMicros() - t0, 1500u);
+  CHECK(!bus.driver.busy());
+}
+
+TEST(read_error_is_counted) {
+  Bus bus;
+  CHECK(bus.driver.begin(BME280_I2C_ADDRESS, bus.wire));
+  CHECK(bus.sample());
+  float t = bus.driver.readTemperature();
+  // Chip drops off the bus during a conversion
+  CHECK(bus.driver.startMeasurement(millis()));
+  bus.chip.present = false;
+  host::advanceMillis(BME280_CONVERSION_TIME);
+  CHECK(!bus.driver.poll(millis()));
+  CHECK_EQ(bus.driver.readErrors, 1u);
+  CHECK(!bus.driver.busy());
+  // The last good reading stays
+  CHECK_EQ(bus.driver.readTemperature(), t);
+  bus.chip.present = true;
+  CHECK(bus.sample());
+}
+
+TEST(loop_passes_do_not_block_on_conversions) {
+  host::Board board;
+  board.boot();
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE; }, 30000));
+  uint32_t conversions = board.bme.conversions;
+  uint64_t worst = 0;
+  for (int i = 0; i < 5000; i++) {
+    uint64_t t0 = host::nowMicros();
+    board.pass();
+    worst = std::max(worst, host::nowMicros() - t0);
+    host::advance(1000);
+  }
+  CHECK_GE(board.bme.conversions - conversions, 4u);
+  // Far below the 9.3 ms a conversion takes
+  CHECK_LT(worst, 2000u);
+}
@@ -0,0 +1,45 @@
+#include "Board.h"
+
+// End to end: boot, associate, connect to the broker, take samples and
+// serve them on the web UI
+
+TEST(boots_and_publishes) {
+  host::Board board;
+  board.boot();
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE; }, 30000));
+  CHECK_EQ(WiFi.status(), WL_CONNECTED);
+  CHECK_EQ(board.bme.conversions > 0, true);
+
+  board.run(30000);
+  CHECK(!sampleStore.empty());
+  const Sample &s = sampleStore.latest();
+  CHECK(s.pmValid());
+  CHECK(s.envValid());
+  CHECK_EQ(s.pm25, 12);
+  CHECK_NEAR(s.temperature, 21.5 + config.tempOffset, 0.05);
+  CHECK_NEAR(s.humidity, 45.0, 0.1);
+  CHECK_NEAR(s.pressure, 1013.25, 0.05);
+  CHECK_GT(board.broker.count("tele/ikea-air-monitor/state"), 0u);
+  CHECK_GT(board.broker.count("homeassistant/#"), 0u);
+}
+
+TEST(serves_status_page) {
+  host::Board board;
+  board.boot();
+  CHECK(board.runUntil([] { return !sampleStore.empty(); }, 60000));
+  host::HttpResponse r = board.get("/");
+  CHECK_EQ(r.status, 200);
+  CHECK(r.body.find("<h1>Status</h1>") != std::string::npos);
+  CHECK(r.body.find("12 µg/m³") != std::string::npos);
+  CHECK_EQ(board.get("/missing").status, 404);
+}
+
+TEST(runs_without_bme280) {
+  host::Board board;
+  board.bme.present = false;
+  board.boot();
+  board.run(30000);
+  CHECK(!sampleStore.empty());
+  CHECK(sampleStore.latest().pmValid());
+  CHECK(!sampleStore.latest().envValid());
+}
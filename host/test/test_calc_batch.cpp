@@ -0,0 +1,156 @@
+#include "Board.h"
+#include "CalculationsBatch.h"
+#include <float.h>
+#include <random>
+#include <vector>
+
+// The batch kernels against the scalar functions they replace, bit for
+// bit: the AQI table for every uint16 input, and dew point and comfort
+// index over the sensor range, special values and every tail length.
+// Built twice, as test_calc_batch with the compiler-vectorized loops and as
+// test_calc_batch_avx2 with CALCULATIONS_BATCH_AVX2 and -mavx2.
+
+static bool avx2Path() {
+#if defined(CALCULATIONS_BATCH_AVX2) && defined(__AVX2__)
+  return true;
+#else
+  return false;
+#endif
+}
+
+// The AVX2 build on a CPU without it would stop at the first instruction
+static bool runnable() {
+#if defined(__AVX2__)
+  if (!__builtin_cpu_supports("avx2")) {
+    printf("no AVX2 on this CPU, skipped\n");
+    return false;
+  }
+#endif
+  return true;
+}
+
+// Same bits, or both NaN: the NaN payload is not part of the contract
+static bool sameFloat(float a, float b) {
+  return (isnan(a) && isnan(b)) || memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static void checkEnvBatch(const std::vector<float> &t, const std::vector<float> &h) {
+  size_t n = t.size();
+  std::vector<float> dew(n), comfort(n);
+  calculateEnvBatch(t.data(), h.data(), dew.data(), comfort.data(), n);
+  for (size_t i = 0; i < n; i++) {
+    float d = calculateDewPoint(t[i], h[i]);
+    float c = calculateComfortIndex(t[i], h[i]);
+    if (!sameFloat(dew[i], d) || !sameFloat(comfort[i], c)) {
+      printf("T %.9g RH %.9g: dew point %.9g vs %.9g, comfort %.9g vs %.9g\n", t[i], h[i], dew[i], d, comfort[i], c);
+    }
+    CHECK(sameFloat(dew[i], d));
+    CHECK(sameFloat(comfort[i], c));
+  }
+}
+
+TEST(aqi_table_matches_scalar) {
+  std::vector<uint16_t> pm(65536), aqi(65536);
+  std::vector<uint8_t> category(65536);
+  for (uint32_t i = 0; i < 65536; i++) {
+    pm[i] = (uint16_t)i;
+  }
+  calculateAQIBatch(pm.data(), aqi.data(), category.data(), pm.size());
+  for (uint32_t i = 0; i < 65536; i++) {
+    CHECK_EQ(aqi[i], calculatePM25AQI((uint16_t)i));
+    CHECK_EQ(category[i], getAQICategory(aqi[i]));
+  }
+}
+
+TEST(env_matches_scalar_over_sensor_range) {
+  if (!runnable()) {
+    return;
+  }
+  printf("%s path\n", avx2Path() ? "AVX2" : "compiler-vectorized");
+  // -40..85 °C and 0..100 % RH in 0.05 steps, 5M pairs
+  std::vector<float> t, h;
+  for (int ti = 0; ti <= 2500; ti++) {
+    for (int hi = 0; hi <= 2000; hi++) {
+      t.push_back(-40.0f + ti * 0.05f);
+      h.push_back(hi * 0.05f);
+    }
+  }
+  checkEnvBatch(t, h);
+}
+
+TEST(env_matches_scalar_on_special_values) {
+  if (!runnable()) {
+    return;
+  }
+  // Every pair of these, including what a missing or broken sensor reads
+  const float values[] = {0.0f, -0.0f, -1.0f, 1e-30f, FLT_MIN, FLT_MIN / 4, FLT_MAX, -FLT_MAX, INFINITY,
+                          -INFINITY, NAN, -NAN, 18.0f, 26.0f, 30.0f, 70.0f, 100.0f, 150.0f, 1e6f};
+  std::vector<float> t, h;
+  for (float a : values) {
+    for (float b : values) {
+      t.push_back(a);
+      h.push_back(b);
+    }
+  }
+  checkEnvBatch(t, h);
+}
+
+TEST(env_matches_scalar_for_every_length_and_offset) {
+  if (!runnable()) {
+    return;
+  }
+  // The vector body and the scalar tail, from unaligned starts
+  std::mt19937 rng(8);
+  std::uniform_real_distribution<float> td(-10.0f, 40.0f), hd(0.0f, 100.0f);
+  for (size_t n = 0; n <= 40; n++) {
+    for (size_t offset = 0; offset < 8; offset++) {
+      std::vector<float> t(offset + n), h(offset + n), dew(offset + n + 1, -1.0f), comfort(offset + n + 1, -1.0f);
+      for (size_t i = 0; i < t.size(); i++) {
+        t[i] = td(rng);
+        h[i] = hd(rng);
+      }
+      calculateEnvBatch(t.data() + offset, h.data() + offset, dew.data() + offset, comfort.data() + offset, n);
+      for (size_t i = 0; i < n; i++) {
+        CHECK(sameFloat(dew[offset + i], calculateDewPoint(t[offset + i], h[offset + i])));
+        CHECK(sameFloat(comfort[offset + i], calculateComfortIndex(t[offset + i], h[offset + i])));
+      }
+      // Nothing written outside the span
+      for (size_t i = 0; i < offset; i++) {
+        CHECK_EQ(dew[i], -1.0f);
+        CHECK_EQ(comfort[i], -1.0f);
+      }
+      CHECK_EQ(dew[offset + n], -1.0f);
+      CHECK_EQ(comfort[offset + n], -1.0f);
+    }
+  }
+}
+
+TEST(derived_batch_matches_calculate_derived) {
+  if (!runnable()) {
+    return;
+  }
+  // The batch against calculateDerived() on whole samples
+  constexpr size_t N = 100000;
+  std::mt19937 rng(9);
+  std::vector<uint16_t> pm(N), aqi(N);
+  std::vector<uint8_t> category(N);
+  std::vector<float> t(N), h(N), dew(N), comfort(N);
+  for (size_t i = 0; i < N; i++) {
+    pm[i] = (uint16_t)std::min(65535.0, std::exponential_distribution<double>(0.05)(rng));
+    t[i] = std::normal_distribution<float>(21.0f, 4.0f)(rng);
+    h[i] = std::uniform_real_distribution<float>(5.0f, 95.0f)(rng);
+  }
+  calculateDerivedBatch({pm.data(), t.data(), h.data()}, {aqi.data(), category.data(), dew.data(), comfort.data()}, N);
+  for (size_t i = 0; i < N; i++) {
+    Sample s = {};
+    s.valid = SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+    s.pm25 = pm[i];
+    s.temperature = t[i];
+    s.humidity = h[i];
+    calculateDerived(s);
+    CHECK_EQ(aqi[i], s.aqi);
+    CHECK_EQ(category[i], s.aqiCategory);
+    CHECK(sameFloat(dew[i], s.dewPoint));
+    CHECK(sameFloat(comfort[i], s.comfortIndex));
+  }
+}
@@ -0,0 +1,92 @@
+#include "Board.h"
+#include <float.h>
+
+// fastLogf() and the libm-free dew point against double-precision
+// references over the whole range the BME280 reports, and the branch-free
+// comfort index against the plain if/else definition.
+
+static double magnusDouble(double t, double h) {
+  double alpha = DEWPOINT_A * t / (DEWPOINT_B + t) + log(h / 100.0);
+  return DEWPOINT_B * alpha / (DEWPOINT_A - alpha);
+}
+
+TEST(fast_log_over_every_float) {
+  // Every float from 0.01 to 100, the humidity range and then some
+  float lo = 0.01f;
+  float hi = 100.0f;
+  uint32_t first, last;
+  memcpy(&first, &lo, sizeof(first));
+  memcpy(&last, &hi, sizeof(last));
+  double maxErr = 0;
+  float worst = 0;
+  for (uint32_t bits = first; bits <= last; bits++) {
+    float x;
+    memcpy(&x, &bits, sizeof(x));
+    double err = fabs(fastLogf(x) - log((double)x));
+    if (err > maxErr) {
+      maxErr = err;
+      worst = x;
+    }
+  }
+  printf("fastLogf over %u floats: max error %.2e at %g\n", (unsigned)(last - first + 1), maxErr, worst);
+  CHECK_LE(maxErr, 3.3e-6);
+}
+
+TEST(fast_log_special_values) {
+  CHECK(isnan(fastLogf(0.0f)));
+  CHECK(isnan(fastLogf(-0.0f)));
+  CHECK(isnan(fastLogf(-1.0f)));
+  CHECK(isnan(fastLogf(INFINITY)));
+  CHECK(isnan(fastLogf(NAN)));
+  CHECK(isnan(calculateDewPoint(20.0f, 0.0f)));
+  CHECK_NEAR(fastLogf(1.0f), 0.0, 4e-6);
+  CHECK_NEAR(fastLogf(FLT_MAX), log((double)FLT_MAX), 1e-4);
+  CHECK_NEAR(fastLogf(FLT_MIN), log((double)FLT_MIN), 1e-4);
+}
+
+TEST(dew_point_against_double_magnus) {
+  // T -40..85 °C and RH 1..100 %, both in 0.02 steps
+  double maxErr = 0, maxErrLibm = 0;
+  float worstT = 0, worstH = 0;
+  uint64_t points = 0;
+  for (int ti = -2000; ti <= 4250; ti++) {
+    float t = ti * 0.02f;
+    for (int hi = 50; hi <= 5000; hi++) {
+      float h = hi * 0.02f;
+      double ref = magnusDouble(t, h);
+      double err = fabs(calculateDewPoint(t, h) - ref);
+      if (err > maxErr) {
+        maxErr = err;
+        worstT = t;
+        worstH = h;
+      }
+      maxErrLibm = std::max(maxErrLibm, fabs(calculateDewPointLibm(t, h) - ref));
+      points++;
+    }
+  }
+  printf("dew point over %llu points: max error %.2e °C at %.2f °C %.2f %% (libm float %.2e °C)\n",
+         (unsigned long long)points, maxErr, worstT, worstH, maxErrLibm);
+  CHECK_LE(maxErr, 9.2e-5);
+}
+
+static float comfortReference(float temp, float humidity) {
+  float tempScore = 100.0f;
+  if (temp < 18.0f || temp > 26.0f) {
+    tempScore = std::max(0.0f, 100.0f - fabsf(temp - 22.0f) * 10.0f);
+  }
+  float humidityScore = 100.0f;
+  if (humidity < 30.0f || humidity > 70.0f) {
+    humidityScore = std::max(0.0f, 100.0f - fabsf(humidity - 50.0f) * 2.0f);
+  }
+  return (tempScore + humidityScore) / 2.0f;
+}
+
+TEST(comfort_index_against_reference) {
+  for (int ti = -400; ti <= 850; ti++) {
+    for (int hi = 0; hi <= 1000; hi++) {
+      float t = ti * 0.1f;
+      float h = hi * 0.1f;
+      CHECK_EQ(calculateComfortIndex(t, h), comfortReference(t, h));
+    }
+  }
+}
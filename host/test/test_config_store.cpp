@@ -0,0 +1,256 @@
+#include "Board.h"
+
+// ConfigStore against power loss: a save cut off after any number of bytes
+// leaves either every field of that save or none of them, in the append
+// path and in a compaction. Plus the device side: a normal boot does not
+// write the config at all.
+
+struct TestConfig {
+  char name[32];
+  uint32_t interval;
+  float offset;
+  uint8_t flag;
+  char url[64];
+};
+
+static const ConfigField TEST_FIELDS[] PROGMEM = {
+  {1, CONFIG_STRING, CONFIG_TRACK_DEFAULT, sizeof(TestConfig::name), offsetof(TestConfig, name)},
+  {2, CONFIG_BINARY, 0, sizeof(TestConfig::interval), offsetof(TestConfig, interval)},
+  {3, CONFIG_BINARY, 0, sizeof(TestConfig::offset), offsetof(TestConfig, offset)},
+  {4, CONFIG_BINARY, 0, sizeof(TestConfig::flag), offsetof(TestConfig, flag)},
+  {5, CONFIG_STRING, 0, sizeof(TestConfig::url), offsetof(TestConfig, url)},
+};
+
+static const char* const PATH = "/test.kv";
+static const char* const TMP_PATH = "/test.new";
+
+static ConfigStore makeStore() {
+  return ConfigStore(PATH, TMP_PATH, TEST_FIELDS, sizeof(TEST_FIELDS) / sizeof(TEST_FIELDS[0]));
+}
+
+static TestConfig defaults() {
+  TestConfig c = {};
+  strcpy(c.name, "device");
+  c.interval = 10;
+  c.offset = -2.0f;
+  return c;
+}
+
+static TestConfig edited(int round) {
+  TestConfig c = defaults();
+  snprintf(c.name, sizeof(c.name), "renamed-%d", round);
+  c.interval = 30 + round;
+  c.offset = -1.5f - round;
+  c.flag = round & 1;
+  snprintf(c.url, sizeof(c.url), "http://collector.local/ingest/%d", round);
+  return c;
+}
+
+static bool same(const TestConfig &a, const TestConfig &b) {
+  return strcmp(a.name, b.name) == 0 && a.interval == b.interval && a.offset == b.offset && a.flag == b.flag &&
+         strcmp(a.url, b.url) == 0;
+}
+
+// What a fresh boot reads back
+static TestConfig reload(ConfigStore &store) {
+  TestConfig d = defaults();
+  TestConfig c = d;
+  store.load(&c, &d);
+  return c;
+}
+
+// A log holding the defaults, then round 0 as a second, appended save
+static void writeBase() {
+  ConfigStore store = makeStore();
+  TestConfig d = defaults();
+  TestConfig c = d;
+  CHECK(!store.load(&c, &d));
+  CHECK(store.save(&c));
+  c = edited(0);
+  CHECK(store.save(&c));
+  CHECK_EQ(store.sequence(), 2u);
+}
+
+TEST(saves_are_committed_with_a_sequence) {
+  writeBase();
+  ConfigStore store = makeStore();
+  CHECK(same(reload(store), edited(0)));
+  CHECK_EQ(store.sequence(), 2u);
+  CHECK(!store.pending());
+  CHECK_EQ(store.uncommitted, 0u);
+  // Unchanged: nothing written
+  TestConfig c = edited(0);
+  size_t size = LittleFS.fileSize(PATH);
+  CHECK(store.save(&c));
+  CHECK_EQ(LittleFS.fileSize(PATH), size);
+  CHECK_EQ(store.sequence(), 2u);
+}
+
+TEST(power_loss_during_an_append) {
+  // Round 1 changes every field: five records and the commit
+  writeBase();
+  std::string before = LittleFS.image();
+  size_t logBefore = LittleFS.fileSize(PATH);
+  size_t saveBytes = 0;
+  {
+    ConfigStore store = makeStore();
+    reload(store);
+    TestConfig c = edited(1);
+    CHECK(store.save(&c));
+    saveBytes = LittleFS.fileSize(PATH) - logBefore;
+    CHECK_EQ(store.compactions, 0u);
+  }
+  printf("append of 5 fields: %zu bytes, cut after each of them\n", saveBytes);
+  for (size_t budget = 0; budget <= saveBytes; budget++) {
+    LittleFS.loadImage(before);
+    LittleFS.powerOn();
+    ConfigStore store = makeStore();
+    reload(store);
+    TestConfig c = edited(1);
+    LittleFS.writeBudget = budget;
+    bool saved = store.save(&c);
+    LittleFS.powerOn();
+
+    ConfigStore after = makeStore();
+    TestConfig loaded = reload(after);
+    // All of the save or none of it
+    bool complete = budget == saveBytes;
+    CHECK(same(loaded, complete ? edited(1) : edited(0)));
+    CHECK_EQ(saved, complete);
+    CHECK_EQ(after.sequence(), complete ? 3u : 2u);
+    CHECK_EQ(after.pending(), budget > 0 && !complete);
+    CHECK_EQ(after.uncommitted + after.torn > 0, budget > 0 && !complete);
+
+    // The next save rewrites the log without the partial group
+    TestConfig next = edited(2);
+    CHECK(after.save(&next));
+    ConfigStore again = makeStore();
+    CHECK(same(reload(again), edited(2)));
+    CHECK(!again.pending());
+    CHECK_EQ(again.torn + again.crcErrors + again.uncommitted, 0u);
+  }
+}
+
+TEST(power_loss_during_a_compaction) {
+  writeBase();
+  std::string before = LittleFS.image();
+  size_t logBytes = 0;
+  {
+    ConfigStore store = makeStore();
+    reload(store);
+    store.requestCompaction();
+    TestConfig c = edited(1);
+    CHECK(store.save(&c));
+    CHECK_EQ(store.compactions, 1u);
+    logBytes = LittleFS.fileSize(PATH);
+  }
+  // Power goes with the last byte at the latest, so the rename never happens
+  for (size_t budget = 0; budget <= logBytes; budget++) {
+    LittleFS.loadImage(before);
+    LittleFS.powerOn();
+    ConfigStore store = makeStore();
+    reload(store);
+    store.requestCompaction();
+    TestConfig c = edited(1);
+    LittleFS.writeBudget = budget;
+    store.save(&c);
+    LittleFS.powerOn();
+
+    ConfigStore after = makeStore();
+    CHECK(same(reload(after), edited(0)));
+    CHECK_EQ(after.sequence(), 2u);
+    CHECK(!LittleFS.exists(TMP_PATH));
+  }
+}
+
+TEST(power_loss_in_a_later_save_keeps_earlier_ones) {
+  // Several appended saves, the last one cut in its commit record
+  writeBase();
+  ConfigStore store = makeStore();
+  reload(store);
+  for (int round = 1; round <= 4; round++) {
+    TestConfig c = edited(round);
+    CHECK(store.save(&c));
+  }
+  // One changed field: its record goes out whole, the commit one byte short
+  TestConfig c = edited(4);
+  c.flag = !c.flag;
+  LittleFS.writeBudget = CONFIG_RECORD_HEAD + 1 + 4 + CONFIG_COMMIT_SIZE - 1;
+  CHECK(!store.save(&c));
+  LittleFS.powerOn();
+
+  ConfigStore after = makeStore();
+  CHECK(same(reload(after), edited(4)));
+  CHECK_EQ(after.sequence(), 6u);
+  CHECK_EQ(after.torn, 1u);
+  CHECK_EQ(after.uncommitted, 1u);
+}
+
+TEST(records_without_a_commit_are_ignored) {
+  // A group that ends cleanly on a record boundary but never got its commit
+  writeBase();
+  ConfigStore store = makeStore();
+  reload(store);
+  TestConfig c = edited(1);
+  size_t commitAt = LittleFS.fileSize(PATH);
+  CHECK(store.save(&c));
+  File f = LittleFS.open(PATH, "r+");
+  CHECK(f.truncate(LittleFS.fileSize(PATH) - CONFIG_COMMIT_SIZE));
+  f.close();
+  CHECK_GT(LittleFS.fileSize(PATH), commitAt);
+
+  ConfigStore after = makeStore();
+  CHECK(same(reload(after), edited(0)));
+  CHECK_EQ(after.uncommitted, 1u);
+  CHECK_EQ(after.torn + after.crcErrors, 0u);
+  CHECK(after.pending());
+}
+
+static std::string bootOnce(const std::string &state, const std::function<void()> &fn = [] {}) {
+  return host::runBoot(state, [&fn] {
+    host::Board board;
+    board.boot();
+    fn();
+  });
+}
+
+TEST(normal_boot_does_not_write_the_config) {
+  // First boot writes the defaults, a boot after an edit nothing
+  std::string state = bootOnce("", [] {
+    CHECK(LittleFS.exists(CONFIG_PATH));
+    CHECK_EQ(configStore.sequence(), 1u);
+    config.sendInterval = 30000;
+    CHECK(saveConfig(config));
+  });
+  for (int boot = 0; boot < 3; boot++) {
+    state = bootOnce(state, [] {
+      CHECK_EQ(config.sendInterval, 30000u);
+      CHECK(!configStore.pending());
+      CHECK_EQ(configStore.recordsWritten, 0u);
+      CHECK_EQ(configStore.compactions, 0u);
+      CHECK_EQ(configStore.sequence(), 2u);
+    });
+  }
+}
+
+TEST(boot_after_a_torn_save_rewrites_the_log) {
+  // The mqttPort record is written whole, sendInterval is cut short
+  std::string state = bootOnce("", [] {
+    config.sendInterval = 30000;
+    config.mqttPort = 8883;
+    LittleFS.writeBudget = CONFIG_RECORD_HEAD + sizeof(config.mqttPort) + 4 + 5;
+    CHECK(!saveConfig(config));
+  });
+  state = bootOnce(state, [] {
+    // Neither field of the torn save
+    CHECK_EQ(config.mqttPort, DEFAULT_MQTT_PORT);
+    CHECK_EQ(config.sendInterval, (uint32_t)DEFAULT_SEND_INTERVAL);
+    CHECK_EQ(configStore.torn, 1u);
+    CHECK_EQ(configStore.uncommitted, 1u);
+    CHECK_EQ(configStore.compactions, 1u);
+  });
+  bootOnce(state, [] {
+    CHECK_EQ(configStore.torn + configStore.uncommitted + configStore.crcErrors, 0u);
+    CHECK_EQ(configStore.compactions, 0u);
+  });
+}
@@ -0,0 +1,195 @@
+#include "Board.h"
+#include "Deadband.h"
+
+// DeadbandFilter replayed over traces: a hand-written one where every row
+// says whether it is published, a week of synthetic readings checked
+// against the filter's rules sample by sample, and the device end to end,
+// where only the samples the filter passes reach the broker.
+
+static DeviceConfig deadbandConfig() {
+  DeviceConfig cfg;
+  resetConfig(cfg);
+  cfg.deadbandEnabled = 1;
+  return cfg;
+}
+
+static Sample makeSample(uint32_t uptime, uint8_t valid, uint16_t pm25, float t, float h, float p) {
+  Sample s = {};
+  s.uptime = uptime;
+  s.valid = valid;
+  s.pm25 = pm25;
+  s.temperature = t;
+  s.humidity = h;
+  s.pressure = p;
+  calculateDerived(s);
+  return s;
+}
+
+constexpr uint8_t BOTH = SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+
+struct TraceRow {
+  uint32_t uptime;
+  uint8_t valid;
+  uint16_t pm25;
+  float temperature, humidity, pressure;
+  bool published;
+};
+
+// Default thresholds: 1 µg/m³, 0.2 °C, 1 %, 0.5 hPa, heartbeat 600 s.
+// Differences are measured from the last published row, never exactly on
+// a threshold.
+static const TraceRow TRACE[] = {
+  {0, BOTH, 10, 20.00f, 45.0f, 1013.0f, true},     // first sample
+  {10, BOTH, 11, 20.10f, 45.5f, 1013.2f, false},   // PM +1 is not more than 1
+  {20, BOTH, 11, 20.15f, 45.9f, 1013.4f, false},   // all within
+  {30, BOTH, 12, 20.15f, 45.9f, 1013.4f, true},    // PM +2
+  {40, BOTH, 12, 20.30f, 45.9f, 1013.4f, false},   // T +0.15
+  {50, BOTH, 12, 20.40f, 45.9f, 1013.4f, true},    // T +0.25 against row 30
+  {60, BOTH, 12, 20.40f, 47.0f, 1013.4f, true},    // H +1.1
+  {70, BOTH, 12, 20.40f, 47.0f, 1014.0f, true},    // P +0.6
+  {80, BOTH, 11, 20.40f, 47.0f, 1013.9f, false},   // PM -1, P -0.1
+  {90, SAMPLE_PM_VALID, 12, 0.0f, 0.0f, 0.0f, true},    // BME280 lost
+  {100, SAMPLE_PM_VALID, 12, 35.0f, 90.0f, 900.0f, false}, // invalid fields are ignored
+  {110, BOTH, 12, 20.40f, 47.0f, 1014.0f, true},   // BME280 back
+  {120, 0, 0, 0.0f, 0.0f, 0.0f, true},             // nothing valid
+  {130, BOTH, 12, 20.40f, 47.0f, 1014.0f, true},
+  {700, BOTH, 12, 20.45f, 47.0f, 1014.0f, false},  // 570 s since the last publish
+  {730, BOTH, 12, 20.45f, 47.0f, 1014.0f, true},   // heartbeat after 600 s
+  {740, BOTH, 13, 20.45f, 47.0f, 1014.0f, false},
+  {750, BOTH, 10, 20.45f, 47.0f, 1014.0f, true},   // PM -2
+};
+
+TEST(hand_written_trace) {
+  DeviceConfig cfg = deadbandConfig();
+  DeadbandFilter filter;
+  uint32_t published = 0;
+  for (const TraceRow &r : TRACE) {
+    Sample s = makeSample(r.uptime, r.valid, r.pm25, r.temperature, r.humidity, r.pressure);
+    bool passed = filter.pass(s, cfg);
+    if (passed != r.published) {
+      printf("row at %u s: published %d, expected %d\n", (unsigned)r.uptime, passed, r.published);
+    }
+    CHECK_EQ(passed, r.published);
+    published += r.published;
+  }
+  CHECK_EQ(filter.passed, published);
+  CHECK_EQ(filter.suppressed, sizeof(TRACE) / sizeof(TRACE[0]) - published);
+}
+
+TEST(disabled_filter_publishes_everything) {
+  DeviceConfig cfg = deadbandConfig();
+  cfg.deadbandEnabled = 0;
+  DeadbandFilter filter;
+  for (const TraceRow &r : TRACE) {
+    CHECK(filter.pass(makeSample(r.uptime, r.valid, r.pm25, r.temperature, r.humidity, r.pressure), cfg));
+  }
+  CHECK_EQ(filter.suppressed, 0u);
+}
+
+TEST(custom_thresholds_and_heartbeat) {
+  DeviceConfig cfg = deadbandConfig();
+  cfg.deadbandTemp = 0.5f;
+  cfg.deadbandPm = 5;
+  cfg.heartbeatInterval = 120;
+  DeadbandFilter filter;
+  CHECK(filter.pass(makeSample(0, BOTH, 10, 20.0f, 45.0f, 1013.0f), cfg));
+  CHECK(!filter.pass(makeSample(10, BOTH, 15, 20.4f, 45.0f, 1013.0f), cfg));
+  CHECK(filter.pass(makeSample(20, BOTH, 16, 20.4f, 45.0f, 1013.0f), cfg));
+  CHECK(!filter.pass(makeSample(30, BOTH, 16, 19.95f, 45.0f, 1013.0f), cfg));
+  CHECK(filter.pass(makeSample(40, BOTH, 16, 19.85f, 45.0f, 1013.0f), cfg));
+  CHECK(!filter.pass(makeSample(150, BOTH, 16, 19.85f, 45.0f, 1013.0f), cfg));
+  CHECK(filter.pass(makeSample(160, BOTH, 16, 19.85f, 45.0f, 1013.0f), cfg));
+}
+
+// A week at the 10 s interval: diurnal temperature and humidity swing,
+// slow pressure drift, BME280-level noise, PM2.5 jittering by ±1 around a
+// baseline and two cooking spikes a day. Deterministic.
+static std::vector<Sample> syntheticWeek() {
+  std::vector<Sample> trace;
+  uint32_t rng = 12345;
+  auto noise = [&rng] {
+    rng = rng * 1664525u + 1013904223u;
+    return (int32_t)(rng >> 8) / (float)(1 << 23) - 1.0f;  // -1..1
+  };
+  for (uint32_t t = 0; t < 7 * 86400; t += 10) {
+    float day = (t % 86400) / 86400.0f;
+    float temp = 21.0f + 1.5f * sinf(2 * (float)M_PI * (day - 0.3f)) + 0.03f * noise();
+    float hum = 45.0f - 4.0f * sinf(2 * (float)M_PI * (day - 0.3f)) + 0.3f * noise();
+    float press = 1013.0f + 6.0f * sinf(2 * (float)M_PI * t / (5 * 86400.0f)) + 0.12f * noise();
+    int pm = 8 + (int)lroundf(noise());
+    for (float spike : {0.52f, 0.79f}) {
+      float dt = (day - spike) * 24 * 60;  // minutes after the spike started
+      if (dt >= 0 && dt < 90) {
+        pm += (int)(60 * expf(-dt / 20.0f) * (1 - expf(-dt / 3.0f)));
+      }
+    }
+    trace.push_back(makeSample(t, BOTH, (uint16_t)pm, temp, hum, press));
+  }
+  return trace;
+}
+
+TEST(synthetic_week_follows_the_rules) {
+  DeviceConfig cfg = deadbandConfig();
+  DeadbandFilter filter;
+  std::vector<Sample> trace = syntheticWeek();
+  const Sample* last = nullptr;
+  uint32_t published = 0;
+  uint64_t bytesAll = 0;
+  uint64_t bytesPublished = 0;
+  uint32_t longestSilence = 0;
+  for (const Sample &s : trace) {
+    char payload[STATE_JSON_SIZE];
+    int len = formatStateJson(s, payload, sizeof(payload));
+    CHECK_GT(len, 0);
+    bytesAll += len;
+    bool moved = !last || abs((int)s.pm25 - (int)last->pm25) > cfg.deadbandPm ||
+                 fabsf(s.temperature - last->temperature) > cfg.deadbandTemp ||
+                 fabsf(s.humidity - last->humidity) > cfg.deadbandHum ||
+                 fabsf(s.pressure - last->pressure) > cfg.deadbandPress;
+    bool heartbeat = last && s.uptime - last->uptime >= cfg.heartbeatInterval;
+    // Published exactly when a field moved past its threshold since the
+    // last published sample, or the heartbeat is due
+    CHECK_EQ(filter.pass(s, cfg), moved || heartbeat);
+    if (moved || heartbeat) {
+      if (last) {
+        longestSilence = max(longestSilence, s.uptime - last->uptime);
+      }
+      last = &s;
+      published++;
+      bytesPublished += len;
+    }
+  }
+  printf("%zu samples -> %u published (%.1f %%), state JSON %.2f MB -> %.2f MB\n", trace.size(),
+         (unsigned)published, 100.0 * published / trace.size(), bytesAll / 1e6, bytesPublished / 1e6);
+  CHECK_LE(longestSilence, (uint32_t)cfg.heartbeatInterval);
+  // The default thresholds drop most of a quiet room's samples
+  CHECK_LT(published, trace.size() / 3);
+  CHECK_GT(published, (uint32_t)(7 * 86400 / cfg.heartbeatInterval));
+}
+
+TEST(device_publishes_only_what_the_filter_passes) {
+  host::Board board;
+  board.boot();
+  config.deadbandEnabled = 1;
+  board.bme.setEnvironment(22.0, 40.0, 101300);
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE && !sampleStore.empty(); }, 60000));
+  const char* topic = "tele/ikea-air-monitor/state";
+
+  // Nothing moves: one heartbeat per interval
+  board.run(config.heartbeatInterval * 1000u);
+  board.broker.clearLog();
+  uint32_t samples = deadband.passed + deadband.suppressed;
+  board.run(3 * config.heartbeatInterval * 1000u);
+  CHECK_EQ(board.broker.count(topic), 3u);
+  CHECK_EQ(deadband.passed + deadband.suppressed - samples, 3 * config.heartbeatInterval * 1000u / config.sendInterval);
+
+  // A change past the temperature threshold goes out with the next sample
+  // (20.5 after the default -2 °C offset)
+  board.broker.clearLog();
+  board.bme.setEnvironment(22.5, 40.0, 101300);
+  board.run(config.sendInterval + 1000);
+  CHECK_EQ(board.broker.count(topic), 1u);
+  CHECK(board.broker.log().back().payload.find("\"Temperature\":20.5") != std::string::npos);
+  board.run(5 * config.sendInterval);
+  CHECK_EQ(board.broker.count(topic), 1u);
+}
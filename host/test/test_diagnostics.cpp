@@ -0,0 +1,307 @@
+#include "Board.h"
+#include <set>
+#include <sstream>
+
+// /metrics in the Prometheus text format and the retained diag payload:
+// both parse, carry every periodic task and agree with the counters they
+// are exported from.
+
+struct Series {
+  std::string name;
+  std::map<std::string, std::string> labels;
+  double value;
+};
+
+// One "name{label="value",...} number" line
+static bool parseSeries(const std::string &line, Series &s) {
+  size_t brace = line.find('{');
+  size_t space = line.rfind(' ');
+  if (space == std::string::npos) {
+    return false;
+  }
+  s.name = line.substr(0, min(brace, space));
+  s.labels.clear();
+  if (brace != std::string::npos && brace < space) {
+    size_t pos = brace + 1;
+    while (line[pos] != '}') {
+      size_t eq = line.find("=\"", pos);
+      size_t end = line.find('"', eq + 2);
+      if (eq == std::string::npos || end == std::string::npos) {
+        return false;
+      }
+      s.labels[line.substr(pos, eq - pos)] = line.substr(eq + 2, end - eq - 2);
+      pos = end + 1;
+      if (line[pos] == ',') {
+        pos++;
+      }
+    }
+  }
+  std::string value = line.substr(space + 1);
+  char* end;
+  s.value = strtod(value.c_str(), &end);
+  return !value.empty() && *end == '\0';
+}
+
+static bool validName(const std::string &name) {
+  if (name.empty() || isdigit((unsigned char)name[0])) {
+    return false;
+  }
+  for (char c : name) {
+    if (!isalnum((unsigned char)c) && c != '_' && c != ':') {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct Exposition {
+  std::map<std::string, std::string> types;   // family -> counter/gauge/histogram
+  std::vector<Series> series;
+
+  const Series* find(const std::string &name, const std::string &subsystem = "") const {
+    for (const Series &s : series) {
+      if (s.name == name && (subsystem.empty() || (s.labels.count("subsystem") && s.labels.at("subsystem") == subsystem))) {
+        return &s;
+      }
+    }
+    return nullptr;
+  }
+};
+
+// Every sample line parses and belongs to a family declared before it,
+// no series appears twice
+static Exposition parseExposition(const std::string &body) {
+  Exposition e;
+  std::set<std::string> seen;
+  std::istringstream in(body);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    if (line.compare(0, 7, "# TYPE ") == 0) {
+      std::istringstream t(line.substr(7));
+      std::string family, type;
+      t >> family >> type;
+      CHECK(validName(family));
+      CHECK(type == "counter" || type == "gauge" || type == "histogram");
+      CHECK_EQ(e.types.count(family), 0u);
+      e.types[family] = type;
+      continue;
+    }
+    if (line[0] == '#') {
+      continue;
+    }
+    Series s;
+    CHECK(parseSeries(line, s));
+    CHECK(validName(s.name));
+    std::string family = s.name;
+    for (const char* suffix : {"_bucket", "_sum", "_count"}) {
+      size_t n = strlen(suffix);
+      if (!e.types.count(family) && family.size() > n && family.compare(family.size() - n, n, suffix) == 0) {
+        family.resize(family.size() - n);
+      }
+    }
+    CHECK_EQ(e.types.count(family), 1u);
+    std::string key = line.substr(0, line.rfind(' '));
+    CHECK_EQ(seen.count(key), 0u);
+    seen.insert(key);
+    e.series.push_back(s);
+  }
+  return e;
+}
+
+static void checkHistogram(const Exposition &e, const std::string &subsystem) {
+  double previous = 0;
+  double limit = 0;
+  bool inf = false;
+  for (const Series &s : e.series) {
+    if (s.name != "ikea_air_duration_seconds_bucket" || s.labels.at("subsystem") != subsystem) {
+      continue;
+    }
+    CHECK(!inf);
+    CHECK_GE(s.value, previous);
+    previous = s.value;
+    if (s.labels.at("le") == "+Inf") {
+      inf = true;
+    } else {
+      double le = strtod(s.labels.at("le").c_str(), nullptr);
+      CHECK_GT(le, limit);
+      limit = le;
+    }
+  }
+  CHECK(inf);
+  const Series* count = e.find("ikea_air_duration_seconds_count", subsystem);
+  const Series* sum = e.find("ikea_air_duration_seconds_sum", subsystem);
+  CHECK(count && sum);
+  CHECK_EQ(count->value, previous);
+  CHECK_GE(sum->value, 0.0);
+}
+
+static void bootAndRun(host::Board &board) {
+  board.boot();
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE; }, 60000));
+  board.run(DIAG_INTERVAL + 10000);
+}
+
+TEST(metrics_exposition) {
+  host::Board board;
+  bootAndRun(board);
+  host::HttpResponse r = board.get("/metrics");
+  CHECK_EQ(r.status, 200);
+  CHECK_EQ(r.headers["content-type"], std::string("text/plain; version=0.0.4"));
+  Exposition e = parseExposition(r.body);
+
+  CHECK_EQ(e.types["ikea_air_duration_seconds"], std::string("histogram"));
+  for (uint8_t i = 0; i < Scheduler::capacity(); i++) {
+    const SchedulerTask &t = scheduler.task(i);
+    if (t.active && !t.oneShot) {
+      checkHistogram(e, t.name);
+    }
+  }
+  checkHistogram(e, "read");
+  checkHistogram(e, "publish");
+  CHECK_GT(e.find("ikea_air_duration_seconds_count", "sample")->value, 0.0);
+
+  for (const auto &kv : e.types) {
+    if (kv.second == "counter") {
+      CHECK(kv.first.size() > 6 && kv.first.compare(kv.first.size() - 6, 6, "_total") == 0);
+    }
+  }
+  CHECK_EQ(e.find("ikea_air_mqtt_connects_total")->value, (double)metrics.mqttConnects);
+  CHECK_EQ(e.find("ikea_air_mqtt_publishes_total")->value, (double)metrics.mqttPublishes);
+  CHECK_EQ(e.find("ikea_air_pm_frames_total")->value, (double)pmParser.frameCount);
+  CHECK_LE(e.find("ikea_air_loop_max_pass_microseconds")->value, (double)scheduler.maxPassUs);
+  CHECK_EQ(e.find("ikea_air_heap_free_bytes")->value, (double)host::heap.free);
+  CHECK_GT(e.find("ikea_air_uptime_seconds")->value, DIAG_INTERVAL / 1000.0);
+  CHECK_GT(e.find("ikea_air_mqtt_publishes_total")->value, 0.0);
+}
+
+// Minimal JSON syntax check, the payload is hand-formatted
+static bool skipJsonValue(const char* &p);
+
+static void skipSpace(const char* &p) {
+  while (*p == ' ' || *p == '\n') {
+    p++;
+  }
+}
+
+static bool skipJsonString(const char* &p) {
+  if (*p++ != '"') {
+    return false;
+  }
+  while (*p && *p != '"') {
+    p += *p == '\\' ? 2 : 1;
+  }
+  return *p++ == '"';
+}
+
+static bool skipJsonValue(const char* &p) {
+  skipSpace(p);
+  if (*p == '{' || *p == '[') {
+    char close = *p == '{' ? '}' : ']';
+    bool object = *p++ == '{';
+    skipSpace(p);
+    if (*p == close) {
+      p++;
+      return true;
+    }
+    while (true) {
+      if (object) {
+        skipSpace(p);
+        if (!skipJsonString(p) || (skipSpace(p), *p++ != ':')) {
+          return false;
+        }
+      }
+      if (!skipJsonValue(p)) {
+        return false;
+      }
+      skipSpace(p);
+      if (*p == ',') {
+        p++;
+        continue;
+      }
+      return *p++ == close;
+    }
+  }
+  if (*p == '"') {
+    return skipJsonString(p);
+  }
+  char* end;
+  strtod(p, &end);
+  if (end == p) {
+    return false;
+  }
+  p = end;
+  return true;
+}
+
+static unsigned long jsonNumber(const std::string &json, const char* key) {
+  size_t pos = json.find(std::string("\"") + key + "\":");
+  CHECK(pos != std::string::npos);
+  return strtoul(json.c_str() + pos + strlen(key) + 3, nullptr, 10);
+}
+
+TEST(diag_payload) {
+  host::Board board;
+  bootAndRun(board);
+  auto it = board.broker.retained().find("tele/ikea-air-monitor/diag");
+  CHECK(it != board.broker.retained().end());
+  const std::string &json = it->second;
+  const char* p = json.c_str();
+  CHECK(skipJsonValue(p));
+  CHECK_EQ(*p, '\0');
+
+  // Every periodic task with [count, avg, max], avg never above max
+  for (uint8_t i = 0; i < Scheduler::capacity(); i++) {
+    const SchedulerTask &t = scheduler.task(i);
+    if (!t.active || t.oneShot) {
+      continue;
+    }
+    size_t pos = json.find(std::string("\"") + t.name + "\":[");
+    CHECK(pos != std::string::npos);
+    unsigned long count, avg, max;
+    CHECK_EQ(sscanf(json.c_str() + pos + strlen(t.name) + 4, "%lu,%lu,%lu]", &count, &avg, &max), 3);
+    // The diag task's own run is recorded after it published
+    if (strcmp(t.name, "diag") != 0) {
+      CHECK_GT(count, 0ul);
+    }
+    CHECK_LE(avg, max);
+  }
+  CHECK(json.find("\"read\":[") != std::string::npos);
+  CHECK(json.find("\"publish\":[") != std::string::npos);
+
+  // Taken at the last diag run, so some counters have moved on since
+  CHECK_EQ(jsonNumber(json, "connects"), (unsigned long)metrics.mqttConnects);
+  CHECK_EQ(jsonNumber(json, "connect_failures"), (unsigned long)metrics.mqttConnectFailures);
+  CHECK_LE(jsonNumber(json, "publishes"), (unsigned long)metrics.mqttPublishes);
+  CHECK_GT(jsonNumber(json, "publishes"), 0ul);
+  CHECK_EQ(jsonNumber(json, "heap_free"), (unsigned long)host::heap.free);
+  CHECK_EQ(jsonNumber(json, "uptime"), DIAG_INTERVAL / 1000);
+  CHECK_LE(jsonNumber(json, "loop_max_us"), (unsigned long)SCHEDULER_LOOP_BUDGET_US);
+  CHECK_GT(jsonNumber(json, "boot_wifi_ms"), 0ul);
+}
+
+TEST(diag_payload_fits_with_every_task_slot_used) {
+  // The payload buffer has to hold a latency entry for every task the
+  // scheduler can run, with the largest numbers each field can show
+  host::Board board;
+  board.boot();
+  while (scheduler.every("abcdefgh", [](uint32_t) {}, 1000) >= 0) {
+  }
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE; }, 60000));
+  for (uint8_t i = 0; i < Scheduler::capacity(); i++) {
+    LatencyHistogram &h = const_cast<LatencyHistogram &>(scheduler.task(i).latency);
+    h.count = UINT32_MAX;
+    h.sumCycles = UINT64_MAX / 2;
+    h.maxCycles = UINT32_MAX;
+  }
+  board.broker.clearLog();
+  publishDiagnostics();
+  CHECK_EQ(board.broker.count("tele/ikea-air-monitor/diag"), 1u);
+  const std::string &json = board.broker.log().back().payload;
+  printf("diag payload with %u tasks: %zu of %zu bytes\n", (unsigned)Scheduler::capacity(), json.size(),
+         MQTT_BATCH_PAYLOAD_SIZE);
+  const char* p = json.c_str();
+  CHECK(skipJsonValue(p));
+}
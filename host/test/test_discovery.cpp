@@ -0,0 +1,72 @@
+#include "Board.h"
+
+// Home Assistant discovery against the broker's retained configs: the first
+// connection publishes every sensor, a reconnect to a broker that kept them
+// publishes nothing, and only a config that differs is sent again
+
+static const char* CONFIGS = "homeassistant/sensor/+/+/config";
+
+static void online(host::Board &board) {
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE; }, 60000));
+}
+
+static void reconnect(host::Board &board) {
+  board.broker.clearLog();
+  board.broker.restart();
+  CHECK(board.runUntil([] { return mqttState != MQTT_STATE_ONLINE; }, 10000));
+  online(board);
+}
+
+TEST(first_connect_publishes_every_sensor) {
+  host::Board board;
+  board.boot();
+  online(board);
+  CHECK_EQ(board.broker.count(CONFIGS), (size_t)DISCOVERY_SENSOR_COUNT);
+  size_t retained = 0;
+  for (const auto &kv : board.broker.retained()) {
+    retained += host::MqttBroker::matches(CONFIGS, kv.first);
+  }
+  CHECK_EQ(retained, (size_t)DISCOVERY_SENSOR_COUNT);
+}
+
+TEST(unchanged_configs_are_not_republished) {
+  host::Board board;
+  board.boot();
+  online(board);
+  for (int i = 0; i < 3; i++) {
+    uint64_t bytes = board.broker.bytesIn;
+    reconnect(board);
+    CHECK_EQ(board.broker.count(CONFIGS), 0u);
+    CHECK_EQ(discoveryMatched, (1u << DISCOVERY_SENSOR_COUNT) - 1);
+    printf("  reconnect %d: %llu bytes to the broker\n", i, (unsigned long long)(board.broker.bytesIn - bytes));
+  }
+  // Samples keep flowing after the check window
+  size_t states = board.broker.count("tele/ikea-air-monitor/state");
+  board.run(30000);
+  CHECK_GT(board.broker.count("tele/ikea-air-monitor/state"), states);
+}
+
+TEST(changed_or_missing_configs_are_republished) {
+  host::Board board;
+  board.boot();
+  online(board);
+  std::vector<std::string> topics;
+  for (const auto &kv : board.broker.retained()) {
+    if (host::MqttBroker::matches(CONFIGS, kv.first)) {
+      topics.push_back(kv.first);
+    }
+  }
+  CHECK_GE(topics.size(), 2u);
+  const std::string changed = topics[0], removed = topics[1];
+  uint32_t other = board.broker.connect("other", nullptr, nullptr, false);
+  board.broker.publish(other, changed, "{\"name\":\"stale\"}", true);
+  board.broker.publish(other, removed, "", true);
+  board.broker.disconnect(other, true);
+
+  reconnect(board);
+  CHECK_EQ(board.broker.count(CONFIGS), 2u);
+  CHECK_EQ(board.broker.count(changed), 1u);
+  CHECK_EQ(board.broker.count(removed), 1u);
+  CHECK(board.broker.retained().at(changed).find("stale") == std::string::npos);
+  CHECK(board.broker.retained().count(removed));
+}
@@ -0,0 +1,160 @@
+#include "Board.h"
+#include "Bench.h"
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Server-sent events on /events with SSE_MAX_CLIENTS subscribers: every
+// client gets each sample in the pass that committed it, the fan-out costs
+// no allocation and a fixed amount of RAM per client, and a client that
+// stops reading neither holds up the others nor the rest of the web server
+
+static uint32_t newCalls = 0;
+
+void* operator new(size_t size) {
+  newCalls++;
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+struct Subscriber {
+  int fd = -1;
+  std::string received;
+
+  // The id of the last complete event received so far, 0 for none
+  uint32_t lastId() {
+    received += host::readSocket(fd);
+    size_t end = received.rfind("\n\n");
+    if (end == std::string::npos) {
+      return 0;
+    }
+    size_t id = received.rfind("id: ", end);
+    return id == std::string::npos ? 0 : strtoul(received.c_str() + id + 4, nullptr, 10);
+  }
+};
+
+static void ready(host::Board &board) {
+  board.boot();
+  CHECK(board.runUntil([] { return networkServicesStarted && !sampleStore.empty(); }, 60000));
+}
+
+static void subscribe(host::Board &board, Subscriber* subs, int n) {
+  for (int i = 0; i < n; i++) {
+    subs[i].fd = board.open("/events");
+    CHECK_GE(subs[i].fd, 0);
+  }
+  CHECK(board.runUntil([&] { return eventStream.clientCount() == n; }, 1000));
+}
+
+// A new sample committed and published the way the sample task does it
+static void commitSample(uint16_t pm25) {
+  Sample &s = sampleStore.beginWrite();
+  s.valid = SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+  s.pm25 = pm25;
+  sampleStore.commit();
+  eventStream.publish(sampleStore.latest());
+}
+
+TEST(fan_out_to_every_client) {
+  host::Board board;
+  ready(board);
+  Subscriber subs[SSE_MAX_CLIENTS];
+  subscribe(board, subs, SSE_MAX_CLIENTS);
+  for (auto &sub : subs) {
+    CHECK_EQ(sub.lastId(), sampleStore.latest().seq);
+    CHECK(sub.received.find("Content-Type: text/event-stream") != std::string::npos);
+  }
+  // One more is turned away
+  int extra = board.open("/events");
+  board.run(20);
+  CHECK(host::readSocket(extra).find("503") != std::string::npos);
+  close(extra);
+
+  // Each sample reaches every client within the pass that committed it
+  for (int round = 0; round < 20; round++) {
+    uint32_t seq = sampleStore.latest().seq;
+    CHECK(board.runUntil([&] { return sampleStore.latest().seq != seq; }, 30000));
+    seq = sampleStore.latest().seq;
+    usleep(200);  // loopback delivery
+    for (auto &sub : subs) {
+      CHECK_EQ(sub.lastId(), seq);
+    }
+  }
+  CHECK_EQ(eventStream.eventsDropped, 0u);
+}
+
+TEST(fan_out_cost) {
+  host::Board board;
+  ready(board);
+  Subscriber subs[SSE_MAX_CLIENTS];
+  subscribe(board, subs, SSE_MAX_CLIENTS);
+
+  uint32_t allocs = 0;
+  uint32_t rounds = 200;
+  double ns = 0;
+  for (uint32_t i = 0; i < rounds; i++) {
+    uint32_t before = newCalls;
+    auto start = std::chrono::steady_clock::now();
+    commitSample((uint16_t)i);
+    ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    allocs += newCalls - before;
+    for (auto &sub : subs) {
+      CHECK_EQ(sub.lastId(), sampleStore.latest().seq);
+    }
+  }
+  printf("  publish to %d clients: %.0f ns, %zu bytes RAM per client, %zu in total\n", SSE_MAX_CLIENTS, ns / rounds,
+         EventStream::memoryPerClient(), EventStream::memoryUsage());
+  CHECK_EQ(allocs, 0u);
+  CHECK_LE(EventStream::memoryPerClient(), 64u);
+  CHECK_LE(EventStream::memoryUsage(), SSE_EVENT_SIZE + SSE_MAX_CLIENTS * EventStream::memoryPerClient() + 32);
+}
+
+TEST(stalled_client_does_not_block_others) {
+  host::Board board;
+  ready(board);
+  Subscriber subs[SSE_MAX_CLIENTS];
+  subscribe(board, subs, SSE_MAX_CLIENTS);
+  // The first client never reads again; once its socket buffers are full
+  // the events it cannot take are skipped
+  int rcvbuf = 1024;
+  setsockopt(subs[0].fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  for (int i = 0; i < 2000; i++) {
+    commitSample((uint16_t)(i & 0xFF));
+    board.pass();
+    for (int c = 1; c < SSE_MAX_CLIENTS; c++) {
+      CHECK_EQ(subs[c].lastId(), sampleStore.latest().seq);
+    }
+  }
+  uint32_t stalledAt = subs[0].lastId();
+  CHECK_LT(stalledAt, sampleStore.latest().seq - 1000);
+  CHECK_EQ(eventStream.clientCount(), SSE_MAX_CLIENTS);
+
+  // Plain requests are served as quickly as without subscribers
+  for (int i = 0; i < 10; i++) {
+    uint64_t start = host::nowMicros();
+    host::HttpResponse r = board.get("/api/state");
+    CHECK_EQ(r.status, 200);
+    CHECK_LE(host::nowMicros() - start, 20000u);
+  }
+  host::HttpResponse r = board.get("/");
+  CHECK_EQ(r.status, 200);
+
+  // Once it reads again it gets the latest sample, the skipped ones are
+  // counted
+  // The kernel reopens the zero window on its own timers, in real time
+  for (int i = 0; i < 5000 && subs[0].lastId() != sampleStore.latest().seq; i++) {
+    board.pass();
+    usleep(1000);
+  }
+  CHECK_EQ(subs[0].lastId(), sampleStore.latest().seq);
+  CHECK_GT(eventStream.eventsDropped, 1000u);
+
+  // Closing a client frees its slot
+  close(subs[0].fd);
+  CHECK(board.runUntil([] { return eventStream.clientCount() == SSE_MAX_CLIENTS - 1; }, 30000));
+}
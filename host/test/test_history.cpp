@@ -0,0 +1,193 @@
+#include "Board.h"
+#include <random>
+
+// The two-tier RAM history: exact round trip of the fine tier, 5 minute
+// averages in the coarse tier, and at least 24 h of coverage at a 10 s
+// sample interval for both typical and worst-case data
+
+constexpr uint32_t INTERVAL_MS = 10000;
+constexpr uint32_t DAY_MS = 24 * 3600 * 1000UL;
+
+static Sample makeSample(uint16_t pm25, float t, float h, float p, uint8_t valid = SAMPLE_PM_VALID | SAMPLE_ENV_VALID) {
+  Sample s = {};
+  s.valid = valid;
+  s.pm25 = pm25;
+  s.temperature = t;
+  s.humidity = h;
+  s.pressure = p;
+  return s;
+}
+
+// Indoor air: slow random walks with the occasional PM2.5 spike
+struct Room {
+  std::mt19937 rng{42};
+  double pm = 8, t = 21.0, h = 45.0, p = 1013.0;
+
+  Sample next() {
+    std::normal_distribution<double> step(0, 1);
+    pm = std::max(0.0, pm + step(rng) * 0.8 + (rng() % 500 == 0 ? 40 : 0) - (pm > 10 ? 0.05 * (pm - 10) : 0));
+    t = std::min(30.0, std::max(15.0, t + step(rng) * 0.05));
+    h = std::min(90.0, std::max(20.0, h + step(rng) * 0.2));
+    p = std::min(1040.0, std::max(980.0, p + step(rng) * 0.03));
+    return makeSample((uint16_t)lround(pm), t, h, p);
+  }
+};
+
+struct Span {
+  uint32_t first = UINT32_MAX, last = 0, count = 0;
+};
+
+static Span span(const SampleHistory &history) {
+  Span s;
+  uint32_t prev = 0;
+  history.forEach([&](const HistoryEntry &e) {
+    CHECK(s.count == 0 || e.timeMs > prev);  // strictly oldest first
+    prev = e.timeMs;
+    s.first = std::min(s.first, e.timeMs);
+    s.last = e.timeMs;
+    s.count++;
+  });
+  return s;
+}
+
+static SampleHistory history24;
+
+TEST(memory_is_a_few_kb) {
+  printf("  history RAM: %zu bytes\n", SampleHistory::memoryUsage());
+  CHECK_LE(SampleHistory::memoryUsage(), 8192u);
+}
+
+TEST(fine_tier_round_trip_is_exact) {
+  Room room;
+  std::vector<Sample> in;
+  uint32_t now = 0;
+  for (int i = 0; i < 500; i++) {
+    in.push_back(room.next());
+    history24.append(in.back(), now);
+    now += INTERVAL_MS;
+  }
+  size_t i = 0;
+  history24.forEach([&](const HistoryEntry &e) {
+    const Sample &s = in[i];
+    CHECK_EQ(e.timeMs, i * INTERVAL_MS);
+    CHECK_EQ(e.valid, SAMPLE_PM_VALID | SAMPLE_ENV_VALID);
+    CHECK_EQ(e.v[0], s.pm25);
+    CHECK_EQ(e.v[1], lroundf(s.temperature * 10));
+    CHECK_EQ(e.v[2], lroundf(s.humidity * 10));
+    CHECK_EQ(e.v[3], lroundf(s.pressure * 10));
+    i++;
+  });
+  CHECK_EQ(i, in.size());
+}
+
+TEST(coarse_tier_holds_window_averages) {
+  // Values step once per 5 minute window, with a wobble that averages out
+  uint32_t now = 0;
+  for (uint32_t w = 0; w < 24 * 12 + 1; w++) {
+    for (uint32_t i = 0; i < HISTORY_COARSE_INTERVAL / INTERVAL_MS; i++) {
+      int wobble = i & 1 ? 1 : -1;
+      history24.append(makeSample(10 + w % 50 + wobble, 20.0f + (w % 7) * 0.5f + wobble * 0.1f, 50.0f, 1000.0f), now);
+      now += INTERVAL_MS;
+    }
+  }
+  // Coarse entries come first, 5 minutes apart
+  uint32_t coarse = 0;
+  bool fine = false;
+  history24.forEach([&](const HistoryEntry &e) {
+    fine = fine || (coarse > 0 && e.timeMs - (coarse - 1) * HISTORY_COARSE_INTERVAL < HISTORY_COARSE_INTERVAL);
+    if (fine) {
+      return;
+    }
+    CHECK_EQ(e.timeMs, coarse * HISTORY_COARSE_INTERVAL);
+    uint32_t w = e.timeMs / HISTORY_COARSE_INTERVAL;
+    CHECK_EQ(e.v[0], (int)(10 + w % 50));
+    CHECK_EQ(e.v[1], (int)(200 + (w % 7) * 5));
+    CHECK_EQ(e.v[2], 500);
+    CHECK_EQ(e.v[3], 10000);
+    coarse++;
+  });
+  CHECK_LE(coarse, history24.coarseCount());
+  CHECK_GT(coarse, 200u);
+}
+
+TEST(typical_day_is_covered) {
+  Room room;
+  uint32_t now = 0;
+  for (uint32_t i = 0; i < DAY_MS / INTERVAL_MS + 1; i++) {
+    history24.append(room.next(), now);
+    now += INTERVAL_MS;
+  }
+  Span s = span(history24);
+  printf("  typical day: %u entries (%u of them 5 minute averages) over %.1f h\n", s.count,
+         history24.coarseCount(), (s.last - s.first) / 3600000.0);
+  CHECK_EQ(s.last, DAY_MS);
+  CHECK_LE(s.first, 0u + HISTORY_COARSE_INTERVAL);
+  CHECK_GE(s.last - s.first, DAY_MS - HISTORY_COARSE_INTERVAL);
+}
+
+TEST(worst_case_two_days_keep_24h) {
+  // Every field jumps by more than an 8-bit delta on every sample, so each
+  // record has the maximum size, and the coarse averages jump as well
+  uint32_t now = 0;
+  for (uint32_t i = 0; i < 2 * DAY_MS / INTERVAL_MS; i++) {
+    bool hi = (i / 30) & 1 ? i & 1 : !(i & 1);
+    history24.append(makeSample(hi ? 900 : 5, hi ? 60.0f : -20.0f, hi ? 99.0f : 1.0f, hi ? 1100.0f : 300.0f), now);
+    now += INTERVAL_MS;
+  }
+  Span s = span(history24);
+  uint32_t newest = now - INTERVAL_MS;
+  printf("  worst case: %u entries over %.1f h\n", s.count, (s.last - s.first) / 3600000.0);
+  CHECK_EQ(s.last, newest);
+  CHECK_GE(s.last - s.first, DAY_MS);
+}
+
+TEST(invalid_fields_stay_invalid) {
+  uint32_t now = 0;
+  for (uint32_t i = 0; i < 3 * 3600 * 1000 / INTERVAL_MS; i++) {
+    // The BME280 is gone for the first hour
+    uint8_t valid = now < 3600 * 1000UL ? SAMPLE_PM_VALID : SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+    history24.append(makeSample(20, 22.0f, 40.0f, 1010.0f, valid), now);
+    now += INTERVAL_MS;
+  }
+  history24.forEach([&](const HistoryEntry &e) {
+    CHECK(e.valid & SAMPLE_PM_VALID);
+    CHECK_EQ(e.v[0], 20);
+    if (e.timeMs < 3600 * 1000UL) {
+      CHECK(!(e.valid & SAMPLE_ENV_VALID));
+    } else {
+      CHECK(e.valid & SAMPLE_ENV_VALID);
+      CHECK_EQ(e.v[1], 220);
+    }
+  });
+}
+
+TEST(web_history_merges_both_tiers) {
+  host::Board board;
+  board.boot();
+  CHECK(board.runUntil([] { return server.localPort() != 0; }, 30000));
+  Room room;
+  uint32_t now = 0;
+  for (uint32_t i = 0; i < DAY_MS / INTERVAL_MS + 1; i++) {
+    history.append(room.next(), now);
+    now += INTERVAL_MS;
+  }
+  uint32_t expected = 0;
+  history.forEach([&](const HistoryEntry &) { expected++; });
+
+  host::HttpResponse r = board.get("/history.csv");
+  CHECK_EQ(r.status, 200);
+  uint32_t lines = 0;
+  long prev = -1;
+  size_t pos = r.body.find('\n') + 1;  // header
+  while (pos < r.body.size()) {
+    long uptime = strtol(r.body.c_str() + pos, nullptr, 10);
+    CHECK_GT(uptime, prev);
+    prev = uptime;
+    lines++;
+    pos = r.body.find('\n', pos) + 1;
+  }
+  CHECK_EQ(lines, expected);
+  CHECK_LE(prev - strtol(r.body.c_str() + r.body.find('\n') + 1, nullptr, 10), (long)(DAY_MS / 1000));
+  CHECK_GE(prev - strtol(r.body.c_str() + r.body.find('\n') + 1, nullptr, 10),
+           (long)((DAY_MS - HISTORY_COARSE_INTERVAL) / 1000));
+}
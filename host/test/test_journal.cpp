@@ -0,0 +1,268 @@
+#include "Board.h"
+#include <vector>
+
+// Store-and-forward journal: a broker outage end to end (every sample taken
+// while offline is replayed once, oldest first), the flash bytes and write
+// calls it costs, rotation past JOURNAL_MAX_SEGMENTS, corrupted records, a
+// flash that fails to open or cuts a write short, and restarts with records
+// still buffered in RAM
+
+static Sample makeSample(uint32_t uptime, uint16_t pm25) {
+  Sample s = {};
+  s.valid = SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+  s.uptime = uptime;
+  s.pm25 = pm25;
+  s.temperature = 21.5f;
+  s.humidity = 45.0f;
+  s.pressure = 1013.25f;
+  return s;
+}
+
+// The "uptime" of every entry in the backlog messages, in order
+static std::vector<uint32_t> backlogUptimes(const host::MqttBroker &broker) {
+  std::vector<uint32_t> out;
+  for (const auto &m : broker.log()) {
+    if (m.topic != "tele/ikea-air-monitor/backlog") {
+      continue;
+    }
+    for (size_t at = m.payload.find("\"uptime\":"); at != std::string::npos;
+         at = m.payload.find("\"uptime\":", at + 1)) {
+      out.push_back(strtoul(m.payload.c_str() + at + 9, nullptr, 10));
+    }
+  }
+  return out;
+}
+
+TEST(outage_is_replayed_in_order) {
+  host::Board board;
+  board.boot();
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE; }, 30000));
+  board.run(20000);
+
+  // 30 minutes without a broker: one sample every 10 s goes to the journal
+  board.broker.setUp(false);
+  uint64_t flashBytes = LittleFS.bytesWritten;
+  uint32_t flashWrites = LittleFS.writeCalls;
+  board.run(30 * 60 * 1000);
+  uint32_t journaled = journal.pending();
+  printf("  outage: %u samples journaled, %llu flash bytes in %u writes\n", journaled,
+         (unsigned long long)(LittleFS.bytesWritten - flashBytes), LittleFS.writeCalls - flashWrites);
+  CHECK_GE(journaled, 175u);
+  CHECK_LE(journaled, 181u);
+  // 24 bytes a record and one write per JOURNAL_FLUSH_RECORDS records;
+  // anything else written meanwhile (config, WiFi lease) is far smaller
+  CHECK_LE(LittleFS.bytesWritten - flashBytes, journaled * sizeof(JournalRecord) + 256);
+  CHECK_LE(LittleFS.writeCalls - flashWrites, journaled / JOURNAL_FLUSH_RECORDS + 4);
+
+  board.broker.clearLog();
+  board.broker.setUp(true);
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE && journal.empty(); }, 120000));
+  std::vector<uint32_t> uptimes = backlogUptimes(board.broker);
+  // Samples keep going to the journal until the reconnect backoff expires
+  CHECK_GE(journal.recordsWritten, journaled);
+  CHECK_EQ(uptimes.size(), (size_t)journal.recordsWritten);
+  for (size_t i = 1; i < uptimes.size(); i++) {
+    CHECK_GT(uptimes[i], uptimes[i - 1]);
+  }
+  CHECK_EQ(journal.recordsReplayed, journal.recordsWritten);
+  CHECK_EQ(journal.recordsDropped, 0u);
+  CHECK_EQ(journal.crcErrors, 0u);
+  // Replay is rate-limited to JOURNAL_BATCH_RECORDS per JOURNAL_BATCH_INTERVAL
+  CHECK_GE(board.broker.count("tele/ikea-air-monitor/backlog"), journal.recordsWritten / JOURNAL_BATCH_RECORDS);
+}
+
+TEST(pending_records_survive_a_reboot) {
+  std::string state = host::runBoot("", [] {
+    CHECK(journal.begin());
+    for (uint32_t i = 0; i < 40; i++) {
+      CHECK(journal.append(makeSample(i * 10, (uint16_t)i)));
+    }
+    CHECK(journal.flush());
+  });
+  host::runBoot(state, [] {
+    CHECK(journal.begin());
+    CHECK_EQ(journal.pending(), 40u);
+    JournalRecord r[JOURNAL_MAX_PEEK];
+    uint32_t next = 0;
+    while (size_t n = journal.peek(r, JOURNAL_MAX_PEEK)) {
+      for (size_t i = 0; i < n; i++) {
+        CHECK_EQ(r[i].uptime, next * 10);
+        CHECK_EQ(r[i].pm25, next);
+        next++;
+      }
+      journal.consume(n);
+    }
+    CHECK_EQ(next, 40u);
+    CHECK(journal.empty());
+  });
+}
+
+TEST(replayed_records_are_not_sent_again_after_a_reboot) {
+  std::string state = host::runBoot("", [] {
+    CHECK(journal.begin());
+    for (uint32_t i = 0; i < 40; i++) {
+      CHECK(journal.append(makeSample(i * 10, (uint16_t)i)));
+    }
+    JournalRecord r[JOURNAL_MAX_PEEK];
+    while (size_t n = journal.peek(r, JOURNAL_MAX_PEEK)) {
+      journal.consume(n);
+    }
+    CHECK(journal.empty());
+  });
+  state = host::runBoot(state, [] {
+    CHECK(journal.begin());
+    CHECK_EQ(journal.pending(), 0u);
+    // Appending after the reboot starts a fresh segment
+    CHECK(journal.append(makeSample(1000, 1)));
+    CHECK(journal.flush());
+  });
+  host::runBoot(state, [] {
+    CHECK(journal.begin());
+    CHECK_EQ(journal.pending(), 1u);
+    JournalRecord r[JOURNAL_MAX_PEEK];
+    CHECK_EQ(journal.peek(r, JOURNAL_MAX_PEEK), 1u);
+    CHECK_EQ(r[0].uptime, 1000u);
+  });
+}
+
+TEST(oldest_segment_is_dropped_when_full) {
+  CHECK(journal.begin());
+  uint32_t total = (JOURNAL_MAX_SEGMENTS + 2) * JOURNAL_SEGMENT_RECORDS;
+  for (uint32_t i = 0; i < total; i++) {
+    CHECK(journal.append(makeSample(i, (uint16_t)(i & 0xFFFF))));
+  }
+  CHECK(journal.flush());
+  CHECK_GT(journal.recordsDropped, 0u);
+  CHECK_EQ(journal.pending() + journal.recordsDropped, total);
+  CHECK_LE(journal.pending(), JOURNAL_MAX_SEGMENTS * JOURNAL_SEGMENT_RECORDS);
+  // What is left is the newest records, oldest first
+  JournalRecord r[JOURNAL_MAX_PEEK];
+  size_t n = journal.peek(r, JOURNAL_MAX_PEEK);
+  CHECK_EQ(n, JOURNAL_MAX_PEEK);
+  CHECK_EQ(r[0].uptime, journal.recordsDropped);
+}
+
+TEST(corrupted_record_is_skipped) {
+  CHECK(journal.begin());
+  for (uint32_t i = 0; i < 12; i++) {
+    CHECK(journal.append(makeSample(i, (uint16_t)i)));
+  }
+  CHECK(journal.flush());
+  Dir dir = LittleFS.openDir("/journal");
+  CHECK(dir.next());
+  std::string path = std::string("/journal/") + dir.fileName().c_str();
+  File f = LittleFS.open(path.c_str(), "r+");
+  CHECK(f);
+  CHECK(f.seek(5 * sizeof(JournalRecord) + 4));
+  f.write((uint8_t)0xEE);
+  f.close();
+
+  std::vector<uint32_t> seen;
+  JournalRecord r[JOURNAL_MAX_PEEK];
+  while (size_t n = journal.peek(r, JOURNAL_MAX_PEEK)) {
+    for (size_t i = 0; i < n; i++) {
+      seen.push_back(r[i].uptime);
+    }
+    journal.consume(n);
+  }
+  CHECK_EQ(journal.crcErrors, 1u);
+  CHECK_EQ(seen.size(), 11u);
+  CHECK(std::find(seen.begin(), seen.end(), 5u) == seen.end());
+  CHECK(journal.empty());
+}
+
+TEST(records_stay_bounded_while_the_flash_cannot_be_opened) {
+  CHECK(journal.begin());
+  LittleFS.failOpens = 1000;
+  for (uint32_t i = 0; i < 20; i++) {
+    journal.append(makeSample(i, (uint16_t)i));
+  }
+  JournalRecord r[JOURNAL_MAX_PEEK];
+  CHECK_EQ(journal.peek(r, JOURNAL_MAX_PEEK), 0u);
+  journal.append(makeSample(20, 20));
+  // Only the newest JOURNAL_FLUSH_RECORDS are kept in RAM, the rest counted
+  CHECK_EQ(journal.pending(), (uint32_t)JOURNAL_FLUSH_RECORDS);
+  CHECK_EQ(journal.recordsDropped, 21u - JOURNAL_FLUSH_RECORDS);
+
+  LittleFS.failOpens = 0;
+  size_t n = journal.peek(r, JOURNAL_MAX_PEEK);
+  CHECK_EQ(n, (size_t)JOURNAL_FLUSH_RECORDS);
+  for (size_t i = 0; i < n; i++) {
+    CHECK_EQ(r[i].uptime, 21u - JOURNAL_FLUSH_RECORDS + i);
+  }
+  journal.consume(n);
+  CHECK(journal.empty());
+}
+
+TEST(short_write_keeps_the_whole_records) {
+  CHECK(journal.begin());
+  uint32_t uptime = 0;
+  for (size_t i = 0; i < JOURNAL_FLUSH_RECORDS; i++) {
+    CHECK(journal.append(makeSample(uptime++, 1)));
+  }
+  // The next flush stops 6 bytes into its second record
+  LittleFS.writeBudget = sizeof(JournalRecord) + 6;
+  for (size_t i = 0; i < JOURNAL_FLUSH_RECORDS; i++) {
+    journal.append(makeSample(uptime++, 2));
+  }
+  CHECK_EQ(journal.recordsDropped, (uint32_t)JOURNAL_FLUSH_RECORDS - 1);
+  CHECK_EQ(journal.pending(), (uint32_t)JOURNAL_FLUSH_RECORDS + 1);
+  LittleFS.powerOn();
+  for (size_t i = 0; i < JOURNAL_FLUSH_RECORDS; i++) {
+    CHECK(journal.append(makeSample(uptime++, 3)));
+  }
+
+  // Everything written in whole is read back, nothing fails its CRC. Like
+  // drainJournal(), keep asking: the peek that reaches the partial record
+  // closes its segment and returns nothing.
+  std::vector<uint32_t> seen;
+  JournalRecord r[JOURNAL_MAX_PEEK];
+  for (int batch = 0; batch < 10 && !journal.empty(); batch++) {
+    size_t n = journal.peek(r, JOURNAL_MAX_PEEK);
+    for (size_t i = 0; i < n; i++) {
+      seen.push_back(r[i].uptime);
+    }
+    journal.consume(n);
+  }
+  CHECK_EQ(journal.crcErrors, 0u);
+  CHECK_EQ(seen.size(), 2u * JOURNAL_FLUSH_RECORDS + 1);
+  CHECK_EQ(seen[JOURNAL_FLUSH_RECORDS], (uint32_t)JOURNAL_FLUSH_RECORDS);
+  CHECK_EQ(seen[JOURNAL_FLUSH_RECORDS + 1], 2u * JOURNAL_FLUSH_RECORDS);
+  CHECK(journal.empty());
+}
+
+// Records in the journal segments on flash
+static uint32_t journalRecordsOnFlash() {
+  uint32_t records = 0;
+  Dir dir = LittleFS.openDir("/journal");
+  while (dir.next()) {
+    records += dir.fileSize() / sizeof(JournalRecord);
+  }
+  return records;
+}
+
+// Offline long enough that the journal holds records that are not yet
+// flushed
+static void journalWhileOffline(host::Board &board) {
+  board.boot();
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE; }, 30000));
+  board.broker.setUp(false);
+  CHECK(board.runUntil([] {
+    return journal.pending() > JOURNAL_FLUSH_RECORDS && journalRecordsOnFlash() < journal.pending();
+  }, 600000));
+}
+
+TEST(buffered_records_are_flushed_before_a_restart) {
+  host::Board board;
+  journalWhileOffline(board);
+  CHECK_EQ(board.http("POST", "/save", "sendInterval=10").status, 200);
+  CHECK(board.runUntil([] { return host::restarts == 1; }, RESTART_DELAY + 1000));
+  CHECK_EQ(journalRecordsOnFlash(), journal.pending());
+}
+
+TEST(buffered_records_are_flushed_when_an_update_starts) {
+  host::Board board;
+  journalWhileOffline(board);
+  ArduinoOTA.start();
+  CHECK_EQ(journalRecordsOnFlash(), journal.pending());
+}
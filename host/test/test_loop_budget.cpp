@@ -0,0 +1,188 @@
+#include "Board.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// No loop() pass takes longer than SCHEDULER_LOOP_BUDGET_US, measured by
+// the scheduler itself in virtual time plus the host time spent in the
+// pass, through boot, steady state and the network failures that used to
+// wait inside a task: an unknown broker name, a broker address nobody
+// answers, a broker slow to send CONNACK, an uplink server that does not
+// answer and a configuration save.
+
+static void resetBudget() {
+  scheduler.maxPassUs = 0;
+  scheduler.budgetOverruns = 0;
+}
+
+static void checkBudget() {
+  CHECK_LE(scheduler.maxPassUs, (uint32_t)SCHEDULER_LOOP_BUDGET_US);
+  CHECK_EQ(scheduler.budgetOverruns, 0u);
+}
+
+static void bootOnline(host::Board &board) {
+  board.boot();
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE && !sampleStore.empty(); }, 60000));
+}
+
+// HTTP listener on 127.0.0.1, returns its port
+static int listenLocal(uint16_t &port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  listen(fd, 8);
+  socklen_t len = sizeof(addr);
+  getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+  port = ntohs(addr.sin_port);
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+TEST(boot_and_steady_state) {
+  host::Board board;
+  resetBudget();
+  bootOnline(board);
+  board.run(120000);
+  for (int i = 0; i < 20; i++) {
+    CHECK_EQ(board.get("/api/state").status, 200);
+    board.run(500);
+  }
+  checkBudget();
+  CHECK_GT(scheduler.passes, 100000u);
+}
+
+TEST(broker_restart) {
+  host::Board board;
+  bootOnline(board);
+  uint32_t connects = metrics.mqttConnects;
+  resetBudget();
+  board.broker.restart();
+  CHECK(board.runUntil([&] { return metrics.mqttConnects > connects && mqttState == MQTT_STATE_ONLINE; }, 180000));
+  checkBudget();
+}
+
+TEST(unknown_broker_name) {
+  // Used to wait MQTT_TCP_TIMEOUT in WiFi.hostByName() on every attempt
+  host::Board board;
+  bootOnline(board);
+  strcpy(config.mqttHost, "nowhere.test");
+  uint32_t failures = metrics.mqttConnectFailures;
+  resetBudget();
+  board.broker.restart();
+  board.run(180000);
+  checkBudget();
+  CHECK_GT(metrics.mqttConnectFailures, failures + 2);
+  CHECK(mqttState != MQTT_STATE_ONLINE);
+}
+
+TEST(uplink_to_dead_address) {
+  // Used to wait the full UPLINK_HTTP_TIMEOUT in the sample task
+  host::Board board;
+  bootOnline(board);
+  strcpy(config.uplinkUrl, "http://10.9.9.9/sensor");
+  resetBudget();
+  board.run(60000);
+  checkBudget();
+  CHECK_GE(metrics.uplinkFailures, 5u);
+  CHECK_EQ(metrics.uplinkPosts, 0u);
+}
+
+TEST(uplink_to_silent_server) {
+  // Accepts the connection (the kernel completes the handshake) but never
+  // answers, so every request runs into UPLINK_HTTP_TIMEOUT
+  host::Board board;
+  uint16_t port;
+  int fd = listenLocal(port);
+  bootOnline(board);
+  snprintf(config.uplinkUrl, sizeof(config.uplinkUrl), "http://127.0.0.1:%u/sensor", port);
+  resetBudget();
+  board.run(60000);
+  checkBudget();
+  CHECK_GE(metrics.uplinkFailures, 5u);
+  close(fd);
+}
+
+TEST(uplink_posts_frames) {
+  host::Board board;
+  uint16_t port;
+  int fd = listenLocal(port);
+  bootOnline(board);
+  snprintf(config.uplinkUrl, sizeof(config.uplinkUrl), "http://localhost:%u/sensor", port);
+  resetBudget();
+  // Answered between passes, once the whole request is in
+  std::string request;
+  int conn = -1;
+  CHECK(board.runUntil([&] {
+    if (conn < 0) {
+      conn = accept(fd, nullptr, nullptr);
+      return false;
+    }
+    request += host::readSocket(conn);
+    size_t head = request.find("\r\n\r\n");
+    if (head == std::string::npos || request.size() < head + 4 + UPLINK_FRAME_SIZE) {
+      return false;
+    }
+    const char* ok = "HTTP/1.1 204 No Content\r\n\r\n";
+    send(conn, ok, strlen(ok), MSG_NOSIGNAL);
+    close(conn);
+    return true;
+  }, 30000));
+  CHECK(board.runUntil([] { return metrics.uplinkPosts > 0; }, 5000));
+  checkBudget();
+  CHECK_EQ(metrics.uplinkFailures, 0u);
+  CHECK_EQ(request.compare(0, 21, "POST /sensor HTTP/1.1"), 0);
+  size_t body = request.find("\r\n\r\n") + 4;
+  UplinkFrame f;
+  CHECK(decodeUplink(reinterpret_cast<const uint8_t*>(request.data() + body), request.size() - body, f));
+  CHECK_EQ(f.seq, sampleStore.latest().seq);
+  close(fd);
+}
+
+TEST(config_save) {
+  // handleSave() no longer joins the network inside the request
+  host::Board board;
+  bootOnline(board);
+  uint32_t begins = host::wifi.begins;
+  resetBudget();
+  host::HttpResponse r = board.http("POST", "/save", "ssid=testnet&password=testpass&mqttHost=broker.test");
+  CHECK_EQ(r.status, 200);
+  CHECK(r.body.find("Neustart") != std::string::npos);
+  CHECK_EQ(host::wifi.begins, begins);
+  checkBudget();
+}
+
+TEST(unreachable_broker_address) {
+  // Used to wait MQTT_TCP_TIMEOUT in WiFiClient::connect()
+  host::Board board;
+  bootOnline(board);
+  strcpy(config.mqttHost, "192.168.1.99");
+  uint32_t failures = metrics.mqttConnectFailures;
+  resetBudget();
+  board.broker.restart();
+  board.run(60000);
+  checkBudget();
+  CHECK_GT(metrics.mqttConnectFailures, failures + 2);
+}
+
+TEST(slow_connack) {
+  // Used to spin in PubSubClient::connect() until the socket timeout
+  host::Board board;
+  bootOnline(board);
+  uint32_t failures = metrics.mqttConnectFailures;
+  board.broker.connackUs = MQTT_CONNACK_TIMEOUT * 1000u + 500000;
+  resetBudget();
+  board.broker.restart();
+  board.run(60000);
+  checkBudget();
+  CHECK_GT(metrics.mqttConnectFailures, failures + 2);
+  CHECK(mqttState != MQTT_STATE_ONLINE);
+
+  // Late but within the timeout is fine
+  board.broker.connackUs = MQTT_CONNACK_TIMEOUT * 1000u - 500000;
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE; }, 180000));
+  checkBudget();
+}
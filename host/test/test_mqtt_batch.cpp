@@ -0,0 +1,99 @@
+#include "Board.h"
+
+// Batched state messages: the worst case of MQTT_BATCH_MAX samples with
+// every field at its widest still fits MQTT_BATCH_PAYLOAD_SIZE, and a batch
+// arrives on the broker as valid samples in order
+
+// Every field valid and printed as wide as the sensors allow: 16-bit PM2.5,
+// BME280 limits (-40 °C, 100 %RH, 1100 hPa) and full statistics windows
+static Sample widestSample() {
+  Sample s = {};
+  s.valid = SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+  s.uptime = UINT32_MAX;
+  s.pm25 = UINT16_MAX;
+  s.aqi = 500;
+  s.aqiCategory = 5;
+  s.temperature = -40.0f;
+  s.humidity = 100.0f;
+  s.pressure = 1100.0f;
+  s.dewPoint = -40.0f;
+  s.comfortIndex = -100.0f;
+  FieldStats pm = {UINT16_MAX, 65535.0f, 65535.0f, 65535.0f, 65535.0f, 65535.0f};
+  FieldStats t = {UINT16_MAX, -40.0f, -40.0f, -40.0f, -40.0f, -40.0f};
+  FieldStats h = {UINT16_MAX, 100.0f, 100.0f, 100.0f, 100.0f, 100.0f};
+  FieldStats p = {UINT16_MAX, 1100.0f, 1100.0f, 1100.0f, 1100.0f, 1100.0f};
+  s.stats.pm25 = pm;
+  s.stats.temperature = t;
+  s.stats.humidity = h;
+  s.stats.pressure = p;
+  return s;
+}
+
+static void boardOnline(host::Board &board, uint8_t batchSize) {
+  board.boot();
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE; }, 30000));
+  config.mqttBatchSize = batchSize;
+  mqttBatchCount = 0;
+  board.broker.clearLog();
+}
+
+TEST(widest_full_batch_fits) {
+  host::Board board;
+  boardOnline(board, MQTT_BATCH_MAX);
+  Sample s = widestSample();
+  char latest[STATE_JSON_SIZE];
+  int latestLen = formatStateJson(s, latest, sizeof(latest));
+  CHECK_GT(latestLen, 0);
+  CHECK_LT(latestLen, (int)STATE_JSON_SIZE);
+  CHECK_EQ(latest[latestLen - 1], '}');
+
+  uint32_t failures = metrics.mqttPublishFailures;
+  for (uint8_t i = 0; i < MQTT_BATCH_MAX; i++) {
+    s.uptime = UINT32_MAX - MQTT_BATCH_MAX + 1 + i;
+    publishSensorData(s);
+  }
+  CHECK_EQ(metrics.mqttPublishFailures, failures);
+  CHECK_EQ(board.broker.count("tele/ikea-air-monitor/state"), 1u);
+  std::string payload;
+  for (const auto &m : board.broker.log()) {
+    if (m.topic == "tele/ikea-air-monitor/state") {
+      payload = m.payload;
+    }
+  }
+  printf("  widest batch: %zu of %zu bytes\n", payload.size(), MQTT_BATCH_PAYLOAD_SIZE);
+  CHECK_LT(payload.size(), MQTT_BATCH_PAYLOAD_SIZE);
+  CHECK_EQ(payload.compare(payload.size() - 2, 2, "]}"), 0);
+  size_t entries = 0;
+  for (size_t at = payload.find("[4294967"); at != std::string::npos; at = payload.find("[4294967", at + 1)) {
+    CHECK_EQ(payload.compare(at, 38, "[" + std::to_string(UINT32_MAX - MQTT_BATCH_MAX + 1 + entries) +
+                                      ",65535,-40.0,100.0,1100.00]"), 0);
+    entries++;
+  }
+  CHECK_EQ(entries, (size_t)MQTT_BATCH_MAX);
+}
+
+TEST(batch_carries_samples_in_order) {
+  host::Board board;
+  boardOnline(board, 6);
+  for (uint32_t i = 0; i < 12; i++) {
+    Sample s = {};
+    s.uptime = 100 + i * 10;
+    s.valid = i % 3 == 0 ? SAMPLE_PM_VALID : SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+    s.pm25 = (uint16_t)i;
+    s.temperature = 21.0f;
+    s.humidity = 40.0f;
+    s.pressure = 1000.0f;
+    publishSensorData(s);
+  }
+  std::vector<std::string> states;
+  for (const auto &m : board.broker.log()) {
+    if (m.topic == "tele/ikea-air-monitor/state") {
+      states.push_back(m.payload);
+    }
+  }
+  CHECK_EQ(states.size(), 2u);
+  CHECK(states[0].find("\"samples\":[[100,0,null,null,null],[110,1,21.0,40.0,1000.00],") != std::string::npos);
+  CHECK(states[0].find("[150,5,21.0,40.0,1000.00]]}") != std::string::npos);
+  CHECK(states[1].find("[210,11,21.0,40.0,1000.00]]}") != std::string::npos);
+  CHECK(states[1].find("\"samples\":[[160,6,null,null,null],") != std::string::npos);
+}
@@ -0,0 +1,144 @@
+#include "Board.h"
+#include <algorithm>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// 100 devices lose their broker at the same moment and reconnect once it
+// is back. Each device runs in its own process with its own MAC, so its
+// retry jitter is seeded differently; the attempts every device makes are
+// collected to check that they arrive spread out, not as one burst, that
+// every device gets back online and that no loop pass went over budget
+// while retrying.
+
+constexpr int DEVICES = 100;
+constexpr uint32_t OUTAGE_MS = 60000;
+constexpr uint8_t MAX_ATTEMPTS = 24;
+constexpr uint32_t STEP_US = 5000;  // between loop passes, coarser than usual to keep 100 runs short
+
+struct DeviceRun {
+  uint32_t attemptMs[MAX_ATTEMPTS];  // TCP connects to the broker, ms after the outage began
+  uint8_t attempts;
+  uint32_t onlineMs;                 // back online, ms after the broker returned
+  uint32_t maxPassUs;
+  uint32_t budgetOverruns;
+  bool ok;
+};
+
+static void simulateDevice(int index, DeviceRun &r) {
+  host::wifi.mac[4] = index >> 8;
+  host::wifi.mac[5] = index;
+  host::Board board;
+  board.boot();
+  if (!board.runUntil([] { return mqttState == MQTT_STATE_ONLINE; }, 60000, STEP_US)) {
+    return;
+  }
+  scheduler.maxPassUs = 0;
+  scheduler.budgetOverruns = 0;
+  uint64_t outageUs = host::nowMicros();
+  uint32_t seen = board.broker.tcpConnects + board.broker.tcpRefused;
+  auto recordAttempts = [&] {
+    uint32_t now = board.broker.tcpConnects + board.broker.tcpRefused;
+    for (; seen < now; seen++) {
+      if (r.attempts < MAX_ATTEMPTS) {
+        r.attemptMs[r.attempts++] = (host::nowMicros() - outageUs) / 1000;
+      }
+    }
+  };
+  board.broker.setUp(false);
+  board.runUntil([&] {
+    recordAttempts();
+    return host::nowMicros() - outageUs >= OUTAGE_MS * 1000ULL;
+  }, OUTAGE_MS + 1000, STEP_US);
+  board.broker.setUp(true);
+  uint64_t backUs = host::nowMicros();
+  r.ok = board.runUntil([&] {
+    recordAttempts();
+    return mqttState == MQTT_STATE_ONLINE;
+  }, MQTT_BACKOFF_MAX + 30000, STEP_US);
+  r.onlineMs = (host::nowMicros() - backUs) / 1000;
+  r.maxPassUs = scheduler.maxPassUs;
+  r.budgetOverruns = scheduler.budgetOverruns;
+}
+
+// Every device in its own child, as many at a time as there are CPUs: a
+// pass that waits for the CPU would count against the loop budget
+static std::vector<DeviceRun> simulateFleet() {
+  std::vector<DeviceRun> runs(DEVICES);
+  int parallel = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+  fflush(stdout);
+  for (int first = 0; first < DEVICES; first += parallel) {
+    int last = min(DEVICES, first + parallel);
+    std::vector<std::pair<pid_t, int>> children;
+    for (int i = first; i < last; i++) {
+      int fds[2];
+      CHECK(pipe(fds) == 0);
+      pid_t pid = fork();
+      if (pid == 0) {
+        close(fds[0]);
+        DeviceRun r = {};
+        simulateDevice(i + 1, r);
+        ssize_t n = write(fds[1], &r, sizeof(r));
+        _exit(n == sizeof(r) ? 0 : 2);
+      }
+      close(fds[1]);
+      children.push_back({pid, fds[0]});
+    }
+    for (int i = first; i < last; i++) {
+      auto &child = children[i - first];
+      ssize_t n = read(child.second, &runs[i], sizeof(DeviceRun));
+      close(child.second);
+      int status = 0;
+      waitpid(child.first, &status, 0);
+      CHECK_EQ(n, (ssize_t)sizeof(DeviceRun));
+      CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+  }
+  return runs;
+}
+
+TEST(hundred_devices_reconnect_spread_out) {
+  std::vector<DeviceRun> runs = simulateFleet();
+
+  std::vector<uint32_t> online;
+  std::vector<uint32_t> firstAfterReturn;
+  uint32_t perSecond[(OUTAGE_MS + MQTT_BACKOFF_MAX + 30000) / 1000 + 1] = {};
+  uint32_t maxPassUs = 0;
+  for (const DeviceRun &r : runs) {
+    CHECK(r.ok);
+    CHECK_EQ(r.budgetOverruns, 0u);
+    CHECK_LE(r.onlineMs, MQTT_BACKOFF_MAX + 5000);
+    CHECK_GE(r.attempts, 4);
+    maxPassUs = max(maxPassUs, r.maxPassUs);
+    online.push_back(r.onlineMs);
+    for (uint8_t i = 0; i < r.attempts; i++) {
+      perSecond[r.attemptMs[i] / 1000]++;
+      if (r.attemptMs[i] >= OUTAGE_MS) {
+        firstAfterReturn.push_back(r.attemptMs[i] - OUTAGE_MS);
+        break;
+      }
+    }
+  }
+  CHECK_EQ(firstAfterReturn.size(), (size_t)DEVICES);
+  std::sort(online.begin(), online.end());
+  std::sort(firstAfterReturn.begin(), firstAfterReturn.end());
+  // The first retries after the loss are only seconds apart by design; what
+  // matters is the load on the broker once it is back
+  uint32_t peak = *std::max_element(std::begin(perSecond), std::end(perSecond));
+  uint32_t peakAfterReturn = *std::max_element(std::begin(perSecond) + OUTAGE_MS / 1000, std::end(perSecond));
+
+  printf("100 devices, broker down for %u s\n", (unsigned)(OUTAGE_MS / 1000));
+  printf("  back online after return: p50 %u ms, p90 %u ms, max %u ms\n", (unsigned)online[DEVICES / 2],
+         (unsigned)online[DEVICES * 9 / 10], (unsigned)online.back());
+  printf("  first attempt after return: min %u ms, max %u ms\n", (unsigned)firstAfterReturn.front(),
+         (unsigned)firstAfterReturn.back());
+  printf("  connect attempts per second: peak %u, peak after return %u\n", (unsigned)peak,
+         (unsigned)peakAfterReturn);
+  printf("  longest loop pass: %u us\n", (unsigned)maxPassUs);
+
+  CHECK_LE(maxPassUs, (uint32_t)SCHEDULER_LOOP_BUDGET_US);
+  // No burst: without the jitter the whole fleet would retry in the same
+  // second; with it at most an eighth does, and the first attempts after
+  // the return spread over much of the retry window
+  CHECK_LE(peakAfterReturn, (uint32_t)DEVICES / 8);
+  CHECK_GE(firstAfterReturn.back() - firstAfterReturn.front(), 10000u);
+}
@@ -0,0 +1,91 @@
+#include "Board.h"
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+
+// The Vindriktning bytes go straight from the SoftwareSerial buffer into
+// the parser. The receive side of the fake is fed from another thread here,
+// like the driver's interrupt on the device.
+
+TEST(producer_thread_against_loop) {
+  host::Board board;
+  board.pmIntervalMs = 0;
+  board.boot();
+  const uint32_t frames = 20000;
+  std::atomic<bool> done(false);
+  std::thread producer([&] {
+    uint8_t f[VINDRIKTNING_FRAME_SIZE];
+    for (uint32_t i = 0; i < frames; i++) {
+      host::vindriktningFrame((uint16_t)(i % 1000), f);
+      // Never more than the buffer holds, like a line that is drained in time
+      while (pms.capacity() - pms.available() < sizeof(f)) {
+        std::this_thread::yield();
+      }
+      pms.receive(f, sizeof(f));
+    }
+    done = true;
+  });
+  while (!done || pms.available() > 0) {
+    pollPMSensor();
+  }
+  producer.join();
+  CHECK_EQ(pmParser.frameCount, frames);
+  CHECK_EQ(pmParser.checksumErrors, 0u);
+  CHECK_EQ(pmParser.droppedBytes, 0u);
+  CHECK_EQ(metrics.pmUartOverflows, 0u);
+}
+
+TEST(flooding_producer_is_counted_and_recovered) {
+  host::Board board;
+  board.pmIntervalMs = 0;
+  board.boot();
+  std::thread producer([&] {
+    uint8_t f[VINDRIKTNING_FRAME_SIZE];
+    for (uint32_t i = 0; i < 20000; i++) {
+      host::vindriktningFrame((uint16_t)(i % 1000), f);
+      pms.receive(f, sizeof(f));
+    }
+  });
+  uint32_t polls = 0;
+  while (polls < 1000) {
+    pollPMSensor();
+    polls++;
+    usleep(10);
+  }
+  producer.join();
+  pollPMSensor();
+  CHECK_GT(pms.bytesLost, 0u);
+  CHECK_GT(metrics.pmUartOverflows, 0u);
+  // The parser finds the next frame after every gap
+  uint32_t before = pmParser.frameCount;
+  board.sendPm(77);
+  board.run(100);
+  CHECK_EQ(pmParser.frameCount, before + 1);
+  CHECK_EQ(pmParser.pm25(), 77);
+}
+
+TEST(loop_stall_within_buffer_loses_nothing) {
+  // 128 bytes take 133 ms at 9600 baud; six back-to-back frames (125 ms)
+  // survive a pass that blocks for 130 ms
+  host::Board board;
+  board.pmIntervalMs = 0;
+  board.boot();
+  board.run(100);
+  uint32_t before = pmParser.frameCount;
+  for (int i = 0; i < 6; i++) {
+    board.sendPm(10 + i);
+  }
+  host::advanceMillis(130);
+  board.run(50);
+  CHECK_EQ(pmParser.frameCount, before + 6);
+  CHECK_EQ(metrics.pmUartOverflows, 0u);
+
+  // A longer stall overflows and is counted
+  for (int i = 0; i < 10; i++) {
+    board.sendPm(20 + i);
+  }
+  host::advanceMillis(300);
+  board.run(50);
+  CHECK_EQ(metrics.pmUartOverflows, 1u);
+  CHECK_GE(pmParser.frameCount, before + 6 + 6);
+}
@@ -0,0 +1,251 @@
+#include "Board.h"
+#include <random>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// The RTC sample buffer's packed records, and the duty cycle simulated
+// over hours of virtual time: how often the radio actually comes on for
+// each sample interval and uplink period, what that costs in the modeled
+// supply current against the radio always on, and that every buffered
+// sample reaches the backlog topic.
+
+static Sample makeSample(uint32_t uptime, uint8_t valid, uint16_t pm25, float t, float h, float p) {
+  Sample s = {};
+  s.uptime = uptime;
+  s.valid = valid;
+  s.pm25 = pm25;
+  s.temperature = t;
+  s.humidity = h;
+  s.pressure = p;
+  return s;
+}
+
+constexpr uint8_t BOTH = SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+
+TEST(packed_samples_round_trip) {
+  CHECK_EQ(RTC_SAMPLE_CAPACITY, 41u);
+  std::mt19937 rng(2);
+  RtcSampleBuffer buf;
+  buf.begin();
+  std::vector<Sample> in;
+  uint32_t uptime = 100;
+  for (size_t i = 0; i < RTC_SAMPLE_CAPACITY; i++) {
+    uint8_t valid = i % 7 == 3 ? SAMPLE_PM_VALID : i % 11 == 5 ? SAMPLE_ENV_VALID : BOTH;
+    in.push_back(makeSample(uptime, valid, rng() % 1000, -40.0f + (rng() % 12500) / 100.0f,
+                            (rng() % 10001) / 100.0f, 300.0f + (rng() % 8000) / 10.0f));
+    CHECK(buf.append(in.back()));
+    uptime += 1 + rng() % 4000;
+  }
+  CHECK(buf.full());
+  CHECK(!buf.append(makeSample(uptime, BOTH, 1, 20.0f, 40.0f, 1000.0f)));
+
+  // Back from RTC memory as after a reset, read in pieces
+  RtcSampleBuffer after;
+  CHECK(after.begin());
+  CHECK_EQ(after.pending(), RTC_SAMPLE_CAPACITY);
+  size_t i = 0;
+  JournalRecord r[5];
+  while (size_t n = after.peek(r, 5)) {
+    for (size_t k = 0; k < n; k++, i++) {
+      const Sample &s = in[i];
+      CHECK_EQ(r[k].uptime, s.uptime);
+      CHECK_EQ(r[k].valid, s.valid);
+      CHECK_EQ(r[k].crc, crc32(&r[k], offsetof(JournalRecord, crc)));
+      if (s.pmValid()) {
+        CHECK_EQ(r[k].pm25, s.pm25);
+      }
+      if (s.envValid()) {
+        CHECK_EQ(r[k].temperature, (int16_t)lroundf(s.temperature * 100.0f));
+        CHECK_EQ(r[k].humidity, (uint16_t)lroundf(s.humidity * 100.0f));
+        CHECK_EQ(r[k].pressure, (uint32_t)lroundf(s.pressure * 10.0f) * 10);
+      }
+    }
+    after.consume(n);
+  }
+  CHECK_EQ(i, RTC_SAMPLE_CAPACITY);
+  CHECK(after.empty());
+}
+
+TEST(out_of_range_values_are_clamped) {
+  RtcSampleBuffer buf;
+  buf.begin();
+  CHECK(buf.append(makeSample(0, BOTH, 5000, -55.0f, 100.0f, 0.05f)));
+  CHECK(buf.append(makeSample(10, BOTH, 1022, 150.0f, 0.0f, 1100.0f)));
+  JournalRecord r[2];
+  CHECK_EQ(buf.peek(r, 2), 2u);
+  CHECK_EQ(r[0].pm25, 1022);
+  CHECK_EQ(r[0].temperature, RTC_TEMP_MIN);
+  CHECK_EQ(r[0].humidity, 10000);
+  // Rounds to 0, which would read as "no environment values"
+  CHECK_EQ(r[0].valid, BOTH);
+  CHECK_EQ(r[0].pressure, 10u);
+  CHECK_EQ(r[1].pm25, 1022);
+  CHECK_EQ(r[1].temperature, (int16_t)((1 << RTC_TEMP_BITS) - 1 + RTC_TEMP_MIN));
+  CHECK_EQ(r[1].pressure, 110000u);
+}
+
+TEST(gaps_beyond_the_delta_field_are_refused) {
+  RtcSampleBuffer buf;
+  buf.begin();
+  CHECK(buf.append(makeSample(1000, BOTH, 1, 20.0f, 40.0f, 1000.0f)));
+  CHECK(!buf.append(makeSample(1000 + (1 << RTC_DELTA_BITS), BOTH, 1, 20.0f, 40.0f, 1000.0f)));
+  CHECK(!buf.append(makeSample(999, BOTH, 1, 20.0f, 40.0f, 1000.0f)));
+  CHECK(buf.append(makeSample(1000 + (1 << RTC_DELTA_BITS) - 1, BOTH, 1, 20.0f, 40.0f, 1000.0f)));
+  CHECK_EQ(buf.pending(), 2u);
+
+  // A damaged buffer is dropped on the next boot
+  uint8_t block[4];
+  CHECK(rtcRead(RTC_BLOCK_SAMPLES + 5, block, sizeof(block)));
+  block[0] ^= 1;
+  CHECK(rtcWrite(RTC_BLOCK_SAMPLES + 5, block, sizeof(block)));
+  RtcSampleBuffer after;
+  CHECK(!after.begin());
+  CHECK(after.empty());
+}
+
+struct PowerRun {
+  uint32_t hours;
+  uint32_t samples;         // taken while measuring
+  uint32_t backlog;         // entries on the backlog topic
+  uint32_t pending;         // still in the RTC buffer at the end
+  uint32_t backlogOrdered;  // 1 if their uptimes only increase
+  uint32_t wakeups;
+  uint32_t intervals;       // wake to wake, after the first
+  uint32_t intervalMinMs;
+  uint32_t intervalMaxMs;
+  uint64_t intervalSumMs;
+  uint32_t radioOnMs;
+  uint32_t elapsedMs;
+  uint32_t currentUa;
+  uint32_t spilled;
+  uint32_t expectedMs;      // powerSaveWakeInterval()
+};
+
+// One device for hours of virtual time with this config, in a child with
+// the result sent back through a pipe
+static PowerRun simulate(uint32_t sendIntervalS, uint16_t uplinkPeriod, bool powerSave, uint32_t hours) {
+  std::string state = host::runBoot("", [&] {
+    host::Board board;
+    board.boot();
+    config.sendInterval = sendIntervalS * 1000;
+    config.uplinkPeriod = uplinkPeriod;
+    config.powerSave = powerSave;
+    config.wifiReuseIp = 1;
+    CHECK(saveConfig(config));
+    CHECK(board.runUntil([] { return wifiState == WIFI_STATE_CONNECTED; }, 30000));
+  });
+  int fds[2];
+  CHECK(pipe(fds) == 0);
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    host::loadState(state);
+    PowerRun r = {};
+    r.hours = hours;
+    host::Board board;
+    board.boot();
+    // Up to the end of the first burst, or online without power save
+    CHECK(board.runUntil([&] { return powerSave ? wifiState == WIFI_STATE_OFF : mqttState == MQTT_STATE_ONLINE; },
+                         120000));
+    board.broker.clearLog();
+    metrics.radioOnMs = 0;
+    metrics.radioWakeups = 0;
+    uint32_t samples = deadband.passed + deadband.suppressed;
+    uint32_t start = millis();
+    uint32_t lastWake = 0;
+    bool off = wifiState == WIFI_STATE_OFF;
+    r.intervalMinMs = UINT32_MAX;
+    while (millis() - start < hours * 3600000UL) {
+      board.run(100, 5000);
+      bool nowOff = wifiState == WIFI_STATE_OFF;
+      if (off && !nowOff) {
+        uint32_t now = millis();
+        if (lastWake) {
+          uint32_t interval = now - lastWake;
+          r.intervals++;
+          r.intervalSumMs += interval;
+          r.intervalMinMs = min(r.intervalMinMs, interval);
+          r.intervalMaxMs = max(r.intervalMaxMs, interval);
+        }
+        lastWake = now;
+      }
+      off = nowOff;
+    }
+    r.elapsedMs = millis() - start;
+    r.samples = deadband.passed + deadband.suppressed - samples;
+    r.wakeups = metrics.radioWakeups;
+    r.radioOnMs = metrics.radioOnMs;
+    r.currentUa = modeledCurrentUa(metrics, r.elapsedMs);
+    r.spilled = rtcSamples.spilled;
+    r.pending = rtcSamples.pending();
+    r.expectedMs = powerSaveWakeInterval();
+    r.backlogOrdered = 1;
+    unsigned long last = 0;
+    for (const auto &m : board.broker.log()) {
+      if (m.topic != "tele/ikea-air-monitor/backlog") {
+        continue;
+      }
+      for (size_t pos = 0; (pos = m.payload.find("\"uptime\":", pos)) != std::string::npos; pos++) {
+        unsigned long uptime = strtoul(m.payload.c_str() + pos + 9, nullptr, 10);
+        r.backlogOrdered &= uptime > last;
+        last = uptime;
+        r.backlog++;
+      }
+    }
+    ssize_t n = write(fds[1], &r, sizeof(r));
+    _exit(n == sizeof(r) ? 0 : 2);
+  }
+  close(fds[1]);
+  PowerRun r = {};
+  ssize_t n = read(fds[0], &r, sizeof(r));
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  CHECK_EQ(n, (ssize_t)sizeof(r));
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  return r;
+}
+
+TEST(duty_cycle_energy) {
+  struct Case {
+    uint32_t sendIntervalS;
+    uint16_t uplinkPeriod;
+    uint32_t hours;
+  };
+  // The defaults; a period the buffer cuts short; and periods reached
+  // with a longer sample interval
+  const Case cases[] = {{10, 5, 3}, {10, 15, 3}, {30, 15, 4}, {60, 60, 6}};
+
+  PowerRun always = simulate(10, 5, false, 3);
+  printf("%-16s %8s %10s %10s %8s %9s %10s\n", "interval/period", "wakeups", "wake every", "expected", "radio on",
+         "current", "backlog + buffered of samples");
+  printf("%-16s %8u %10s %10s %7.1f%% %6.1f mA %10s\n", "always on", (unsigned)always.wakeups, "-", "-",
+         100.0 * always.radioOnMs / always.elapsedMs, always.currentUa / 1000.0, "-");
+  CHECK_EQ(always.currentUa, (uint32_t)POWER_RADIO_ON_UA);
+
+  for (const Case &c : cases) {
+    PowerRun r = simulate(c.sendIntervalS, c.uplinkPeriod, true, c.hours);
+    char label[32];
+    snprintf(label, sizeof(label), "%u s / %u min", (unsigned)c.sendIntervalS, (unsigned)c.uplinkPeriod);
+    double meanS = r.intervals ? r.intervalSumMs / 1000.0 / r.intervals : 0;
+    printf("%-16s %8u %8.0f s %8.0f s %7.1f%% %6.1f mA %4u + %-4u of %u\n", label, (unsigned)r.wakeups, meanS,
+           r.expectedMs / 1000.0, 100.0 * r.radioOnMs / r.elapsedMs, r.currentUa / 1000.0, (unsigned)r.backlog,
+           (unsigned)r.pending, (unsigned)r.samples);
+
+    // The radio comes on at the cadence powerSaveWakeInterval() gives: a
+    // burst and up to one sample interval later than it
+    CHECK_GE(r.intervals, 5u);
+    CHECK_GE(r.intervalMinMs + c.sendIntervalS * 1000, r.expectedMs);
+    CHECK_LE(r.intervalMaxMs, r.expectedMs + c.sendIntervalS * 1000 + 10000);
+    CHECK_EQ(r.expectedMs, min<uint32_t>(RTC_SAMPLE_CAPACITY * c.sendIntervalS, c.uplinkPeriod * 60u) * 1000);
+    // Every sample goes out on the backlog topic, once and in order, but
+    // for those taken since the last burst
+    CHECK_EQ(r.spilled, 0u);
+    CHECK(r.backlogOrdered);
+    CHECK_EQ(r.backlog + r.pending, r.samples);
+    CHECK_LT(r.pending, (uint32_t)RTC_SAMPLE_CAPACITY);
+    // Well below the radio always on
+    CHECK_LT(r.currentUa, (POWER_RADIO_ON_UA + 2 * POWER_RADIO_OFF_UA) / 3);
+  }
+}
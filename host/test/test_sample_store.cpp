@@ -0,0 +1,106 @@
+#include "Board.h"
+
+// SampleStore: a commit publishes the back buffer in one step, readers keep
+// a consistent snapshot until the next write, and the sequence number keeps
+// counting across both buffers and its own wraparound. End to end, the web
+// API and MQTT serve the same snapshot.
+
+static SampleStore store;
+
+static void writeSample(uint16_t pm25, float t) {
+  Sample &s = store.beginWrite();
+  s.valid = SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+  s.pm25 = pm25;
+  s.temperature = t;
+  store.commit();
+}
+
+TEST(starts_empty) {
+  CHECK(store.empty());
+  CHECK_EQ(store.latest().seq, 0u);
+  writeSample(5, 20.0f);
+  CHECK(!store.empty());
+  CHECK_EQ(store.latest().seq, 1u);
+  CHECK_EQ(store.latest().pm25, 5);
+}
+
+TEST(write_is_invisible_until_commit) {
+  writeSample(5, 20.0f);
+  const Sample &before = store.latest();
+  Sample &back = store.beginWrite();
+  CHECK(&back != &before);
+  back.pm25 = 77;
+  back.temperature = 30.0f;
+  back.valid = SAMPLE_PM_VALID;
+  CHECK_EQ(store.latest().pm25, 5);
+  CHECK_EQ(store.latest().temperature, 20.0f);
+  CHECK_EQ(store.latest().valid, SAMPLE_PM_VALID | SAMPLE_ENV_VALID);
+  store.commit();
+  CHECK_EQ(&store.latest(), &back);
+  CHECK_EQ(store.latest().pm25, 77);
+  CHECK_EQ(store.latest().seq, 2u);
+  // The previous snapshot is untouched until the next beginWrite()
+  CHECK_EQ(before.pm25, 5);
+  CHECK_EQ(before.seq, 1u);
+}
+
+TEST(back_buffer_starts_from_latest) {
+  writeSample(9, 21.5f);
+  Sample &back = store.beginWrite();
+  CHECK_EQ(back.pm25, 9);
+  CHECK_EQ(back.temperature, 21.5f);
+  CHECK_EQ(back.valid, 0);  // the writer sets the flags of what it read
+  CHECK_EQ(store.latest().valid, SAMPLE_PM_VALID | SAMPLE_ENV_VALID);
+}
+
+TEST(buffers_alternate_in_order) {
+  const Sample* prev = nullptr;
+  for (uint32_t i = 1; i <= 10000; i++) {
+    writeSample((uint16_t)i, i * 0.5f);
+    const Sample &s = store.latest();
+    CHECK_EQ(s.seq, i);
+    CHECK_EQ(s.pm25, (uint16_t)i);
+    CHECK_EQ(s.temperature, i * 0.5f);
+    if (prev) {
+      CHECK(prev != &s);
+      CHECK_EQ(prev->seq, i - 1);
+    }
+    prev = &s;
+  }
+}
+
+TEST(sequence_skips_zero_on_wraparound) {
+  writeSample(1, 20.0f);
+  const_cast<Sample &>(store.latest()).seq = UINT32_MAX - 1;
+  writeSample(2, 20.0f);
+  CHECK_EQ(store.latest().seq, UINT32_MAX);
+  writeSample(3, 20.0f);
+  CHECK_EQ(store.latest().seq, 1u);
+  CHECK(!store.empty());
+  writeSample(4, 20.0f);
+  CHECK_EQ(store.latest().seq, 2u);
+}
+
+TEST(web_and_mqtt_serve_the_same_snapshot) {
+  host::Board board;
+  board.boot();
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE && !sampleStore.empty(); }, 60000));
+  for (int round = 0; round < 3; round++) {
+    uint32_t seq = sampleStore.latest().seq;
+    board.pm25 = 20 + round;
+    CHECK(board.runUntil([&] { return sampleStore.latest().seq != seq; }, 30000));
+    char expected[STATE_JSON_SIZE];
+    formatStateJson(sampleStore.latest(), expected, sizeof(expected));
+    host::HttpResponse r = board.get("/api/state");
+    CHECK_EQ(r.status, 200);
+    CHECK_EQ(r.body, std::string(expected));
+    const host::MqttMessage* last = nullptr;
+    for (const auto &m : board.broker.log()) {
+      if (m.topic == "tele/ikea-air-monitor/state") {
+        last = &m;
+      }
+    }
+    CHECK(last != nullptr);
+    CHECK_EQ(last->payload, std::string(expected));
+  }
+}
@@ -0,0 +1,110 @@
+#include "Board.h"
+#include <string.h>
+
+// Binary uplink frame: round trip of valid and invalid fields, the legacy
+// 18-byte prefix with its sentinels, CRC and length checks, and the frame
+// as it arrives on the MQTT bin topic
+
+static Sample makeSample(uint8_t valid) {
+  Sample s = {};
+  s.valid = valid;
+  s.seq = 4711;
+  s.uptime = 86400;
+  s.pm25 = 37;
+  s.temperature = 22.25f;
+  s.humidity = 48.5f;
+  s.pressure = 1008.75f;
+  return s;
+}
+
+static UplinkFrame roundTrip(const Sample &s, size_t len = UPLINK_FRAME_SIZE) {
+  UplinkFrame f;
+  encodeUplink(s, f);
+  UplinkFrame out;
+  CHECK(decodeUplink(reinterpret_cast<const uint8_t*>(&f), len, out));
+  return out;
+}
+
+TEST(valid_sample_round_trips) {
+  UplinkFrame f = roundTrip(makeSample(SAMPLE_PM_VALID | SAMPLE_ENV_VALID));
+  CHECK_EQ(f.pm25, 37);
+  CHECK_EQ(f.temperature, 22.25f);
+  CHECK_EQ(f.humidity, 48.5f);
+  CHECK_EQ(f.pressure, 1008.75f);
+  CHECK_EQ(f.uptime, 86400u);
+  CHECK_EQ(f.version, UPLINK_VERSION);
+  CHECK_EQ(f.valid, SAMPLE_PM_VALID | SAMPLE_ENV_VALID);
+  CHECK_EQ(f.seq, 4711u);
+}
+
+TEST(invalid_fields_use_sentinels) {
+  UplinkFrame f = roundTrip(makeSample(SAMPLE_ENV_VALID));
+  CHECK_EQ(f.pm25, UPLINK_PM_INVALID);
+  CHECK_EQ(f.valid, SAMPLE_ENV_VALID);
+  CHECK_EQ(f.temperature, 22.25f);
+
+  f = roundTrip(makeSample(SAMPLE_PM_VALID));
+  CHECK_EQ(f.pm25, 37);
+  CHECK(isnan(f.temperature) && isnan(f.humidity) && isnan(f.pressure));
+  CHECK_EQ(f.valid, SAMPLE_PM_VALID);
+
+  // A valid reading never collides with the sentinel
+  Sample s = makeSample(SAMPLE_PM_VALID | SAMPLE_ENV_VALID);
+  s.pm25 = UINT16_MAX;
+  f = roundTrip(s);
+  CHECK_EQ(f.pm25, UPLINK_PM_INVALID - 1);
+  CHECK_EQ(f.valid, SAMPLE_PM_VALID | SAMPLE_ENV_VALID);
+}
+
+TEST(legacy_prefix_decodes_validity_from_sentinels) {
+  const uint8_t all = SAMPLE_PM_VALID | SAMPLE_ENV_VALID;
+  UplinkFrame f = roundTrip(makeSample(all), UPLINK_LEGACY_SIZE);
+  CHECK_EQ(f.valid, all);
+  CHECK_EQ(f.pm25, 37);
+  CHECK_EQ(f.uptime, 86400u);
+  CHECK_EQ(f.seq, 0u);
+  CHECK_EQ(roundTrip(makeSample(SAMPLE_ENV_VALID), UPLINK_LEGACY_SIZE).valid, SAMPLE_ENV_VALID);
+  CHECK_EQ(roundTrip(makeSample(SAMPLE_PM_VALID), UPLINK_LEGACY_SIZE).valid, SAMPLE_PM_VALID);
+  CHECK_EQ(roundTrip(makeSample(0), UPLINK_LEGACY_SIZE).valid, 0);
+}
+
+TEST(corrupt_or_short_frames_are_rejected) {
+  UplinkFrame f;
+  encodeUplink(makeSample(SAMPLE_PM_VALID | SAMPLE_ENV_VALID), f);
+  uint8_t bytes[UPLINK_FRAME_SIZE];
+  UplinkFrame out;
+  for (size_t i = 0; i < UPLINK_FRAME_SIZE; i++) {
+    memcpy(bytes, &f, sizeof(bytes));
+    bytes[i] ^= 0x10;
+    CHECK(!decodeUplink(bytes, sizeof(bytes), out));
+  }
+  memcpy(bytes, &f, sizeof(bytes));
+  for (size_t len = 0; len < UPLINK_FRAME_SIZE; len++) {
+    CHECK_EQ(decodeUplink(bytes, len, out), len == UPLINK_LEGACY_SIZE);
+  }
+}
+
+TEST(bin_topic_carries_the_frame) {
+  host::Board board;
+  board.boot();
+  CHECK(board.runUntil([] { return mqttState == MQTT_STATE_ONLINE; }, 30000));
+  config.mqttBinary = 1;
+  board.broker.clearLog();
+  board.run(30000);
+  const host::MqttMessage* bin = nullptr;
+  for (const auto &m : board.broker.log()) {
+    if (m.topic == "tele/ikea-air-monitor/bin") {
+      bin = &m;
+    }
+  }
+  CHECK(bin != nullptr);
+  CHECK_EQ(bin->payload.size(), UPLINK_FRAME_SIZE);
+  UplinkFrame f;
+  CHECK(decodeUplink(reinterpret_cast<const uint8_t*>(bin->payload.data()), bin->payload.size(), f));
+  const Sample &s = sampleStore.latest();
+  CHECK_EQ(f.seq, s.seq);
+  CHECK_EQ(f.uptime, s.uptime);
+  CHECK_EQ(f.pm25, s.pm25);
+  CHECK_EQ(f.temperature, s.temperature);
+  CHECK_EQ(f.valid, SAMPLE_PM_VALID | SAMPLE_ENV_VALID);
+}
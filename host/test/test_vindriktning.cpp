@@ -0,0 +1,151 @@
+#include "Board.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// Corrupted-stream corpus for VindriktningParser: every intact frame must be
+// decoded once, whatever surrounds it and however the stream is chunked
+
+static std::vector<uint8_t> frame(uint16_t pm25) {
+  std::vector<uint8_t> f(VINDRIKTNING_FRAME_SIZE);
+  host::vindriktningFrame(pm25, f.data());
+  return f;
+}
+
+// Grow first and copy into the new tail; GCC 12 mistakes the range insert
+// of a fresh vector for an out-of-bounds memcpy (-Warray-bounds)
+static void append(std::vector<uint8_t> &stream, const std::vector<uint8_t> &bytes) {
+  size_t at = stream.size();
+  stream.resize(at + bytes.size());
+  std::copy(bytes.begin(), bytes.end(), stream.begin() + at);
+}
+
+// Feed in chunks of the given size, collect the decoded values
+static std::vector<uint16_t> decode(const std::vector<uint8_t> &stream, size_t chunk, VindriktningParser &p) {
+  std::vector<uint16_t> values;
+  for (size_t i = 0; i < stream.size(); i += chunk) {
+    size_t n = std::min(chunk, stream.size() - i);
+    for (size_t j = 0; j < n; j++) {
+      if (p.feed(stream[i + j], (uint32_t)i)) {
+        values.push_back(p.pm25());
+      }
+    }
+  }
+  return values;
+}
+
+TEST(clean_stream_any_chunk_size) {
+  std::vector<uint8_t> stream;
+  std::vector<uint16_t> expected;
+  for (uint16_t v = 0; v < 50; v++) {
+    append(stream, frame(v * 37));
+    expected.push_back(v * 37);
+  }
+  for (size_t chunk = 1; chunk <= 64; chunk++) {
+    VindriktningParser p;
+    CHECK(decode(stream, chunk, p) == expected);
+    CHECK_EQ(p.checksumErrors, 0u);
+    CHECK_EQ(p.droppedBytes, 0u);
+  }
+}
+
+TEST(chunk_api_counts_frames) {
+  std::vector<uint8_t> stream;
+  append(stream, frame(5));
+  append(stream, frame(6));
+  VindriktningParser p;
+  CHECK_EQ(p.feed(stream.data(), 7, 100), 0u);
+  CHECK(!p.hasFrame());
+  CHECK_EQ(p.feed(stream.data() + 7, stream.size() - 7, 200), 2u);
+  CHECK_EQ(p.pm25(), 6);
+  CHECK_EQ(p.frameTime(), 200u);
+}
+
+TEST(garbage_before_frame) {
+  std::vector<uint8_t> stream = {0x00, 0xFF, 0x11, 0x0B, 0x42};
+  append(stream, frame(17));
+  VindriktningParser p;
+  CHECK(decode(stream, 3, p) == std::vector<uint16_t>{17});
+  CHECK_EQ(p.droppedBytes, 5u);
+}
+
+TEST(partial_headers_before_frame) {
+  // A header cut short at every position must not eat the real header
+  for (size_t cut = 1; cut <= 3; cut++) {
+    std::vector<uint8_t> f = frame(99);
+    std::vector<uint8_t> stream(f.begin(), f.begin() + cut);
+    append(stream, f);
+    VindriktningParser p;
+    CHECK(decode(stream, 1, p) == std::vector<uint16_t>{99});
+  }
+  std::vector<uint8_t> stream = {0x16, 0x16, 0x16};
+  append(stream, frame(3));
+  VindriktningParser p;
+  CHECK(decode(stream, 1, p) == std::vector<uint16_t>{3});
+}
+
+TEST(truncated_frame_then_frame) {
+  // The frame after a truncated one is found again by the resync
+  for (size_t keep = 4; keep < VINDRIKTNING_FRAME_SIZE; keep++) {
+    std::vector<uint8_t> f = frame(1000);
+    std::vector<uint8_t> stream(f.begin(), f.begin() + keep);
+    append(stream, frame(42));
+    append(stream, frame(43));
+    VindriktningParser p;
+    std::vector<uint16_t> values = decode(stream, 5, p);
+    CHECK(values == (std::vector<uint16_t>{42, 43}));
+    CHECK_GE(p.checksumErrors, 1u);
+  }
+}
+
+TEST(bad_checksum_is_not_published) {
+  std::vector<uint8_t> bad = frame(500);
+  bad[19] ^= 0x01;
+  std::vector<uint8_t> stream = bad;
+  append(stream, frame(8));
+  VindriktningParser p;
+  CHECK(decode(stream, 20, p) == std::vector<uint16_t>{8});
+  CHECK_EQ(p.checksumErrors, 1u);
+}
+
+TEST(header_bytes_inside_payload) {
+  // 0x160B as PM2.5 and a header sequence in the unused bytes
+  std::vector<uint8_t> f(VINDRIKTNING_FRAME_SIZE, 0);
+  f[0] = 0x16; f[1] = 0x11; f[2] = 0x0B;
+  f[5] = 0x16; f[6] = 0x0B;
+  f[9] = 0x16; f[10] = 0x11; f[11] = 0x0B;
+  uint8_t sum = 0;
+  for (int i = 0; i < 19; i++) sum += f[i];
+  f[19] = (uint8_t)(0x100 - sum);
+  std::vector<uint8_t> stream = f;
+  append(stream, frame(1));
+  VindriktningParser p;
+  CHECK(decode(stream, 1, p) == (std::vector<uint16_t>{0x160B, 1}));
+}
+
+TEST(random_corpus) {
+  // Intact frames separated by noise bursts and frames with flipped bits
+  std::minstd_rand rng(12345);
+  std::vector<uint8_t> stream;
+  std::vector<uint16_t> expected;
+  for (int i = 0; i < 2000; i++) {
+    int kind = rng() % 4;
+    if (kind == 0) {
+      int n = rng() % 30;
+      for (int j = 0; j < n; j++) {
+        stream.push_back((uint8_t)rng());
+      }
+    } else if (kind == 1) {
+      std::vector<uint8_t> f = frame((uint16_t)(rng() % 1000));
+      f[3 + rng() % 17] ^= (uint8_t)(1 << (rng() % 8));
+      append(stream, f);
+    }
+    uint16_t v = (uint16_t)(rng() % 1000);
+    append(stream, frame(v));
+    expected.push_back(v);
+  }
+  for (size_t chunk : {1, 7, 20, 64}) {
+    VindriktningParser p;
+    CHECK(decode(stream, chunk, p) == expected);
+  }
+}
@@ -0,0 +1,159 @@
+#include "Board.h"
+#include "Bench.h"
+#include <new>
+#include <stdlib.h>
+
+// POST /save: every field of the form is applied and validated, and reading
+// the form costs no heap allocation and little stack. Allocations are
+// counted through operator new, which Arduino String (std::string on the
+// host) goes through.
+
+static uint32_t newCalls = 0;
+
+void* operator new(size_t size) {
+  newCalls++;
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// Stack high-water mark of fn: paint a region below the caller's frame,
+// run fn, then count how much of the paint was overwritten. Both probes are
+// the same non-inlined function called from the same frame, so their array
+// covers the same addresses.
+constexpr size_t STACK_PROBE = 32768;
+constexpr uint8_t STACK_PAINT = 0xA5;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((noinline)) static size_t stackProbe(bool paint) {
+  volatile uint8_t area[STACK_PROBE];
+  if (paint) {
+    for (size_t i = 0; i < STACK_PROBE; i++) {
+      area[i] = STACK_PAINT;
+    }
+    return 0;
+  }
+  size_t untouched = 0;
+  while (untouched < STACK_PROBE && area[untouched] == STACK_PAINT) {
+    untouched++;
+  }
+  return STACK_PROBE - untouched;
+}
+#pragma GCC diagnostic pop
+
+template <typename Fn>
+__attribute__((noinline)) static size_t stackUsed(Fn fn) {
+  stackProbe(true);
+  fn();
+  return stackProbe(false);
+}
+
+static std::string fill(char c, size_t n) { return std::string(n, c); }
+
+// Every field at the longest value it accepts, far past the small-string
+// buffer of std::string
+static std::string fullForm() {
+  return "ssid=" + fill('s', sizeof(config.ssid) - 1) + "&password=" + fill('p', sizeof(config.password) - 1) +
+         "&hostname=" + fill('h', sizeof(config.hostname) - 1) + "&mqttHost=" + fill('m', sizeof(config.mqttHost) - 1) +
+         "&mqttPort=8883&mqttUser=" + fill('u', sizeof(config.mqttUser) - 1) +
+         "&mqttPassword=" + fill('w', sizeof(config.mqttPassword) - 1) + "&mqttTopic=" + fill('t', sizeof(config.mqttTopic) - 1) +
+         "&sendInterval=30&tempOffset=-1.5&mqttBatchSize=6&wifiReuseIp=1&mqttBinary=1&uplinkUrl=" +
+         fill('x', sizeof(config.uplinkUrl) - 1) +
+         "&deadbandEnabled=1&deadbandTemp=0.3&deadbandHum=2&deadbandPress=0.75&deadbandPm=3"
+         "&heartbeatInterval=600&powerSave=1&uplinkPeriod=30";
+}
+
+TEST(save_applies_every_field) {
+  host::Board board;
+  board.boot();
+  CHECK(board.runUntil([] { return networkServicesStarted; }, 30000));
+  host::HttpResponse r = board.http("POST", "/save", fullForm());
+  CHECK_EQ(r.status, 200);
+  CHECK_EQ(std::string(config.ssid), fill('s', sizeof(config.ssid) - 1));
+  CHECK_EQ(std::string(config.password), fill('p', sizeof(config.password) - 1));
+  CHECK_EQ(std::string(config.hostname), fill('h', sizeof(config.hostname) - 1));
+  CHECK_EQ(std::string(config.mqttHost), fill('m', sizeof(config.mqttHost) - 1));
+  CHECK_EQ(config.mqttPort, 8883);
+  CHECK_EQ(std::string(config.mqttUser), fill('u', sizeof(config.mqttUser) - 1));
+  CHECK_EQ(std::string(config.mqttPassword), fill('w', sizeof(config.mqttPassword) - 1));
+  CHECK_EQ(std::string(config.mqttTopic), fill('t', sizeof(config.mqttTopic) - 1));
+  CHECK_EQ(config.sendInterval, 30000u);
+  CHECK_EQ(config.tempOffset, -1.5f);
+  CHECK_EQ(config.mqttBatchSize, 6);
+  CHECK_EQ(config.wifiReuseIp, 1);
+  CHECK_EQ(config.mqttBinary, 1);
+  CHECK_EQ(std::string(config.uplinkUrl), fill('x', sizeof(config.uplinkUrl) - 1));
+  CHECK_EQ(config.deadbandEnabled, 1);
+  CHECK_NEAR(config.deadbandTemp, 0.3, 1e-6);
+  CHECK_EQ(config.deadbandHum, 2.0f);
+  CHECK_EQ(config.deadbandPress, 0.75f);
+  CHECK_EQ(config.deadbandPm, 3);
+  CHECK_EQ(config.heartbeatInterval, 600);
+  CHECK_EQ(config.powerSave, 1);
+  CHECK_EQ(config.uplinkPeriod, 30);
+  // Saved to flash, the device restarts after RESTART_DELAY
+  DeviceConfig loaded;
+  loadConfig(loaded);
+  CHECK_EQ(std::string(loaded.mqttHost), std::string(config.mqttHost));
+  board.run(RESTART_DELAY + 1000);
+  CHECK_EQ(host::restarts, 1u);
+}
+
+TEST(invalid_values_keep_the_old_ones) {
+  host::Board board;
+  board.boot();
+  CHECK(board.runUntil([] { return networkServicesStarted; }, 30000));
+  DeviceConfig before = config;
+  std::string form = "ssid=" + fill('s', sizeof(config.ssid)) + "&hostname=&mqttPort=70000&sendInterval=0"
+                     "&tempOffset=51&mqttBatchSize=25&deadbandTemp=-1&deadbandPm=101&heartbeatInterval=5"
+                     "&uplinkPeriod=241";
+  CHECK_EQ(board.http("POST", "/save", form).status, 200);
+  CHECK_EQ(std::string(config.ssid), std::string(before.ssid));
+  CHECK_EQ(std::string(config.hostname), std::string(before.hostname));
+  CHECK_EQ(config.mqttPort, before.mqttPort);
+  CHECK_EQ(config.sendInterval, before.sendInterval);
+  CHECK_EQ(config.tempOffset, before.tempOffset);
+  CHECK_EQ(config.mqttBatchSize, before.mqttBatchSize);
+  CHECK_EQ(config.deadbandTemp, before.deadbandTemp);
+  CHECK_EQ(config.deadbandPm, before.deadbandPm);
+  CHECK_EQ(config.heartbeatInterval, before.heartbeatInterval);
+  CHECK_EQ(config.uplinkPeriod, before.uplinkPeriod);
+  // Checkboxes missing from the form are unticked
+  CHECK_EQ(config.wifiReuseIp, 0);
+  CHECK_EQ(config.deadbandEnabled, 0);
+}
+
+TEST(reading_the_form_is_allocation_free) {
+  host::Board board;
+  board.boot();
+  CHECK(board.runUntil([] { return networkServicesStarted; }, 30000));
+  uint32_t allocs = UINT32_MAX, stringAllocs = 0;
+  size_t stack = 0, libcStack = 0;
+  server.on("/probe", HTTP_POST, [&] {
+    // Once before measuring, so the dynamic linker has resolved the libc
+    // calls; its lazy binding alone takes a few KB of stack
+    applyConfigForm();
+    uint32_t before = newCalls;
+    stack = stackUsed(applyConfigForm);
+    allocs = newCalls - before;
+    libcStack = stackUsed([] { bench::keep(strtof("-1.5", nullptr)); });
+    // The counter sees what the old code did: a String copy of a long value
+    before = newCalls;
+    String copy = server.arg("ssid");
+    stringAllocs = newCalls - before;
+    server.send(204);
+  });
+  CHECK_EQ(board.http("POST", "/probe", fullForm()).status, 204);
+  printf("  applyConfigForm: %u allocations, %zu bytes of stack, %zu of them in strtof()\n", allocs, stack,
+         libcStack);
+  CHECK_EQ(stringAllocs, 1u);
+  CHECK_EQ(allocs, 0u);
+  CHECK_GT(stack, libcStack);
+  CHECK_LE(stack - libcStack, 128u);
+}
@@ -0,0 +1,164 @@
+#include "Board.h"
+
+// Boots in sequence against the fake access point, each in its own
+// process with the RTC memory and flash the previous one left: the first
+// boot scans and stores the lease, later ones go straight to the cached
+// BSSID and channel and skip DHCP with wifiReuseIp, and a boot falls back
+// to a scan when the access point moved or the credentials changed.
+
+struct WiFiBoot {
+  uint32_t connectMs;  // boot to association, virtual time
+  uint32_t scans;
+  uint32_t pinnedBegins;
+  uint32_t dhcpRequests;
+};
+
+// One boot up to the association. before() runs first, to move the access
+// point or drop the RTC memory as a power loss does; check() gets the
+// result in the same process.
+static std::string boot(const char* label, const std::string &state, const std::function<void()> &before,
+                        const std::function<void(const WiFiBoot &)> &check) {
+  return host::runBoot(state, [&] {
+    before();
+    uint64_t start = host::nowMicros();
+    host::Board board;
+    board.boot();
+    CHECK(board.runUntil([] { return wifiState == WIFI_STATE_CONNECTED; }, 2 * WIFI_CONNECT_TIMEOUT));
+    WiFiBoot r = {(uint32_t)((host::nowMicros() - start) / 1000), host::wifi.scans, host::wifi.pinnedBegins,
+                  host::wifi.dhcpRequests};
+    printf("  %-34s %5u ms, %u scans, %u pinned, %u DHCP\n", label, (unsigned)r.connectMs, (unsigned)r.scans,
+           (unsigned)r.pinnedBegins, (unsigned)r.dhcpRequests);
+    check(r);
+  });
+}
+
+static void nothing() {}
+
+// Scan and DHCP as the fake times them
+static uint32_t scanPathMs() {
+  return host::wifi.scanMs + host::wifi.authMs + host::wifi.dhcpMs;
+}
+
+// The scheduler polls the WiFi state every WIFI_POLL_INTERVAL
+static void checkTime(uint32_t connectMs, uint32_t expectedMs) {
+  CHECK_GE(connectMs, expectedMs);
+  CHECK_LE(connectMs, expectedMs + WIFI_POLL_INTERVAL + 50);
+}
+
+static std::string firstBoot(uint8_t reuseIp) {
+  return boot("first boot, no lease", "", nothing, [reuseIp](const WiFiBoot &r) {
+    CHECK_EQ(r.scans, 1u);
+    CHECK_EQ(r.pinnedBegins, 0u);
+    CHECK_EQ(r.dhcpRequests, 1u);
+    checkTime(r.connectMs, scanPathMs());
+    CHECK_EQ(metrics.wifiFastConnects, 0u);
+    CHECK(LittleFS.exists(WIFI_LEASE_PATH));
+    WiFiLease lease;
+    CHECK(loadWiFiLease(lease, wifiNetworkHash(config.ssid, config.password)));
+    CHECK_EQ(lease.channel, host::wifi.channel);
+    CHECK(memcmp(lease.bssid, host::wifi.bssid, 6) == 0);
+    CHECK_EQ(lease.ip, (uint32_t)host::wifi.dhcpIp);
+    config.wifiReuseIp = reuseIp;
+    CHECK(saveConfig(config));
+  });
+}
+
+TEST(restart_uses_the_lease_from_rtc_memory) {
+  printf("wifiReuseIp off\n");
+  std::string state = firstBoot(0);
+  boot("restart, lease in RTC memory", state, nothing, [](const WiFiBoot &r) {
+    CHECK_EQ(r.scans, 0u);
+    CHECK_EQ(r.pinnedBegins, 1u);
+    CHECK_EQ(r.dhcpRequests, 1u);
+    checkTime(r.connectMs, host::wifi.authMs + host::wifi.dhcpMs);
+    CHECK_EQ(metrics.wifiFastConnects, 1u);
+  });
+}
+
+TEST(restart_reuses_the_ip_with_wifi_reuse_ip) {
+  printf("wifiReuseIp on\n");
+  std::string state = firstBoot(1);
+  for (int i = 0; i < 3; i++) {
+    state = boot("restart, lease in RTC memory", state, nothing, [](const WiFiBoot &r) {
+      CHECK_EQ(r.scans, 0u);
+      CHECK_EQ(r.pinnedBegins, 1u);
+      CHECK_EQ(r.dhcpRequests, 0u);
+      checkTime(r.connectMs, host::wifi.authMs);
+      CHECK_EQ(WiFi.localIP(), host::wifi.dhcpIp);
+      CHECK_EQ(WiFi.gatewayIP(), host::wifi.gateway);
+      CHECK_EQ(metrics.wifiFastConnects, 1u);
+      // The lease did not change, so flash was not written
+      CHECK_EQ(LittleFS.bytesWritten, 0u);
+    });
+  }
+}
+
+TEST(power_loss_takes_the_lease_from_flash) {
+  std::string state = firstBoot(1);
+  boot("power loss, lease in flash", state, [] { host::rtcClear(); }, [](const WiFiBoot &r) {
+    CHECK_EQ(r.scans, 0u);
+    CHECK_EQ(r.pinnedBegins, 1u);
+    CHECK_EQ(r.dhcpRequests, 0u);
+    checkTime(r.connectMs, host::wifi.authMs);
+    // Copied back to RTC memory for the next restart
+    WiFiLease lease;
+    CHECK(rtcRead(RTC_BLOCK_WIFI_LEASE, &lease, sizeof(lease)));
+    CHECK(wifiLeaseValid(lease, wifiNetworkHash(config.ssid, config.password)));
+  });
+}
+
+TEST(moved_access_point_falls_back_to_a_scan) {
+  std::string state = firstBoot(1);
+  // The router came back on another channel
+  auto moved = [] { host::wifi.channel = 11; };
+  state = boot("AP on a new channel", state, moved, [](const WiFiBoot &r) {
+    CHECK_EQ(r.pinnedBegins, 1u);
+    CHECK_EQ(r.scans, 1u);
+    // The static IP is dropped with the lease, DHCP again
+    CHECK_EQ(r.dhcpRequests, 1u);
+    checkTime(r.connectMs, WIFI_FAST_CONNECT_TIMEOUT + scanPathMs());
+    CHECK_EQ(metrics.wifiFastConnectFallbacks, 1u);
+    CHECK_EQ(metrics.wifiFastConnects, 0u);
+    WiFiLease lease;
+    CHECK(loadWiFiLease(lease, wifiNetworkHash(config.ssid, config.password)));
+    CHECK_EQ(lease.channel, 11);
+  });
+  // The new channel is cached from then on
+  boot("restart after the move", state, moved, [](const WiFiBoot &r) {
+    CHECK_EQ(r.scans, 0u);
+    CHECK_EQ(r.pinnedBegins, 1u);
+    CHECK_EQ(r.dhcpRequests, 0u);
+    CHECK_EQ(metrics.wifiFastConnects, 1u);
+  });
+}
+
+TEST(replaced_access_point_falls_back_to_a_scan) {
+  // Same network name and channel, another BSSID
+  std::string state = firstBoot(1);
+  boot("AP replaced", state, [] { host::wifi.bssid[5] = 0x02; }, [](const WiFiBoot &r) {
+    CHECK_EQ(r.pinnedBegins, 1u);
+    CHECK_EQ(r.scans, 1u);
+    CHECK_EQ(metrics.wifiFastConnectFallbacks, 1u);
+    WiFiLease lease;
+    CHECK(loadWiFiLease(lease, wifiNetworkHash(config.ssid, config.password)));
+    CHECK_EQ(lease.bssid[5], 0x02);
+  });
+}
+
+TEST(changed_credentials_ignore_the_lease) {
+  std::string state = firstBoot(1);
+  state = host::runBoot(state, [] {
+    host::Board board;
+    board.boot();
+    strcpy(config.password, "newpass");
+    CHECK(saveConfig(config));
+  });
+  boot("new password", state, [] { host::wifi.password = "newpass"; }, [](const WiFiBoot &r) {
+    // The lease is for the old credentials: no pinned attempt at all
+    CHECK_EQ(r.pinnedBegins, 0u);
+    CHECK_EQ(r.scans, 1u);
+    CHECK_EQ(r.dhcpRequests, 1u);
+    checkTime(r.connectMs, scanPathMs());
+    CHECK_EQ(metrics.wifiFastConnectFallbacks, 0u);
+  });
+}